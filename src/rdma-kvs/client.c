@@ -1,4 +1,23 @@
+//./client 10.10.1.1
+//./client -l              같은 호스트의 서버에 /kvs-shm 으로 연결
+//./client -l -b 100000    PUT/GET 을 100000 번씩 보내고 평균 지연 시간 출력
+//./client -u 10.10.1.1    서버의 공유 UD QP 로 요청 (서버도 -u)
+//./client -z -b 100000 10.10.1.1   value 를 caller 버퍼에서 바로 보내고 받는다 (MR cache)
+//./client -C 4096 -Z 0.99 -b 100000 10.10.1.1   GET lease 캐시, zipfian GET 구간 추가
+//./client -s 32 -b 100000 10.10.1.1   bench 에 SCAN 구간 추가, chunk 당 32 entry (서버는 -O)
+//./client -A -b 100000 10.10.1.1   bench 에 서버 atomic 영역의 fetch-add / CAS lock 구간 추가
+
 #include "common.h"
+#include "lease.h"
+#include "log.h"
+#include "mr_cache.h"
+#include "sizeclass.h"
+#include "transport.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
 
 /* RDMA resource */
 static struct rdma_context ctx;
@@ -16,30 +35,184 @@ struct ibv_sge send_sge, recv_sge;
 struct ibv_wc wc;
 static char *send_buffer = NULL, *recv_buffer = NULL;
 
+// 메시지 경로: verbs (기본) 또는 shm (-l)
+static const struct kvs_transport *tp;
+static void *tp_conn;
+static struct shm_conn local;
+static int quiet = 0;
+
+// -u: UD 모드. 서버 UD QP 의 주소와 재전송 상태
+static int ud_mode = 0;
+static struct ibv_ah *ud_ah = NULL;
+static uint32_t ud_remote_qpn, ud_remote_qkey;
+static uint32_t ud_client_id, ud_req_id;
+static int ud_rx_index = -1;        // recv 로 넘겨준 뒤 아직 다시 걸지 않은 버퍼
+static uint64_t ud_retransmits = 0;
+
+// -z: caller 버퍼를 MR cache 로 등록해 value 를 send_buffer 로 복사하지 않는다
+static int zero_copy = 0;
+static struct mr_cache mr_cache;
+static size_t mr_budget = MR_CACHE_DEFAULT_BUDGET;
+static uint64_t zc_fallbacks = 0;
+
+// -C: GET 응답의 lease 동안 value 를 캐시에서 읽는다 (lease.h)
+static int lease_enabled = 0;
+static struct lease_cache lease_cache;
+
+// -Z: bench 에 zipfian key 로 GET 하는 구간을 더한다
+static double zipf_theta = 0;
+
+// -s: SCAN chunk 당 entry 수 (credit). verbs 는 서버가 scan_buffer 로 chunk 를 RDMA WRITE 한다
+static int scan_chunk = 16;
+static int scan_bench = 0;
+static struct scan_entry *scan_buffer = NULL;
+static struct ibv_mr *scan_mr = NULL;
+
+// -A: bench 에 서버 INCR 와 RDMA atomic 구간을 더한다. 서버 atomic 영역은 연결할 때 rep_pdata 로 받는다
+static int atomic_bench = 0;
+static uint64_t *atomic_result = NULL;
+static struct ibv_mr *atomic_mr = NULL;
+
 static void setup_connection(const char *server_ip);
 static void pre_post_recv_buffer();
 static void connect_server();
+static void setup_send_buffer();
+static void setup_ud_buffers();
+static void connect_server_ud();
+static void run_bench(int ops);
+static struct message *put_zc(const char *key, const char *value, uint32_t value_len);
+static struct message *get_zc(const char *key, char *value);
+static struct message *request_leased(struct message *msg);
+static long scan_range(const char *start, const char *end, int print, int *chunks);
+static int atomic_ready(uint32_t slot);
+static uint64_t atomic_fetch_add(uint32_t slot, uint64_t add);
+static uint64_t atomic_cmp_swap(uint32_t slot, uint64_t expected, uint64_t desired);
 
 int on_connect();
 void post_send_message();
-int receive_response();
+int receive_response(struct message *response);
 int wait_for_completion();
 int post_and_wait(struct ibv_send_wr *wr, const char *operation_name);
 
 void cleanup(struct rdma_cm_id *id);
 
+static struct message *verbs_recv(void *conn);
+static int verbs_send(void *conn, const struct message *msg);
+static void verbs_close(void *conn);
+
+static const struct kvs_transport verbs_transport = {
+    .name = "verbs",
+    .recv = verbs_recv,
+    .send = verbs_send,
+    .close = verbs_close,
+};
+
+static struct message *ud_recv(void *conn);
+static int ud_send(void *conn, const struct message *msg);
+static void ud_close(void *conn);
+
+static const struct kvs_transport ud_transport = {
+    .name = "ud",
+    .recv = ud_recv,
+    .send = ud_send,
+    .close = ud_close,
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
 
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <server-ip>\n", argv[0]);
+    const char *usage = "Usage: %s [-u] [-z [-M budget-MB]] [-C entries] [-b ops [-Z theta]] [-s chunk] [-A] [-v] <server-ip>[:port]\n"
+        "       %s -l [-C entries] [-b ops [-Z theta]] [-s chunk] [-A] [-v]\n";
+    int opt, use_local = 0, bench_ops = 0;
+
+    while ((opt = getopt(argc, argv, "lub:zM:C:Z:s:Av")) != -1) {
+        switch (opt) {
+        case 'l':
+            use_local = 1;
+            break;
+        case 'u':
+            ud_mode = 1;
+            break;
+        case 'b':
+            bench_ops = atoi(optarg);
+            break;
+        case 'z':
+            zero_copy = 1;
+            break;
+        case 'M':
+            mr_budget = strtoull(optarg, NULL, 10) << 20;
+            break;
+        case 'C':
+            if (lease_cache_init(&lease_cache, atoi(optarg) > 0 ? atoi(optarg) : 1) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            lease_enabled = 1;
+            break;
+        case 'Z':
+            zipf_theta = atof(optarg);
+            break;
+        case 's':
+            scan_chunk = atoi(optarg);
+            if (scan_chunk < 1 || scan_chunk > SCAN_CHUNK_MAX) {
+                scan_chunk = SCAN_CHUNK_MAX;
+            }
+            scan_bench = 1;
+            break;
+        case 'A':
+            atomic_bench = 1;
+            break;
+        case 'v':
+            log_level = LOG_LEVEL_DEBUG;  // 보내고 받은 message 를 찍는다
+            break;
+        default:
+            fprintf(stderr, usage, argv[0], argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != (use_local ? 0 : 1)) {
+        fprintf(stderr, usage, argv[0], argv[0]);
         return EXIT_FAILURE;
     }
+    if (log_start() < 0) {
+        exit(EXIT_FAILURE);
+    }
 
-    setup_connection(argv[1]);
-    pre_post_recv_buffer();
-    connect_server();
-    on_connect();
+    if (use_local) {
+        if (shm_transport_connect(&local) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        tp = &shm_transport;
+        tp_conn = &local;
+        printf("The client is connected through %s. \n\n", SHM_TRANSPORT_NAME);
+    } else if (ud_mode) {
+        setup_connection(argv[optind]);
+        setup_ud_buffers();
+        connect_server_ud();
+        tp = &ud_transport;
+        tp_conn = NULL;
+    } else {
+        setup_connection(argv[optind]);
+        pre_post_recv_buffer();
+        connect_server();
+        setup_send_buffer();
+        tp = &verbs_transport;
+        tp_conn = NULL;
+        mr_cache_init(&mr_cache, ctx.pd, IBV_ACCESS_LOCAL_WRITE, mr_budget);
+    }
+
+    if (bench_ops > 0) {
+        run_bench(bench_ops);
+    } else {
+        on_connect();
+    }
 
+    tp->close(tp_conn);
     return 0;
 }
 
@@ -47,10 +220,11 @@ static void setup_connection(const char *server_ip) {
     int ret;
     struct sockaddr_in addr;
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(SERVER_PORT);
-    addr.sin_addr.s_addr = inet_addr(server_ip);
+    // backup (-B) 이나 -p 로 띄운 서버는 ip:port 로 붙는다
+    if (parse_server_addr(server_ip, &addr) < 0) {
+        fprintf(stderr, "Bad server address %s\n", server_ip);
+        exit(EXIT_FAILURE);
+    }
 
     ec = rdma_create_event_channel();
     if (!ec) {
@@ -58,7 +232,7 @@ static void setup_connection(const char *server_ip) {
         exit(EXIT_FAILURE);
     }
 
-    ret = rdma_create_id(ec, &id, NULL, RDMA_PS_TCP);
+    ret = rdma_create_id(ec, &id, NULL, ud_mode ? RDMA_PS_UDP : RDMA_PS_TCP);
     if (ret) {
         perror("rdma_create_id");
         exit(EXIT_FAILURE);
@@ -84,6 +258,9 @@ static void setup_connection(const char *server_ip) {
 
     build_context(&ctx, id);
     build_qp_attr(&qp_attr, &ctx);
+    if (ud_mode) {
+        qp_attr.qp_type = IBV_QPT_UD;
+    }
 
     printf("Creating QP...\n");
     ret = rdma_create_qp(id, ctx.pd, &qp_attr);
@@ -148,15 +325,30 @@ static void pre_post_recv_buffer() {
         perror("Failed to post receive work request");
         exit(EXIT_FAILURE);
     }
-    printf("Memory registered at address %p with LKey %u\n", recv_buffer, ctx.recv_mr->lkey);
+    if (!quiet) {
+        printf("Memory registered at address %p with LKey %u\n", recv_buffer, ctx.recv_mr->lkey);
+    }
 }
 
 
 static void connect_server() {
     struct rdma_conn_param conn_param;
 
-    rep_pdata.buf_va = (uintptr_t)recv_buffer;
-    rep_pdata.buf_rkey = htonl(ctx.recv_mr->rkey);
+    // 서버가 SCAN chunk 를 RDMA WRITE 할 곳을 알려준다
+    scan_buffer = calloc(SCAN_CHUNK_MAX, sizeof(struct scan_entry));
+    if (!scan_buffer) {
+        perror("Failed to allocate scan buffer");
+        exit(EXIT_FAILURE);
+    }
+    scan_mr = ibv_reg_mr(ctx.pd, scan_buffer, SCAN_CHUNK_MAX * sizeof(struct scan_entry),
+        IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+    if (!scan_mr) {
+        perror("Failed to register scan buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    rep_pdata.buf_va = htonll((uintptr_t)scan_buffer);
+    rep_pdata.buf_rkey = htonl(scan_mr->rkey);
 
     memset(&conn_param, 0, sizeof(conn_param));
     conn_param.initiator_depth = 3;
@@ -179,6 +371,22 @@ static void connect_server() {
 
     memcpy(&rep_pdata, event->param.conn.private_data, sizeof(rep_pdata));
     printf("Received Server Memory at address %p with RKey %u\n\n",(void *)rep_pdata.buf_va, ntohl(rep_pdata.buf_rkey));
+    if (rep_pdata.atomic_num) {
+        printf("Server atomic region: %u slots at %p with RKey %u\n\n", ntohl(rep_pdata.atomic_num),
+            (void *)ntohll(rep_pdata.atomic_va), ntohl(rep_pdata.atomic_rkey));
+    }
+
+    // fetch-add / CAS 가 이전 값을 돌려받는 곳 (8 바이트 정렬)
+    atomic_result = calloc(1, sizeof(uint64_t));
+    if (!atomic_result) {
+        perror("Failed to allocate atomic result buffer");
+        exit(EXIT_FAILURE);
+    }
+    atomic_mr = ibv_reg_mr(ctx.pd, atomic_result, sizeof(uint64_t), IBV_ACCESS_LOCAL_WRITE);
+    if (!atomic_mr) {
+        perror("Failed to register atomic result buffer");
+        exit(EXIT_FAILURE);
+    }
 
     if (rdma_ack_cm_event(event)) {
         perror("Failed to acknowledge cm event");
@@ -187,10 +395,7 @@ static void connect_server() {
     printf("The client is connected successfully. \n\n");
 }
 
-int on_connect() {
-    char command[256];
-    struct message msg_send;
-
+static void setup_send_buffer() {
     //send_buffer = (char *)malloc(sizeof(struct message));
     send_buffer = (char *)calloc(2, sizeof(struct message));
     if (!send_buffer) {
@@ -205,12 +410,18 @@ int on_connect() {
         fprintf(stderr, "Failed to register client metadata buffer.\n");
         exit(EXIT_FAILURE);
     }
+}
+
+int on_connect() {
+    char command[256];
+    struct message msg_send;
+    struct message *response;
 
     while (1) {
-        printf("Enter command ( put k v / get k ): ");
+        printf("Enter command ( put k v / get k / del k / scan start [end] / incr k [n] / append k v / cput k version v"
+            " / fadd slot [n] / cas slot old new ): ");
         if (fgets(command, sizeof(command), stdin) == NULL) {
-            fprintf(stderr, "Error reading command\n");
-            continue;
+            break;  // EOF: 연결을 정리하고 끝낸다
         }
         command[strcspn(command, "\n")] = '\0'; 
 
@@ -229,7 +440,7 @@ int on_connect() {
             msg_send.type = MSG_PUT;
             //printf("value size Packet size: %lu bytes\n\n", sizeof(msg_send.kv.value));
 
-            printf("msg key: %s, msg value: %s\n", msg_send.kv.key, msg_send.kv.value);
+            LOG_DEBUG("msg key: %s, msg value: %s\n", msg_send.kv.key, msg_send.kv.value);
 
         } else if (strcmp(cmd, "get") == 0) {
 
@@ -240,26 +451,730 @@ int on_connect() {
             msg_send.kv.value[0] = '\0'; 
             msg_send.type = MSG_GET;
 
-            printf("msg key: %s, msg value: %s\n", msg_send.kv.key, msg_send.kv.value);
+            LOG_DEBUG("msg key: %s, msg value: %s\n", msg_send.kv.key, msg_send.kv.value);
+        } else if (strcmp(cmd, "del") == 0) {
+
+            char *key = strtok(NULL, "");
+
+            strncpy(msg_send.kv.key, key, sizeof(msg_send.kv.key));
+            msg_send.kv.key[KEY_VALUE_SIZE - 1] = '\0';
+            msg_send.kv.value[0] = '\0';
+            msg_send.type = MSG_DELETE;
+
+            LOG_DEBUG("msg key: %s\n", msg_send.kv.key);
+        } else if (strcmp(cmd, "incr") == 0 || strcmp(cmd, "append") == 0 || strcmp(cmd, "cput") == 0) {
+            char *key = strtok(NULL, " ");
+            char *version = cmd[0] == 'c' ? strtok(NULL, " ") : NULL;
+            char *value = strtok(NULL, "");
+
+            // incr 의 n 은 없어도 되고 (1), append/cput 은 value 가 있어야 한다
+            if (!key || (cmd[0] != 'i' && !value) || (cmd[0] == 'c' && !version)) {
+                printf("Invalid command\n");
+                continue;
+            }
+            strncpy(msg_send.kv.key, key, sizeof(msg_send.kv.key));
+            msg_send.kv.key[KEY_VALUE_SIZE - 1] = '\0';
+            strncpy(msg_send.kv.value, value ? value : "", sizeof(msg_send.kv.value));
+            msg_send.kv.value[KEY_VALUE_SIZE - 1] = '\0';
+            msg_send.version = version ? strtoull(version, NULL, 10) : 0;
+            msg_send.type = cmd[0] == 'i' ? MSG_INCR : cmd[0] == 'a' ? MSG_APPEND : MSG_CAS;
+
+            LOG_DEBUG("msg key: %s, msg value: %s\n", msg_send.kv.key, msg_send.kv.value);
+        } else if (strcmp(cmd, "scan") == 0) {
+            char *start = strtok(NULL, " ");
+            char *end = strtok(NULL, " ");
+            int chunks;
+            long n = scan_range(start ? start : "", end ? end : "", 1, &chunks);
+
+            if (n < 0) {
+                printf("SCAN is not supported by the server (start it with -O)\n");
+            } else {
+                printf("%ld entries in %d chunks\n", n, chunks);
+            }
+            continue;
+        } else if (strcmp(cmd, "fadd") == 0 || strcmp(cmd, "cas") == 0) {
+            char *slot = strtok(NULL, " ");
+            char *arg1 = strtok(NULL, " ");
+            char *arg2 = strtok(NULL, " ");
+            uint64_t old;
+
+            if (!slot || (cmd[0] == 'c' && (!arg1 || !arg2)) || !atomic_ready(atoi(slot))) {
+                printf("Invalid command\n");
+                continue;
+            }
+            if (cmd[0] == 'f') {
+                old = atomic_fetch_add(atoi(slot), arg1 ? strtoull(arg1, NULL, 10) : 1);
+                printf("FADD slot %s: %lu -> %lu\n", slot, (unsigned long)old,
+                    (unsigned long)(old + (arg1 ? strtoull(arg1, NULL, 10) : 1)));
+            } else {
+                old = atomic_cmp_swap(atoi(slot), strtoull(arg1, NULL, 10), strtoull(arg2, NULL, 10));
+                printf("CAS slot %s: was %lu, %s\n", slot, (unsigned long)old,
+                    old == strtoull(arg1, NULL, 10) ? "swapped" : "not swapped");
+            }
+            continue;
         } else {
             printf("Invalid command\n");
             continue;
         }
 
-        memcpy(send_buffer, &msg_send, sizeof(struct message));
-    
-        post_send_message();
+        if ((response = request_leased(&msg_send)) == NULL) {
+            fprintf(stderr, "Failed to receive response\n");
+            exit(EXIT_FAILURE);
+        }
+        receive_response(response);
+    }
+
+    return 0;
+}
+
+/*
+ * YCSB 의 zipfian 생성기 (Gray et al., "Quickly generating billion-record synthetic databases").
+ * 0 이 가장 자주 나온다
+ */
+struct zipf_gen {
+    uint64_t n;
+    double theta, alpha, zetan, eta;
+};
+
+static double zeta(uint64_t n, double theta) {
+    double sum = 0;
+
+    for (uint64_t i = 1; i <= n; i++) {
+        sum += 1.0 / pow((double)i, theta);
+    }
+    return sum;
+}
+
+static void zipf_init(struct zipf_gen *z, uint64_t n, double theta) {
+    z->n = n;
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->zetan = zeta(n, theta);
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / z->zetan);
+}
+
+static uint64_t zipf_next(struct zipf_gen *z) {
+    double u = drand48(), uz = u * z->zetan;
+
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, z->theta)) {
+        return 1;
+    }
+    return (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha)) % z->n;
+}
+
+// bench 가 PUT 한 key 들을 zipfian 으로 ops 번 GET 한다 (-C 면 lease 캐시를 거친다)
+static void run_zipf_gets(int ops) {
+    struct zipf_gen zipf;
+    struct message msg;
+    uint64_t start;
+
+    zipf_init(&zipf, ops, zipf_theta);
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_GET;
+
+    start = now_ns();
+    for (int i = 0; i < ops; i++) {
+        snprintf(msg.kv.key, KEY_VALUE_SIZE, "key%lu", (unsigned long)zipf_next(&zipf));
+        msg.kv.value[0] = '\0';
+        if (request_leased(&msg) == NULL) {
+            fprintf(stderr, "Failed to receive response\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("GET zipf %.2f: %d ops over %s, %.3f us/op\n", zipf_theta, ops, tp->name, (now_ns() - start) / 1e3 / ops);
+}
+
+/*
+ * [start, end) 를 chunk 단위로 읽는다 (end 가 "" 이면 끝까지). 서버는 chunk 사이에 상태를
+ * 두지 않으므로 마지막 key 와 SCAN_AFTER 로 그 key 바로 다음부터 다시 요청한다.
+ * entry 수, 서버가 SCAN 을 받지 않으면 -1
+ */
+static long scan_range(const char *start, const char *end, int print, int *chunks) {
+    struct message msg, *response;
+    struct scan_entry entry;
+    long total = 0;
+    int n, more;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_SCAN;
+    strncpy(msg.kv.key, start, KEY_VALUE_SIZE - 1);
+    *chunks = 0;
+
+    do {
+        strncpy(msg.kv.value, end, KEY_VALUE_SIZE - 1);
+        msg.count = scan_chunk;
+        if (tp->send(tp_conn, &msg) != 0) {
+            fprintf(stderr, "Failed to send scan request\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // verbs 는 SEND 하나 (chunk 는 이미 scan_buffer 에 있다), 나머지는 entry 마다 메시지 하나
+        n = 0;
+        while (1) {
+            if ((response = tp->recv(tp_conn)) == NULL) {
+                fprintf(stderr, "Failed to receive response\n");
+                exit(EXIT_FAILURE);
+            }
+            if (response->type != MSG_SCAN_ENTRY) {
+                break;
+            }
+            memcpy(entry.key, response->kv.key, KEY_VALUE_SIZE);
+            memcpy(entry.value, response->kv.value, KEY_VALUE_SIZE);
+            if (print) {
+                printf("  %s = %s\n", entry.key, entry.value);
+            }
+            n++;
+        }
+        if (strcmp(response->kv.value, "UNSUPPORTED") == 0) {
+            return -1;
+        }
+        more = strcmp(response->kv.value, "MORE") == 0;
+
+        if (tp == &verbs_transport) {
+            n = response->count;
+            for (int i = 0; print && i < n; i++) {
+                printf("  %s = %s\n", scan_buffer[i].key, scan_buffer[i].value);
+            }
+            memcpy(&entry, &scan_buffer[n > 0 ? n - 1 : 0], sizeof(entry));
+        }
+        total += n;
+        (*chunks)++;
+
+        if (more && n > 0) {
+            memcpy(msg.kv.key, entry.key, KEY_VALUE_SIZE);
+            msg.version = SCAN_AFTER;
+        }
+    } while (more && n > 0);
+
+    return total;
+}
+
+// PUT 을 ops 번 보낸 뒤 같은 key 들을 GET 해서 op 당 평균 왕복 시간을 잰다
+static void run_bench(int ops) {
+    struct message msg_send;
+    struct message *response;
+    char *values = NULL, *value;
+    uint64_t start;
+
+    quiet = 1;
+    memset(&msg_send, 0, sizeof(msg_send));
+
+    // -z: application 이 가진 value 배열에서 바로 보내고, GET 도 그 자리로 받는다
+    if (zero_copy) {
+        values = malloc((size_t)ops * KEY_VALUE_SIZE);
+        if (!values) {
+            perror("Failed to allocate bench values");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int type = MSG_PUT; type <= MSG_GET; type++) {
+        start = now_ns();
+        for (int i = 0; i < ops; i++) {
+            if (values) {
+                value = values + (size_t)i * KEY_VALUE_SIZE;
+                snprintf(msg_send.kv.key, KEY_VALUE_SIZE, "key%d", i);
+                if (type == MSG_PUT) {
+                    snprintf(value, KEY_VALUE_SIZE, "value%d", i);
+                    response = put_zc(msg_send.kv.key, value, strlen(value) + 1);
+                } else {
+                    response = get_zc(msg_send.kv.key, value);
+                }
+                if (!response) {
+                    fprintf(stderr, "Failed to receive response\n");
+                    exit(EXIT_FAILURE);
+                }
+                continue;
+            }
+
+            msg_send.type = type;
+            snprintf(msg_send.kv.key, KEY_VALUE_SIZE, "key%d", i);
+            if (type == MSG_PUT) {
+                snprintf(msg_send.kv.value, KEY_VALUE_SIZE, "value%d", i);
+            } else {
+                msg_send.kv.value[0] = '\0';
+            }
+
+            if ((response = request_leased(&msg_send)) == NULL) {
+                fprintf(stderr, "Failed to receive response\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        printf("%s: %d ops over %s, %.3f us/op\n", type == MSG_PUT ? "PUT" : "GET", ops, tp->name,
+            (now_ns() - start) / 1e3 / ops);
+    }
+
+    if (zipf_theta > 0) {
+        run_zipf_gets(ops);
+    }
+    if (atomic_bench) {
+        // 같은 카운터를 서버가 올린다 (요청 하나에 bucket lock 한 번, 모든 transport)
+        msg_send.type = MSG_INCR;
+        strcpy(msg_send.kv.key, "bench-counter");
+        msg_send.kv.value[0] = '\0';
+        start = now_ns();
+        for (int i = 0; i < ops; i++) {
+            if ((response = request_leased(&msg_send)) == NULL) {
+                fprintf(stderr, "Failed to receive response\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        printf("INCR: %d ops over %s, %.3f us/op, counter %s (version %lu)\n", ops, tp->name,
+            (now_ns() - start) / 1e3 / ops, response->kv.value, (unsigned long)response->version);
+    }
+    if (atomic_bench && atomic_ready(0)) {
+        uint64_t first = atomic_fetch_add(0, 0), old;
+        long spins = 0;
+
+        // rate limiter: 카운터 하나를 fetch-add 로만 올린다
+        start = now_ns();
+        for (int i = 0; i < ops; i++) {
+            atomic_fetch_add(0, 1);
+        }
+        printf("FADD: %d ops over RDMA atomics, %.3f us/op, counter %lu -> %lu\n", ops, (now_ns() - start) / 1e3 / ops,
+            (unsigned long)first, (unsigned long)atomic_fetch_add(0, 0));
+
+        // lock: 0 -> owner 로 CAS 해서 잡고, owner -> 0 으로 CAS 해서 푼다
+        start = now_ns();
+        for (int i = 0; i < ops; i++) {
+            while ((old = atomic_cmp_swap(1, 0, getpid())) != 0) {
+                spins++;
+            }
+            atomic_cmp_swap(1, getpid(), 0);
+        }
+        printf("CAS lock: %d acquire/release pairs, %.3f us/pair, %ld failed acquires\n", ops,
+            (now_ns() - start) / 1e3 / ops, spins);
+    }
+    if (scan_bench) {
+        int chunks;
+        long n;
+
+        // bench 의 key 는 모두 "key" 로 시작한다
+        start = now_ns();
+        n = scan_range("key", "kez", 0, &chunks);
+        if (n < 0) {
+            printf("SCAN: not supported by the server (start it with -O)\n");
+        } else {
+            printf("SCAN: %ld entries in %d chunks of %d over %s, %.0f entries/s\n", n, chunks, scan_chunk,
+                tp->name, n / ((now_ns() - start) / 1e9));
+        }
+    }
+    if (lease_enabled) {
+        printf("Lease cache: %lu hits, %lu misses, %lu fills\n", (unsigned long)lease_cache.hits,
+            (unsigned long)lease_cache.misses, (unsigned long)lease_cache.fills);
+    }
+    if (tp == &ud_transport) {
+        printf("UD retransmits: %lu\n", (unsigned long)ud_retransmits);
+    }
+    if (values) {
+        printf("MR cache: %lu hits, %lu misses, %lu evictions, %lu KB pinned, %lu copy fallbacks\n",
+            (unsigned long)mr_cache.hits, (unsigned long)mr_cache.misses, (unsigned long)mr_cache.evictions,
+            (unsigned long)(mr_cache.pinned >> 10), (unsigned long)zc_fallbacks);
+        if (tp == &verbs_transport) {
+            mr_cache_invalidate(&mr_cache, values, (size_t)ops * KEY_VALUE_SIZE);
+        }
+        free(values);
+    }
+}
+
+/*
+ * -C: lease 가 남은 key 의 GET 은 보내지 않고 캐시의 value 로 응답을 만든다.
+ * 그 밖의 GET 은 lease 를 요청하고, PUT/DELETE 는 자기 캐시의 그 key 를 먼저 지운다
+ * (서버는 남은 lease 가 끝날 때까지 쓰기를 미룬다)
+ */
+static struct message *request_leased(struct message *msg) {
+    static struct message cached;
+    struct message *response;
+    const char *value;
+    uint64_t sent;
+
+    msg->lease_us = 0;
+    if (lease_enabled && msg->type == MSG_GET) {
+        if ((value = lease_cache_get(&lease_cache, msg->kv.key)) != NULL) {
+            cached.type = MSG_GET;
+            strcpy(cached.kv.key, msg->kv.key);
+            strcpy(cached.kv.value, value);
+            return &cached;
+        }
+        msg->lease_us = LEASE_REQUEST_US;
+    } else if (lease_enabled) {
+        lease_cache_invalidate(&lease_cache, msg->kv.key);
+    }
+
+    sent = now_ns();
+    if (tp->send(tp_conn, msg) != 0 || (response = tp->recv(tp_conn)) == NULL) {
+        return NULL;
+    }
+    if (msg->lease_us) {
+        lease_cache_fill(&lease_cache, msg->kv.key, response->kv.value, sent, response->lease_us);
+    }
+    return response;
+}
+
+// zero-copy 를 쓸 수 없으면 (verbs 가 아니거나 budget 초과) 기존처럼 복사해서 보낸다
+static struct message *request_copy(int type, const char *key, const char *value, char *out) {
+    struct message msg;
+    struct message *response;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type = type;
+    strncpy(msg.kv.key, key, KEY_VALUE_SIZE - 1);
+    if (value) {
+        strncpy(msg.kv.value, value, KEY_VALUE_SIZE - 1);
+    }
+
+    if (tp->send(tp_conn, &msg) != 0 || (response = tp->recv(tp_conn)) == NULL) {
+        return NULL;
+    }
+    if (out) {
+        memcpy(out, response->kv.value, KEY_VALUE_SIZE);
+    }
+    return response;
+}
+
+/*
+ * send 는 [send_buffer 의 type/key][caller 의 value] 두 SGE, GET 의 recv 는
+ * [recv_buffer 의 header][caller 버퍼][recv_buffer 의 나머지] 세 SGE 로 건다.
+ * 서버가 보는 메시지 배치는 그대로라 서버는 바뀌지 않는다.
+ */
+static struct message *request_zc(int type, const char *key, const char *value, uint32_t value_len, char *out) {
+    struct message *hdr = (struct message *)send_buffer;
+    struct mr_cache_entry *in_mr = NULL, *out_mr = NULL;
+    struct ibv_sge sge[3], rsge[3];
+    struct ibv_send_wr wr;
+    struct ibv_recv_wr rwr, *bad_rwr;
+
+    if (tp != &verbs_transport || !zero_copy) {
+        return request_copy(type, key, value, out);
+    }
+
+    if (value) {
+        in_mr = mr_cache_acquire(&mr_cache, value, value_len);
+    }
+    if (out) {
+        out_mr = mr_cache_acquire(&mr_cache, out, KEY_VALUE_SIZE);
     }
+    if ((value && !in_mr) || (out && !out_mr)) {
+        if (in_mr) {
+            mr_cache_release(&mr_cache, in_mr);
+        }
+        if (out_mr) {
+            mr_cache_release(&mr_cache, out_mr);
+        }
+        zc_fallbacks++;
+        return request_copy(type, key, value, out);
+    }
+
+    if (out_mr) {
+        rsge[0].addr = (uintptr_t)recv_buffer;
+        rsge[0].length = MSG_HEADER_SIZE;
+        rsge[0].lkey = ctx.recv_mr->lkey;
+        rsge[1].addr = (uintptr_t)out;
+        rsge[1].length = KEY_VALUE_SIZE;
+        rsge[1].lkey = out_mr->mr->lkey;
+        rsge[2].addr = (uintptr_t)recv_buffer + MSG_HEADER_SIZE + KEY_VALUE_SIZE;
+        rsge[2].length = sizeof(struct message) - MSG_HEADER_SIZE - KEY_VALUE_SIZE;
+        rsge[2].lkey = ctx.recv_mr->lkey;
+
+        memset(&rwr, 0, sizeof(rwr));
+        rwr.sg_list = rsge;
+        rwr.num_sge = 3;
+        if (ibv_post_recv(id->qp, &rwr, &bad_rwr)) {
+            perror("Failed to post receive work request");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        pre_post_recv_buffer();
+    }
+
+    hdr->type = type;
+    hdr->lease_us = 0;
+    strncpy(hdr->kv.key, key, KEY_VALUE_SIZE - 1);
+    hdr->kv.key[KEY_VALUE_SIZE - 1] = '\0';
+
+    sge[0].addr = (uintptr_t)send_buffer;
+    sge[0].length = MSG_HEADER_SIZE;
+    sge[0].lkey = ctx.send_mr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = 2;
+    wr.opcode = IBV_WR_SEND;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    wr.sg_list = sge;
+    wr.num_sge = 1;
+    if (in_mr) {
+        sge[1].addr = (uintptr_t)value;
+        sge[1].length = value_len;
+        sge[1].lkey = in_mr->mr->lkey;
+        wr.num_sge = 2;
+    }
+
+    post_and_wait(&wr, "Send");
+    wait_for_completion();
+
+    if (in_mr) {
+        mr_cache_release(&mr_cache, in_mr);
+    }
+    if (out_mr) {
+        mr_cache_release(&mr_cache, out_mr);
+    }
+    return (struct message *)recv_buffer;
+}
+
+// value 는 NUL 을 포함해 value_len 바이트, 응답을 받을 때까지 바꾸면 안 된다
+static struct message *put_zc(const char *key, const char *value, uint32_t value_len) {
+    if (value_len > KEY_VALUE_SIZE) {
+        value_len = KEY_VALUE_SIZE;
+    }
+    return request_zc(MSG_PUT, key, value, value_len, NULL);
+}
+
+// 응답의 value 가 caller 의 KEY_VALUE_SIZE 바이트 버퍼로 바로 들어간다
+static struct message *get_zc(const char *key, char *value) {
+    return request_zc(MSG_GET, key, NULL, 0, value);
+}
+
+// 서버 atomic 영역을 쓸 수 있으면 1 (verbs 연결이고 서버 장치가 atomic 을 한다)
+static int atomic_ready(uint32_t slot) {
+    if (tp != &verbs_transport || !rep_pdata.atomic_num) {
+        printf("RDMA atomics need an RC connection to a server device with atomic support\n");
+        return 0;
+    }
+    if (slot >= ntohl(rep_pdata.atomic_num)) {
+        printf("Atomic slot %u out of range (%u slots)\n", slot, ntohl(rep_pdata.atomic_num));
+        return 0;
+    }
+    return 1;
+}
+
+// 서버 CPU 를 거치지 않는 one-sided atomic 하나. 서버의 이전 값을 돌려준다
+static uint64_t post_atomic(enum ibv_wr_opcode opcode, uint32_t slot, uint64_t compare_add, uint64_t swap) {
+    struct ibv_send_wr wr;
+    struct ibv_sge sge;
+
+    sge.addr = (uintptr_t)atomic_result;
+    sge.length = sizeof(uint64_t);
+    sge.lkey = atomic_mr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = 3;
+    wr.opcode = opcode;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.wr.atomic.remote_addr = ntohll(rep_pdata.atomic_va) + (uint64_t)slot * sizeof(uint64_t);
+    wr.wr.atomic.rkey = ntohl(rep_pdata.atomic_rkey);
+    wr.wr.atomic.compare_add = compare_add;
+    wr.wr.atomic.swap = swap;
+
+    post_and_wait(&wr, opcode == IBV_WR_ATOMIC_FETCH_AND_ADD ? "Fetch-and-add" : "Compare-and-swap");
+    return *(volatile uint64_t *)atomic_result;
+}
+
+static uint64_t atomic_fetch_add(uint32_t slot, uint64_t add) {
+    return post_atomic(IBV_WR_ATOMIC_FETCH_AND_ADD, slot, add, 0);
+}
+
+// 이전 값이 expected 면 바꾼 것이다
+static uint64_t atomic_cmp_swap(uint32_t slot, uint64_t expected, uint64_t desired) {
+    return post_atomic(IBV_WR_ATOMIC_CMP_AND_SWP, slot, expected, desired);
+}
+
+static struct message *verbs_recv(void *conn) {
+    if (wait_for_completion() != 0) {
+        return NULL;
+    }
+    return (struct message *)recv_buffer;
+}
 
+static int verbs_send(void *conn, const struct message *msg) {
+    msg_copy((struct message *)send_buffer, msg);
+    post_send_message();
+    return 0;
+}
+
+static void verbs_close(void *conn) {
     cleanup(id);
+}
+
+static void setup_ud_buffers() {
+    recv_buffer = calloc(UD_CLIENT_RECV, UD_RECV_SIZE);
+    send_buffer = calloc(1, sizeof(struct ud_message));
+    if (!recv_buffer || !send_buffer) {
+        perror("Failed to allocate UD buffers");
+        exit(EXIT_FAILURE);
+    }
+
+    ctx.recv_mr = ibv_reg_mr(ctx.pd, recv_buffer, UD_CLIENT_RECV * UD_RECV_SIZE, IBV_ACCESS_LOCAL_WRITE);
+    ctx.send_mr = ibv_reg_mr(ctx.pd, send_buffer, sizeof(struct ud_message), IBV_ACCESS_LOCAL_WRITE);
+    if (!ctx.recv_mr || !ctx.send_mr) {
+        perror("Failed to register memory region");
+        exit(EXIT_FAILURE);
+    }
+
+    // 서버가 재시작 전의 요청과 구분할 수 있도록 연결마다 다른 값
+    ud_client_id = (uint32_t)(now_ns() * 0x9E3779B97F4A7C15ull >> 32) ^ (uint32_t)getpid();
+}
+
+static void ud_post_recv(int index) {
+    recv_sge.addr = (uintptr_t)(recv_buffer + (size_t)index * UD_RECV_SIZE);
+    recv_sge.length = UD_RECV_SIZE;
+    recv_sge.lkey = ctx.recv_mr->lkey;
+
+    memset(&recv_wr, 0, sizeof(recv_wr));
+    recv_wr.wr_id = index;
+    recv_wr.sg_list = &recv_sge;
+    recv_wr.num_sge = 1;
+
+    if (ibv_post_recv(id->qp, &recv_wr, &bad_recv_wr)) {
+        perror("Failed to post receive work request");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// SIDR: 연결 대신 서버 UD QP 의 번호와 주소만 받아온다
+static void connect_server_ud() {
+    struct rdma_conn_param conn_param;
+
+    for (int i = 0; i < UD_CLIENT_RECV; i++) {
+        ud_post_recv(i);
+    }
+
+    memset(&conn_param, 0, sizeof(conn_param));
+
+    printf("Resolving UD server...\n");
+    if (rdma_connect(id, &conn_param)) {
+        perror("Failed to connect to remote host");
+        exit(EXIT_FAILURE);
+    }
+
+    if (rdma_get_cm_event(ec, &event)) {
+        perror("Failed to get cm event");
+        exit(EXIT_FAILURE);
+    }
+
+    if (event->event != RDMA_CM_EVENT_ESTABLISHED) {
+        fprintf(stderr, "UD resolution failed: %s\n", rdma_event_str(event->event));
+        exit(EXIT_FAILURE);
+    }
+
+    ud_remote_qpn = event->param.ud.qp_num;
+    ud_remote_qkey = event->param.ud.qkey;
+    ud_ah = ibv_create_ah(ctx.pd, &event->param.ud.ah_attr);
+    if (!ud_ah) {
+        perror("ibv_create_ah");
+        exit(EXIT_FAILURE);
+    }
+
+    if (rdma_ack_cm_event(event)) {
+        perror("Failed to acknowledge cm event");
+        exit(EXIT_FAILURE);
+    }
+    printf("The client uses server UD QP %u. \n\n", ud_remote_qpn);
+}
+
+static void ud_post_send() {
+    send_sge.addr = (uintptr_t)send_buffer;
+    send_sge.length = sizeof(struct ud_message);
+    send_sge.lkey = ctx.send_mr->lkey;
+
+    memset(&send_wr, 0, sizeof(send_wr));
+    send_wr.opcode = IBV_WR_SEND;
+    send_wr.send_flags = IBV_SEND_SIGNALED;
+    send_wr.sg_list = &send_sge;
+    send_wr.num_sge = 1;
+    send_wr.wr.ud.ah = ud_ah;
+    send_wr.wr.ud.remote_qpn = ud_remote_qpn;
+    send_wr.wr.ud.remote_qkey = ud_remote_qkey;
+
+    if (ibv_post_send(id->qp, &send_wr, &bad_send_wr)) {
+        fprintf(stderr, "Failed to post Send work request: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int ud_send(void *conn, const struct message *msg) {
+    struct ud_message *req = (struct ud_message *)send_buffer;
+
+    if (ud_rx_index >= 0) {
+        ud_post_recv(ud_rx_index);
+        ud_rx_index = -1;
+    }
+
+    req->client_id = ud_client_id;
+    req->req_id = ++ud_req_id;
+    memcpy(&req->msg, msg, sizeof(struct message));
+
+    ud_post_send();
     return 0;
 }
 
+// 응답이 제시간에 안 오면 같은 req_id 로 다시 보낸다 (대기 시간은 매번 두 배)
+static struct message *ud_recv(void *conn) {
+    struct ibv_wc wc[UD_CLIENT_RECV + 1];
+    uint64_t timeout = UD_TIMEOUT_US * 1000ull;
+    uint64_t deadline = now_ns() + timeout;
+    struct ud_message *resp, *match = NULL;
+    int n, retries = 0;
+
+    while (1) {
+        n = ibv_poll_cq(ctx.cq, UD_CLIENT_RECV + 1, wc);
+        if (n < 0) {
+            fprintf(stderr, "Failed to poll CQ: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "WR failed with status %s\n", ibv_wc_status_str(wc[i].status));
+                exit(EXIT_FAILURE);
+            }
+            if (!(wc[i].opcode & IBV_WC_RECV)) {
+                continue;
+            }
+
+            resp = (struct ud_message *)(recv_buffer + wc[i].wr_id * UD_RECV_SIZE + UD_GRH_SIZE);
+            if (!match && resp->client_id == ud_client_id && resp->req_id == ud_req_id) {
+                match = resp;
+                ud_rx_index = wc[i].wr_id;
+            } else {
+                ud_post_recv(wc[i].wr_id);  // 중복되거나 늦게 온 응답
+            }
+        }
+
+        if (match) {
+            return &match->msg;
+        }
+
+        if (now_ns() > deadline) {
+            if (++retries > UD_MAX_RETRIES) {
+                fprintf(stderr, "No response for request %u after %d retries\n", ud_req_id, UD_MAX_RETRIES);
+                return NULL;
+            }
+            ud_retransmits++;
+            ud_post_send();
+            timeout *= 2;
+            deadline = now_ns() + timeout;
+        }
+    }
+}
+
+static void ud_close(void *conn) {
+    if (ud_ah) {
+        ibv_destroy_ah(ud_ah);
+        ud_ah = NULL;
+    }
+    cleanup(id);
+}
+
 void post_send_message() {
     struct message *msg_send = (struct message *)send_buffer;
 
     send_sge.addr = (uintptr_t)send_buffer;
-    send_sge.length = sizeof(struct message);
+    send_sge.length = msg_wire_size(msg_send);
     send_sge.lkey = ctx.send_mr->lkey;
 
     send_wr.wr_id = 2;
@@ -272,10 +1187,8 @@ void post_send_message() {
 	send_wr.wr.rdma.remote_addr = ntohll(rep_pdata.buf_va); 
 
     struct message *msg_in_buffer = (struct message *)send_buffer;
-    printf("\nsend_buffer content:\n");
-    printf("Type: %d\n", msg_in_buffer->type);
-    printf("Key: %s\n", msg_in_buffer->kv.key);
-    printf("Value: %s\n\n", msg_in_buffer->kv.value);
+    LOG_DEBUG("\nsend_buffer content:\nType: %d\nKey: %s\nValue: %s\n\n", msg_in_buffer->type, msg_in_buffer->kv.key,
+        msg_in_buffer->kv.value);
 
     // if (post_and_wait(&send_wr, "RDMA Write") != 0) {
     //     exit(EXIT_FAILURE);
@@ -287,13 +1200,10 @@ void post_send_message() {
     pre_post_recv_buffer();
     //sleep(5);
 
+    // 응답 recv 는 transport 의 recv (verbs_recv) 에서 기다린다
     if (post_and_wait(&send_wr, "Send") != 0) {
         exit(EXIT_FAILURE);
     }
-    if (receive_response() != 0) {
-        fprintf(stderr, "Failed to receive response\n");
-        exit(EXIT_FAILURE);
-    }
 }
 
 int post_and_wait(struct ibv_send_wr *wr, const char *operation_name) {
@@ -307,7 +1217,7 @@ int post_and_wait(struct ibv_send_wr *wr, const char *operation_name) {
         exit(EXIT_FAILURE);
     }
 
-    printf("%s completed successfully\n", operation_name);
+    LOG_DEBUG("%s completed successfully\n", operation_name);
     return 0;
 }
 
@@ -330,23 +1240,23 @@ int wait_for_completion() {
     return 0;
 }
 
-int receive_response() {
-    if (wait_for_completion() != 0) {
-        fprintf(stderr, "Failed to receive response\n");
-        exit(EXIT_FAILURE);
-    }
-
-    struct message *response = (struct message *)recv_buffer;
-    printf("\nrecv_buffer content:\n");
-    printf("Type: %d\n", response->type);
-    printf("Key: %s\n", response->kv.key);
-    printf("Value: %s\n\n", response->kv.value);
+int receive_response(struct message *response) {
+    LOG_DEBUG("\nrecv_buffer content:\nType: %d\nKey: %s\nValue: %s\n\n", response->type, response->kv.key,
+        response->kv.value);
+    log_flush();  // 대화형: 앞의 debug 로그가 결과보다 먼저 나오게
 
 
     if (response->type == MSG_GET) {
-        printf("GET Received response: Key: %s, Value: %s\n\n", response->kv.key, response->kv.value);
+        printf("GET Received response: Key: %s, Value: %s, Version: %lu\n\n", response->kv.key, response->kv.value,
+            (unsigned long)response->version);
+    } else if (response->type == MSG_INCR || response->type == MSG_APPEND || response->type == MSG_CAS) {
+        printf("%s Response value: %s, Version: %lu\n\n",
+            response->type == MSG_INCR ? "INCR" : response->type == MSG_APPEND ? "APPEND" : "CPUT",
+            response->kv.value, (unsigned long)response->version);
     } else if (response->type == MSG_PUT) {
         printf("PUT Response value: %s\n\n", response->kv.value);
+    } else if (response->type == MSG_DELETE) {
+        printf("DEL Response value: %s\n\n", response->kv.value);
     }
 
     return 0;
@@ -354,6 +1264,10 @@ int receive_response() {
 
 void cleanup(struct rdma_cm_id *id) {
 
+    if (mr_cache.pd) {
+        mr_cache_destroy(&mr_cache);
+    }
+
     if (send_buffer) {
         free(send_buffer);
         send_buffer = NULL;
@@ -374,6 +1288,20 @@ void cleanup(struct rdma_cm_id *id) {
         ctx.send_mr = NULL;
     }
 
+    if (atomic_mr) {
+        ibv_dereg_mr(atomic_mr);
+        atomic_mr = NULL;
+        free(atomic_result);
+        atomic_result = NULL;
+    }
+
+    if (scan_mr) {
+        ibv_dereg_mr(scan_mr);
+        scan_mr = NULL;
+        free(scan_buffer);
+        scan_buffer = NULL;
+    }
+
     if (ctx.qp) {
         rdma_destroy_qp(id);
         ctx.qp = NULL;
@@ -1,11 +1,9 @@
 #include "common.h"
 
 void build_context(struct rdma_context *ctx, struct rdma_cm_id *id) {
-    // device
-    struct ibv_device **device_list = ibv_get_device_list(NULL);
-    ctx->device = device_list[0]; 
-    ctx->verbs = ibv_open_device(ctx->device); 
-    ibv_free_device_list(device_list); 
+    // device: rdma_cm 이 주소로 고른 장치를 그대로 쓴다 (따로 열면 쓰지도 않는 context 가 샌다)
+    ctx->verbs = id->verbs;
+    ctx->device = id->verbs->device;
 
     // resource
     ctx->pd = ibv_alloc_pd(id->verbs);
@@ -55,3 +53,23 @@ void build_qp_attr(struct ibv_qp_init_attr *attr, struct rdma_context *ctx) {
     attr->sq_sig_all = 0;
 }
 
+
+int parse_server_addr(const char *str, struct sockaddr_in *addr) {
+    char host[64];
+    const char *colon = strchr(str, ':');
+    size_t len = colon ? (size_t)(colon - str) : strlen(str);
+
+    if (len >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, str, len);
+    host[len] = '\0';
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(colon ? atoi(colon + 1) : SERVER_PORT);
+    if (inet_pton(AF_INET, host, &addr->sin_addr) != 1 || addr->sin_port == 0) {
+        return -1;
+    }
+    return 0;
+}
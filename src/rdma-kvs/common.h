@@ -1,6 +1,7 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,17 +26,46 @@
 #define SERVER_PORT 20079
 #define TIMEOUT_IN_MS 500
 #define CQ_CAPACITY 16
-#define MAX_SGE 1
+#define MAX_SGE 3    // zero-copy: header + caller 버퍼 value + 나머지
 #define MAX_WR 16
+#define KVS_RECV_DEPTH 8    // 서버가 RC 연결마다 걸어두는 recv (클라이언트는 이보다 하나 적게 파이프라인한다)
 
+/*
+ * RDMA atomic 영역: 서버가 등록해 둔 uint64_t 카운터 KVS_ATOMIC_SLOTS 개.
+ * 클라이언트는 IBV_WR_ATOMIC_FETCH_AND_ADD / IBV_WR_ATOMIC_CMP_AND_SWP 로 서버 CPU 없이 고친다
+ * (rate limiter 는 fetch-add 하나, lock 은 0 -> owner CAS 하나).
+ * 주소와 rkey 는 연결할 때 서버 pdata 로 받는다. atomic_num 이 0 이면 서버 장치가 atomic 을 못 한다.
+ * 값은 메모리에만 있어 서버를 다시 띄우면 0 부터 시작한다.
+ */
+#define KVS_ATOMIC_SLOTS 4096
+
+// pdata.role: 보통 클라이언트는 0, primary 가 backup 에 붙는 복제 연결 (replica.h) 은 KVS_ROLE_REPLICA
+#define KVS_ROLE_CLIENT 0
+#define KVS_ROLE_REPLICA 1
+
+// 연결 private data (클라이언트 -> 서버는 buf 와 role 만, 서버 -> 클라이언트는 atomic 영역과 복제 ring 도).
+// rdma_connect 의 private data 는 56 바이트까지다
 struct pdata { 
     uint64_t buf_va; 
     uint32_t buf_rkey;
+    uint32_t atomic_rkey;
+    uint64_t atomic_va;
+    uint32_t atomic_num;
+    uint32_t role;
+    uint64_t repl_va;          // backup 의 복제 ring (복제 연결에만)
+    uint32_t repl_rkey;
+    uint32_t repl_slots;
 };
 
 enum msg_type {
     MSG_PUT,
-    MSG_GET
+    MSG_GET,
+    MSG_DELETE,
+    MSG_SCAN,
+    MSG_SCAN_ENTRY,
+    MSG_INCR,
+    MSG_APPEND,
+    MSG_CAS
 };
 
 struct kv_pair {
@@ -46,9 +76,73 @@ struct kv_pair {
 
 struct message {
     enum msg_type type;
+    uint32_t lease_us;         // GET 요청: 원하는 lease (0 이면 없음), 응답: 서버가 준 lease (lease.h)
+    uint32_t count;            // SCAN 요청: 받을 수 있는 entry 수 (credit), 응답: 이번 chunk 의 entry 수
+    uint64_t version;          // CAS 요청: 기대하는 version (0 이면 key 가 없어야 한다), SCAN 요청: SCAN_AFTER, 응답: entry 의 version
     struct kv_pair kv;
 };
 
+// 메시지에서 value 앞까지 (type + lease + count + version + key)
+#define MSG_HEADER_SIZE offsetof(struct message, kv.value)
+
+/*
+ * MSG_SCAN: [kv.key, kv.value) 의 key 를 순서대로 읽는다 (kv.value 가 "" 이면 끝까지).
+ * 서버는 요청의 count (클라이언트가 받을 자리, SCAN_CHUNK_MAX 이하) 만큼만 보내고 멈춘다.
+ * 응답의 value 가 "MORE" 면 클라이언트가 마지막 key 를 kv.key 에, version 에 SCAN_AFTER 를 넣어
+ * 그 key 바로 뒤부터 다음 chunk 를 요청하고,
+ * "END" 면 끝, 서버에 순서 index 가 없으면 (-O) "UNSUPPORTED".
+ * verbs 는 chunk 를 연결할 때 pdata 로 알려준 클라이언트 버퍼에 RDMA WRITE 하고
+ * 응답 SEND 하나만 보낸다. 다른 transport 는 entry 마다 MSG_SCAN_ENTRY 를 보낸 뒤 응답을 보낸다.
+ */
+#define SCAN_CHUNK_MAX 64
+#define SCAN_AFTER 1           // SCAN 요청의 version: kv.key 자체는 빼고 그 뒤부터
+
+/*
+ * 서버에서 한 번에 읽고 고치는 요청 (bucket lock 하나 안에서 끝나므로 같은 key 의 다른 쓰기와 섞이지 않는다).
+ * entry 마다 version 이 있어 새 key 는 1 로 시작하고 PUT/RMW 마다 1 씩 오른다.
+ *  - MSG_INCR: value 의 10 진수 (비어 있으면 1) 를 더한다. 없는 key 는 0 에서 시작, 숫자가 아니면 "NOT_A_NUMBER"
+ *  - MSG_APPEND: value 를 뒤에 붙인다. 없는 key 는 만들고, 길이가 넘치면 "VALUE_TOO_LARGE"
+ *  - MSG_CAS: entry 의 version 이 요청의 version 과 같을 때만 value 로 바꾼다. 아니면 "VERSION_MISMATCH"
+ * 성공하면 응답의 value/version 은 새 값, 실패하면 version 은 지금의 version 이다 (없으면 0).
+ */
+
+struct scan_entry {
+    char key[KEY_VALUE_SIZE];
+    char value[KEY_VALUE_SIZE];
+};
+
+/*
+ * UD 모드: 서버는 UD QP 하나로 모든 클라이언트를 받는다.
+ * 연결 상태가 없으므로 클라이언트가 req_id 로 재전송하고, 서버는
+ * (client_id, qpn) 별 마지막 응답을 캐시해 중복 요청에 그대로 돌려준다.
+ */
+#define UD_GRH_SIZE 40         // UD recv 버퍼 앞에 붙는 GRH
+#define UD_RECV_DEPTH 256
+#define UD_SEND_DEPTH 256
+#define UD_SIGNAL_EVERY 32     // send 는 이 간격으로만 completion 을 받는다
+#define UD_CLIENT_SLOTS 1024   // 서버의 dedup/AH 캐시 크기 (클라이언트 수와 무관하게 고정)
+#define UD_CLIENT_WAYS 8       // 같은 set 에 들어가는 client 수
+#define UD_CLIENT_RECV 4
+#define UD_TIMEOUT_US 1000     // 첫 재전송까지의 시간, 재전송마다 두 배
+#define UD_MAX_RETRIES 8
+// 클라이언트가 재전송을 포기하는 시간보다 길다. 이만큼 조용한 client 만 테이블에서 밀어낸다
+#define UD_CLIENT_IDLE_US ((uint64_t)UD_TIMEOUT_US << (UD_MAX_RETRIES + 1))
+#define UD_MIN_MTU 1024
+
+struct ud_message {
+    uint32_t client_id;        // 클라이언트가 시작할 때 고른 임의의 값
+    uint32_t req_id;           // 요청마다 1 씩 증가, 재전송은 같은 값
+    struct message msg;
+};
+
+#define UD_RECV_SIZE (UD_GRH_SIZE + sizeof(struct ud_message))
+
+#ifdef __cplusplus
+static_assert(sizeof(struct ud_message) <= UD_MIN_MTU, "UD request must fit in one MTU");
+#else
+_Static_assert(sizeof(struct ud_message) <= UD_MIN_MTU, "UD request must fit in one MTU");
+#endif
+
 struct rdma_context {
     struct ibv_device *device;
     struct ibv_context *verbs;
@@ -63,4 +157,7 @@ struct rdma_context {
 void build_context(struct rdma_context *ctx, struct rdma_cm_id *id);
 void build_qp_attr(struct ibv_qp_init_attr *attr, struct rdma_context *ctx);
 
+// "ip" 또는 "ip:port" (port 가 없으면 SERVER_PORT). 주소가 잘못됐으면 -1
+int parse_server_addr(const char *str, struct sockaddr_in *addr);
+
 #endif // COMMON_H
@@ -0,0 +1,268 @@
+//./conn-bench <server-ip>
+//./conn-bench -n 5000 -k user1 <server-ip>
+
+/*
+ * 연결을 맺고 GET 하나를 보내고 끊기를 반복해서
+ * 초당 연결 수와 연결 시작부터 첫 응답까지 (time-to-first-op) 시간을 잰다.
+ * 클라이언트 쪽도 PD, CQ, 버퍼 MR 은 처음 한 번만 만들고 연결마다 QP 만 새로 만든다.
+ */
+
+#include "common.h"
+
+#include <time.h>
+#include <unistd.h>
+
+static struct rdma_event_channel *ec;
+static struct ibv_context *verbs;
+static struct ibv_pd *pd;
+static struct ibv_cq *cq;
+static struct ibv_mr *mr;
+static char *send_buffer, *recv_buffer;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 기다리던 이벤트면 0, 거절당했으면 1
+static int expect_event(enum rdma_cm_event_type type) {
+    struct rdma_cm_event *event;
+    enum rdma_cm_event_type got;
+
+    if (rdma_get_cm_event(ec, &event)) {
+        perror("rdma_get_cm_event");
+        exit(EXIT_FAILURE);
+    }
+    got = event->event;
+    rdma_ack_cm_event(event);
+
+    if (got == type) {
+        return 0;
+    }
+    if (got == RDMA_CM_EVENT_REJECTED || got == RDMA_CM_EVENT_UNREACHABLE) {
+        return 1;
+    }
+    fprintf(stderr, "Expected %s, got %s\n", rdma_event_str(type), rdma_event_str(got));
+    exit(EXIT_FAILURE);
+}
+
+// 처음 보는 장치에 PD/CQ/MR 을 만든다. 이후 연결은 모두 이것을 같이 쓴다
+static void setup_shared(struct rdma_cm_id *id) {
+    if (verbs == id->verbs) {
+        return;
+    }
+    if (verbs) {
+        fprintf(stderr, "Route moved to another device\n");
+        exit(EXIT_FAILURE);
+    }
+    verbs = id->verbs;
+
+    pd = ibv_alloc_pd(verbs);
+    cq = ibv_create_cq(verbs, CQ_CAPACITY, NULL, NULL, 0);
+    send_buffer = calloc(2, sizeof(struct message));
+    if (!pd || !cq || !send_buffer) {
+        perror("Failed to set up shared resources");
+        exit(EXIT_FAILURE);
+    }
+    recv_buffer = send_buffer + sizeof(struct message);
+
+    mr = ibv_reg_mr(pd, send_buffer, 2 * sizeof(struct message),
+        IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+    if (!mr) {
+        perror("ibv_reg_mr");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// 연결 하나: 맺은 시각과 첫 GET 응답 시각을 돌려준다. 거절당하면 1
+static int connect_once(struct sockaddr_in *addr, const char *key, uint64_t *connected_ns, uint64_t *first_op_ns) {
+    struct rdma_cm_id *id;
+    struct ibv_qp_init_attr qp_attr;
+    struct rdma_context tmp;
+    struct rdma_conn_param conn_param;
+    struct pdata pdata;
+    struct ibv_sge send_sge, recv_sge;
+    struct ibv_send_wr send_wr, *bad_send_wr;
+    struct ibv_recv_wr recv_wr, *bad_recv_wr;
+    struct ibv_wc wc[2];
+    struct message *msg = (struct message *)send_buffer;
+    int pending = 2, n, rejected;
+
+    if (rdma_create_id(ec, &id, NULL, RDMA_PS_TCP)) {
+        perror("rdma_create_id");
+        exit(EXIT_FAILURE);
+    }
+    if (rdma_resolve_addr(id, NULL, (struct sockaddr *)addr, TIMEOUT_IN_MS) || expect_event(RDMA_CM_EVENT_ADDR_RESOLVED)) {
+        perror("rdma_resolve_addr");
+        exit(EXIT_FAILURE);
+    }
+    if (rdma_resolve_route(id, TIMEOUT_IN_MS) || expect_event(RDMA_CM_EVENT_ROUTE_RESOLVED)) {
+        perror("rdma_resolve_route");
+        exit(EXIT_FAILURE);
+    }
+
+    setup_shared(id);
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.cq = cq;
+    build_qp_attr(&qp_attr, &tmp);
+    if (rdma_create_qp(id, pd, &qp_attr)) {
+        perror("rdma_create_qp");
+        exit(EXIT_FAILURE);
+    }
+
+    recv_sge.addr = (uintptr_t)recv_buffer;
+    recv_sge.length = sizeof(struct message);
+    recv_sge.lkey = mr->lkey;
+    memset(&recv_wr, 0, sizeof(recv_wr));
+    recv_wr.sg_list = &recv_sge;
+    recv_wr.num_sge = 1;
+    if (ibv_post_recv(id->qp, &recv_wr, &bad_recv_wr)) {
+        perror("ibv_post_recv");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&pdata, 0, sizeof(pdata));
+    pdata.buf_va = htonll((uintptr_t)recv_buffer);
+    pdata.buf_rkey = htonl(mr->rkey);
+    memset(&conn_param, 0, sizeof(conn_param));
+    conn_param.initiator_depth = 3;
+    conn_param.responder_resources = 3;
+    conn_param.retry_count = 3;
+    conn_param.private_data = &pdata;
+    conn_param.private_data_len = sizeof(pdata);
+
+    if (rdma_connect(id, &conn_param)) {
+        perror("rdma_connect");
+        exit(EXIT_FAILURE);
+    }
+    rejected = expect_event(RDMA_CM_EVENT_ESTABLISHED);
+    *connected_ns = now_ns();
+
+    if (!rejected) {
+        memset(msg, 0, sizeof(*msg));
+        msg->type = MSG_GET;
+        strncpy(msg->kv.key, key, KEY_VALUE_SIZE - 1);
+
+        send_sge.addr = (uintptr_t)send_buffer;
+        send_sge.length = sizeof(struct message);
+        send_sge.lkey = mr->lkey;
+        memset(&send_wr, 0, sizeof(send_wr));
+        send_wr.opcode = IBV_WR_SEND;
+        send_wr.send_flags = IBV_SEND_SIGNALED;
+        send_wr.sg_list = &send_sge;
+        send_wr.num_sge = 1;
+        if (ibv_post_send(id->qp, &send_wr, &bad_send_wr)) {
+            perror("ibv_post_send");
+            exit(EXIT_FAILURE);
+        }
+
+        while (pending > 0) {
+            n = ibv_poll_cq(cq, pending, wc);
+            if (n < 0) {
+                perror("ibv_poll_cq");
+                exit(EXIT_FAILURE);
+            }
+            for (int i = 0; i < n; i++) {
+                if (wc[i].status != IBV_WC_SUCCESS) {
+                    fprintf(stderr, "First op failed: %s\n", ibv_wc_status_str(wc[i].status));
+                    exit(EXIT_FAILURE);
+                }
+            }
+            pending -= n;
+        }
+        *first_op_ns = now_ns();
+
+        rdma_disconnect(id);
+        expect_event(RDMA_CM_EVENT_DISCONNECTED);
+    }
+
+    rdma_destroy_qp(id);
+    rdma_destroy_id(id);
+    while (ibv_poll_cq(cq, 2, wc) > 0);  // 거절된 연결의 flush 된 recv
+    return rejected;
+}
+
+static void print_latency(const char *name, uint64_t *ns, int n) {
+    uint64_t sum = 0;
+
+    qsort(ns, n, sizeof(*ns), cmp_u64);
+    for (int i = 0; i < n; i++) {
+        sum += ns[i];
+    }
+    printf("%-14s avg %8.1f us  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name,
+        sum / 1e3 / n, ns[n / 2] / 1e3, ns[(int)(n * 0.99)] / 1e3, ns[n - 1] / 1e3);
+}
+
+int main(int argc, char **argv) {
+    const char *usage =
+        "Usage: %s [options] <server-ip>\n"
+        "  -n conns      connections to open and close (default 1000)\n"
+        "  -k key        key of the first GET (default bench)\n";
+    const char *key = "bench";
+    struct sockaddr_in addr;
+    uint64_t *connect_ns, *first_op_ns, start, begin, connected, first_op;
+    int opt, conns = 1000, done = 0, rejects = 0;
+
+    while ((opt = getopt(argc, argv, "n:k:")) != -1) {
+        switch (opt) {
+        case 'n':
+            conns = atoi(optarg);
+            break;
+        case 'k':
+            key = optarg;
+            break;
+        default:
+            fprintf(stderr, usage, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 1 || conns <= 0) {
+        fprintf(stderr, usage, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SERVER_PORT);
+    addr.sin_addr.s_addr = inet_addr(argv[optind]);
+
+    ec = rdma_create_event_channel();
+    connect_ns = calloc(conns, sizeof(uint64_t));
+    first_op_ns = calloc(conns, sizeof(uint64_t));
+    if (!ec || !connect_ns || !first_op_ns) {
+        perror("Failed to set up benchmark");
+        exit(EXIT_FAILURE);
+    }
+
+    start = now_ns();
+    while (done < conns) {
+        begin = now_ns();
+        if (connect_once(&addr, key, &connected, &first_op)) {
+            // 서버가 아직 앞 연결의 tenant 를 정리하지 못했다
+            rejects++;
+            usleep(100);
+            continue;
+        }
+        connect_ns[done] = connected - begin;
+        first_op_ns[done] = first_op - begin;
+        done++;
+    }
+
+    printf("%d connections in %.3f s: %.0f conn/s (%d rejected and retried)\n", conns,
+        (now_ns() - start) / 1e9, conns * 1e9 / (now_ns() - start), rejects);
+    print_latency("connect", connect_ns, conns);
+    print_latency("first op", first_op_ns, conns);
+
+    ibv_dereg_mr(mr);
+    free(send_buffer);
+    ibv_destroy_cq(cq);
+    ibv_dealloc_pd(pd);
+    rdma_destroy_event_channel(ec);
+    return EXIT_SUCCESS;
+}
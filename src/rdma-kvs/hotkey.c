@@ -0,0 +1,151 @@
+#include "hotkey.h"
+
+static __thread uint32_t sample_state;
+
+// FNV-1a 64. 위/아래 32 bit 로 행마다 다른 index 를 만든다 (h1 + i * h2)
+static uint64_t hotkey_hash(const char *key) {
+    uint64_t hash = 14695981039346656037ull;
+
+    while (*key) {
+        hash = (hash ^ (uint8_t)*key++) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static int sampled() {
+    uint32_t x = sample_state;
+
+    if (x == 0) {
+        x = (uint32_t)(uintptr_t)&sample_state | 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sample_state = x;
+    return (x & (HOTKEY_SAMPLE - 1)) == 0;
+}
+
+void hotkey_init(struct hotkey *h) {
+    memset(h, 0, sizeof(*h));
+    pthread_mutex_init(&h->lock, NULL);
+}
+
+static void swap_items(struct hotkey_item *a, struct hotkey_item *b) {
+    struct hotkey_item tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void sift_down(struct hotkey *h, int i) {
+    int smallest, l, r;
+
+    while (1) {
+        smallest = i;
+        l = 2 * i + 1;
+        r = 2 * i + 2;
+        if (l < h->heap_size && h->heap[l].count < h->heap[smallest].count) {
+            smallest = l;
+        }
+        if (r < h->heap_size && h->heap[r].count < h->heap[smallest].count) {
+            smallest = r;
+        }
+        if (smallest == i) {
+            return;
+        }
+        swap_items(&h->heap[i], &h->heap[smallest]);
+        i = smallest;
+    }
+}
+
+static void sift_up(struct hotkey *h, int i) {
+    while (i > 0 && h->heap[(i - 1) / 2].count > h->heap[i].count) {
+        swap_items(&h->heap[i], &h->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_offer(struct hotkey *h, const char *key, uint64_t count) {
+    for (int i = 0; i < h->heap_size; i++) {
+        if (strcmp(h->heap[i].key, key) == 0) {
+            if (count > h->heap[i].count) {
+                h->heap[i].count = count;
+                sift_down(h, i);
+            }
+            return;
+        }
+    }
+
+    if (h->heap_size < HOTKEY_TOPK) {
+        h->heap[h->heap_size].count = count;
+        strncpy(h->heap[h->heap_size].key, key, KEY_VALUE_SIZE - 1);
+        h->heap[h->heap_size].key[KEY_VALUE_SIZE - 1] = '\0';
+        sift_up(h, h->heap_size++);
+    } else if (count > h->heap[0].count) {
+        h->heap[0].count = count;
+        strncpy(h->heap[0].key, key, KEY_VALUE_SIZE - 1);
+        h->heap[0].key[KEY_VALUE_SIZE - 1] = '\0';
+        sift_down(h, 0);
+    }
+    __atomic_store_n(&h->heap_min, h->heap_size == HOTKEY_TOPK ? h->heap[0].count : 0, __ATOMIC_RELAXED);
+}
+
+void hotkey_record(struct hotkey *h, const char *key) {
+    uint64_t hash;
+    uint32_t h1, h2, est = UINT32_MAX, c;
+
+    if (!sampled()) {
+        return;
+    }
+
+    hash = hotkey_hash(key);
+    h1 = (uint32_t)hash;
+    h2 = (uint32_t)(hash >> 32) | 1;
+    for (int i = 0; i < HOTKEY_DEPTH; i++) {
+        c = __atomic_add_fetch(&h->counters[i][(h1 + i * h2) & (HOTKEY_WIDTH - 1)], 1, __ATOMIC_RELAXED);
+        if (c < est) {
+            est = c;
+        }
+    }
+    __atomic_add_fetch(&h->total, 1, __ATOMIC_RELAXED);
+
+    if (est <= __atomic_load_n(&h->heap_min, __ATOMIC_RELAXED)) {
+        return;
+    }
+    pthread_mutex_lock(&h->lock);
+    heap_offer(h, key, est);
+    pthread_mutex_unlock(&h->lock);
+}
+
+static int cmp_count_desc(const void *a, const void *b) {
+    uint64_t x = ((const struct hotkey_item *)a)->count, y = ((const struct hotkey_item *)b)->count;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+int hotkey_refresh(struct hotkey *h, struct hotkey_item *out, uint64_t *total) {
+    uint32_t c;
+    int n;
+
+    pthread_mutex_lock(&h->lock);
+    n = h->heap_size;
+    memcpy(out, h->heap, n * sizeof(*out));
+    for (int i = 0; i < n; i++) {
+        h->heap[i].count /= 2;
+    }
+    __atomic_store_n(&h->heap_min, h->heap_size == HOTKEY_TOPK ? h->heap[0].count : 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&h->lock);
+
+    // 그 사이의 add 를 잃지 않도록 읽은 값의 절반만 뺀다
+    for (int i = 0; i < HOTKEY_DEPTH; i++) {
+        for (int j = 0; j < HOTKEY_WIDTH; j++) {
+            c = __atomic_load_n(&h->counters[i][j], __ATOMIC_RELAXED);
+            if (c > 1) {
+                __atomic_sub_fetch(&h->counters[i][j], c / 2, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    *total = __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&h->total, *total / 2, __ATOMIC_RELAXED);
+
+    qsort(out, n, sizeof(*out), cmp_count_desc);
+    return n;
+}
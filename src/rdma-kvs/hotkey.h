@@ -0,0 +1,43 @@
+#ifndef HOTKEY_H
+#define HOTKEY_H
+
+#include "common.h"
+#include "perf_shm.h"
+
+/*
+ * 요청 key 의 heavy hitter 추적 (count-min sketch + top-K).
+ * worker 는 HOTKEY_SAMPLE 번에 한 번 정도만 sketch 를 올린다 (스레드마다 xorshift).
+ * 카운터는 여러 worker 가 같이 올리므로 relaxed atomic add 이고, 추정치가 top-K 의
+ * 최소보다 클 때만 lock 을 잡고 heap 을 고친다.
+ * hotkey_refresh 는 top-K 를 꺼낸 뒤 카운터와 heap 을 반으로 줄여서 지난 skew 를 잊는다.
+ */
+#define HOTKEY_DEPTH 4
+#define HOTKEY_WIDTH 4096          // 2 의 거듭제곱
+#define HOTKEY_SAMPLE 16           // 2 의 거듭제곱
+#define HOTKEY_TOPK PERF_HOT_KEYS
+#define HOTKEY_DEFAULT_INTERVAL_SEC 5
+
+struct hotkey_item {
+    uint64_t count;                // sample 단위 추정치
+    char key[KEY_VALUE_SIZE];
+};
+
+struct hotkey {
+    uint32_t counters[HOTKEY_DEPTH][HOTKEY_WIDTH];
+    uint64_t total;                // sample 수 (counters 와 같이 줄어든다)
+
+    pthread_mutex_t lock;
+    struct hotkey_item heap[HOTKEY_TOPK];  // count 의 최소 heap
+    int heap_size;
+    uint64_t heap_min;             // heap 이 차 있으면 heap[0].count (lock 없이 보는 문턱)
+};
+
+void hotkey_init(struct hotkey *h);
+
+// 요청 경로: 대부분 난수 하나만 뽑고 돌아간다
+void hotkey_record(struct hotkey *h, const char *key);
+
+// top-K 를 count 가 큰 순서로 out 에 복사하고 (개수를 돌려준다) sketch 를 반으로 줄인다
+int hotkey_refresh(struct hotkey *h, struct hotkey_item *out, uint64_t *total);
+
+#endif // HOTKEY_H
@@ -0,0 +1,36 @@
+#ifndef HUGEMEM_H
+#define HUGEMEM_H
+
+#include <stddef.h>
+
+/*
+ * ibv_reg_mr 할 메모리를 hugepage 로 할당한다.
+ * 4 KB page 로 잡으면 NIC 의 MTT/IOTLB 에 page 마다 entry 가 필요해서
+ * 큰 영역은 등록도 느리고 접근할 때 translation miss 가 잦다.
+ * 1 GB -> 2 MB (MAP_HUGETLB, hugetlbfs 예약분) -> THP (madvise) -> 4 KB 순으로 시도한다.
+ */
+#define HUGEMEM_2M (2ul << 20)
+#define HUGEMEM_1G (1ul << 30)
+#define HUGEMEM_MIN (64ul << 10)   // 이보다 작으면 hugepage 하나를 통째로 쓰지 않는다
+
+enum hugemem_kind {
+    HUGEMEM_SMALL,               // 일반 4 KB page
+    HUGEMEM_THP,                 // 2 MB 정렬 + MADV_HUGEPAGE (커널이 안 해줄 수도 있다)
+    HUGEMEM_HUGETLB_2M,
+    HUGEMEM_HUGETLB_1G
+};
+
+struct hugemem {
+    void *addr;
+    size_t len;                  // 실제로 매핑한 길이 (page 크기로 올림)
+    int kind;
+};
+
+// 0 으로 채워진 size 바이트를 돌려준다. max_kind 보다 큰 page 는 시도하지 않는다
+void *hugemem_alloc_kind(struct hugemem *m, size_t size, int max_kind);
+void *hugemem_alloc(struct hugemem *m, size_t size);
+void hugemem_free(struct hugemem *m);
+
+const char *hugemem_kind_name(int kind);
+
+#endif // HUGEMEM_H
@@ -0,0 +1,318 @@
+// ./kvs-stat            top 형태로 1초마다 갱신
+// ./kvs-stat -j         JSON 한 번 출력
+// ./kvs-stat -i 2 -n 5  2초 간격으로 5번 출력
+
+#include "perf_shm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *op_names[PERF_OP_MAX] = { "put", "get", "del", "scan", NULL, "incr", "append", "cas" };
+
+static struct perf_tenant_stats prev[MAX_TENANT_NUM];
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const char *op_name(int op) {
+    static char buf[PERF_OP_MAX][8];
+    if (op_names[op]) {
+        return op_names[op];
+    }
+    snprintf(buf[op], sizeof(buf[op]), "op%d", op);
+    return buf[op];
+}
+
+// 다른 프로세스가 쓰는 중이므로 필드 단위 relaxed load 로 복사
+static void snapshot(const struct perf_tenant_stats *src, struct perf_tenant_stats *dst) {
+    const uint64_t *s = (const uint64_t *)src;
+    uint64_t *d = (uint64_t *)dst;
+    for (size_t i = 0; i < sizeof(*src) / sizeof(uint64_t); i++) {
+        d[i] = __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+    }
+}
+
+static uint64_t total_ops(const struct perf_tenant_stats *s) {
+    uint64_t n = 0;
+    for (int op = 0; op < PERF_OP_MAX; op++) {
+        n += s->ops[op];
+    }
+    return n;
+}
+
+// bucket 상한값 (ns) 을 반환
+static uint64_t hist_percentile(const uint64_t *hist, double pct) {
+    uint64_t total = 0, seen = 0;
+    for (int b = 0; b < PERF_LAT_BUCKETS; b++) {
+        total += hist[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (int b = 0; b < PERF_LAT_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen * 100.0 >= total * pct) {
+            return 2ull << b;
+        }
+    }
+    return 2ull << (PERF_LAT_BUCKETS - 1);
+}
+
+static void merged_hist(const struct perf_tenant_stats *s, uint64_t *hist) {
+    memset(hist, 0, sizeof(uint64_t) * PERF_LAT_BUCKETS);
+    for (int op = 0; op < PERF_OP_MAX; op++) {
+        for (int b = 0; b < PERF_LAT_BUCKETS; b++) {
+            hist[b] += s->lat_hist[op][b];
+        }
+    }
+}
+
+struct hot_snapshot {
+    uint32_t interval_sec, num;
+    uint64_t updated_ns, total, pinned, hits;
+    struct perf_hot_key keys[PERF_HOT_KEYS];
+};
+
+// 서버가 쓰는 중 (hot_seq 홀수) 이거나 읽는 사이 바뀌었으면 다시 읽는다
+static void hot_snapshot(struct perf_shm_context *shm, struct hot_snapshot *h) {
+    uint64_t seq;
+
+    do {
+        while ((seq = __atomic_load_n(&shm->hot_seq, __ATOMIC_ACQUIRE)) & 1) {
+            usleep(100);
+        }
+        h->interval_sec = shm->hot_interval_sec;
+        h->num = shm->hot_num < PERF_HOT_KEYS ? shm->hot_num : PERF_HOT_KEYS;
+        h->updated_ns = shm->hot_updated_ns;
+        h->total = shm->hot_total;
+        h->pinned = shm->hot_pinned;
+        h->hits = shm->hot_hits;
+        memcpy(h->keys, shm->hot, sizeof(h->keys));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&shm->hot_seq, __ATOMIC_RELAXED) != seq);
+    for (int i = 0; i < PERF_HOT_KEYS; i++) {
+        h->keys[i].key[PERF_HOT_KEY_LEN - 1] = '\0';
+    }
+}
+
+static void print_json_string(const char *str) {
+    putchar('"');
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            printf("\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            printf("\\u%04x", *str);
+        } else {
+            putchar(*str);
+        }
+    }
+    putchar('"');
+}
+
+static double avg_batch(const struct perf_tenant_stats *s) {
+    uint64_t n = 0, sum = 0;
+    for (int b = 1; b < PERF_BATCH_BUCKETS; b++) {
+        n += s->cq_batch[b];
+        sum += s->cq_batch[b] * b;
+    }
+    return n ? (double)sum / n : 0.0;
+}
+
+
+static void print_top(struct perf_shm_context *shm, struct perf_tenant_stats *cur, double dt) {
+    struct hot_snapshot hot;
+    uint64_t hist[PERF_LAT_BUCKETS];
+    uint64_t entries = PERF_GET(shm->store_entries);
+
+    printf("\033[H\033[2J");
+    printf("rdma-kvs  uptime %.0fs  tenants %u/%u  qps %lu\n",
+        (now_ns() - shm->start_ns) / 1e9, PERF_GET(shm->active_tenant_num), shm->max_qps_limit,
+        (unsigned long)PERF_GET(shm->active_qps_num));
+    printf("store     entries %lu  buckets %u  load factor %.2f\n\n",
+        (unsigned long)entries, shm->hash_buckets, shm->hash_buckets ? (double)entries / shm->hash_buckets : 0.0);
+
+    printf("%-4s %-8s %10s %10s %10s %9s %9s %6s %5s %9s %9s\n",
+        "slot", "tid", "ops/s", "put/s", "get/s", "in MB/s", "out MB/s", "batch", "ring", "p50 us", "p99 us");
+
+    for (int i = 0; i < MAX_TENANT_NUM; i++) {
+        struct perf_tenant_stats *c = &cur[i], *p = &prev[i];
+        if (!c->active && total_ops(c) == 0) {
+            continue;
+        }
+        merged_hist(c, hist);
+        printf("%-4d %-8lu %10.0f %10.0f %10.0f %9.2f %9.2f %6.2f %2u/%-2u %9.1f %9.1f\n",
+            c->tenant_id, (unsigned long)c->thread_id,
+            (total_ops(c) - total_ops(p)) / dt,
+            (c->ops[0] - p->ops[0]) / dt,
+            (c->ops[1] - p->ops[1]) / dt,
+            (c->bytes_in - p->bytes_in) / dt / 1e6,
+            (c->bytes_out - p->bytes_out) / dt / 1e6,
+            avg_batch(c), c->recv_posted, c->recv_depth,
+            hist_percentile(hist, 50) / 1e3, hist_percentile(hist, 99) / 1e3);
+    }
+
+    hot_snapshot(shm, &hot);
+    if (hot.interval_sec > 0 && hot.num > 0) {
+        printf("\nhot keys  (every %us, %.0fs ago)  pinned %lu  hot table hits %lu\n", hot.interval_sec,
+            (now_ns() - hot.updated_ns) / 1e9, (unsigned long)hot.pinned, (unsigned long)hot.hits);
+        for (uint32_t i = 0; i < hot.num && i < 10; i++) {
+            printf("  %-40.40s %10lu %6.2f%%\n", hot.keys[i].key, (unsigned long)hot.keys[i].count,
+                hot.total ? 100.0 * hot.keys[i].count / hot.total : 0.0);
+        }
+    }
+    fflush(stdout);
+}
+
+static void print_json(struct perf_shm_context *shm, struct perf_tenant_stats *cur) {
+    struct hot_snapshot hot;
+    uint64_t entries = PERF_GET(shm->store_entries);
+    int first = 1;
+
+    printf("{\"uptime_ns\":%lu,\"active_tenants\":%u,\"active_qps\":%lu,",
+        (unsigned long)(now_ns() - shm->start_ns), PERF_GET(shm->active_tenant_num),
+        (unsigned long)PERF_GET(shm->active_qps_num));
+    printf("\"store\":{\"entries\":%lu,\"buckets\":%u,\"load_factor\":%.4f},",
+        (unsigned long)entries, shm->hash_buckets, shm->hash_buckets ? (double)entries / shm->hash_buckets : 0.0);
+    printf("\"tenants\":[");
+
+    for (int i = 0; i < MAX_TENANT_NUM; i++) {
+        struct perf_tenant_stats *c = &cur[i];
+        if (!c->active && total_ops(c) == 0) {
+            continue;
+        }
+        printf("%s{\"slot\":%d,\"tenant_id\":%u,\"thread_id\":%lu,\"active\":%u,", first ? "" : ",",
+            i, c->tenant_id, (unsigned long)c->thread_id, c->active);
+        printf("\"bytes_in\":%lu,\"bytes_out\":%lu,\"cq_polls\":%lu,\"recv_posted\":%u,\"recv_depth\":%u,",
+            (unsigned long)c->bytes_in, (unsigned long)c->bytes_out, (unsigned long)c->cq_polls,
+            c->recv_posted, c->recv_depth);
+
+        printf("\"cq_batch\":[");
+        for (int b = 0; b < PERF_BATCH_BUCKETS; b++) {
+            printf("%s%lu", b ? "," : "", (unsigned long)c->cq_batch[b]);
+        }
+        printf("],\"ops\":{");
+
+        int first_op = 1;
+        for (int op = 0; op < PERF_OP_MAX; op++) {
+            if (c->ops[op] == 0) {
+                continue;
+            }
+            printf("%s\"%s\":{\"count\":%lu,\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,\"lat_log2_ns\":[",
+                first_op ? "" : ",", op_name(op), (unsigned long)c->ops[op],
+                (unsigned long)hist_percentile(c->lat_hist[op], 50),
+                (unsigned long)hist_percentile(c->lat_hist[op], 99),
+                (unsigned long)hist_percentile(c->lat_hist[op], 99.9));
+            for (int b = 0; b < PERF_LAT_BUCKETS; b++) {
+                printf("%s%lu", b ? "," : "", (unsigned long)c->lat_hist[op][b]);
+            }
+            printf("]}");
+            first_op = 0;
+        }
+        printf("}}");
+        first = 0;
+    }
+    printf("],");
+
+    hot_snapshot(shm, &hot);
+    printf("\"hot\":{\"interval_sec\":%u,\"updated_ns\":%lu,\"total\":%lu,\"pinned\":%lu,\"table_hits\":%lu,\"keys\":[",
+        hot.interval_sec, (unsigned long)hot.updated_ns, (unsigned long)hot.total, (unsigned long)hot.pinned,
+        (unsigned long)hot.hits);
+    for (uint32_t i = 0; i < hot.num; i++) {
+        printf("%s{\"key\":", i ? "," : "");
+        print_json_string(hot.keys[i].key);
+        printf(",\"count\":%lu}", (unsigned long)hot.keys[i].count);
+    }
+    printf("]}}\n");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    struct perf_shm_context *shm;
+    struct perf_tenant_stats cur[MAX_TENANT_NUM];
+    int json = 0, interval = 1, iterations = -1;
+    int opt, shm_fd, first = 1, port = 0;
+    uint64_t last_ns;
+    char name[32] = PERF_SHM_NAME;
+
+    while ((opt = getopt(argc, argv, "ji:n:p:")) != -1) {
+        switch (opt) {
+        case 'j': json = 1; break;
+        case 'i': interval = atoi(optarg); break;
+        case 'n': iterations = atoi(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-j] [-i interval-sec] [-n count] [-p server-port]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    // -p 로 띄운 서버는 perf-shm 이름에 port 를 붙인다
+    if (port) {
+        snprintf(name, sizeof(name), PERF_SHM_PORT_NAME, port);
+    }
+    if (json && iterations < 0) {
+        iterations = 1;
+    }
+    if (interval < 1) {
+        interval = 1;
+    }
+
+    shm_fd = shm_open(name, O_RDONLY, 0);
+    if (shm_fd == -1) {
+        perror(name);
+        return EXIT_FAILURE;
+    }
+
+    shm = (struct perf_shm_context *)mmap(0, sizeof(struct perf_shm_context), PROT_READ, MAP_SHARED, shm_fd, 0);
+    if (shm == MAP_FAILED) {
+        perror(name);
+        return EXIT_FAILURE;
+    }
+    close(shm_fd);
+
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != PERF_SHM_MAGIC || shm->version != PERF_SHM_VERSION) {
+        fprintf(stderr, "%s is not an rdma-kvs telemetry segment (version %u)\n", name, shm->version);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < MAX_TENANT_NUM; i++) {
+        snapshot(&shm->tenant[i], &prev[i]);
+    }
+    last_ns = now_ns();
+
+    while (iterations != 0) {
+        // JSON 은 누적값이므로 첫 출력은 기다리지 않는다
+        if (!(json && first)) {
+            sleep(interval);
+        }
+        first = 0;
+
+        uint64_t ns = now_ns();
+        for (int i = 0; i < MAX_TENANT_NUM; i++) {
+            snapshot(&shm->tenant[i], &cur[i]);
+        }
+
+        if (json) {
+            print_json(shm, cur);
+        } else {
+            print_top(shm, cur, (ns - last_ns) / 1e9);
+        }
+
+        memcpy(prev, cur, sizeof(prev));
+        last_ns = ns;
+        if (iterations > 0) {
+            iterations--;
+        }
+    }
+
+    munmap(shm, sizeof(struct perf_shm_context));
+    return EXIT_SUCCESS;
+}
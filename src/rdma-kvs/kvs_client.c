@@ -0,0 +1,468 @@
+#include "kvs_client.h"
+#include "sizeclass.h"
+
+#define SEND_SLOT(c, i) ((struct message *)((c)->buf + (size_t)(i) * sizeof(struct message)))
+#define RECV_SLOT(c, i) ((struct message *)((c)->buf + (size_t)(KVS_PIPELINE + (i)) * sizeof(struct message)))
+#define ATOMIC_RESULT(c, i) ((uint64_t *)((c)->buf + (size_t)2 * KVS_PIPELINE * sizeof(struct message)) + (i))
+#define BUF_SIZE (2 * KVS_PIPELINE * sizeof(struct message) + KVS_ATOMIC_DEPTH * sizeof(uint64_t))
+
+// pdata 가 있으면 이벤트의 private data (서버 pdata) 를 복사한다
+static int wait_event(struct kvs_client *c, enum rdma_cm_event_type type, struct pdata *pdata) {
+    struct rdma_cm_event *event;
+    enum rdma_cm_event_type got;
+
+    if (rdma_get_cm_event(c->ec, &event)) {
+        perror("rdma_get_cm_event");
+        return -1;
+    }
+    got = event->event;
+    if (pdata && got == type) {
+        memset(pdata, 0, sizeof(*pdata));
+        if (event->param.conn.private_data) {
+            memcpy(pdata, event->param.conn.private_data, sizeof(*pdata));
+        }
+    }
+    rdma_ack_cm_event(event);
+
+    if (got != type) {
+        fprintf(stderr, "Expected %s, got %s\n", rdma_event_str(type), rdma_event_str(got));
+        return -1;
+    }
+    return 0;
+}
+
+static int post_recv(struct kvs_client *c, int index) {
+    struct ibv_sge sge;
+    struct ibv_recv_wr wr, *bad_wr;
+
+    sge.addr = (uintptr_t)RECV_SLOT(c, index);
+    sge.length = sizeof(struct message);
+    sge.lkey = c->mr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = index;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+
+    if (ibv_post_recv(c->id->qp, &wr, &bad_wr)) {
+        perror("ibv_post_recv");
+        return -1;
+    }
+    return 0;
+}
+
+struct kvs_client *kvs_connect(const char *server_ip) {
+    struct kvs_client *c;
+    struct sockaddr_in addr;
+    struct rdma_context tmp;
+    struct ibv_qp_init_attr qp_attr;
+    struct rdma_conn_param conn_param;
+    struct pdata pdata;
+
+    c = calloc(1, sizeof(*c));
+    if (!c) {
+        perror("Failed to allocate client");
+        return NULL;
+    }
+
+    if (parse_server_addr(server_ip, &addr) < 0) {
+        fprintf(stderr, "Bad server address %s\n", server_ip);
+        goto fail;
+    }
+
+    c->ec = rdma_create_event_channel();
+    if (!c->ec || rdma_create_id(c->ec, &c->id, NULL, RDMA_PS_TCP)) {
+        perror("rdma_create_id");
+        goto fail;
+    }
+    if (rdma_resolve_addr(c->id, NULL, (struct sockaddr *)&addr, TIMEOUT_IN_MS)
+        || wait_event(c, RDMA_CM_EVENT_ADDR_RESOLVED, NULL)
+        || rdma_resolve_route(c->id, TIMEOUT_IN_MS)
+        || wait_event(c, RDMA_CM_EVENT_ROUTE_RESOLVED, NULL)) {
+        perror("Failed to resolve server");
+        goto fail;
+    }
+
+    c->pd = ibv_alloc_pd(c->id->verbs);
+    // recv 와 send 의 completion 에 atomic completion 까지 들어간다
+    c->cq = ibv_create_cq(c->id->verbs, 2 * KVS_PIPELINE + KVS_ATOMIC_DEPTH, NULL, NULL, 0);
+    c->buf = calloc(1, BUF_SIZE);
+    if (!c->pd || !c->cq || !c->buf) {
+        perror("Failed to allocate client resources");
+        goto fail;
+    }
+    c->mr = ibv_reg_mr(c->pd, c->buf, BUF_SIZE, IBV_ACCESS_LOCAL_WRITE);
+    if (!c->mr) {
+        perror("ibv_reg_mr");
+        goto fail;
+    }
+
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.cq = c->cq;
+    build_qp_attr(&qp_attr, &tmp);
+    if (rdma_create_qp(c->id, c->pd, &qp_attr)) {
+        perror("rdma_create_qp");
+        goto fail;
+    }
+
+    for (int i = 0; i < KVS_PIPELINE; i++) {
+        if (post_recv(c, i)) {
+            goto fail;
+        }
+    }
+
+    memset(&pdata, 0, sizeof(pdata));
+    pdata.buf_va = htonll((uintptr_t)RECV_SLOT(c, 0));
+    pdata.buf_rkey = htonl(c->mr->rkey);
+    memset(&conn_param, 0, sizeof(conn_param));
+    conn_param.initiator_depth = 3;
+    conn_param.responder_resources = 3;
+    conn_param.retry_count = 3;
+    conn_param.rnr_retry_count = 7;  // 서버가 recv 를 다시 거는 중이면 기다린다
+    conn_param.private_data = &pdata;
+    conn_param.private_data_len = sizeof(pdata);
+
+    if (rdma_connect(c->id, &conn_param) || wait_event(c, RDMA_CM_EVENT_ESTABLISHED, &pdata)) {
+        perror("Failed to connect to remote host");
+        goto fail;
+    }
+    c->atomic_va = ntohll(pdata.atomic_va);
+    c->atomic_rkey = ntohl(pdata.atomic_rkey);
+    c->atomic_num = ntohl(pdata.atomic_num);
+    return c;
+
+fail:
+    kvs_close(c);
+    return NULL;
+}
+
+// 실패한 연결: 남은 요청은 모두 KVS_ERROR 로 끝낸다
+static void fail_all(struct kvs_client *c) {
+    struct kvs_request *req;
+    struct kvs_atomic_request *areq;
+
+    c->failed = 1;
+    while (c->inflight_count > 0) {
+        req = c->inflight[c->inflight_head];
+        c->inflight_head = (c->inflight_head + 1) % KVS_PIPELINE;
+        c->inflight_count--;
+        req->cb(req->arg, KVS_ERROR, NULL);
+        free(req);
+    }
+    while ((req = c->queue_head) != NULL) {
+        c->queue_head = req->next;
+        c->queued--;
+        req->cb(req->arg, KVS_ERROR, NULL);
+        free(req);
+    }
+    c->queue_tail = NULL;
+    for (int i = 0; i < KVS_ATOMIC_DEPTH; i++) {
+        if (c->atomic_busy & (1u << i)) {
+            c->atomic_busy &= ~(1u << i);
+            c->atomic_inflight[i]->cb(c->atomic_inflight[i]->arg, KVS_ERROR, 0);
+            free(c->atomic_inflight[i]);
+        }
+    }
+    while ((areq = c->atomic_head) != NULL) {
+        c->atomic_head = areq->next;
+        c->atomic_queued--;
+        areq->cb(areq->arg, KVS_ERROR, 0);
+        free(areq);
+    }
+    c->atomic_tail = NULL;
+}
+
+void kvs_close(struct kvs_client *c) {
+    if (!c) {
+        return;
+    }
+    if (!c->failed) {
+        fail_all(c);
+    }
+
+    if (c->id && c->id->qp) {
+        rdma_disconnect(c->id);
+        rdma_destroy_qp(c->id);
+    }
+    if (c->mr) {
+        ibv_dereg_mr(c->mr);
+    }
+    free(c->buf);
+    if (c->cq) {
+        ibv_destroy_cq(c->cq);
+    }
+    if (c->pd) {
+        ibv_dealloc_pd(c->pd);
+    }
+    if (c->id) {
+        rdma_destroy_id(c->id);
+    }
+    if (c->ec) {
+        rdma_destroy_event_channel(c->ec);
+    }
+    free(c);
+}
+
+static int enqueue(struct kvs_client *c, int type, const char *key, const char *value, kvs_callback cb, void *arg) {
+    struct kvs_request *req;
+
+    if (c->failed) {
+        return -1;
+    }
+
+    req = malloc(sizeof(*req));
+    if (!req) {
+        return -1;
+    }
+    req->next = NULL;
+    req->type = type;
+    strncpy(req->key, key, KEY_VALUE_SIZE - 1);
+    req->key[KEY_VALUE_SIZE - 1] = '\0';
+    strncpy(req->value, value ? value : "", KEY_VALUE_SIZE - 1);
+    req->value[KEY_VALUE_SIZE - 1] = '\0';
+    req->cb = cb;
+    req->arg = arg;
+
+    if (c->queue_tail) {
+        c->queue_tail->next = req;
+    } else {
+        c->queue_head = req;
+    }
+    c->queue_tail = req;
+    c->queued++;
+    return 0;
+}
+
+int kvs_get_async(struct kvs_client *c, const char *key, kvs_callback cb, void *arg) {
+    return enqueue(c, MSG_GET, key, NULL, cb, arg);
+}
+
+int kvs_put_async(struct kvs_client *c, const char *key, const char *value, kvs_callback cb, void *arg) {
+    return enqueue(c, MSG_PUT, key, value, cb, arg);
+}
+
+int kvs_del_async(struct kvs_client *c, const char *key, kvs_callback cb, void *arg) {
+    return enqueue(c, MSG_DELETE, key, NULL, cb, arg);
+}
+
+static int enqueue_atomic(struct kvs_client *c, int opcode, uint32_t slot, uint64_t compare_add, uint64_t swap,
+    kvs_atomic_callback cb, void *arg) {
+    struct kvs_atomic_request *req;
+
+    if (c->failed || slot >= c->atomic_num) {
+        return -1;
+    }
+
+    req = malloc(sizeof(*req));
+    if (!req) {
+        return -1;
+    }
+    req->next = NULL;
+    req->opcode = opcode;
+    req->slot = slot;
+    req->compare_add = compare_add;
+    req->swap = swap;
+    req->cb = cb;
+    req->arg = arg;
+
+    if (c->atomic_tail) {
+        c->atomic_tail->next = req;
+    } else {
+        c->atomic_head = req;
+    }
+    c->atomic_tail = req;
+    c->atomic_queued++;
+    return 0;
+}
+
+int kvs_fetch_add_async(struct kvs_client *c, uint32_t slot, uint64_t add, kvs_atomic_callback cb, void *arg) {
+    return enqueue_atomic(c, IBV_WR_ATOMIC_FETCH_AND_ADD, slot, add, 0, cb, arg);
+}
+
+int kvs_cmp_swap_async(struct kvs_client *c, uint32_t slot, uint64_t expected, uint64_t desired,
+    kvs_atomic_callback cb, void *arg) {
+    return enqueue_atomic(c, IBV_WR_ATOMIC_CMP_AND_SWP, slot, expected, desired, cb, arg);
+}
+
+// 빈 atomic 자리만큼 서버 메모리에 one-sided atomic 을 엮어 post 한다. 결과는 그 자리의 uint64_t 로 온다
+static int flush_atomics(struct kvs_client *c) {
+    struct ibv_send_wr wr[KVS_ATOMIC_DEPTH], *bad_wr;
+    struct ibv_sge sge[KVS_ATOMIC_DEPTH];
+    struct kvs_atomic_request *req;
+    int n = 0, i;
+
+    while (c->atomic_head && c->atomic_busy != (1u << KVS_ATOMIC_DEPTH) - 1) {
+        req = c->atomic_head;
+        c->atomic_head = req->next;
+        if (!c->atomic_head) {
+            c->atomic_tail = NULL;
+        }
+        c->atomic_queued--;
+
+        i = __builtin_ctz(~c->atomic_busy);
+        c->atomic_busy |= 1u << i;
+        c->atomic_inflight[i] = req;
+
+        sge[n].addr = (uintptr_t)ATOMIC_RESULT(c, i);
+        sge[n].length = sizeof(uint64_t);
+        sge[n].lkey = c->mr->lkey;
+
+        memset(&wr[n], 0, sizeof(wr[n]));
+        wr[n].wr_id = i;
+        wr[n].opcode = req->opcode;
+        wr[n].send_flags = IBV_SEND_SIGNALED;
+        wr[n].sg_list = &sge[n];
+        wr[n].num_sge = 1;
+        wr[n].wr.atomic.remote_addr = c->atomic_va + (uint64_t)req->slot * sizeof(uint64_t);
+        wr[n].wr.atomic.rkey = c->atomic_rkey;
+        wr[n].wr.atomic.compare_add = req->compare_add;
+        wr[n].wr.atomic.swap = req->swap;
+        if (n > 0) {
+            wr[n - 1].next = &wr[n];
+        }
+        n++;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+    if (ibv_post_send(c->id->qp, wr, &bad_wr)) {
+        perror("ibv_post_send");
+        return -1;
+    }
+    c->posts++;
+    c->posted_requests += n;
+    return 0;
+}
+
+// 빈 pipeline 자리만큼 queue 에서 꺼내 WR 을 엮어 한 번에 post 한다
+static int flush_queue(struct kvs_client *c) {
+    struct ibv_send_wr wr[KVS_PIPELINE], *bad_wr;
+    struct ibv_sge sge[KVS_PIPELINE];
+    struct kvs_request *req;
+    struct message *msg;
+    int n = 0, slot, value_class;
+
+    while (c->queue_head && c->inflight_count < KVS_PIPELINE) {
+        req = c->queue_head;
+        c->queue_head = req->next;
+        if (!c->queue_head) {
+            c->queue_tail = NULL;
+        }
+        c->queued--;
+
+        slot = (c->inflight_head + c->inflight_count) % KVS_PIPELINE;
+        c->inflight[slot] = req;
+        c->inflight_count++;
+
+        msg = SEND_SLOT(c, slot);
+        msg->type = req->type;
+        value_class = kv_class(req->value);
+        kv_copy(msg->kv.key, req->key, kv_class(req->key));
+        kv_copy(msg->kv.value, req->value, value_class);
+
+        sge[n].addr = (uintptr_t)msg;
+        sge[n].length = MSG_HEADER_SIZE + kv_class_size(value_class);
+        sge[n].lkey = c->mr->lkey;
+
+        memset(&wr[n], 0, sizeof(wr[n]));
+        wr[n].wr_id = slot;
+        wr[n].opcode = IBV_WR_SEND;
+        wr[n].send_flags = IBV_SEND_SIGNALED;
+        wr[n].sg_list = &sge[n];
+        wr[n].num_sge = 1;
+        if (n > 0) {
+            wr[n - 1].next = &wr[n];
+        }
+        n++;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+    if (ibv_post_send(c->id->qp, wr, &bad_wr)) {
+        perror("ibv_post_send");
+        return -1;
+    }
+    c->posts++;
+    c->posted_requests += n;
+    return 0;
+}
+
+// 서버는 결과를 value 문자열로 돌려준다
+static int response_status(int type, const struct message *resp) {
+    if ((type == MSG_GET || type == MSG_DELETE) && strcmp(resp->kv.value, "NOT_FOUND") == 0) {
+        return KVS_NOT_FOUND;
+    }
+    if (type == MSG_PUT && strcmp(resp->kv.value, "STORE_FULL") == 0) {
+        return KVS_STORE_FULL;
+    }
+    if ((type == MSG_PUT || type == MSG_DELETE) && strcmp(resp->kv.value, "READ_ONLY") == 0) {
+        return KVS_READ_ONLY;
+    }
+    return KVS_OK;
+}
+
+int kvs_poll(struct kvs_client *c) {
+    struct ibv_wc wc[CQ_CAPACITY];
+    struct kvs_request *req;
+    struct kvs_atomic_request *areq;
+    struct message *resp;
+    int n, done = 0;
+
+    if (c->failed) {
+        return -1;
+    }
+    if (flush_queue(c) || flush_atomics(c)) {
+        fail_all(c);
+        return -1;
+    }
+
+    n = ibv_poll_cq(c->cq, CQ_CAPACITY, wc);
+    if (n < 0) {
+        perror("ibv_poll_cq");
+        fail_all(c);
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "Work completion error: %s\n", ibv_wc_status_str(wc[i].status));
+            fail_all(c);
+            return -1;
+        }
+        if (wc[i].opcode == IBV_WC_FETCH_ADD || wc[i].opcode == IBV_WC_COMP_SWAP) {
+            areq = c->atomic_inflight[wc[i].wr_id];
+            c->atomic_busy &= ~(1u << wc[i].wr_id);
+            areq->cb(areq->arg, KVS_OK, *ATOMIC_RESULT(c, wc[i].wr_id));
+            free(areq);
+            done++;
+            continue;
+        }
+        if (!(wc[i].opcode & IBV_WC_RECV)) {
+            continue;
+        }
+
+        // 응답은 보낸 순서대로 온다
+        resp = RECV_SLOT(c, wc[i].wr_id);
+        req = c->inflight[c->inflight_head];
+        c->inflight_head = (c->inflight_head + 1) % KVS_PIPELINE;
+        c->inflight_count--;
+
+        // 새 요청은 이 poll 이 끝난 뒤에 나가므로 callback 동안 resp 는 그대로다
+        if (post_recv(c, wc[i].wr_id)) {
+            fail_all(c);
+            return -1;
+        }
+        req->cb(req->arg, response_status(req->type, resp), resp->kv.value);
+        free(req);
+        done++;
+    }
+
+    // callback 이 넣은 요청도 바로 내보낸다
+    if (done && (flush_queue(c) || flush_atomics(c))) {
+        fail_all(c);
+        return -1;
+    }
+    return done;
+}
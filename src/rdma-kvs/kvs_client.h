@@ -0,0 +1,109 @@
+#ifndef KVS_CLIENT_H
+#define KVS_CLIENT_H
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 애플리케이션에 넣어 쓰는 RC 클라이언트 (전역 상태 없음, 연결마다 kvs_client 하나).
+ * 요청은 callback 과 함께 queue 에 넣기만 하고, kvs_poll 이 CQ 를 보면서
+ * 응답이 온 요청의 callback 을 부르고 빈 자리만큼 queue 의 요청을 한 번의
+ * ibv_post_send 로 묶어 보낸다. 서버는 연결의 요청을 순서대로 처리하므로
+ * 응답도 보낸 순서대로 온다.
+ *
+ * 한 연결에 KVS_PIPELINE 개까지 동시에 나가 있고 나머지는 queue 에서 기다린다.
+ * 한 스레드에서만 쓴다 (callback 도 kvs_poll 을 부른 스레드에서 불린다).
+ *
+ * 서버 atomic 영역 (common.h) 의 fetch-add / CAS 는 따로 queue 에 넣고, 서버 응답 없이
+ * send completion 으로 끝난다. KVS_ATOMIC_DEPTH 개까지 동시에 나간다.
+ */
+#define KVS_PIPELINE (KVS_RECV_DEPTH - 1)  // 서버가 recv 를 다시 걸기 전의 하나를 남긴다
+#define KVS_ATOMIC_DEPTH 4                 // send queue (MAX_WR) 에 KVS_PIPELINE 과 같이 들어가야 한다
+
+enum kvs_status {
+    KVS_OK,
+    KVS_NOT_FOUND,
+    KVS_STORE_FULL,
+    KVS_READ_ONLY,                      // backup 서버에 쓰기를 보냈다
+    KVS_ERROR
+};
+
+// value 는 GET 이 KVS_OK 일 때만 의미가 있고 callback 이 끝나면 사라진다
+typedef void (*kvs_callback)(void *arg, int status, const char *value);
+// old 는 서버 카운터의 이전 값 (KVS_OK 일 때만)
+typedef void (*kvs_atomic_callback)(void *arg, int status, uint64_t old);
+
+struct kvs_request {
+    struct kvs_request *next;
+    int type;
+    char key[KEY_VALUE_SIZE];
+    char value[KEY_VALUE_SIZE];
+    kvs_callback cb;
+    void *arg;
+};
+
+struct kvs_atomic_request {
+    struct kvs_atomic_request *next;
+    int opcode;                         // IBV_WR_ATOMIC_FETCH_AND_ADD / IBV_WR_ATOMIC_CMP_AND_SWP
+    uint32_t slot;
+    uint64_t compare_add, swap;
+    kvs_atomic_callback cb;
+    void *arg;
+};
+
+struct kvs_client {
+    struct rdma_event_channel *ec;
+    struct rdma_cm_id *id;
+    struct ibv_pd *pd;
+    struct ibv_cq *cq;
+    struct ibv_mr *mr;
+    char *buf;                          // send 슬롯 KVS_PIPELINE 개 + recv 슬롯 KVS_PIPELINE 개 + atomic 결과
+
+    struct kvs_request *inflight[KVS_PIPELINE];  // 보낸 순서 (응답 순서와 같다)
+    int inflight_head, inflight_count;  // inflight[i] 는 send 슬롯 i 를 쓴다
+    struct kvs_request *queue_head, *queue_tail;
+    int queued;
+    int failed;                         // 연결이나 completion 이 실패했다
+
+    // 서버 atomic 영역 (연결할 때 pdata 로 받는다, atomic_num 이 0 이면 못 쓴다)
+    uint64_t atomic_va;
+    uint32_t atomic_rkey, atomic_num;
+    struct kvs_atomic_request *atomic_inflight[KVS_ATOMIC_DEPTH];  // 자리 i 의 결과는 buf 의 i 번째 uint64_t
+    uint32_t atomic_busy;               // atomic_inflight 의 사용 중인 자리 bit
+    struct kvs_atomic_request *atomic_head, *atomic_tail;
+    int atomic_queued;
+
+    uint64_t posts, posted_requests;    // ibv_post_send 호출 수와 그것으로 보낸 요청 수
+};
+
+// 연결을 맺는다 (server_ip 는 "ip" 또는 "ip:port"). 실패하면 NULL
+struct kvs_client *kvs_connect(const char *server_ip);
+void kvs_close(struct kvs_client *c);
+
+// 요청을 queue 에 넣는다 (보내는 것은 kvs_poll). key/value 는 복사해 둔다
+int kvs_get_async(struct kvs_client *c, const char *key, kvs_callback cb, void *arg);
+int kvs_put_async(struct kvs_client *c, const char *key, const char *value, kvs_callback cb, void *arg);
+int kvs_del_async(struct kvs_client *c, const char *key, kvs_callback cb, void *arg);
+
+// 서버 atomic 영역의 slot 에 보낼 요청을 queue 에 넣는다. slot 이 범위 밖이면 (서버가 atomic 을 못 하면) -1
+int kvs_fetch_add_async(struct kvs_client *c, uint32_t slot, uint64_t add, kvs_atomic_callback cb, void *arg);
+// 이전 값이 expected 면 desired 로 바꾼 것이다
+int kvs_cmp_swap_async(struct kvs_client *c, uint32_t slot, uint64_t expected, uint64_t desired,
+    kvs_atomic_callback cb, void *arg);
+
+// queue 를 보내고 도착한 응답의 callback 을 부른다. 끝난 요청 수, 연결이 실패했으면 -1
+int kvs_poll(struct kvs_client *c);
+
+// 보냈거나 queue 에 있는, 아직 callback 을 받지 않은 요청 수
+static inline int kvs_pending(const struct kvs_client *c) {
+    return c->inflight_count + c->queued + __builtin_popcount(c->atomic_busy) + c->atomic_queued;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KVS_CLIENT_H
@@ -0,0 +1,400 @@
+#ifndef KVS_CLIENT_HPP
+#define KVS_CLIENT_HPP
+
+/*
+ * kvs_client 의 C++20 coroutine API.
+ *
+ *   kvs::Task<> lookup(kvs::Client &kv, std::string key) {
+ *       auto value = co_await kv.get(key);   // 응답이 올 때까지 이 coroutine 만 멈춘다
+ *       if (value) co_await kv.put(key, *value + "!");
+ *   }
+ *   kv.spawn(lookup(kv, "k1")); ... kv.run();
+ *
+ * 서버 atomic 영역은 co_await kv.fetch_add(slot, n) / kv.cmp_swap(slot, old, new) 로 쓴다
+ * (이전 값을 돌려준다).
+ *
+ * 읽기 복제본 (server -B) 을 주면 GET 은 primary 와 replica 에 돌아가며 나가고 (연결마다 따로 묶인다)
+ * PUT/DELETE/atomic 은 primary 로만 간다. replica 의 GET 은 조금 예전 값일 수 있다.
+ *
+ * kvs::Client kv(kvs::Shards{{"10.0.0.1", "10.0.0.2"}}) 처럼 서버 여러 개를 주면 key 를 나눠 둔다
+ * (kvs_cluster.h 의 consistent hash). GET/PUT/DELETE 는 key 의 서버로, atomic 은 첫 서버로 간다.
+ *
+ * co_await 는 요청을 queue 에 넣고 멈추며, run() 의 poll loop 가 요청을 묶어서
+ * 보내고 응답이 오면 그 자리에서 coroutine 을 이어서 돌린다. 스레드는 하나다.
+ */
+
+#include "kvs_client.h"
+#include "kvs_cluster.h"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kvs {
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    // 끝나면 기다리던 coroutine 으로 바로 넘어간다 (symmetric transfer)
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            auto next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+} // namespace detail
+
+// co_await 하거나 Client::spawn 에 넘기면 시작하는 coroutine
+template <typename T = void>
+class Task {
+public:
+    struct promise_type : detail::PromiseBase {
+        std::optional<T> value;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_value(T v) { value = std::move(v); }
+    };
+
+    Task(Task &&other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() {
+        if (h_) {
+            h_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        h_.promise().continuation = awaiter;
+        return h_;
+    }
+    T await_resume() {
+        if (h_.promise().error) {
+            std::rethrow_exception(h_.promise().error);
+        }
+        return std::move(*h_.promise().value);
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    std::coroutine_handle<promise_type> h_;
+};
+
+template <>
+class Task<void> {
+public:
+    struct promise_type : detail::PromiseBase {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_void() {}
+    };
+
+    Task(Task &&other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() {
+        if (h_) {
+            h_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        h_.promise().continuation = awaiter;
+        return h_;
+    }
+    void await_resume() {
+        if (h_.promise().error) {
+            std::rethrow_exception(h_.promise().error);
+        }
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    std::coroutine_handle<promise_type> h_;
+};
+
+// key 를 나눠 둘 서버들 ("ip" 또는 "ip:port")
+struct Shards {
+    std::vector<std::string> servers;
+};
+
+class Client {
+public:
+    // 주소는 "ip" 또는 "ip:port"
+    explicit Client(const std::string &server_ip, const std::vector<std::string> &replicas = {}) {
+        nodes_.push_back(kvs_connect(server_ip.c_str()));
+        if (!nodes_[0]) {
+            throw std::runtime_error("kvs: failed to connect to " + server_ip);
+        }
+        for (const auto &replica : replicas) {
+            kvs_client *c = kvs_connect(replica.c_str());
+            if (!c) {
+                close_all();
+                throw std::runtime_error("kvs: failed to connect to replica " + replica);
+            }
+            nodes_.push_back(c);
+        }
+        c_ = nodes_[0];
+    }
+    explicit Client(const Shards &shards) {
+        std::vector<const char *> names;
+
+        for (const auto &server : shards.servers) {
+            names.push_back(server.c_str());
+        }
+        cluster_ = kvs_cluster_connect(names.data(), (int)names.size());
+        if (!cluster_) {
+            throw std::runtime_error("kvs: failed to connect to the cluster");
+        }
+        nodes_.assign(cluster_->nodes, cluster_->nodes + cluster_->num);
+        c_ = nodes_[0];
+    }
+    ~Client() { close_all(); }
+
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    // 요청 하나의 awaitable. 응답 callback 이 결과를 채우고 coroutine 을 다시 돌린다
+    class Request {
+    public:
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h) {
+            int ret;
+
+            handle_ = h;
+            if (type_ == MSG_GET) {
+                ret = kvs_get_async(c_, key_.c_str(), done, this);
+            } else if (type_ == MSG_PUT) {
+                ret = kvs_put_async(c_, key_.c_str(), value_.c_str(), done, this);
+            } else {
+                ret = kvs_del_async(c_, key_.c_str(), done, this);
+            }
+            if (ret != 0) {
+                status_ = KVS_ERROR;
+                return false;  // 멈추지 않고 바로 await_resume
+            }
+            return true;
+        }
+
+    protected:
+        Request(kvs_client *c, int type, std::string key, std::string value)
+            : c_(c), type_(type), key_(std::move(key)), value_(std::move(value)) {}
+
+        int checked_status() const {
+            if (status_ == KVS_ERROR) {
+                throw std::runtime_error("kvs: request failed on a broken connection");
+            }
+            return status_;
+        }
+
+        kvs_client *c_;
+        int type_;
+        std::string key_, value_;
+        int status_ = KVS_ERROR;
+
+    private:
+        static void done(void *arg, int status, const char *value) {
+            Request *req = static_cast<Request *>(arg);
+
+            req->status_ = status;
+            if (status == KVS_OK && req->type_ == MSG_GET) {
+                req->value_ = value;
+            }
+            req->handle_.resume();  // 이 뒤로 req 는 이미 없을 수 있다
+        }
+
+        std::coroutine_handle<> handle_;
+    };
+
+    // 없으면 nullopt
+    class Get : public Request {
+    public:
+        Get(kvs_client *c, std::string key) : Request(c, MSG_GET, std::move(key), {}) {}
+        std::optional<std::string> await_resume() {
+            if (checked_status() != KVS_OK) {
+                return std::nullopt;
+            }
+            return std::move(value_);
+        }
+    };
+
+    // store 가 가득 차면 false
+    class Put : public Request {
+    public:
+        Put(kvs_client *c, std::string key, std::string value) : Request(c, MSG_PUT, std::move(key), std::move(value)) {}
+        bool await_resume() { return checked_status() == KVS_OK; }
+    };
+
+    // key 가 없었으면 false
+    class Del : public Request {
+    public:
+        Del(kvs_client *c, std::string key) : Request(c, MSG_DELETE, std::move(key), {}) {}
+        bool await_resume() { return checked_status() == KVS_OK; }
+    };
+
+    // 서버 atomic 영역의 one-sided fetch-add / CAS. 서버 카운터의 이전 값
+    class Atomic {
+    public:
+        Atomic(kvs_client *c, bool cas, uint32_t slot, uint64_t arg1, uint64_t arg2)
+            : c_(c), cas_(cas), slot_(slot), arg1_(arg1), arg2_(arg2) {}
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h) {
+            int ret;
+
+            handle_ = h;
+            if (cas_) {
+                ret = kvs_cmp_swap_async(c_, slot_, arg1_, arg2_, done, this);
+            } else {
+                ret = kvs_fetch_add_async(c_, slot_, arg1_, done, this);
+            }
+            if (ret != 0) {
+                status_ = KVS_ERROR;
+                return false;
+            }
+            return true;
+        }
+        uint64_t await_resume() {
+            if (status_ != KVS_OK) {
+                throw std::runtime_error("kvs: atomic failed (no free slot, bad index or broken connection)");
+            }
+            return old_;
+        }
+
+    private:
+        static void done(void *arg, int status, uint64_t old) {
+            Atomic *op = static_cast<Atomic *>(arg);
+
+            op->status_ = status;
+            op->old_ = old;
+            op->handle_.resume();
+        }
+
+        kvs_client *c_;
+        bool cas_;
+        uint32_t slot_;
+        uint64_t arg1_, arg2_, old_ = 0;
+        int status_ = KVS_ERROR;
+        std::coroutine_handle<> handle_;
+    };
+
+    Get get(std::string key) {
+        kvs_client *c = cluster_ ? kvs_cluster_route(cluster_, key.c_str()) : nodes_[next_read_++ % nodes_.size()];
+        return Get(c, std::move(key));
+    }
+    Put put(std::string key, std::string value) {
+        kvs_client *c = write_node(key);
+        return Put(c, std::move(key), std::move(value));
+    }
+    Del del(std::string key) {
+        kvs_client *c = write_node(key);
+        return Del(c, std::move(key));
+    }
+    Atomic fetch_add(uint32_t slot, uint64_t add) { return Atomic(c_, false, slot, add, 0); }
+    Atomic cmp_swap(uint32_t slot, uint64_t expected, uint64_t desired) { return Atomic(c_, true, slot, expected, desired); }
+
+    // task 를 바로 시작한다. 끝나는 것은 run() 이 기다린다
+    void spawn(Task<> task) { detach(*this, std::move(task)); }
+
+    // spawn 한 task 가 모두 끝날 때까지 poll 한다. task 가 던진 첫 예외를 다시 던진다
+    void run() {
+        while (live_ > 0 || pending() > 0) {
+            bool progress = false;
+
+            for (kvs_client *c : nodes_) {
+                if (kvs_poll(c) >= 0 || kvs_pending(c) > 0) {
+                    progress = true;
+                }
+            }
+            if (!progress) {
+                break;  // 모든 연결이 실패했고 남은 요청은 KVS_ERROR 로 끝났다
+            }
+        }
+        if (error_) {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+    // primary (나눠 둘 때는 첫 서버) 연결
+    const kvs_client *raw() const { return c_; }
+    // i 번째 연결 (0 은 primary, 그 뒤는 replica. 나눠 둘 때는 Shards 의 순서)
+    const kvs_client *node(size_t i) const { return nodes_[i]; }
+    size_t nodes() const { return nodes_.size(); }
+
+private:
+    // 스스로 정리되는 최상위 coroutine
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    static Detached detach(Client &client, Task<> task) {
+        client.live_++;
+        try {
+            co_await task;
+        } catch (...) {
+            if (!client.error_) {
+                client.error_ = std::current_exception();
+            }
+        }
+        client.live_--;
+    }
+
+    kvs_client *write_node(const std::string &key) const {
+        return cluster_ ? kvs_cluster_route(cluster_, key.c_str()) : c_;
+    }
+
+    int pending() const {
+        int n = 0;
+
+        for (const kvs_client *c : nodes_) {
+            n += kvs_pending(c);
+        }
+        return n;
+    }
+
+    void close_all() {
+        if (cluster_) {
+            kvs_cluster_close(cluster_);  // 연결도 닫는다
+            cluster_ = nullptr;
+        } else {
+            for (kvs_client *c : nodes_) {
+                kvs_close(c);
+            }
+        }
+        nodes_.clear();
+    }
+
+    kvs_cluster *cluster_ = nullptr;
+    std::vector<kvs_client *> nodes_;
+    kvs_client *c_ = nullptr;
+    size_t next_read_ = 0;
+    long live_ = 0;
+    std::exception_ptr error_;
+};
+
+} // namespace kvs
+
+#endif // KVS_CLIENT_HPP
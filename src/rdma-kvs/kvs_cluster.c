@@ -0,0 +1,129 @@
+#include "kvs_cluster.h"
+
+// FNV-1a 64 뒤에 murmur3 의 fmix64 를 한 번 더 섞는다 ("ip#1", "ip#2" 처럼 끝만 다른 이름도 고르게 흩어진다)
+static uint64_t ring_hash(const char *str) {
+    uint64_t hash = 14695981039346656037ull;
+
+    while (*str) {
+        hash = (hash ^ (uint8_t)*str++) * 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static int cmp_point(const void *a, const void *b) {
+    uint64_t x = ((const struct kvs_ring_point *)a)->hash, y = ((const struct kvs_ring_point *)b)->hash;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+int kvs_ring_init(struct kvs_ring *r, const char **names, int n, int vnodes) {
+    char name[96];
+
+    r->num = n * vnodes;
+    r->points = malloc(r->num * sizeof(struct kvs_ring_point));
+    if (!r->points) {
+        perror("Failed to allocate hash ring");
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int v = 0; v < vnodes; v++) {
+            snprintf(name, sizeof(name), "%s#%d", names[i], v);
+            r->points[i * vnodes + v].hash = ring_hash(name);
+            r->points[i * vnodes + v].node = i;
+        }
+    }
+    qsort(r->points, r->num, sizeof(struct kvs_ring_point), cmp_point);
+    return 0;
+}
+
+void kvs_ring_destroy(struct kvs_ring *r) {
+    free(r->points);
+    r->points = NULL;
+    r->num = 0;
+}
+
+int kvs_ring_lookup(const struct kvs_ring *r, const char *key) {
+    uint64_t hash = ring_hash(key);
+    int lo = 0, hi = r->num;
+
+    // hash 이상인 첫 점, 없으면 처음으로 돌아간다
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (r->points[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return r->points[lo == r->num ? 0 : lo].node;
+}
+
+struct kvs_cluster *kvs_cluster_connect(const char **servers, int n) {
+    struct kvs_cluster *cl;
+
+    if (n < 1 || n > KVS_CLUSTER_MAX) {
+        fprintf(stderr, "A cluster has 1 to %d servers\n", KVS_CLUSTER_MAX);
+        return NULL;
+    }
+    cl = calloc(1, sizeof(*cl));
+    if (!cl) {
+        perror("Failed to allocate cluster");
+        return NULL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        cl->nodes[i] = kvs_connect(servers[i]);
+        if (!cl->nodes[i]) {
+            fprintf(stderr, "Failed to connect to %s\n", servers[i]);
+            kvs_cluster_close(cl);
+            return NULL;
+        }
+        cl->num++;
+    }
+    if (kvs_ring_init(&cl->ring, servers, n, KVS_RING_VNODES) < 0) {
+        kvs_cluster_close(cl);
+        return NULL;
+    }
+    return cl;
+}
+
+void kvs_cluster_close(struct kvs_cluster *cl) {
+    if (!cl) {
+        return;
+    }
+    for (int i = 0; i < cl->num; i++) {
+        kvs_close(cl->nodes[i]);
+    }
+    kvs_ring_destroy(&cl->ring);
+    free(cl);
+}
+
+int kvs_cluster_get_async(struct kvs_cluster *cl, const char *key, kvs_callback cb, void *arg) {
+    return kvs_get_async(kvs_cluster_route(cl, key), key, cb, arg);
+}
+
+int kvs_cluster_put_async(struct kvs_cluster *cl, const char *key, const char *value, kvs_callback cb, void *arg) {
+    return kvs_put_async(kvs_cluster_route(cl, key), key, value, cb, arg);
+}
+
+int kvs_cluster_del_async(struct kvs_cluster *cl, const char *key, kvs_callback cb, void *arg) {
+    return kvs_del_async(kvs_cluster_route(cl, key), key, cb, arg);
+}
+
+// 끊긴 서버의 요청은 그 서버의 kvs_poll 이 KVS_ERROR 로 끝낸다. 나머지 서버는 계속 쓴다
+int kvs_cluster_poll(struct kvs_cluster *cl) {
+    int done = 0, alive = 0, n;
+
+    for (int i = 0; i < cl->num; i++) {
+        n = kvs_poll(cl->nodes[i]);
+        if (n >= 0) {
+            done += n;
+            alive++;
+        }
+    }
+    return alive ? done : -1;
+}
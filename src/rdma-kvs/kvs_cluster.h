@@ -0,0 +1,75 @@
+#ifndef KVS_CLUSTER_H
+#define KVS_CLUSTER_H
+
+#include "kvs_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 여러 서버에 key 를 나눠 두는 클라이언트 (서버끼리는 서로 모른다).
+ * 서버마다 kvs_client 연결 하나를 두고, key 는 consistent hash ring 으로 서버를 고른다.
+ * ring 에는 서버마다 주소 ("ip:port#i") 로 만든 가상 노드가 vnodes 개씩 있어서
+ * 서버를 더하거나 빼면 그 서버의 구간에 있던 key (약 1/N) 만 자리를 옮긴다.
+ *
+ * 요청은 고른 서버의 queue 에 들어가고, kvs_cluster_poll 이 서버마다 kvs_poll 을 불러
+ * 서버별로 묶어 보내고 파이프라인한다 (한 서버의 응답을 기다리는 동안 다른 서버 것도 나가 있다).
+ * kvs_client 와 같이 한 스레드에서만 쓴다.
+ */
+#define KVS_CLUSTER_MAX 16
+#define KVS_RING_VNODES 128
+
+struct kvs_ring_point {
+    uint64_t hash;
+    int node;
+};
+
+// hash 순서로 정렬된 가상 노드
+struct kvs_ring {
+    struct kvs_ring_point *points;
+    int num;
+};
+
+// names[i] 의 가상 노드를 vnodes 개씩 만든다. 실패하면 -1
+int kvs_ring_init(struct kvs_ring *r, const char **names, int n, int vnodes);
+void kvs_ring_destroy(struct kvs_ring *r);
+// key 의 hash 다음 (시계 방향) 에 있는 가상 노드의 서버 번호
+int kvs_ring_lookup(const struct kvs_ring *r, const char *key);
+
+struct kvs_cluster {
+    int num;
+    struct kvs_client *nodes[KVS_CLUSTER_MAX];
+    struct kvs_ring ring;
+};
+
+// 모든 서버 ("ip" 또는 "ip:port") 에 연결한다. 하나라도 실패하면 NULL
+struct kvs_cluster *kvs_cluster_connect(const char **servers, int n);
+void kvs_cluster_close(struct kvs_cluster *cl);
+
+static inline struct kvs_client *kvs_cluster_route(const struct kvs_cluster *cl, const char *key) {
+    return cl->nodes[kvs_ring_lookup(&cl->ring, key)];
+}
+
+// key 의 서버 queue 에 넣는다 (kvs_get_async 등과 같다)
+int kvs_cluster_get_async(struct kvs_cluster *cl, const char *key, kvs_callback cb, void *arg);
+int kvs_cluster_put_async(struct kvs_cluster *cl, const char *key, const char *value, kvs_callback cb, void *arg);
+int kvs_cluster_del_async(struct kvs_cluster *cl, const char *key, kvs_callback cb, void *arg);
+
+// 모든 서버를 한 번씩 poll 한다. 끝난 요청 수, 모든 연결이 실패했으면 -1
+int kvs_cluster_poll(struct kvs_cluster *cl);
+
+static inline int kvs_cluster_pending(const struct kvs_cluster *cl) {
+    int n = 0;
+
+    for (int i = 0; i < cl->num; i++) {
+        n += kvs_pending(cl->nodes[i]);
+    }
+    return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KVS_CLUSTER_H
@@ -0,0 +1,152 @@
+#include "lease.h"
+
+#include <time.h>
+
+static uint64_t lease_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// FNV-1a
+static uint32_t lease_hash(const char *key) {
+    uint32_t hash = 2166136261u;
+
+    while (*key) {
+        hash = (hash ^ (uint8_t)*key++) * 16777619u;
+    }
+    return hash;
+}
+
+void lease_table_init(struct lease_table *t, uint32_t max_us) {
+    memset(t, 0, sizeof(*t));
+    pthread_mutex_init(&t->lock, NULL);
+    t->max_us = max_us;
+}
+
+uint32_t lease_read_begin(struct lease_table *t, const char *key) {
+    if (t->max_us == 0) {
+        return 0;
+    }
+    return __atomic_load_n(&t->slots[lease_hash(key) % LEASE_SLOTS].write_seq, __ATOMIC_ACQUIRE);
+}
+
+uint32_t lease_grant(struct lease_table *t, const char *key, uint32_t requested_us, uint32_t seq) {
+    struct lease_slot *s;
+    uint64_t expires;
+    uint32_t us;
+
+    if (t->max_us == 0 || requested_us == 0) {
+        return 0;
+    }
+    us = requested_us < t->max_us ? requested_us : t->max_us;
+    s = &t->slots[lease_hash(key) % LEASE_SLOTS];
+
+    // 순번이 그대로면 읽는 동안 이 slot 에 쓰기가 없었다: 읽은 value 가 아직 최신이다
+    pthread_mutex_lock(&t->lock);
+    if (s->writers > 0 || s->write_seq != seq) {
+        pthread_mutex_unlock(&t->lock);
+        return 0;
+    }
+    expires = lease_now_ns() + (uint64_t)us * 1000;
+    if (expires > s->expires_ns) {
+        s->expires_ns = expires;
+    }
+    t->grants++;
+    pthread_mutex_unlock(&t->lock);
+    return us;
+}
+
+void lease_write_begin(struct lease_table *t, const char *key) {
+    struct lease_slot *s;
+    struct timespec ts;
+    uint64_t expires, now;
+
+    if (t->max_us == 0) {
+        return;
+    }
+    s = &t->slots[lease_hash(key) % LEASE_SLOTS];
+
+    // writers 를 올린 뒤의 만료 시각이 마지막이다 (이후로는 lease 를 주지 않는다)
+    pthread_mutex_lock(&t->lock);
+    s->writers++;
+    __atomic_store_n(&s->write_seq, s->write_seq + 1, __ATOMIC_RELEASE);
+    expires = s->expires_ns;
+    pthread_mutex_unlock(&t->lock);
+
+    now = lease_now_ns();
+    if (now >= expires) {
+        return;
+    }
+    __atomic_add_fetch(&t->write_waits, 1, __ATOMIC_RELAXED);
+    while (now < expires) {
+        ts.tv_sec = (expires - now) / 1000000000ull;
+        ts.tv_nsec = (expires - now) % 1000000000ull;
+        nanosleep(&ts, NULL);
+        now = lease_now_ns();
+    }
+}
+
+void lease_write_end(struct lease_table *t, const char *key) {
+    if (t->max_us == 0) {
+        return;
+    }
+    struct lease_slot *s = &t->slots[lease_hash(key) % LEASE_SLOTS];
+
+    pthread_mutex_lock(&t->lock);
+    s->writers--;
+    __atomic_store_n(&s->write_seq, s->write_seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&t->lock);
+}
+
+int lease_cache_init(struct lease_cache *c, uint32_t entries) {
+    memset(c, 0, sizeof(*c));
+    c->entries = calloc(entries, sizeof(struct lease_cache_entry));
+    if (!c->entries) {
+        perror("Failed to allocate lease cache");
+        return -1;
+    }
+    c->size = entries;
+    return 0;
+}
+
+void lease_cache_destroy(struct lease_cache *c) {
+    free(c->entries);
+    c->entries = NULL;
+}
+
+const char *lease_cache_get(struct lease_cache *c, const char *key) {
+    struct lease_cache_entry *e = &c->entries[lease_hash(key) % c->size];
+
+    if (e->expires_ns != 0 && strcmp(e->key, key) == 0) {
+        if (lease_now_ns() < e->expires_ns) {
+            c->hits++;
+            return e->value;
+        }
+        e->expires_ns = 0;
+    }
+    c->misses++;
+    return NULL;
+}
+
+void lease_cache_fill(struct lease_cache *c, const char *key, const char *value, uint64_t sent_ns, uint32_t lease_us) {
+    struct lease_cache_entry *e = &c->entries[lease_hash(key) % c->size];
+
+    if (lease_us == 0) {
+        return;
+    }
+    strncpy(e->key, key, KEY_VALUE_SIZE - 1);
+    e->key[KEY_VALUE_SIZE - 1] = '\0';
+    strncpy(e->value, value, KEY_VALUE_SIZE - 1);
+    e->value[KEY_VALUE_SIZE - 1] = '\0';
+    e->expires_ns = sent_ns + (uint64_t)lease_us * 1000;
+    c->fills++;
+}
+
+void lease_cache_invalidate(struct lease_cache *c, const char *key) {
+    struct lease_cache_entry *e = &c->entries[lease_hash(key) % c->size];
+
+    if (e->expires_ns != 0 && strcmp(e->key, key) == 0) {
+        e->expires_ns = 0;
+    }
+}
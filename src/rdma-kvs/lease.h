@@ -0,0 +1,76 @@
+#ifndef LEASE_H
+#define LEASE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/*
+ * GET lease. 클라이언트가 GET 에 lease_us 를 실어 보내면 서버는 그 key 에 lease 를
+ * 주고 (응답의 lease_us), 클라이언트는 그동안 value 를 자기 캐시에서 읽는다.
+ * 서버는 lease 가 끝나기 전에는 그 key 를 바꾸지 않는다: PUT/DELETE 는 만료까지
+ * 기다리고, 기다리는 쓰기가 있는 key 에는 새 lease 를 주지 않는다 (쓰기가 굶지 않는다).
+ *
+ * 서버는 key 의 hash 로 고른 고정 크기 테이블에 만료 시각만 둔다. 충돌하면 다른 key 의
+ * lease 까지 기다릴 뿐 오래된 value 가 읽히지는 않는다.
+ * lease 는 value 를 찾았을 때만 준다. 읽기 전에 slot 의 쓰기 순번을 찍어 두고, 그 사이에
+ * 쓰기가 시작하거나 끝났으면 주지 않는다 (없는 key 의 GET 이 뒤따르는 PUT 을 재우지 않는다).
+ * 클라이언트는 요청을 보내기 전 시각부터 lease 를 세므로 서버의 만료보다 먼저 끝난다.
+ */
+#define LEASE_SLOTS 4096
+#define LEASE_DEFAULT_MAX_US 10000      // 서버가 주는 가장 긴 lease
+#define LEASE_REQUEST_US UINT32_MAX     // 클라이언트는 서버가 주는 만큼 받는다
+
+// 서버
+struct lease_slot {
+    uint64_t expires_ns;
+    uint32_t writers;                   // 만료를 기다리거나 쓰는 중인 PUT/DELETE
+    uint32_t write_seq;                 // write_begin/end 마다 증가
+};
+
+struct lease_table {
+    pthread_mutex_t lock;
+    uint32_t max_us;                    // 0 이면 lease 를 주지 않는다
+    struct lease_slot slots[LEASE_SLOTS];
+    uint64_t grants, write_waits;
+};
+
+void lease_table_init(struct lease_table *t, uint32_t max_us);
+
+// GET 의 value 를 읽기 전에 부른다. 돌려준 순번을 lease_grant 에 넘긴다
+uint32_t lease_read_begin(struct lease_table *t, const char *key);
+
+// GET 이 value 를 찾은 뒤에 부른다. 준 lease 길이 (us), 읽는 사이에 쓰기가 있었거나 줄 수 없으면 0
+uint32_t lease_grant(struct lease_table *t, const char *key, uint32_t requested_us, uint32_t seq);
+
+// PUT/DELETE 를 store 에 반영하기 전후에 부른다. begin 은 남은 lease 가 끝날 때까지 잔다
+void lease_write_begin(struct lease_table *t, const char *key);
+void lease_write_end(struct lease_table *t, const char *key);
+
+// 클라이언트: direct-mapped 캐시, 충돌하면 이전 entry 를 밀어낸다
+struct lease_cache_entry {
+    uint64_t expires_ns;                // 0 이면 빈 entry
+    char key[KEY_VALUE_SIZE];
+    char value[KEY_VALUE_SIZE];
+};
+
+struct lease_cache {
+    struct lease_cache_entry *entries;
+    uint32_t size;
+    uint64_t hits, misses, fills;
+};
+
+int lease_cache_init(struct lease_cache *c, uint32_t entries);
+void lease_cache_destroy(struct lease_cache *c);
+
+// lease 가 남아 있으면 value, 아니면 NULL
+const char *lease_cache_get(struct lease_cache *c, const char *key);
+
+// sent_ns: GET 을 보내기 전에 잰 시각, lease_us: 응답이 준 lease
+void lease_cache_fill(struct lease_cache *c, const char *key, const char *value, uint64_t sent_ns, uint32_t lease_us);
+
+// 자기가 쓰는 key 는 캐시에서 지운다
+void lease_cache_invalidate(struct lease_cache *c, const char *key);
+
+#endif // LEASE_H
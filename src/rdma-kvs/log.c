@@ -0,0 +1,455 @@
+#include "log.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_ARGS_SIZE (LOG_RECORD_SIZE - 16)
+#define LOG_STR_TRUNCATED 0x8000   // 문자열 길이에 붙는 표시: 잘렸다
+#define LOG_LINE_MAX 1024
+
+// 인자는 format 순서대로: 정수/포인터/실수/'*' 는 8 바이트, 문자열은 [uint16 길이][바이트]
+struct log_record {
+    const char *fmt;
+    uint32_t level;
+    uint32_t len;                  // args 에 쓴 바이트
+    char args[LOG_ARGS_SIZE];
+};
+
+// 스레드 하나가 쓰고 log 스레드가 읽는 SPSC ring
+struct log_ring {
+    uint32_t head __attribute__((aligned(64)));  // log 스레드만 쓴다
+    uint32_t tail __attribute__((aligned(64)));  // 주인 스레드만 쓴다
+    uint64_t dropped;              // 가득 차서 버린 record 수
+    uint64_t reported;             // log 스레드가 알린 dropped
+    uint32_t in_use;               // 스레드가 끝나면 0, 다음 스레드가 이어서 쓴다
+    struct log_ring *next;
+    struct log_record rec[LOG_RING_SLOTS] __attribute__((aligned(64)));
+};
+
+// 하나의 변환 ("%-8.*lu" 등)
+struct log_spec {
+    const char *start, *end;       // '%' 부터 변환 문자 다음까지
+    int stars;                     // '*' 로 받는 폭/정밀도 수
+    char length[3];                // 길이 지정자 ("", "h", "hh", "l", "ll", "z", "j", "t", "L")
+    char conv;
+};
+
+int log_level = LOG_LEVEL_INFO;
+
+static struct log_ring *rings;     // 늘기만 한다 (log 스레드는 lock 없이 따라간다)
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;  // log 스레드와 log_flush 가 나눠 비운다
+static pthread_key_t ring_key;
+static __thread struct log_ring *my_ring;
+static int started;
+
+static const char *parse_spec(const char *p, struct log_spec *s) {
+    int n = 0;
+
+    s->start = p++;
+    s->stars = 0;
+    while (*p && strchr("-+ #0'", *p)) {
+        p++;
+    }
+    if (*p == '*') {
+        s->stars++;
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            s->stars++;
+            p++;
+        } else {
+            while (*p >= '0' && *p <= '9') {
+                p++;
+            }
+        }
+    }
+    while (*p && strchr("hlzjtL", *p) && n < 2) {
+        s->length[n++] = *p++;
+    }
+    s->length[n] = '\0';
+    s->conv = *p;
+    s->end = *p ? p + 1 : p;
+    return s->end;
+}
+
+static int put_u64(struct log_record *r, uint64_t v) {
+    if (r->len + sizeof(v) > LOG_ARGS_SIZE) {
+        r->len = LOG_ARGS_SIZE;    // 뒤의 인자도 넣지 않는다
+        return -1;
+    }
+    memcpy(r->args + r->len, &v, sizeof(v));
+    r->len += sizeof(v);
+    return 0;
+}
+
+static int put_str(struct log_record *r, const char *str) {
+    size_t len, room;
+    uint16_t hdr;
+
+    if (!str) {
+        str = "(null)";
+    }
+    if (r->len + sizeof(hdr) >= LOG_ARGS_SIZE) {
+        r->len = LOG_ARGS_SIZE;
+        return -1;
+    }
+    room = LOG_ARGS_SIZE - r->len - sizeof(hdr);
+    len = strnlen(str, LOG_STR_MAX + 1);
+    hdr = len;
+    if (len > LOG_STR_MAX || len > room) {
+        len = len > LOG_STR_MAX ? LOG_STR_MAX : len;
+        len = len > room ? room : len;
+        hdr = len | LOG_STR_TRUNCATED;
+    }
+    memcpy(r->args + r->len, &hdr, sizeof(hdr));
+    memcpy(r->args + r->len + sizeof(hdr), str, len);
+    r->len += sizeof(hdr) + len;
+    return 0;
+}
+
+static int64_t arg_signed(const struct log_spec *s, va_list *ap) {
+    if (!strcmp(s->length, "hh")) {
+        return (signed char)va_arg(*ap, int);
+    } else if (!strcmp(s->length, "h")) {
+        return (short)va_arg(*ap, int);
+    } else if (!strcmp(s->length, "l")) {
+        return va_arg(*ap, long);
+    } else if (!strcmp(s->length, "ll")) {
+        return va_arg(*ap, long long);
+    } else if (!strcmp(s->length, "z")) {
+        return (int64_t)va_arg(*ap, size_t);
+    } else if (!strcmp(s->length, "j")) {
+        return va_arg(*ap, intmax_t);
+    } else if (!strcmp(s->length, "t")) {
+        return va_arg(*ap, ptrdiff_t);
+    }
+    return va_arg(*ap, int);
+}
+
+static uint64_t arg_unsigned(const struct log_spec *s, va_list *ap) {
+    if (!strcmp(s->length, "hh")) {
+        return (unsigned char)va_arg(*ap, unsigned int);
+    } else if (!strcmp(s->length, "h")) {
+        return (unsigned short)va_arg(*ap, unsigned int);
+    } else if (!strcmp(s->length, "l")) {
+        return va_arg(*ap, unsigned long);
+    } else if (!strcmp(s->length, "ll")) {
+        return va_arg(*ap, unsigned long long);
+    } else if (!strcmp(s->length, "z")) {
+        return va_arg(*ap, size_t);
+    } else if (!strcmp(s->length, "j")) {
+        return va_arg(*ap, uintmax_t);
+    } else if (!strcmp(s->length, "t")) {
+        return (uint64_t)va_arg(*ap, ptrdiff_t);
+    }
+    return va_arg(*ap, unsigned int);
+}
+
+// 문자열로 만들지 않고 인자만 record 에 옮긴다
+static void capture(struct log_record *r, const char *fmt, va_list *ap) {
+    struct log_spec s;
+    const char *p = fmt;
+    uint64_t bits;
+    double d;
+    int ret = 0;
+
+    while (*p && ret == 0) {
+        if (*p++ != '%') {
+            continue;
+        }
+        p = parse_spec(p - 1, &s);
+        for (int i = 0; i < s.stars && ret == 0; i++) {
+            ret = put_u64(r, (uint64_t)(int64_t)va_arg(*ap, int));
+        }
+        if (ret) {
+            break;
+        }
+        switch (s.conv) {
+        case 'd':
+        case 'i':
+            ret = put_u64(r, (uint64_t)arg_signed(&s, ap));
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            ret = put_u64(r, arg_unsigned(&s, ap));
+            break;
+        case 'c':
+            ret = put_u64(r, (uint64_t)va_arg(*ap, int));
+            break;
+        case 'p':
+            ret = put_u64(r, (uint64_t)(uintptr_t)va_arg(*ap, void *));
+            break;
+        case 's':
+            ret = put_str(r, va_arg(*ap, const char *));
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            d = s.length[0] == 'L' ? (double)va_arg(*ap, long double) : va_arg(*ap, double);
+            memcpy(&bits, &d, sizeof(bits));
+            ret = put_u64(r, bits);
+            break;
+        case '%':
+            break;
+        default:
+            return;                // 모르는 변환: 뒤의 인자는 읽지 않는다
+        }
+    }
+}
+
+static int get_u64(const struct log_record *r, uint32_t *off, uint64_t *v) {
+    if (*off + sizeof(*v) > r->len) {
+        return -1;
+    }
+    memcpy(v, r->args + *off, sizeof(*v));
+    *off += sizeof(*v);
+    return 0;
+}
+
+static int get_str(const struct log_record *r, uint32_t *off, char *out) {
+    uint16_t hdr;
+    size_t len;
+
+    if (*off + sizeof(hdr) > r->len) {
+        return -1;
+    }
+    memcpy(&hdr, r->args + *off, sizeof(hdr));
+    len = hdr & ~LOG_STR_TRUNCATED;
+    memcpy(out, r->args + *off + sizeof(hdr), len);
+    strcpy(out + len, hdr & LOG_STR_TRUNCATED ? "..." : "");
+    *off += sizeof(hdr) + len;
+    return 0;
+}
+
+// '*' 는 받은 숫자로 바꾸고 길이 지정자는 뺀 변환 (정수는 "ll" 로 찍는다)
+static int build_spec(const struct log_record *r, uint32_t *off, const struct log_spec *s, char *spec, size_t size) {
+    size_t n = 0;
+    uint64_t v;
+
+    for (const char *p = s->start; p < s->end - 1 && n + 24 < size; p++) {
+        if (*p == '*') {
+            if (get_u64(r, off, &v)) {
+                return -1;
+            }
+            n += snprintf(spec + n, size - n, "%d", (int)(int64_t)v);
+        } else if (!strchr("hlzjtL", *p)) {
+            spec[n++] = *p;
+        }
+    }
+    if (strchr("diuxXo", s->conv)) {
+        spec[n++] = 'l';
+        spec[n++] = 'l';
+    }
+    spec[n++] = s->conv;
+    spec[n] = '\0';
+    return 0;
+}
+
+static size_t format_record(const struct log_record *r, char *out, size_t size) {
+    struct log_spec s;
+    const char *p = r->fmt;
+    char spec[64], str[LOG_STR_MAX + 4];
+    uint32_t off = 0;
+    uint64_t v;
+    double d;
+    size_t n = 0;
+    int ret;
+
+    while (*p && n < size - 1) {
+        if (*p != '%') {
+            out[n++] = *p++;
+            continue;
+        }
+        p = parse_spec(p, &s);
+        if (s.conv == '%') {
+            out[n++] = '%';
+            continue;
+        }
+
+        ret = -1;
+        if (build_spec(r, &off, &s, spec, sizeof(spec)) == 0) {
+            if (s.conv == 's') {
+                if (get_str(r, &off, str) == 0) {
+                    ret = snprintf(out + n, size - n, spec, str);
+                }
+            } else if (get_u64(r, &off, &v) == 0) {
+                if (strchr("di", s.conv)) {
+                    ret = snprintf(out + n, size - n, spec, (long long)v);
+                } else if (strchr("uxXo", s.conv)) {
+                    ret = snprintf(out + n, size - n, spec, (unsigned long long)v);
+                } else if (s.conv == 'c') {
+                    ret = snprintf(out + n, size - n, spec, (int)v);
+                } else if (s.conv == 'p') {
+                    ret = snprintf(out + n, size - n, spec, (void *)(uintptr_t)v);
+                } else if (strchr("fFeEgGaA", s.conv)) {
+                    memcpy(&d, &v, sizeof(d));
+                    ret = snprintf(out + n, size - n, spec, d);
+                }
+            }
+        }
+        if (ret < 0) {
+            ret = snprintf(out + n, size - n, "<?>");  // record 에 자리가 모자라 인자를 못 넣었다
+        }
+        n += ret;
+        if (n >= size) {
+            n = size - 1;
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static void ring_release(void *arg) {
+    __atomic_store_n(&((struct log_ring *)arg)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static struct log_ring *ring_get(void) {
+    struct log_ring *r;
+
+    if (my_ring) {
+        return my_ring;
+    }
+
+    pthread_mutex_lock(&rings_lock);
+    for (r = rings; r; r = r->next) {
+        if (!__atomic_load_n(&r->in_use, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+    }
+    if (!r) {
+        if (posix_memalign((void **)&r, 64, sizeof(*r)) != 0) {
+            pthread_mutex_unlock(&rings_lock);
+            return NULL;
+        }
+        memset(r, 0, sizeof(*r));
+        r->next = rings;
+        __atomic_store_n(&rings, r, __ATOMIC_RELEASE);
+    }
+    r->in_use = 1;
+    pthread_mutex_unlock(&rings_lock);
+
+    pthread_setspecific(ring_key, r);
+    my_ring = r;
+    return r;
+}
+
+void log_write(int level, const char *fmt, ...) {
+    struct log_ring *r;
+    struct log_record *rec;
+    uint32_t tail;
+    va_list ap;
+
+    va_start(ap, fmt);
+    // log 스레드가 없으면 (시작 전이나 ring 을 못 만들었을 때) 그 자리에서 찍는다
+    if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE) || !(r = ring_get())) {
+        vfprintf(level <= LOG_LEVEL_WARN ? stderr : stdout, fmt, ap);
+        va_end(ap);
+        return;
+    }
+
+    tail = r->tail;
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == LOG_RING_SLOTS) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        va_end(ap);
+        return;
+    }
+
+    rec = &r->rec[tail & (LOG_RING_SLOTS - 1)];
+    rec->fmt = fmt;
+    rec->level = level;
+    rec->len = 0;
+    capture(rec, fmt, &ap);
+    va_end(ap);
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// 모든 ring 을 한 번 비운다. 찍은 record 수
+static int drain(void) {
+    static char line[LOG_LINE_MAX];
+    struct log_ring *r;
+    struct log_record *rec;
+    uint32_t head, tail;
+    uint64_t dropped;
+    size_t len;
+    int n = 0;
+
+    pthread_mutex_lock(&drain_lock);
+    for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        head = r->head;
+        tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            rec = &r->rec[head & (LOG_RING_SLOTS - 1)];
+            len = format_record(rec, line, sizeof(line));
+            fwrite(line, 1, len, rec->level <= LOG_LEVEL_WARN ? stderr : stdout);
+            n++;
+        }
+        __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+
+        dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        if (dropped != r->reported) {
+            fprintf(stderr, "log: %lu records dropped (ring full)\n", (unsigned long)(dropped - r->reported));
+            r->reported = dropped;
+        }
+    }
+    if (n) {
+        fflush(stdout);
+    }
+    pthread_mutex_unlock(&drain_lock);
+    return n;
+}
+
+static void *log_main(void *arg) {
+    (void)arg;
+    while (1) {
+        if (!drain()) {
+            usleep(LOG_IDLE_US);
+        }
+    }
+    return NULL;
+}
+
+int log_start(void) {
+    pthread_t thread;
+
+    if (started) {
+        return 0;
+    }
+    if (pthread_key_create(&ring_key, ring_release) != 0) {
+        perror("pthread_key_create");
+        return -1;
+    }
+    if (pthread_create(&thread, NULL, log_main, NULL) != 0) {
+        perror("Failed to start log thread");
+        return -1;
+    }
+    pthread_detach(thread);
+    __atomic_store_n(&started, 1, __ATOMIC_RELEASE);
+    atexit(log_flush);
+    return 0;
+}
+
+void log_flush(void) {
+    if (__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+        drain();
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,53 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+/*
+ * 요청 경로의 printf 를 대신하는 비동기 로그.
+ * 부르는 스레드는 format 포인터와 인자만 자기 스레드의 ring 에 record 로 넣고 바로 돌아간다.
+ * 정수와 실수는 8 바이트로, 문자열은 LOG_STR_MAX 까지 복사해서 넣는다.
+ * 문자열로 만드는 일과 stdout 에 쓰는 일은 log 스레드가 한다.
+ * ring 이 가득 차면 기다리지 않고 버린다. 버린 수는 log 스레드가 알린다.
+ *
+ * 수준은 두 번 거른다.
+ *  - 컴파일: LOG_LEVEL_MAX 보다 자세한 LOG_* 는 코드에서 빠진다 (예: -DLOG_LEVEL_MAX=LOG_LEVEL_INFO).
+ *  - 실행: log_level 보다 자세하면 branch 하나로 끝난다. 기본은 INFO 이고 -v 를 주면 DEBUG.
+ * format 은 문자열 상수여야 한다 (record 에는 포인터만 남는다).
+ * 변환은 d i u x X o c s p f e g 와 % 이고, flag, 폭, 정밀도 ('*' 포함) 와 길이 지정자를 쓸 수 있다.
+ */
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef LOG_LEVEL_MAX
+#define LOG_LEVEL_MAX LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_RING_SLOTS 1024        // 스레드마다 (2 의 거듭제곱)
+#define LOG_RECORD_SIZE 256
+#define LOG_STR_MAX 64             // 문자열 인자는 이만큼만 남기고 "..." 을 붙인다
+#define LOG_IDLE_US 1000           // log 스레드가 ring 이 모두 비었을 때 쉬는 시간
+
+extern int log_level;
+
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+// log 스레드를 띄운다. 그 전에는 log_write 가 그 자리에서 찍는다
+int log_start(void);
+// 지금까지 들어온 record 를 모두 찍는다 (log_start 가 atexit 에도 걸어 둔다)
+void log_flush(void);
+
+#define LOG_AT(level, ...)                                            \
+    do {                                                              \
+        if ((level) <= LOG_LEVEL_MAX && (level) <= log_level) {       \
+            log_write(level, __VA_ARGS__);                            \
+        }                                                             \
+    } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif // LOG_H
@@ -0,0 +1,234 @@
+#include "mr_cache.h"
+
+#include <unistd.h>
+
+static uintptr_t page_size;
+
+static void update(struct mr_cache_entry *t) {
+    t->max_end = t->end;
+    if (t->left && t->left->max_end > t->max_end) {
+        t->max_end = t->left->max_end;
+    }
+    if (t->right && t->right->max_end > t->max_end) {
+        t->max_end = t->right->max_end;
+    }
+}
+
+// l 에는 start < key, r 에는 start >= key
+static void split(struct mr_cache_entry *t, uintptr_t key, struct mr_cache_entry **l, struct mr_cache_entry **r) {
+    if (!t) {
+        *l = *r = NULL;
+        return;
+    }
+    if (t->start < key) {
+        split(t->right, key, &t->right, r);
+        *l = t;
+    } else {
+        split(t->left, key, l, &t->left);
+        *r = t;
+    }
+    update(t);
+}
+
+// a 의 모든 key 가 b 의 key 보다 작거나 같다
+static struct mr_cache_entry *merge(struct mr_cache_entry *a, struct mr_cache_entry *b) {
+    if (!a || !b) {
+        return a ? a : b;
+    }
+    if (a->prio > b->prio) {
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+}
+
+static struct mr_cache_entry *insert(struct mr_cache_entry *t, struct mr_cache_entry *n) {
+    if (!t) {
+        return n;
+    }
+    if (n->prio > t->prio) {
+        split(t, n->start, &n->left, &n->right);
+        update(n);
+        return n;
+    }
+    if (n->start < t->start) {
+        t->left = insert(t->left, n);
+    } else {
+        t->right = insert(t->right, n);
+    }
+    update(t);
+    return t;
+}
+
+static struct mr_cache_entry *remove_entry(struct mr_cache_entry *t, struct mr_cache_entry *n) {
+    if (!t) {
+        return NULL;
+    }
+    if (t == n) {
+        return merge(t->left, t->right);
+    }
+    // start 가 같은 노드는 어느 쪽에든 있을 수 있다
+    if (n->start <= t->start) {
+        t->left = remove_entry(t->left, n);
+    }
+    if (n->start >= t->start) {
+        t->right = remove_entry(t->right, n);
+    }
+    update(t);
+    return t;
+}
+
+// [a, b) 를 통째로 덮는 구간
+static struct mr_cache_entry *find_cover(struct mr_cache_entry *t, uintptr_t a, uintptr_t b) {
+    struct mr_cache_entry *r;
+
+    if (!t || t->max_end < b) {
+        return NULL;
+    }
+    if ((r = find_cover(t->left, a, b)) != NULL) {
+        return r;
+    }
+    if (t->start <= a && t->end >= b) {
+        return t;
+    }
+    if (t->start > a) {
+        return NULL;  // 오른쪽은 모두 a 보다 뒤에서 시작한다
+    }
+    return find_cover(t->right, a, b);
+}
+
+// [a, b) 와 겹치는 구간
+static struct mr_cache_entry *find_overlap(struct mr_cache_entry *t, uintptr_t a, uintptr_t b) {
+    struct mr_cache_entry *r;
+
+    if (!t || t->max_end <= a) {
+        return NULL;
+    }
+    if ((r = find_overlap(t->left, a, b)) != NULL) {
+        return r;
+    }
+    if (t->start < b && t->end > a) {
+        return t;
+    }
+    if (t->start >= b) {
+        return NULL;
+    }
+    return find_overlap(t->right, a, b);
+}
+
+static void lru_unlink(struct mr_cache_entry *e) {
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+}
+
+static void lru_push_front(struct mr_cache *c, struct mr_cache_entry *e) {
+    e->prev = &c->lru;
+    e->next = c->lru.next;
+    c->lru.next->prev = e;
+    c->lru.next = e;
+}
+
+static void drop(struct mr_cache *c, struct mr_cache_entry *e) {
+    c->root = remove_entry(c->root, e);
+    lru_unlink(e);
+    c->pinned -= e->end - e->start;
+    ibv_dereg_mr(e->mr);
+    free(e);
+}
+
+// 오래된 것부터 해제해 len 바이트를 더 등록할 자리를 만든다
+static int make_room(struct mr_cache *c, size_t len) {
+    struct mr_cache_entry *e = c->lru.prev, *prev;
+
+    while (c->pinned + len > c->budget && e != &c->lru) {
+        prev = e->prev;
+        if (e->refs == 0) {
+            drop(c, e);
+            c->evictions++;
+        }
+        e = prev;
+    }
+    return c->pinned + len <= c->budget ? 0 : -1;
+}
+
+void mr_cache_init(struct mr_cache *c, struct ibv_pd *pd, int access, size_t budget) {
+    memset(c, 0, sizeof(*c));
+    c->pd = pd;
+    c->access = access;
+    c->budget = budget;
+    c->lru.prev = c->lru.next = &c->lru;
+    c->seed = 2463534242u;
+
+    page_size = sysconf(_SC_PAGESIZE);
+}
+
+void mr_cache_destroy(struct mr_cache *c) {
+    while (c->lru.next != &c->lru) {
+        drop(c, c->lru.next);
+    }
+}
+
+struct mr_cache_entry *mr_cache_acquire(struct mr_cache *c, const void *addr, size_t len) {
+    uintptr_t a = (uintptr_t)addr, b = a + len;
+    struct mr_cache_entry *e;
+
+    e = find_cover(c->root, a, b);
+    if (e) {
+        c->hits++;
+        e->refs++;
+        lru_unlink(e);
+        lru_push_front(c, e);
+        return e;
+    }
+    c->misses++;
+
+    a &= ~(page_size - 1);
+    b = (b + page_size - 1) & ~(page_size - 1);
+    if (make_room(c, b - a) != 0) {
+        return NULL;
+    }
+
+    e = calloc(1, sizeof(*e));
+    if (!e) {
+        return NULL;
+    }
+    e->mr = ibv_reg_mr(c->pd, (void *)a, b - a, c->access);
+    if (!e->mr) {
+        free(e);
+        return NULL;
+    }
+
+    e->start = a;
+    e->end = b;
+    e->refs = 1;
+    c->seed ^= c->seed << 13;
+    c->seed ^= c->seed >> 17;
+    c->seed ^= c->seed << 5;
+    e->prio = c->seed;
+    update(e);
+
+    c->root = insert(c->root, e);
+    lru_push_front(c, e);
+    c->pinned += b - a;
+    return e;
+}
+
+void mr_cache_release(struct mr_cache *c, struct mr_cache_entry *e) {
+    e->refs--;
+}
+
+int mr_cache_invalidate(struct mr_cache *c, const void *addr, size_t len) {
+    uintptr_t a = (uintptr_t)addr, b = a + len;
+    struct mr_cache_entry *e;
+
+    while ((e = find_overlap(c->root, a, b)) != NULL) {
+        if (e->refs > 0) {
+            return -1;
+        }
+        drop(c, e);
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef MR_CACHE_H
+#define MR_CACHE_H
+
+#include "common.h"
+
+/*
+ * Pin-down cache: caller 가 가진 버퍼를 처음 쓸 때 등록하고, 같은 범위를 다시
+ * 쓰면 그 MR 을 재사용한다. 등록은 [start, end) 구간으로 interval tree
+ * (start 를 key 로 한 treap, 노드마다 subtree 의 최대 end) 에 들어가므로
+ * 요청 범위를 덮는 MR 을 subtree 를 건너뛰며 찾는다.
+ * 등록된 바이트가 budget 을 넘으면 쓰이지 않는 (refs == 0) 것부터 LRU 로 해제한다.
+ *
+ * 등록은 요청 범위를 page 단위로 넓힌 것이라 같은 page 의 이웃 버퍼도 맞는다.
+ * 등록된 메모리를 free/munmap 하기 전에 mr_cache_invalidate 를 불러야 한다:
+ * 그렇지 않으면 같은 주소에 새로 생긴 메모리를 예전 page 로 보내게 된다.
+ */
+#define MR_CACHE_DEFAULT_BUDGET (64ul << 20)
+
+struct mr_cache_entry {
+    uintptr_t start, end;
+    struct ibv_mr *mr;
+    int refs;                         // 진행 중인 op 가 쓰는 중이면 해제하지 않는다
+
+    struct mr_cache_entry *left, *right;
+    uintptr_t max_end;                // 이 subtree 에서 가장 큰 end
+    uint32_t prio;
+
+    struct mr_cache_entry *prev, *next;  // LRU (lru.next 가 가장 최근)
+};
+
+struct mr_cache {
+    struct ibv_pd *pd;
+    int access;
+    size_t budget;
+    size_t pinned;                    // 지금 등록되어 있는 바이트
+
+    struct mr_cache_entry *root;
+    struct mr_cache_entry lru;
+    uint32_t seed;
+
+    uint64_t hits, misses, evictions;
+};
+
+void mr_cache_init(struct mr_cache *c, struct ibv_pd *pd, int access, size_t budget);
+void mr_cache_destroy(struct mr_cache *c);
+
+// [addr, addr+len) 을 덮는 MR 을 찾거나 등록하고 참조를 하나 잡는다.
+// budget 안에서 자리를 만들 수 없거나 등록에 실패하면 NULL (caller 는 복사 경로로)
+struct mr_cache_entry *mr_cache_acquire(struct mr_cache *c, const void *addr, size_t len);
+void mr_cache_release(struct mr_cache *c, struct mr_cache_entry *e);
+
+// [addr, addr+len) 과 겹치는 등록을 모두 해제한다 (쓰는 중인 것은 -1)
+int mr_cache_invalidate(struct mr_cache *c, const void *addr, size_t len);
+
+#endif // MR_CACHE_H
@@ -0,0 +1,103 @@
+#ifndef PERF_SHM_H
+#define PERF_SHM_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+// 서버와 kvs-stat이 함께 보는 /perf-shm 레이아웃
+#define PERF_SHM_NAME "/perf-shm"
+#define PERF_SHM_PORT_NAME "/perf-shm-%d"  // 기본 port 가 아닌 서버 (server -p, kvs-stat -p)
+#define PERF_SHM_MAGIC 0x6b767374u  // "kvst"
+#define PERF_SHM_VERSION 3
+
+#define MAX_TENANT_NUM 5
+
+#define PERF_OP_MAX 8          // msg_type 별 카운터 슬롯
+#define PERF_LAT_BUCKETS 32    // bucket i = [2^i, 2^(i+1)) ns
+#define PERF_BATCH_BUCKETS 17  // ibv_poll_cq 가 한 번에 돌려준 완료 개수 (0..16)
+#define PERF_HOT_KEYS 16       // 서버가 내보내는 top-K hot key
+#define PERF_HOT_KEY_LEN 64    // 이보다 긴 key 는 잘라서 보인다
+
+/*
+ * Per-tenant telemetry slot. Each tenant is served by exactly one worker
+ * thread, which is the only writer of its slot, so counters are bumped with
+ * relaxed load/store (no lock prefix) and the slot is padded to its own
+ * cache lines. Readers (kvs-stat) only ever load.
+ */
+struct perf_tenant_stats {
+    uint32_t active;
+    uint32_t tenant_id;
+    uint64_t thread_id;
+    uint64_t connected_ns;
+
+    uint64_t ops[PERF_OP_MAX];
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t store_inserts;
+
+    uint64_t cq_polls;
+    uint64_t cq_batch[PERF_BATCH_BUCKETS];
+
+    uint32_t recv_posted;
+    uint32_t recv_depth;
+
+    uint64_t lat_hist[PERF_OP_MAX][PERF_LAT_BUCKETS];
+} __attribute__((aligned(64)));
+
+// count 는 sample 배율을 곱한 추정 접근 수 (refresh 마다 반으로 줄어든다)
+struct perf_hot_key {
+    uint64_t count;
+    char key[PERF_HOT_KEY_LEN];
+};
+
+// 자원 관리 (메모리 공유)
+struct perf_shm_context {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start_ns;
+    uint32_t hash_buckets;
+    uint64_t store_entries;    // 재시작 후 복구된 entry 포함
+
+    uint32_t next_tenant_id;
+    uint32_t tenant_num;
+    uint32_t active_tenant_num;
+    uint64_t active_qps_num;
+    uint32_t active_stenant_num;
+    uint32_t active_dtenant_num;
+    uint32_t active_mtenant_num;
+    uint32_t active_rrtenant_num;
+    uint32_t max_qps_limit;
+
+    uint32_t active_qps_per_tenant[MAX_TENANT_NUM];
+    uint32_t additional_qps_num[MAX_TENANT_NUM];
+    uint64_t avg_msg_size[MAX_TENANT_NUM];
+
+    pthread_mutex_t perf_thread_lock[MAX_TENANT_NUM];
+    pthread_cond_t perf_thread_cond[MAX_TENANT_NUM];
+    pthread_mutex_t lock;
+
+    struct perf_tenant_stats tenant[MAX_TENANT_NUM];
+
+    // hot key (hotkey.h). 서버의 refresh 스레드 하나만 쓰고, 쓰는 동안 hot_seq 가 홀수다
+    uint64_t hot_seq;
+    uint64_t hot_updated_ns;
+    uint32_t hot_interval_sec;
+    uint32_t hot_num;
+    uint64_t hot_total;        // hot[].count 와 같은 단위의 전체 접근 수
+    uint64_t hot_pinned;       // store hot table 에 든 key
+    uint64_t hot_hits;         // hot table 에서 찾은 GET (누적)
+    struct perf_hot_key hot[PERF_HOT_KEYS];
+};
+
+// single writer 전용: 다른 프로세스에서 찢어진 값이 보이지 않도록 relaxed store
+#define PERF_ADD(field, v) \
+    __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (v), __ATOMIC_RELAXED)
+#define PERF_SET(field, v) __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
+#define PERF_GET(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static inline int perf_lat_bucket(uint64_t ns) {
+    int b = ns ? 63 - __builtin_clzll(ns) : 0;
+    return b < PERF_LAT_BUCKETS ? b : PERF_LAT_BUCKETS - 1;
+}
+
+#endif // PERF_SHM_H
@@ -0,0 +1,311 @@
+#include "replica.h"
+
+#include <unistd.h>
+
+int repl_backup_init(struct repl_backup *b, uint32_t slots) {
+    memset(b, 0, sizeof(*b));
+    b->ring = hugemem_alloc(&b->mem, sizeof(struct repl_ring) + (size_t)slots * sizeof(struct repl_record));
+    if (!b->ring) {
+        perror("Failed to allocate replication ring");
+        return -1;
+    }
+    b->slots = slots;
+    pthread_mutex_init(&b->lock, NULL);
+    return 0;
+}
+
+int repl_backup_attach(struct repl_backup *b) {
+    pthread_mutex_lock(&b->lock);
+    if (b->connected) {
+        pthread_mutex_unlock(&b->lock);
+        return -1;
+    }
+    // 이전 primary 의 record 가 새 seq 와 섞이지 않도록 비운다
+    memset(b->ring, 0, sizeof(struct repl_ring) + (size_t)b->slots * sizeof(struct repl_record));
+    b->connected = 1;
+    pthread_mutex_unlock(&b->lock);
+    return 0;
+}
+
+void repl_backup_detach(struct repl_backup *b) {
+    pthread_mutex_lock(&b->lock);
+    b->connected = 0;
+    pthread_mutex_unlock(&b->lock);
+}
+
+void repl_backup_run(struct repl_backup *b, repl_apply_fn apply, void *arg) {
+    struct repl_record *rec;
+    char key[KEY_VALUE_SIZE], value[KEY_VALUE_SIZE];
+    uint64_t next;
+    int idle = 0;
+
+    while (1) {
+        pthread_mutex_lock(&b->lock);
+        next = b->ring->applied + 1;
+        rec = &b->ring->rec[next % b->slots];
+
+        // 뒤의 seq 부터 본다: 앞뒤가 모두 next 면 그 사이도 다 쓰였다.
+        // primary 는 applied 가 오르기 전에는 이 자리를 다시 쓰지 않는다
+        if (__atomic_load_n(&rec->seq_end, __ATOMIC_ACQUIRE) == next
+            && __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) == next) {
+            memcpy(key, rec->key, KEY_VALUE_SIZE);
+            memcpy(value, rec->value, KEY_VALUE_SIZE);
+            key[KEY_VALUE_SIZE - 1] = '\0';
+            value[KEY_VALUE_SIZE - 1] = '\0';
+            apply(arg, rec->type, key, value);
+
+            __atomic_store_n(&b->ring->applied, next, __ATOMIC_RELEASE);
+            b->applied_total++;
+            idle = 0;
+        } else {
+            idle++;
+        }
+        pthread_mutex_unlock(&b->lock);
+
+        if (idle > REPL_SPIN_LOOPS) {
+            usleep(REPL_IDLE_US);
+        }
+    }
+}
+
+// pdata 가 있으면 이벤트의 private data (backup 의 pdata) 를 복사한다
+static int wait_event(struct repl_primary *r, enum rdma_cm_event_type type, struct pdata *pdata) {
+    struct rdma_cm_event *event;
+    enum rdma_cm_event_type got;
+
+    if (rdma_get_cm_event(r->ec, &event)) {
+        perror("rdma_get_cm_event");
+        return -1;
+    }
+    got = event->event;
+    if (pdata && got == type) {
+        memset(pdata, 0, sizeof(*pdata));
+        if (event->param.conn.private_data) {
+            memcpy(pdata, event->param.conn.private_data, sizeof(*pdata));
+        }
+    }
+    rdma_ack_cm_event(event);
+
+    if (got != type) {
+        fprintf(stderr, "Backup %s: expected %s, got %s\n", r->name, rdma_event_str(type), rdma_event_str(got));
+        return -1;
+    }
+    return 0;
+}
+
+int repl_connect(struct repl_primary *r, const char *server) {
+    struct sockaddr_in addr;
+    struct ibv_qp_init_attr qp_attr;
+    struct rdma_conn_param conn_param;
+    struct pdata pdata;
+    size_t bytes = REPL_SEND_DEPTH * sizeof(struct repl_record) + sizeof(uint64_t);
+
+    memset(r, 0, sizeof(*r));
+    strncpy(r->name, server, sizeof(r->name) - 1);
+    if (parse_server_addr(server, &addr) < 0) {
+        fprintf(stderr, "Bad backup address %s\n", server);
+        return -1;
+    }
+
+    r->ec = rdma_create_event_channel();
+    if (!r->ec || rdma_create_id(r->ec, &r->id, NULL, RDMA_PS_TCP)) {
+        perror("rdma_create_id");
+        goto fail;
+    }
+    if (rdma_resolve_addr(r->id, NULL, (struct sockaddr *)&addr, TIMEOUT_IN_MS)
+        || wait_event(r, RDMA_CM_EVENT_ADDR_RESOLVED, NULL)
+        || rdma_resolve_route(r->id, TIMEOUT_IN_MS)
+        || wait_event(r, RDMA_CM_EVENT_ROUTE_RESOLVED, NULL)) {
+        perror("Failed to resolve backup");
+        goto fail;
+    }
+
+    r->pd = ibv_alloc_pd(r->id->verbs);
+    // signal 한 WRITE 와 applied READ 의 completion 만 들어온다
+    r->cq = ibv_create_cq(r->id->verbs, REPL_SEND_DEPTH + 1, NULL, NULL, 0);
+    if (!r->pd || !r->cq || posix_memalign((void **)&r->stage, 64, bytes) != 0) {
+        perror("Failed to allocate replication resources");
+        goto fail;
+    }
+    memset(r->stage, 0, bytes);
+    r->applied_buf = (uint64_t *)(r->stage + REPL_SEND_DEPTH);
+    r->mr = ibv_reg_mr(r->pd, r->stage, bytes, IBV_ACCESS_LOCAL_WRITE);
+    if (!r->mr) {
+        perror("ibv_reg_mr");
+        goto fail;
+    }
+
+    memset(&qp_attr, 0, sizeof(qp_attr));
+    qp_attr.qp_type = IBV_QPT_RC;
+    qp_attr.send_cq = r->cq;
+    qp_attr.recv_cq = r->cq;
+    qp_attr.cap.max_send_wr = REPL_SEND_DEPTH + 1;
+    qp_attr.cap.max_recv_wr = 1;
+    qp_attr.cap.max_send_sge = 1;
+    qp_attr.cap.max_recv_sge = 1;
+    if (rdma_create_qp(r->id, r->pd, &qp_attr)) {
+        perror("rdma_create_qp");
+        goto fail;
+    }
+
+    memset(&pdata, 0, sizeof(pdata));
+    pdata.role = htonl(KVS_ROLE_REPLICA);
+    memset(&conn_param, 0, sizeof(conn_param));
+    conn_param.initiator_depth = 1;      // applied 를 RDMA READ 한다
+    conn_param.responder_resources = 1;
+    conn_param.retry_count = 3;
+    conn_param.rnr_retry_count = 7;
+    conn_param.private_data = &pdata;
+    conn_param.private_data_len = sizeof(pdata);
+
+    if (rdma_connect(r->id, &conn_param) || wait_event(r, RDMA_CM_EVENT_ESTABLISHED, &pdata)) {
+        fprintf(stderr, "Failed to connect to backup %s (is it running with -B?)\n", server);
+        goto fail;
+    }
+    r->remote_va = ntohll(pdata.repl_va);
+    r->remote_rkey = ntohl(pdata.repl_rkey);
+    r->slots = ntohl(pdata.repl_slots);
+    if (!r->slots) {
+        fprintf(stderr, "%s did not send a replication ring\n", server);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    repl_close(r);
+    return -1;
+}
+
+// CQ 를 한 번 본다. applied READ 가 끝났으면 1, 실패한 completion 이 있으면 -1
+static int repl_poll(struct repl_primary *r) {
+    struct ibv_wc wc[REPL_SEND_DEPTH / REPL_SIGNAL_EVERY + 1];
+    int n, read_done = 0;
+
+    n = ibv_poll_cq(r->cq, sizeof(wc) / sizeof(wc[0]), wc);
+    if (n < 0) {
+        r->failed = 1;
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "Backup %s: %s, replication stopped\n", r->name, ibv_wc_status_str(wc[i].status));
+            r->failed = 1;
+            return -1;
+        }
+        if (wc[i].wr_id == 0) {
+            read_done = 1;
+        } else {
+            r->completed = wc[i].wr_id;  // RC 는 순서대로 끝나므로 그 앞의 unsignaled WRITE 도 끝났다
+        }
+    }
+    return read_done;
+}
+
+static int repl_post(struct repl_primary *r, enum ibv_wr_opcode opcode, void *local, uint32_t len, uint64_t remote,
+    uint64_t wr_id, int signaled) {
+    struct ibv_sge sge;
+    struct ibv_send_wr wr, *bad_wr;
+
+    sge.addr = (uintptr_t)local;
+    sge.length = len;
+    sge.lkey = r->mr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = wr_id;
+    wr.opcode = opcode;
+    wr.send_flags = signaled ? IBV_SEND_SIGNALED : 0;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.wr.rdma.remote_addr = remote;
+    wr.wr.rdma.rkey = r->remote_rkey;
+
+    if (ibv_post_send(r->id->qp, &wr, &bad_wr)) {
+        perror("Failed to post replication work request");
+        r->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int repl_read_applied(struct repl_primary *r) {
+    int ret;
+
+    if (repl_post(r, IBV_WR_RDMA_READ, r->applied_buf, sizeof(uint64_t),
+        r->remote_va + offsetof(struct repl_ring, applied), 0, 1)) {
+        return -1;
+    }
+    while ((ret = repl_poll(r)) == 0);
+    if (ret < 0) {
+        return -1;
+    }
+    r->applied = __atomic_load_n(r->applied_buf, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+int repl_ship(struct repl_primary *r, int type, const char *key, const char *value) {
+    uint64_t seq = r->seq + 1;
+    struct repl_record *rec;
+
+    if (r->failed) {
+        return -1;
+    }
+
+    // staging 자리는 REPL_SEND_DEPTH 개 앞의 WRITE 가 끝나야 다시 쓴다
+    while (seq - r->completed > REPL_SEND_DEPTH) {
+        if (repl_poll(r) < 0) {
+            return -1;
+        }
+    }
+    // ring 이 찼으면 backup 이 반영할 때까지 기다린다 (뒤처짐의 상한)
+    while (seq - r->applied > r->slots) {
+        r->stalls++;
+        if (repl_read_applied(r) < 0) {
+            return -1;
+        }
+    }
+
+    rec = &r->stage[seq % REPL_SEND_DEPTH];
+    rec->seq = seq;
+    rec->type = type;
+    strncpy(rec->key, key, KEY_VALUE_SIZE);
+    strncpy(rec->value, value ? value : "", KEY_VALUE_SIZE);
+    rec->seq_end = seq;
+
+    if (repl_post(r, IBV_WR_RDMA_WRITE, rec, sizeof(*rec),
+        r->remote_va + offsetof(struct repl_ring, rec) + (seq % r->slots) * sizeof(struct repl_record),
+        seq, seq % REPL_SIGNAL_EVERY == 0)) {
+        return -1;
+    }
+    r->seq = seq;
+    return 0;
+}
+
+void repl_close(struct repl_primary *r) {
+    if (r->id && r->id->qp) {
+        rdma_disconnect(r->id);
+        rdma_destroy_qp(r->id);
+    }
+    if (r->mr) {
+        ibv_dereg_mr(r->mr);
+    }
+    if (r->cq) {
+        ibv_destroy_cq(r->cq);
+    }
+    if (r->pd) {
+        ibv_dealloc_pd(r->pd);
+    }
+    if (r->id) {
+        rdma_destroy_id(r->id);
+    }
+    if (r->ec) {
+        rdma_destroy_event_channel(r->ec);
+    }
+    free(r->stage);
+    r->id = NULL;
+    r->ec = NULL;
+    r->mr = NULL;
+    r->cq = NULL;
+    r->pd = NULL;
+    r->stage = NULL;
+    r->failed = 1;
+}
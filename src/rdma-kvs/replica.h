@@ -0,0 +1,88 @@
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include "common.h"
+#include "hugemem.h"
+
+/*
+ * primary/backup 복제 (읽기 복제본).
+ * backup (-B) 은 복제 log ring 을 등록해 두고, primary (-R) 는 backup 마다 RC 연결 하나를 맺어
+ * PUT/DELETE 를 쓸 때마다 record 하나를 ring 의 seq 자리에 RDMA WRITE 한다 (backup CPU 는 관여하지 않는다).
+ * backup 의 apply 스레드는 다음 seq 의 record 가 다 도착했는지 (앞뒤 seq 가 같은지) 보고 store 에 반영한 뒤
+ * ring 의 applied 를 올린다. primary 는 ring 이 찼다고 볼 때만 applied 를 RDMA READ 로 다시 읽는다.
+ *
+ * primary 는 WRITE 완료를 기다리지 않고 응답한다 (비동기 복제). 대신 ring 이 차면 쓰기를 멈추므로
+ * backup 은 많아야 ring 의 record 수 (slots) 만큼 뒤처진다. record 는 NIC 가 주소 순서로 쓴다고 보고
+ * 마지막 seq_end 가 보이면 record 전체가 도착한 것으로 본다.
+ */
+#define REPL_MAX_BACKUPS 4
+#define REPL_RING_SLOTS 4096       // backup 이 뒤처질 수 있는 최대 record 수
+#define REPL_SEND_DEPTH 64         // primary 가 완료를 보지 않고 내보내는 WRITE 수 (staging record 수)
+#define REPL_SIGNAL_EVERY 16
+#define REPL_SPIN_LOOPS 4096       // apply 스레드가 잠들기 전 polling 횟수
+#define REPL_IDLE_US 50
+#define REPL_CLEAR 3               // record type: backup 의 store 를 비운다 (새 primary 가 snapshot 앞에 보낸다)
+
+struct repl_record {
+    uint64_t seq;                  // 1 부터. record 의 맨 앞
+    uint32_t type;                 // WAL_PUT / WAL_DELETE / REPL_CLEAR
+    uint32_t pad;
+    char key[KEY_VALUE_SIZE];
+    char value[KEY_VALUE_SIZE];
+    uint64_t seq_end;              // 맨 뒤: seq 와 같으면 record 가 다 도착했다
+};
+
+// backup 의 등록된 영역. seq 의 record 는 rec[seq % slots]
+struct repl_ring {
+    uint64_t applied;              // backup 이 반영한 마지막 seq (primary 가 RDMA READ)
+    char pad[56];
+    struct repl_record rec[];
+};
+
+// backup 쪽
+struct repl_backup {
+    struct hugemem mem;
+    struct repl_ring *ring;
+    uint32_t slots;
+    pthread_mutex_t lock;          // apply 와 새 primary 를 받을 때의 reset 을 나눈다
+    int connected;                 // primary 가 붙어 있다 (한 번에 하나)
+    uint64_t applied_total;
+};
+
+typedef void (*repl_apply_fn)(void *arg, int type, const char *key, const char *value);
+
+int repl_backup_init(struct repl_backup *b, uint32_t slots);
+// 새 primary 가 붙었다: seq 1 부터 다시 받는다. 이미 primary 가 있으면 -1
+int repl_backup_attach(struct repl_backup *b);
+void repl_backup_detach(struct repl_backup *b);
+// 도착한 record 를 apply 로 반영하기를 계속한다 (스레드 본체, 돌아오지 않는다)
+void repl_backup_run(struct repl_backup *b, repl_apply_fn apply, void *arg);
+
+// primary 쪽: backup 하나
+struct repl_primary {
+    char name[64];                 // "ip[:port]"
+    struct rdma_event_channel *ec;
+    struct rdma_cm_id *id;
+    struct ibv_pd *pd;
+    struct ibv_cq *cq;
+    struct ibv_mr *mr;
+    struct repl_record *stage;     // REPL_SEND_DEPTH 개 + applied 를 읽어 올 자리
+    uint64_t *applied_buf;
+
+    uint64_t remote_va;
+    uint32_t remote_rkey, slots;
+
+    uint64_t seq;                  // 마지막으로 보낸 record
+    uint64_t completed;            // 이 seq 까지의 WRITE 는 끝났다 (staging 재사용)
+    uint64_t applied;              // 마지막으로 읽은 backup 의 applied
+    uint64_t stalls;               // ring 이 차서 applied 를 다시 읽은 횟수
+    int failed;
+};
+
+// backup 에 연결하고 ring 을 받는다. 실패하면 -1
+int repl_connect(struct repl_primary *r, const char *server);
+// record 하나를 보낸다. 쓰기 순서대로 (write_lock 안에서) 부른다. 연결이 끊겼으면 -1
+int repl_ship(struct repl_primary *r, int type, const char *key, const char *value);
+void repl_close(struct repl_primary *r);
+
+#endif // REPLICA_H
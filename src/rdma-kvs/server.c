@@ -1,107 +1,650 @@
 #include "common.h"
-
-#define MAX_TENANT_NUM 5
-
-struct ibv_recv_wr recv_wr, *bad_recv_wr = NULL;
-struct ibv_send_wr send_wr, *bad_send_wr = NULL;
-struct ibv_sge recv_sge, send_sge;
-struct ibv_wc wc;
-static char *send_buffer = NULL, *recv_buffer = NULL;
-static void *cq_context;
+#include "hotkey.h"
+#include "hugemem.h"
+#include "lease.h"
+#include "log.h"
+#include "perf_shm.h"
+#include "replica.h"
+#include "sizeclass.h"
+#include "store.h"
+#include "transport.h"
+#include "wal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct rdma_cm_id *listen_id;
+static struct rdma_event_channel *ec = NULL;
+static struct rdma_cm_event *event = NULL;
 static int count = 0;
 
+static struct perf_shm_context *shm_ctx = NULL;
+
+/*
+ * RC 연결 자원 pool. rdma_cm 이 여는 장치마다 PD, store MR, 메시지 버퍼 MR 을 하나씩
+ * 두고 QP/CQ/completion channel 을 MAX_TENANT_NUM 개씩 listen 전에 만들어 둔다.
+ * on_connect 는 빈 slot 의 QP 를 INIT -> RTR -> RTS 로 옮겨 qp_num 으로 accept 하고,
+ * 연결이 끝나면 QP 를 RESET 으로 되돌려 slot 을 반납한다. accept 경로에서 device open,
+ * PD 할당, MR 등록, QP/CQ 생성이 모두 빠진다.
+ */
+#define MAX_DEVICES 4
+
+struct qp_slot {
+    struct ibv_comp_channel *comp_channel;
+    struct ibv_cq *cq;
+    struct ibv_qp *qp;
+    char *send_buffer, *recv_buffer;   // dev->mem 안에서 이 slot 몫 (recv 는 KVS_RECV_DEPTH 개)
+    struct scan_entry *scan_buffer;    // SCAN chunk 를 모아 RDMA WRITE 하는 곳
+    int in_use;
+};
 
-// 자원 관리 (메모리 공유)
-struct perf_shm_context {
-    uint32_t next_tenant_id;
-    uint32_t tenant_num;
-    uint32_t active_tenant_num;
-    uint64_t active_qps_num;
-    uint32_t active_stenant_num;
-    uint32_t active_dtenant_num;
-    uint32_t active_mtenant_num;
-    uint32_t active_rrtenant_num;
-    uint32_t max_qps_limit;
-
-    uint32_t active_qps_per_tenant[MAX_TENANT_NUM];
-    uint32_t additional_qps_num[MAX_TENANT_NUM];
-    uint64_t avg_msg_size[MAX_TENANT_NUM];
-
-    pthread_mutex_t perf_thread_lock[MAX_TENANT_NUM];
-    pthread_cond_t perf_thread_cond[MAX_TENANT_NUM];
-    pthread_mutex_t lock;
+struct device_pool {
+    struct ibv_context *verbs;
+    struct ibv_pd *pd;
+    struct ibv_mr *store_mr;           // store 매핑 전체 (zero-copy 응답용)
+    struct hugemem mem;                // 모든 slot 의 send/recv 버퍼
+    struct ibv_mr *buf_mr;
+    struct ibv_mr *atomic_mr;          // atomic_mem (장치가 atomic 을 못 하면 NULL)
+    struct ibv_mr *repl_mr;            // backup 의 복제 ring (-B 가 아니면 NULL)
+    struct qp_slot slots[MAX_TENANT_NUM];
 };
 
+static struct device_pool devices[MAX_DEVICES];
+static struct hugemem atomic_mem;      // KVS_ATOMIC_SLOTS 개의 카운터, 모든 장치가 같이 등록한다
+static int device_count = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct tenant_context {
     struct rdma_context ctx;
     struct rdma_cm_id* id;
-    struct rdma_cm_id* listen_id;
-    struct rdma_event_channel* ec;
-    struct rdma_cm_event* event;
     struct ibv_qp_init_attr qp_attr;
-    struct pdata rep_pdata;  
+    struct pdata rep_pdata;
+    struct ibv_mr *store_mr;        // dev->store_mr
+    struct device_pool *dev;        // verbs 연결이 빌려 쓰는 pool slot
+    struct qp_slot *slot;
+
+    struct ibv_recv_wr recv_wr, *bad_recv_wr;
+    struct ibv_send_wr send_wr, *bad_send_wr;
+    struct ibv_sge recv_sge, send_sge[2];
+    struct ibv_wc wc;
+    char *send_buffer, *recv_buffer;
+    void *cq_context;
+
+    // 클라이언트가 요청을 파이프라인하면 send 완료를 기다리는 중에 다음 recv 가 먼저 온다.
+    // 그런 recv 는 ready 에 순서대로 쌓아 두고 다음 verbs_recv 가 꺼낸다
+    int recv_index;                 // 지금 처리 중인 메시지의 recv 버퍼
+    int ready[KVS_RECV_DEPTH];
+    int ready_head, ready_count;
+    struct store_entry *send_ref;   // 이번 응답의 value 를 store 에서 바로 보낸다 (보낸 뒤 release)
+    struct scan_entry *scan_buffer;
+    uint32_t send_write_len;        // 이번 응답 앞에 scan_buffer 를 클라이언트 버퍼 (pdata) 로 WRITE 한다
+
+    int tenant_id;
+    int in_use;
+    int replica;                    // primary 의 복제 연결 (요청은 오지 않고 ring 에 WRITE 만 한다)
+    volatile int disconnected;      // DISCONNECTED 이벤트를 받으면 worker 가 정리하고 끝난다
+    pthread_t thread;
+    struct perf_tenant_stats *stats;
+
+    // 메시지 경로: verbs 연결이면 tp_conn == 자기 자신, shm 연결이면 &local
+    const struct kvs_transport *tp;
+    void *tp_conn;
+    struct shm_conn local;
 };
 
 struct tenant_context ctx[MAX_TENANT_NUM];
 
+/*
+ * -u (UD 모드) 의 서버 자원. 클라이언트 수와 무관하게 UD QP 하나, CQ 두 개,
+ * recv ring 하나, 고정 크기 client 테이블뿐이다. client 테이블은 (client_id, qpn)
+ * 으로 UD_CLIENT_WAYS 개짜리 set 을 고르며, 항목은 AH 와 마지막 응답을 들고 있어
+ * 재전송 요청은 다시 실행하지 않고 캐시된 응답을 보낸다.
+ * 항목은 UD_CLIENT_IDLE_US 동안 조용해서 더 재전송할 수 없고, 그 응답 send 가 모두
+ * 끝났을 때만 밀어낸다. set 에 그런 항목이 없으면 새 client 의 요청을 버린다 (재전송이 다시 온다).
+ */
+struct ud_client {
+    int valid;
+    int pending;                // 이번 poll 의 reply[] 에 들어 있다
+    uint32_t client_id;
+    uint32_t qpn;
+    uint32_t last_req_id;
+    uint64_t last_seen_ns;
+    uint64_t last_send;         // 마지막으로 resp 를 보낸 send 의 순번
+    struct ibv_ah *ah;
+    struct ud_message resp;     // 응답은 여기서 바로 send 한다 (table_mr)
+};
+
+static int ud_mode = 0;
+static struct rdma_cm_id *ud_accepted_id = NULL;  // ack 후 바로 destroy
+
+static struct {
+    struct ibv_pd *pd;
+    struct ibv_cq *send_cq, *recv_cq;
+    struct ibv_qp *qp;
+    uint8_t port_num;
+    struct hugemem mem;         // recv ring 과 client 테이블을 한 영역에 두고 한 번만 등록한다
+    struct ibv_mr *buf_mr, *store_mr;
+    char *recv_buffer;
+    struct ud_client *clients;
+    uint64_t send_seq;          // 지금까지 건 send 수 (signal 된 send 의 wr_id)
+    uint64_t done_seq;          // completion 으로 끝난 것이 확인된 send 수
+    uint32_t unsignaled;
+    struct tenant_context *t;
+    pthread_t thread;
+} ud;
+
 
 static void setup_connection();
 static int handle_event();
-static void on_connect();
+static void on_connect(struct rdma_cm_id *id);
+static int qp_to_state(struct rdma_cm_id *id, struct ibv_qp *qp, enum ibv_qp_state state,
+    const struct rdma_conn_param *param);
+static void device_pools_init();
+static struct qp_slot *qp_slot_get(struct ibv_context *verbs, struct device_pool **dev);
+static void qp_slot_put(struct qp_slot *slot);
+static void *accept_local(void *arg);
+static void on_connect_ud(struct rdma_cm_id *id);
+static void *ud_worker(void *arg);
+static struct tenant_context *alloc_tenant();
+static void release_tenant(struct tenant_context *t);
+
+static int pre_post_recv_buffer(struct tenant_context *t, int index);
+static int wait_for_completion(struct tenant_context *t);
+static uint64_t handle_message(struct message *msg, struct perf_tenant_stats *stats, struct store_entry **ref);
+static void *process_message(void *arg);
+static int handle_scan(struct tenant_context *t, struct message *msg);
+void cleanup(struct tenant_context *t);
+
+static struct message *verbs_recv(void *conn);
+static int verbs_send(void *conn, const struct message *msg);
+static void verbs_close(void *conn);
+
+static const struct kvs_transport verbs_transport = {
+    .name = "verbs",
+    .recv = verbs_recv,
+    .send = verbs_send,
+    .close = verbs_close,
+};
+
+
+// -f 파일에 매핑된 store: 재시작해도 다시 매핑만 하면 된다
+static struct store store;
+
+// -w: PUT/DELETE 를 WAL 에 남기고 group commit 된 뒤에 응답한다.
+// write_lock 은 lsn 순서와 store 에 반영되는 순서를 같게 만든다
+static int wal_enabled = 0;
+static struct wal wal;
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+static int checkpoint_sec = 10;
+
+static void *checkpoint_thread(void *arg);
+
+// -e: GET 에 주는 lease 의 최대 길이 (us). 0 이면 lease 를 주지 않는다
+static struct lease_table leases;
+
+// -H: hot key 를 추적해 이 주기 (초) 로 perf-shm 에 내보내고 store hot table 에 pin 한다. 0 이면 끈다
+static struct hotkey hotkeys;
+static int hot_interval_sec = HOTKEY_DEFAULT_INTERVAL_SEC;
+
+static void *hotkey_thread(void *arg);
+
+// -p: listen port. 기본이 아니면 perf-shm 이름에 port 를 붙이고 /kvs-shm 은 열지 않는다 (한 호스트에 서버 여럿)
+static int listen_port = SERVER_PORT;
+
+// -R: PUT/DELETE 를 복제할 backup 들 (replica.h). -B: 이 서버가 backup 이라 클라이언트 쓰기는 받지 않는다
+static struct repl_primary replicas[REPL_MAX_BACKUPS];
+static int repl_num = 0;
+static int backup_mode = 0;
+static struct repl_backup backup;
+
+static void *repl_apply_thread(void *arg);
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// write_lock 안에서 부른다: backup 은 store 에 반영한 순서대로 받는다
+static void replicate(int type, const char *key, const char *value) {
+    for (int i = 0; i < repl_num; i++) {
+        if (!replicas[i].failed && repl_ship(&replicas[i], type, key, value) < 0) {
+            fprintf(stderr, "Backup %s dropped, it no longer receives writes\n", replicas[i].name);
+        }
+    }
+}
+
+// 새 key 면 1, 덮어썼으면 0, store 가 가득 찼으면 -1.
+// WAL 을 쓰면 *lsn 에 이 record 의 lsn 을 돌려준다 (응답 전에 wal_wait).
+// record 는 store 가 받아들인 뒤에만 남긴다 (rmw 와 같이): 거절된 PUT 이 재생되지 않는다.
+// write_lock 안이므로 lsn 순서는 store 에 반영한 순서와 같다
+int put(const char *key, const char *value, uint64_t *lsn) {
+    int ret;
 
-static int pre_post_recv_buffer();
-static void wait_for_completion();
-static void process_message();
-int post_and_wait(struct ibv_send_wr *wr, const char *operation_name);
-void cleanup(struct rdma_cm_id *id);
+    if (wal_enabled || repl_num) {
+        pthread_mutex_lock(&write_lock);
+        ret = store_put(&store, key, value);
+        if (ret >= 0 && wal_enabled) {
+            *lsn = wal_append(&wal, WAL_PUT, key, value);
+        }
+        if (ret >= 0) {
+            replicate(WAL_PUT, key, value);
+        }
+        pthread_mutex_unlock(&write_lock);
+    } else {
+        ret = store_put(&store, key, value);
+    }
 
+    if (ret < 0) {
+        LOG_DEBUG("PUT operation: Key: %s, store is full\n\n", key);
+        return ret;
+    }
+    PERF_SET(shm_ctx->store_entries, store.hdr->entries);
+    LOG_DEBUG("PUT operation: Key: %s, Value: %s\n\n", key, value);
+    return ret;
+}
 
-#define HASH_SIZE 100
+int get(const char *key, char *value, uint64_t *version) {
+    if (store_get(&store, key, value, version)) {
+        LOG_DEBUG("GET operation: Key: %s, Value: %s\n", key, value);
+        return 1;
+    }
+    LOG_DEBUG("GET operation: Key: %s, Value: not found\n\n", key);
+    return 0;
+}
 
-static struct kv_pair *hash_table[HASH_SIZE];
+// zero-copy GET: value 를 복사하지 않고 entry 에 참조를 잡는다 (send 완료 후 store_release)
+struct store_entry *get_ref(const char *key) {
+    struct store_entry *entry = store_get_ref(&store, key);
 
-unsigned int hash(const char *key) {
-    unsigned int hash = 0;
-    while (*key) {
-        hash = (hash << 5) + *key++;
+    if (entry) {
+        LOG_DEBUG("GET operation: Key: %s, Value: %s\n", key, entry->value);
+        return entry;
     }
-    return hash % HASH_SIZE;
+    LOG_DEBUG("GET operation: Key: %s, Value: not found\n\n", key);
+    return NULL;
 }
 
-void put(const char *key, const char *value) {
-    unsigned int index = hash(key);
-    printf("PUT operation hash key: %d\n", index);
-    
-    struct kv_pair *new_entry = malloc(sizeof(struct kv_pair));
-    strncpy(new_entry->key, key, KEY_VALUE_SIZE);
-    strncpy(new_entry->value, value, KEY_VALUE_SIZE);
-    new_entry->next = hash_table[index];
-    hash_table[index] = new_entry;
-    printf("PUT operation: Key: %s, Value: %s\n\n", key, value);
+int del(const char *key, uint64_t *lsn) {
+    int ret;
+
+    if (wal_enabled || repl_num) {
+        pthread_mutex_lock(&write_lock);
+        if (wal_enabled) {
+            *lsn = wal_append(&wal, WAL_DELETE, key, NULL);
+        }
+        ret = store_delete(&store, key);
+        if (ret) {
+            replicate(WAL_DELETE, key, NULL);
+        }
+        pthread_mutex_unlock(&write_lock);
+    } else {
+        ret = store_delete(&store, key);
+    }
+
+    PERF_SET(shm_ctx->store_entries, store.hdr->entries);
+    LOG_DEBUG("DELETE operation: Key: %s, %s\n\n", key, ret ? "deleted" : "not found");
+    return ret;
+}
+
+// INCR/APPEND/CAS 한 번: rmw_apply 가 bucket lock 안에서 arg 로 새 value 를 만든다
+struct rmw_op {
+    int type;
+    char arg[KEY_VALUE_SIZE];  // INCR 의 delta, APPEND 로 붙일 것, CAS 의 새 value
+    uint64_t version;          // CAS 가 기대하는 version
+    const char *err;           // 거절한 이유 (응답 value)
+};
+
+static int parse_number(const char *str, long long *out) {
+    char *end;
+
+    if (*str == '\0') {
+        return -1;
+    }
+    errno = 0;
+    *out = strtoll(str, &end, 10);
+    return errno || *end != '\0' ? -1 : 0;
 }
 
-char *get(const char *key) {
-    unsigned int index = hash(key);
-    printf("GET operation hash key: %d\n", index);
-    struct kv_pair *entry = hash_table[index];
-    while (entry != NULL) {
-        if (strncmp(entry->key, key, KEY_VALUE_SIZE) == 0) {
-            printf("GET operation: Key: %s, Value: %s\n", key, entry->value);
-            return entry->value;
+static int rmw_apply(void *arg, const char *old, uint64_t version, char *out) {
+    struct rmw_op *op = (struct rmw_op *)arg;
+    long long cur = 0, delta = 1;
+
+    if (op->type == MSG_INCR) {
+        if ((old && parse_number(old, &cur)) || (op->arg[0] && parse_number(op->arg, &delta))
+            || __builtin_add_overflow(cur, delta, &cur)) {
+            op->err = "NOT_A_NUMBER";
+            return -1;
+        }
+        snprintf(out, KEY_VALUE_SIZE, "%lld", cur);
+    } else if (op->type == MSG_APPEND) {
+        if (snprintf(out, KEY_VALUE_SIZE, "%s%s", old ? old : "", op->arg) >= KEY_VALUE_SIZE) {
+            op->err = "VALUE_TOO_LARGE";
+            return -1;
+        }
+    } else {
+        if (version != op->version) {
+            op->err = "VERSION_MISMATCH";
+            return -1;
         }
-        entry = entry->next;
+        strncpy(out, op->arg, KEY_VALUE_SIZE - 1);
     }
-    printf("GET operation: Key: %s, Value: not found\n\n", key);
+    return 0;
+}
+
+// 1/0/-1 은 put 과 같고, 거절하면 STORE_RMW_REJECTED. value/version 은 결과 (store_rmw).
+// WAL 에는 결과 value 를 PUT 으로 남긴다: 재생하면 version 이 건너뛸 수는 있어도 되돌아가지 않는다
+int rmw(struct rmw_op *op, const char *key, char *value, uint64_t *version, uint64_t *lsn) {
+    int ret;
+
+    if (wal_enabled || repl_num) {
+        pthread_mutex_lock(&write_lock);
+        ret = store_rmw(&store, key, rmw_apply, op, value, version);
+        if (ret >= 0 && wal_enabled) {
+            *lsn = wal_append(&wal, WAL_PUT, key, value);
+        }
+        if (ret >= 0) {
+            replicate(WAL_PUT, key, value);
+        }
+        pthread_mutex_unlock(&write_lock);
+    } else {
+        ret = store_rmw(&store, key, rmw_apply, op, value, version);
+    }
+
+    if (ret == STORE_RMW_REJECTED) {
+        LOG_DEBUG("RMW operation: Key: %s, %s\n\n", key, op->err);
+        return ret;
+    } else if (ret < 0) {
+        LOG_DEBUG("RMW operation: Key: %s, store is full\n\n", key);
+        return ret;
+    }
+    PERF_SET(shm_ctx->store_entries, store.hdr->entries);
+    LOG_DEBUG("RMW operation: Key: %s, Value: %s, Version: %lu\n\n", key, value, (unsigned long)*version);
+    return ret;
+}
+
+// WAL 재생: checkpoint 이후의 record 를 store 에 다시 반영한다
+static void wal_apply(void *arg, int type, const char *key, const char *value) {
+    struct store *s = (struct store *)arg;
+
+    if (type == WAL_PUT) {
+        store_put(s, key, value);
+    } else if (type == WAL_DELETE) {
+        store_delete(s, key);
+    }
+}
+
+struct key_list {
+    char (*keys)[KEY_VALUE_SIZE];
+    size_t num, cap;
+};
+
+static void collect_key(void *arg, const char *key, const char *value) {
+    struct key_list *l = (struct key_list *)arg;
+
+    if (l->num == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 1024;
+        l->keys = realloc(l->keys, l->cap * KEY_VALUE_SIZE);
+        if (!l->keys) {
+            perror("Failed to allocate key list");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(l->keys[l->num++], key, KEY_VALUE_SIZE);
+}
+
+// backup: 새 primary 의 snapshot 을 받기 전에 store 를 비운다. primary 와 떨어져 있는 동안
+// 지워진 key 가 남지 않도록 모든 key 를 DELETE 와 같은 경로로 지운다
+static void repl_clear() {
+    struct key_list list = { NULL, 0, 0 };
+    uint64_t lsn = 0;
+
+    store_foreach(&store, collect_key, &list);
+    for (size_t i = 0; i < list.num; i++) {
+        lease_write_begin(&leases, list.keys[i]);
+        del(list.keys[i], &lsn);
+        lease_write_end(&leases, list.keys[i]);
+    }
+    free(list.keys);
+    printf("Backup: cleared %lu entries for a new primary\n", (unsigned long)list.num);
+}
+
+// backup: primary 가 보낸 record 를 클라이언트 쓰기와 같은 경로로 반영한다
+// (lease 를 지키고, 이 서버의 WAL 과 이 서버의 backup (-R) 에도 남는다)
+static void repl_apply(void *arg, int type, const char *key, const char *value) {
+    uint64_t lsn = 0;
+
+    if (type == REPL_CLEAR) {
+        repl_clear();
+        return;
+    }
+    lease_write_begin(&leases, key);
+    if (type == WAL_PUT) {
+        put(key, value, &lsn);
+    } else if (type == WAL_DELETE) {
+        del(key, &lsn);
+    }
+    lease_write_end(&leases, key);
+}
+
+static void *repl_apply_thread(void *arg) {
+    repl_backup_run(&backup, repl_apply, NULL);
     return NULL;
 }
 
-int main() {
+// 새 backup 은 REPL_CLEAR 로 store 를 비우고, 지금 store 의 모든 entry 를 PUT record 로 받은 뒤
+// 이어지는 쓰기를 받는다
+static void repl_snapshot(void *arg, const char *key, const char *value) {
+    repl_ship((struct repl_primary *)arg, WAL_PUT, key, value);
+}
+
+// top-K 를 seqlock 으로 perf-shm 에 쓰고 (kvs-stat 은 hot_seq 가 같은 동안 읽은 것만 쓴다)
+// 같은 key 들을 store hot table 에 pin 한다
+static void *hotkey_thread(void *arg) {
+    struct hotkey_item items[HOTKEY_TOPK];
+    const char *keys[HOTKEY_TOPK];
+    uint64_t total, seq;
+    int n, pinned;
+
+    while (1) {
+        sleep(hot_interval_sec);
+
+        n = hotkey_refresh(&hotkeys, items, &total);
+        for (int i = 0; i < n; i++) {
+            keys[i] = items[i].key;
+        }
+        pinned = store_pin_hot(&store, keys, n);
+
+        seq = shm_ctx->hot_seq;
+        __atomic_store_n(&shm_ctx->hot_seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        for (int i = 0; i < n; i++) {
+            shm_ctx->hot[i].count = items[i].count * HOTKEY_SAMPLE;
+            strncpy(shm_ctx->hot[i].key, items[i].key, PERF_HOT_KEY_LEN - 1);
+            shm_ctx->hot[i].key[PERF_HOT_KEY_LEN - 1] = '\0';
+        }
+        shm_ctx->hot_num = n;
+        shm_ctx->hot_total = total * HOTKEY_SAMPLE;
+        shm_ctx->hot_pinned = pinned;
+        shm_ctx->hot_hits = store_hot_hits(&store);
+        shm_ctx->hot_updated_ns = now_ns();
+        __atomic_store_n(&shm_ctx->hot_seq, seq + 2, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// store 를 디스크에 내리고 그 시점까지의 WAL 을 비운다
+static void *checkpoint_thread(void *arg) {
+    uint64_t lsn, off, last_lsn = store.hdr->wal_ckpt_lsn;
+    uint64_t groups, records, start_ns;
+
+    while (1) {
+        sleep(checkpoint_sec);
+
+        // write_lock 안에서 찍어야 lsn 까지의 record 가 모두 store 에 반영되어 있다
+        pthread_mutex_lock(&write_lock);
+        wal_mark(&wal, &lsn, &off);
+        pthread_mutex_unlock(&write_lock);
+
+        if (lsn == last_lsn) {
+            continue;
+        }
+
+        start_ns = now_ns();
+        store_sync(&store);
+        store_set_checkpoint(&store, lsn, off);
+        wal_truncate(&wal, lsn, off);
+        last_lsn = lsn;
+
+        groups = __atomic_load_n(&wal.groups, __ATOMIC_RELAXED);
+        records = __atomic_load_n(&wal.records, __ATOMIC_RELAXED);
+        printf("Checkpoint at lsn %lu (%.3f ms), %lu records in %lu group commits (%.1f per fdatasync)\n",
+            (unsigned long)lsn, (now_ns() - start_ns) / 1e6, (unsigned long)records, (unsigned long)groups,
+            groups ? (double)records / groups : 0.0);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
     // 공유 메모리 생성 및 초기화
-    struct perf_shm_context* shm_ctx = NULL;
-    int shm_fd;
+    int shm_fd, opt, local_only = 0, recovered;
+    pthread_t local_thread, ckpt_thread, hot_thread, apply_thread;
+    const char *backup_addrs[REPL_MAX_BACKUPS];
+    int backup_addr_num = 0;
+    char perf_name[32];
+    const char *store_path = STORE_DEFAULT_PATH, *wal_path = NULL;
+    uint64_t store_size = STORE_DEFAULT_SIZE, start_ns;
+    uint32_t wal_window_us = WAL_DEFAULT_WINDOW_US, wal_batch = WAL_DEFAULT_BATCH;
+    long replayed;
+    uint32_t lease_max_us = LEASE_DEFAULT_MAX_US;
+    int ordered = 0;
+
+    // -L: RDMA 장치 없이 shm transport 로만 서비스
+    // -u: RC 대신 UD QP 하나로 모든 클라이언트를 받는다
+    // -f/-S: store 파일과 (새로 만들 때의) 크기 MB
+    // -w: WAL 파일. -g/-b: group commit window (us) 와 최대 batch, -k: checkpoint 주기 (초)
+    // -e: 최대 lease (us, 0 이면 끈다), -H: hot key 갱신 주기 (초, 0 이면 끈다)
+    // -O: key 순서 index 를 만들어 SCAN 을 받는다
+    // -p: listen port, -B: backup 으로 뜬다, -R: 쓰기를 이 backup (ip[:port]) 에 복제한다 (여러 번 줄 수 있다)
+    // -v: 요청마다 찍는 debug 로그를 켠다 (log 스레드가 찍는다)
+    while ((opt = getopt(argc, argv, "Luf:S:w:g:b:k:e:H:Op:BR:v")) != -1) {
+        switch (opt) {
+        case 'L':
+            local_only = 1;
+            break;
+        case 'u':
+            ud_mode = 1;
+            break;
+        case 'f':
+            store_path = optarg;
+            break;
+        case 'S':
+            store_size = strtoull(optarg, NULL, 10) << 20;
+            break;
+        case 'w':
+            wal_path = optarg;
+            break;
+        case 'g':
+            wal_window_us = atoi(optarg);
+            break;
+        case 'b':
+            wal_batch = atoi(optarg);
+            break;
+        case 'k':
+            checkpoint_sec = atoi(optarg);
+            break;
+        case 'e':
+            lease_max_us = atoi(optarg);
+            break;
+        case 'H':
+            hot_interval_sec = atoi(optarg);
+            break;
+        case 'O':
+            ordered = 1;
+            break;
+        case 'p':
+            listen_port = atoi(optarg);
+            break;
+        case 'B':
+            backup_mode = 1;
+            break;
+        case 'R':
+            if (backup_addr_num == REPL_MAX_BACKUPS) {
+                fprintf(stderr, "At most %d backups\n", REPL_MAX_BACKUPS);
+                return EXIT_FAILURE;
+            }
+            backup_addrs[backup_addr_num++] = optarg;
+            break;
+        case 'v':
+            log_level = LOG_LEVEL_DEBUG;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-L] [-u] [-f store-file] [-S store-MB]"
+                " [-w wal-file [-g window-us] [-b batch] [-k checkpoint-sec]] [-e max-lease-us]"
+                " [-H hot-interval-sec] [-O] [-p port] [-B] [-R backup-ip[:port]]... [-v]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (listen_port <= 0 || listen_port > 65535 || (local_only && (listen_port != SERVER_PORT || backup_mode))
+        || (backup_mode && ud_mode)) {
+        fprintf(stderr, "-L only serves /kvs-shm on the default port, and a backup (-B) needs RC connections\n");
+        return EXIT_FAILURE;
+    }
+
+    if (log_start() < 0) {
+        exit(EXIT_FAILURE);
+    }
+    lease_table_init(&leases, lease_max_us);
+    hotkey_init(&hotkeys);
+
+    start_ns = now_ns();
+    recovered = store_open(&store, store_path, store_size, STORE_DEFAULT_BUCKETS);
+    if (recovered < 0) {
+        exit(EXIT_FAILURE);
+    }
+    printf("%s store %s: %lu entries, %lu MB, %.3f ms\n", recovered ? "Recovered" : "Created", store_path,
+        (unsigned long)store.hdr->entries, (unsigned long)(store.hdr->size >> 20), (now_ns() - start_ns) / 1e6);
+
+    if (ordered) {
+        start_ns = now_ns();
+        if (store_enable_index(&store) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        printf("Built ordered index: %lu keys, %.3f ms\n", (unsigned long)store.index->size, (now_ns() - start_ns) / 1e6);
+    }
+
+    if (wal_path) {
+        start_ns = now_ns();
+        replayed = wal_open(&wal, wal_path, store.hdr->wal_ckpt_off, store.hdr->wal_ckpt_lsn, wal_apply, &store);
+        if (replayed < 0 || wal_start(&wal, wal_window_us, wal_batch) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        wal_enabled = 1;
+        printf("Replayed %ld WAL records from %s (lsn %lu), %.3f ms, group commit window %u us / batch %u\n",
+            replayed, wal_path, (unsigned long)wal.durable_lsn, (now_ns() - start_ns) / 1e6,
+            wal_window_us, wal_batch);
+
+        if (pthread_create(&ckpt_thread, NULL, checkpoint_thread, NULL) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(ckpt_thread);
+    }
 
-    printf("Init perf_shm\n");
-    shm_fd = shm_open("/perf-shm", O_CREAT | O_RDWR, 0666);
+    // 같은 호스트의 두 번째 서버 (다른 port) 는 자기 perf-shm 을 쓴다 (kvs-stat -p)
+    if (listen_port == SERVER_PORT) {
+        snprintf(perf_name, sizeof(perf_name), "%s", PERF_SHM_NAME);
+    } else {
+        snprintf(perf_name, sizeof(perf_name), PERF_SHM_PORT_NAME, listen_port);
+    }
+    printf("Init perf_shm %s\n", perf_name);
+    shm_fd = shm_open(perf_name, O_CREAT | O_RDWR, 0666);
 
     if (shm_fd == -1)
     {
@@ -118,6 +661,14 @@ int main() {
         printf("Error mapping shared memory perf_shm");
         exit(1);
     }
+    close(shm_fd);
+
+    // 이전 실행의 통계가 남아있지 않도록 전체를 지운 뒤 magic 은 마지막에 기록
+    memset(shm_ctx, 0, sizeof(struct perf_shm_context));
+    shm_ctx->version = PERF_SHM_VERSION;
+    shm_ctx->start_ns = now_ns();
+    shm_ctx->hash_buckets = store.hdr->buckets;
+    shm_ctx->store_entries = store.hdr->entries;
 
     shm_ctx->next_tenant_id = 0;
     shm_ctx->tenant_num = 0;
@@ -126,6 +677,7 @@ int main() {
     shm_ctx->active_stenant_num = 0;
     shm_ctx->active_mtenant_num = 0;
     shm_ctx->active_dtenant_num = 0;
+    shm_ctx->max_qps_limit = MAX_TENANT_NUM;
 
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
@@ -136,6 +688,64 @@ int main() {
     pthread_condattr_init(&attrcond);
     pthread_condattr_setpshared(&attrcond, PTHREAD_PROCESS_SHARED);
 
+    for (int i = 0; i < MAX_TENANT_NUM; i++) {
+        pthread_mutex_init(&(shm_ctx->perf_thread_lock[i]), &attr);
+        pthread_cond_init(&(shm_ctx->perf_thread_cond[i]), &attrcond);
+    }
+
+    shm_ctx->hot_interval_sec = hot_interval_sec;
+
+    __atomic_store_n(&shm_ctx->magic, PERF_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    if (hot_interval_sec > 0) {
+        if (pthread_create(&hot_thread, NULL, hotkey_thread, NULL) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(hot_thread);
+    }
+
+    if (backup_mode) {
+        if (repl_backup_init(&backup, REPL_RING_SLOTS) < 0
+            || pthread_create(&apply_thread, NULL, repl_apply_thread, NULL) != 0) {
+            perror("Failed to start replication");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(apply_thread);
+        printf("Backup: replication ring of %u records, client writes are refused\n", REPL_RING_SLOTS);
+    }
+
+    // 클라이언트를 받기 전에 backup 마다 지금 store 를 통째로 보낸다
+    for (int i = 0; i < backup_addr_num; i++) {
+        start_ns = now_ns();
+        if (repl_connect(&replicas[i], backup_addrs[i]) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        repl_ship(&replicas[i], REPL_CLEAR, "", NULL);
+        store_foreach(&store, repl_snapshot, &replicas[i]);
+        if (replicas[i].failed) {
+            exit(EXIT_FAILURE);
+        }
+        printf("Backup %s: shipped %lu entries, ring of %u records, %.3f ms\n", backup_addrs[i],
+            (unsigned long)replicas[i].seq - 1, replicas[i].slots, (now_ns() - start_ns) / 1e6);
+    }
+    pthread_mutex_lock(&write_lock);
+    repl_num = backup_addr_num;
+    pthread_mutex_unlock(&write_lock);
+
+    // 같은 호스트의 클라이언트는 NIC 을 거치지 않고 /kvs-shm 으로 붙는다
+    if (listen_port != SERVER_PORT) {
+        printf("Local transport is only served on port %d\n", SERVER_PORT);
+    } else if (pthread_create(&local_thread, NULL, accept_local, NULL) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+
+    if (local_only) {
+        pthread_join(local_thread, NULL);
+        return EXIT_SUCCESS;
+    }
+
     setup_connection();
     return EXIT_SUCCESS;
 }
@@ -145,7 +755,7 @@ static void setup_connection() {
 
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(SERVER_PORT);
+    addr.sin_port = htons(listen_port);
     addr.sin_addr.s_addr = INADDR_ANY;
 
     ec = rdma_create_event_channel();
@@ -154,7 +764,11 @@ static void setup_connection() {
         exit(EXIT_FAILURE);
     }
 
-    if (rdma_create_id(ec, &listen_id, NULL, RDMA_PS_TCP)) {
+    if (!ud_mode) {
+        device_pools_init();
+    }
+
+    if (rdma_create_id(ec, &listen_id, NULL, ud_mode ? RDMA_PS_UDP : RDMA_PS_TCP)) {
         perror("rdma_create_id");
         exit(EXIT_FAILURE);
     }
@@ -164,15 +778,15 @@ static void setup_connection() {
         exit(EXIT_FAILURE);
     }
 
-    if (rdma_listen(listen_id, 1)) {
+    if (rdma_listen(listen_id, MAX_TENANT_NUM)) {
         perror("rdma_listen");
         exit(EXIT_FAILURE);
     }
 
-    printf("Listening for incoming connections...\n\n");
+    printf("Listening for incoming %s connections on port %d...\n\n", ud_mode ? "UD" : "RC", listen_port);
 
     while (1) {
-        
+
         count++;
         //printf("count: %d\n", count);
 
@@ -181,8 +795,6 @@ static void setup_connection() {
             exit(EXIT_FAILURE);
         }
 
-        id = event->id;
-
         if (handle_event()) {
             break;
         }
@@ -191,382 +803,1198 @@ static void setup_connection() {
             perror("rdma_ack_cm_event");
             exit(EXIT_FAILURE);
         }
+
+        // UD 는 accept 로 QP 번호만 알려주면 끝이라 연결별 cm_id 를 남기지 않는다
+        if (ud_accepted_id) {
+            rdma_destroy_id(ud_accepted_id);
+            ud_accepted_id = NULL;
+        }
     }
 }
 // 이벤트 처리
 static int handle_event() {
+    struct tenant_context *t = (struct tenant_context *)event->id->context;
 
     printf("Event type: %s\n", rdma_event_str(event->event));
 
     if (event->event == RDMA_CM_EVENT_CONNECT_REQUEST) {
         printf("Connection request received.\n\n");
-        on_connect();
+        if (ud_mode) {
+            on_connect_ud(event->id);
+        } else {
+            on_connect(event->id);
+        }
     } else if(event->event == RDMA_CM_EVENT_ESTABLISHED) {
 		printf("connect established.\n\n");
-        id = event->id;
-        process_message();
+
+        // 멀티 스레드 생성: tenant 마다 전용 worker 가 메시지를 처리
+        if (pthread_create(&t->thread, NULL, process_message, t) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+        // 비동기처리
+        pthread_detach(t->thread);
     } else if (event->event == RDMA_CM_EVENT_DISCONNECTED) {
+        // 자원은 worker 가 flush 된 completion 을 보고 정리한다 (cleanup 이 이 이벤트의 ack 를 기다림)
         printf("Disconnected from client.\n");
-        cleanup(id);
-        exit(EXIT_FAILURE);
+        if (t) {
+            t->disconnected = 1;
+        }
     }
 
     return 0;
 }
 
-void* create_thread(void* arg) {
-    struct rdma_cm_id* id = (struct rdma_cm_id*)arg;
-    struct rdma_context* client_ctx = NULL;
-
-    // 공유 메모리에서 새로운 tenant_context 할당
-    int tenant_id = shm_ctx->next_tenant_id;
-    if (tenant_id >= MAX_TENANT_NUM) {
-        fprintf(stderr, "Maximum number of tenants reached.\n");
-        rdma_disconnect(id);
-        return NULL;
-    }
+// 빈 tenant 슬롯을 잡고 고유한 tenant_id 를 할당한다
+static struct tenant_context *alloc_tenant() {
+    struct tenant_context *t = NULL;
 
-    // 연결 가능한지 확인 후 연결
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (ctx[i].qp == NULL) { 
-            client_ctx = &ctx[i];
+    pthread_mutex_lock(&shm_ctx->lock);
+    for (int i = 0; i < MAX_TENANT_NUM; i++) {
+        if (!ctx[i].in_use) {
+            t = &ctx[i];
             break;
         }
     }
-    
-    if (!client_ctx) {
-        fprintf(stderr, "Max clients reached, rejecting connection.\n");
-        rdma_disconnect(id);  
+
+    if (!t) {
+        pthread_mutex_unlock(&shm_ctx->lock);
         return NULL;
     }
 
-    // !! 여기가 qp 생성~~
-    build_context(client_ctx, id);
-    build_qp_attr(&qp_attr, client_ctx);
+    memset(t, 0, sizeof(*t));
+    t->in_use = 1;
+    t->tenant_id = shm_ctx->next_tenant_id;
+    shm_ctx->next_tenant_id = (t->tenant_id + 1) % MAX_TENANT_NUM;
+    shm_ctx->tenant_num++;
+    pthread_mutex_unlock(&shm_ctx->lock);
 
-    printf("Creating QP for client...\n");
-    if (rdma_create_qp(id, client_ctx->pd, &qp_attr)) {
-        perror("rdma_create_qp");
-        exit(EXIT_FAILURE);
+    t->stats = &shm_ctx->tenant[t - ctx];
+    memset(t->stats, 0, sizeof(*t->stats));
+    t->stats->tenant_id = t->tenant_id;
+    t->stats->connected_ns = now_ns();
+
+    return t;
+}
+
+static void release_tenant(struct tenant_context *t) {
+    if (t->stats) {
+        PERF_SET(t->stats->active, 0);
     }
 
-    printf("Queue Pair created for client: %p\n", (void*)id->qp);
-    pre_post_recv_buffer();
+    pthread_mutex_lock(&shm_ctx->lock);
+    if (shm_ctx->active_tenant_num > 0) {
+        shm_ctx->active_tenant_num--;
+        if (t->tp == &verbs_transport) {
+            shm_ctx->active_qps_num--;
+        }
+    }
+    shm_ctx->active_qps_per_tenant[t->tenant_id] = 0;
+    t->in_use = 0;
+    pthread_mutex_unlock(&shm_ctx->lock);
+}
 
+static void on_connect(struct rdma_cm_id *id) {
+    struct tenant_context *t;
     struct rdma_conn_param conn_param;
+    const struct pdata *req = event->param.conn.private_data;
+    int replica = req && event->param.conn.private_data_len >= sizeof(*req) && ntohl(req->role) == KVS_ROLE_REPLICA;
+
+    // 복제 연결은 backup 만, 한 번에 primary 하나만 받는다
+    if (replica && (!backup_mode || repl_backup_attach(&backup) < 0)) {
+        fprintf(stderr, "Rejecting replication connection (%s).\n", backup_mode ? "already has a primary" : "not a backup");
+        rdma_reject(id, NULL, 0);
+        return;
+    }
+
+    // 연결 가능한지 확인 후 연결
+    t = alloc_tenant();
+    if (!t) {
+        fprintf(stderr, "Maximum number of tenants reached, rejecting connection.\n");
+        rdma_reject(id, NULL, 0);
+        if (replica) {
+            repl_backup_detach(&backup);
+        }
+        return;
+    }
+    t->replica = replica;
+
+    t->id = id;
+    t->tp = &verbs_transport;
+    t->tp_conn = t;
+    id->context = t;
+
+    // pool 에서 이 장치의 QP 하나를 빌린다. QP 가 id 에 붙어 있지 않으므로 상태 전이를 직접 한다
+    t->slot = qp_slot_get(id->verbs, &t->dev);
+    if (!t->slot) {
+        fprintf(stderr, "No pooled QP left for tenant %d, rejecting connection.\n", t->tenant_id);
+        rdma_reject(id, NULL, 0);
+        id->context = NULL;
+        t->id = NULL;
+        if (replica) {
+            repl_backup_detach(&backup);
+        }
+        release_tenant(t);
+        return;
+    }
+
+    t->ctx.verbs = id->verbs;
+    t->ctx.pd = t->dev->pd;
+    t->ctx.comp_channel = t->slot->comp_channel;
+    t->ctx.cq = t->slot->cq;
+    t->ctx.qp = t->slot->qp;
+    t->ctx.send_mr = t->ctx.recv_mr = t->dev->buf_mr;
+    t->store_mr = t->dev->store_mr;
+    t->send_buffer = t->slot->send_buffer;
+    t->recv_buffer = t->slot->recv_buffer;
+    t->scan_buffer = t->slot->scan_buffer;
+    PERF_SET(t->stats->recv_depth, KVS_RECV_DEPTH);
+    printf("Tenant %d uses pooled QP %u\n\n", t->tenant_id, t->ctx.qp->qp_num);
+
     memset(&conn_param, 0, sizeof(conn_param));
-    conn_param.initiator_depth = 3;
+	conn_param.initiator_depth = 3;
     conn_param.responder_resources = 3;
     conn_param.retry_count = 3;
-    conn_param.private_data = &rep_pdata;
-    conn_param.private_data_len = sizeof(rep_pdata);
+    conn_param.qp_num = t->ctx.qp->qp_num;
+    conn_param.private_data = &t->rep_pdata;
+    conn_param.private_data_len = sizeof(t->rep_pdata);
+
+    // recv 는 INIT 이후에 걸 수 있다. rdma_accept 가 id 의 QP 에 하는 것과 같은 순서
+    if (qp_to_state(id, t->ctx.qp, IBV_QPS_INIT, &conn_param)) {
+        perror("Failed to bring up pooled QP");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < KVS_RECV_DEPTH; i++) {
+        if (pre_post_recv_buffer(t, i)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (qp_to_state(id, t->ctx.qp, IBV_QPS_RTR, &conn_param)
+        || qp_to_state(id, t->ctx.qp, IBV_QPS_RTS, &conn_param)) {
+        perror("Failed to bring up pooled QP");
+        exit(EXIT_FAILURE);
+    }
+
+    t->rep_pdata.buf_va = htonll((uintptr_t) t->recv_buffer);
+    t->rep_pdata.buf_rkey = htonl(t->ctx.recv_mr->rkey);
+    if (t->dev->atomic_mr) {
+        t->rep_pdata.atomic_va = htonll((uintptr_t)atomic_mem.addr);
+        t->rep_pdata.atomic_rkey = htonl(t->dev->atomic_mr->rkey);
+        t->rep_pdata.atomic_num = htonl(KVS_ATOMIC_SLOTS);
+    } else {
+        t->rep_pdata.atomic_va = 0;
+        t->rep_pdata.atomic_rkey = 0;
+        t->rep_pdata.atomic_num = 0;
+    }
+    if (replica) {
+        t->rep_pdata.repl_va = htonll((uintptr_t)backup.ring);
+        t->rep_pdata.repl_rkey = htonl(t->dev->repl_mr->rkey);
+        t->rep_pdata.repl_slots = htonl(backup.slots);
+        printf("Tenant %d is the primary, replicating into a ring of %u records\n", t->tenant_id, backup.slots);
+    } else {
+        t->rep_pdata.repl_va = 0;
+        t->rep_pdata.repl_rkey = 0;
+        t->rep_pdata.repl_slots = 0;
+    }
 
     if (rdma_accept(id, &conn_param)) {
         perror("rdma_accept");
         exit(EXIT_FAILURE);
     }
-
     printf("Connection accepted.\n\n");
 
     // 클라이언트 정보 복사
-    memcpy(&client_ctx->rep_pdata, client_ctx->event->param.conn.private_data, sizeof(client_ctx->rep_pdata));
-    printf("Received client Memory at address %p with RKey %u\n", (void*)client_ctx->rep_pdata.buf_va, ntohl(client_ctx->rep_pdata.buf_rkey));
+    memcpy(&t->rep_pdata,event->param.conn.private_data,sizeof(t->rep_pdata));
+    printf("Received client Memory at address %p with RKey %u\n", (void *)t->rep_pdata.buf_va, ntohl(t->rep_pdata.buf_rkey));
+
+    pthread_mutex_lock(&shm_ctx->lock);
+    shm_ctx->active_tenant_num++;
+    shm_ctx->active_qps_num++;
+    shm_ctx->active_qps_per_tenant[t->tenant_id] = 1;
+    pthread_mutex_unlock(&shm_ctx->lock);
+}
 
-    // 고유한 tenant_id 할당
-    shm_ctx->next_tenant_id = (tenant_id + 1) % MAX_TENANT_NUM;  
+// rdma_cm 이 연결에 맞게 채워 준 속성으로 QP 를 한 단계 옮긴다
+static int qp_to_state(struct rdma_cm_id *id, struct ibv_qp *qp, enum ibv_qp_state state,
+    const struct rdma_conn_param *param) {
+    struct ibv_qp_attr attr;
+    int mask;
 
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = state;
+    if (rdma_init_qp_attr(id, &attr, &mask)) {
+        return -1;
+    }
+    if (state == IBV_QPS_INIT) {
+        // 클라이언트가 atomic 영역에 바로 fetch-add / CAS 한다
+        attr.qp_access_flags |= IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC;
+    } else if (state == IBV_QPS_RTR) {
+        attr.max_dest_rd_atomic = param->responder_resources;
+    } else if (state == IBV_QPS_RTS) {
+        attr.max_rd_atomic = param->initiator_depth;
+    }
+    return ibv_modify_qp(qp, &attr, mask);
+}
 
-    return NULL;
+static void qp_slot_create(struct device_pool *dev, struct qp_slot *slot) {
+    struct rdma_context tmp;
+    struct ibv_qp_init_attr attr;
+
+    slot->comp_channel = ibv_create_comp_channel(dev->verbs);
+    if (!slot->comp_channel) {
+        perror("ibv_create_comp_channel");
+        exit(EXIT_FAILURE);
+    }
+
+    slot->cq = ibv_create_cq(dev->verbs, CQ_CAPACITY, NULL, slot->comp_channel, 0);
+    if (!slot->cq || ibv_req_notify_cq(slot->cq, 0)) {
+        perror("ibv_create_cq");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.cq = slot->cq;
+    build_qp_attr(&attr, &tmp);
+    slot->qp = ibv_create_qp(dev->pd, &attr);
+    if (!slot->qp) {
+        perror("ibv_create_qp");
+        exit(EXIT_FAILURE);
+    }
 }
 
-static void on_connect(struct rdma_cm_event* event) {
-    struct rdma_cm_id* id = event->id;
+// rdma_cm 이 쓰는 장치마다 PD, MR, QP pool 을 만든다 (listen 전에 한 번)
+static void device_pools_init() {
+    struct ibv_context **list;
+    struct device_pool *dev;
+    struct ibv_device_attr dev_attr;
+    size_t slot_bytes = (1 + KVS_RECV_DEPTH) * sizeof(struct message) + SCAN_CHUNK_MAX * sizeof(struct scan_entry);
+    uint64_t start_ns = now_ns();
+    int num;
+
+    if (!hugemem_alloc(&atomic_mem, KVS_ATOMIC_SLOTS * sizeof(uint64_t))) {
+        perror("Failed to allocate atomic region");
+        exit(EXIT_FAILURE);
+    }
 
-    // 멀티 스레드 생성
-    pthread_t thread;
-    int ret = pthread_create(&thread, NULL, create_thread, (void*)id);
-    if (ret != 0) {
-        perror("pthread_create");
+    list = rdma_get_devices(&num);
+    if (!list || num == 0) {
+        fprintf(stderr, "No RDMA device\n");
         exit(EXIT_FAILURE);
     }
 
-    // 비동기처리
-    pthread_detach(thread);
+    for (int i = 0; i < num && device_count < MAX_DEVICES; i++) {
+        dev = &devices[device_count++];
+        dev->verbs = list[i];
+
+        dev->pd = ibv_alloc_pd(dev->verbs);
+        if (!dev->pd) {
+            perror("ibv_alloc_pd");
+            exit(EXIT_FAILURE);
+        }
+
+        // store 매핑을 통째로 등록해 두면 value 를 복사하지 않고 SGE 로 보낼 수 있다
+        dev->store_mr = ibv_reg_mr(dev->pd, store.base, store.hdr->size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ);
+
+        if (!hugemem_alloc(&dev->mem, MAX_TENANT_NUM * slot_bytes)) {
+            perror("Failed to allocate pooled message buffers");
+            exit(EXIT_FAILURE);
+        }
+        dev->buf_mr = ibv_reg_mr(dev->pd, dev->mem.addr, dev->mem.len,
+            IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+        if (!dev->store_mr || !dev->buf_mr) {
+            perror("Failed to register pooled memory region");
+            exit(EXIT_FAILURE);
+        }
+
+        if (ibv_query_device(dev->verbs, &dev_attr)) {
+            perror("ibv_query_device");
+            exit(EXIT_FAILURE);
+        }
+        if (dev_attr.atomic_cap == IBV_ATOMIC_NONE) {
+            printf("Device %s: no RDMA atomics, atomic region disabled\n", ibv_get_device_name(dev->verbs->device));
+        } else {
+            dev->atomic_mr = ibv_reg_mr(dev->pd, atomic_mem.addr, KVS_ATOMIC_SLOTS * sizeof(uint64_t),
+                IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_ATOMIC);
+            if (!dev->atomic_mr) {
+                perror("Failed to register atomic region");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // primary 가 record 를 WRITE 하고 applied 를 READ 한다
+        if (backup_mode) {
+            dev->repl_mr = ibv_reg_mr(dev->pd, backup.ring, backup.mem.len,
+                IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+            if (!dev->repl_mr) {
+                perror("Failed to register replication ring");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        for (int j = 0; j < MAX_TENANT_NUM; j++) {
+            dev->slots[j].send_buffer = (char *)dev->mem.addr + j * slot_bytes;
+            dev->slots[j].recv_buffer = dev->slots[j].send_buffer + sizeof(struct message);
+            dev->slots[j].scan_buffer =
+                (struct scan_entry *)(dev->slots[j].recv_buffer + KVS_RECV_DEPTH * sizeof(struct message));
+            qp_slot_create(dev, &dev->slots[j]);
+        }
+        printf("Device %s: %d pooled QPs\n", ibv_get_device_name(dev->verbs->device), MAX_TENANT_NUM);
+    }
+    rdma_free_devices(list);
+
+    printf("Connection pool ready in %.3f ms\n", (now_ns() - start_ns) / 1e6);
 }
 
-static void on_connect() {
-    struct rdma_conn_param conn_param;
+static struct qp_slot *qp_slot_get(struct ibv_context *verbs, struct device_pool **dev) {
+    struct qp_slot *slot = NULL;
+
+    pthread_mutex_lock(&pool_lock);
+    for (int i = 0; i < device_count && !slot; i++) {
+        if (devices[i].verbs != verbs) {
+            continue;
+        }
+        for (int j = 0; j < MAX_TENANT_NUM; j++) {
+            if (!devices[i].slots[j].in_use) {
+                slot = &devices[i].slots[j];
+                slot->in_use = 1;
+                *dev = &devices[i];
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
 
-    /* Allocate resources */
-    build_context(&ctx, id);
-    build_qp_attr(&qp_attr, &ctx);
+    return slot;
+}
 
-    printf("Creating QP...\n");
-    if (rdma_create_qp(id, ctx.pd, &qp_attr)) {
-        perror("rdma_create_qp");
+// QP 를 RESET 으로 되돌리고 CQ 와 completion channel 에 남은 것을 비운 뒤 반납한다
+static void qp_slot_put(struct qp_slot *slot) {
+    struct ibv_qp_attr attr;
+    struct ibv_wc wc[CQ_CAPACITY];
+    struct ibv_cq *evt_cq;
+    void *cq_context;
+    int flags;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RESET;
+    if (ibv_modify_qp(slot->qp, &attr, IBV_QP_STATE)) {
+        perror("ibv_modify_qp RESET");
         exit(EXIT_FAILURE);
     }
-    printf("Queue Pair created: %p\n\n", (void*)id->qp);
 
-    pre_post_recv_buffer();
+    while (ibv_poll_cq(slot->cq, CQ_CAPACITY, wc) > 0);
+
+    // 받지 않은 이벤트가 남아 있으면 다음 연결이 기다리지 않고 지나간다
+    flags = fcntl(slot->comp_channel->fd, F_GETFL);
+    fcntl(slot->comp_channel->fd, F_SETFL, flags | O_NONBLOCK);
+    while (ibv_get_cq_event(slot->comp_channel, &evt_cq, &cq_context) == 0) {
+        ibv_ack_cq_events(evt_cq, 1);
+    }
+    fcntl(slot->comp_channel->fd, F_SETFL, flags);
+    ibv_req_notify_cq(slot->cq, 0);
+
+    pthread_mutex_lock(&pool_lock);
+    slot->in_use = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
 
-    rep_pdata.buf_va = htonll((uintptr_t) recv_buffer);
-    rep_pdata.buf_rkey = htonl(ctx.recv_mr->rkey);
+// /kvs-shm 연결을 받아 RDMA tenant 와 같은 방식으로 worker 를 붙인다
+static void *accept_local(void *arg) {
+    struct shm_transport_region *region;
+    struct shm_conn conn;
+    struct tenant_context *t;
+
+    region = shm_transport_create();
+    if (!region) {
+        fprintf(stderr, "Local transport disabled.\n");
+        return NULL;
+    }
+    printf("Listening for local connections on %s\n\n", SHM_TRANSPORT_NAME);
+
+    while (1) {
+        int slot = shm_transport_accept(region, &conn);
+
+        t = alloc_tenant();
+        if (!t) {
+            fprintf(stderr, "Maximum number of tenants reached, rejecting local connection.\n");
+            shm_transport_reject(&conn);
+            continue;
+        }
+
+        t->local = conn;
+        t->tp = &shm_transport;
+        t->tp_conn = &t->local;
+
+        pthread_mutex_lock(&shm_ctx->lock);
+        shm_ctx->active_tenant_num++;
+        shm_ctx->active_qps_per_tenant[t->tenant_id] = 1;
+        pthread_mutex_unlock(&shm_ctx->lock);
+
+        printf("Local connection %d (pid %u) accepted as tenant %d.\n\n", slot, t->local.slot->pid, t->tenant_id);
+
+        // worker 의 recv 가 ACTIVE 상태를 보도록 먼저 열어준다
+        shm_transport_ready(&t->local);
+
+        if (pthread_create(&t->thread, NULL, process_message, t) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(t->thread);
+    }
+
+    return NULL;
+}
+
+static void ud_post_recv(int *index, int n) {
+    struct ibv_recv_wr wr[16], *bad_wr;
+    struct ibv_sge sge[16];
+
+    // 한 번의 poll 에서 비운 버퍼를 묶어서 다시 건다
+    for (int i = 0; i < n; i++) {
+        sge[i].addr = (uintptr_t)(ud.recv_buffer + (size_t)index[i] * UD_RECV_SIZE);
+        sge[i].length = UD_RECV_SIZE;
+        sge[i].lkey = ud.buf_mr->lkey;
+
+        memset(&wr[i], 0, sizeof(wr[i]));
+        wr[i].wr_id = index[i];
+        wr[i].sg_list = &sge[i];
+        wr[i].num_sge = 1;
+        wr[i].next = i + 1 < n ? &wr[i + 1] : NULL;
+    }
+
+    if (ibv_post_recv(ud.qp, wr, &bad_wr)) {
+        perror("Failed to post UD receive work request");
+        exit(EXIT_FAILURE);
+    }
+    PERF_ADD(ud.t->stats->recv_posted, n);
+}
+
+// 첫 UD 연결 요청이 온 장치에 공유 QP 를 만든다
+static void ud_setup(struct rdma_cm_id *id) {
+    struct ibv_qp_init_attr init_attr;
+    struct ibv_qp_attr attr;
+    int index[16];
+
+    ud.port_num = id->port_num;
+
+    ud.pd = ibv_alloc_pd(id->verbs);
+    if (!ud.pd) {
+        perror("ibv_alloc_pd");
+        exit(EXIT_FAILURE);
+    }
+
+    ud.send_cq = ibv_create_cq(id->verbs, UD_SEND_DEPTH, NULL, NULL, 0);
+    ud.recv_cq = ibv_create_cq(id->verbs, UD_RECV_DEPTH, NULL, NULL, 0);
+    if (!ud.send_cq || !ud.recv_cq) {
+        perror("ibv_create_cq");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&init_attr, 0, sizeof(init_attr));
+    init_attr.qp_type = IBV_QPT_UD;
+    init_attr.send_cq = ud.send_cq;
+    init_attr.recv_cq = ud.recv_cq;
+    init_attr.cap.max_send_wr = UD_SEND_DEPTH;
+    init_attr.cap.max_recv_wr = UD_RECV_DEPTH;
+    init_attr.cap.max_send_sge = MAX_SGE;
+    init_attr.cap.max_recv_sge = MAX_SGE;
+
+    ud.qp = ibv_create_qp(ud.pd, &init_attr);
+    if (!ud.qp) {
+        perror("ibv_create_qp");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_INIT;
+    attr.pkey_index = 0;
+    attr.port_num = ud.port_num;
+    attr.qkey = RDMA_UDP_QKEY;
+    if (ibv_modify_qp(ud.qp, &attr, IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_QKEY)) {
+        perror("ibv_modify_qp INIT");
+        exit(EXIT_FAILURE);
+    }
+
+    attr.qp_state = IBV_QPS_RTR;
+    if (ibv_modify_qp(ud.qp, &attr, IBV_QP_STATE)) {
+        perror("ibv_modify_qp RTR");
+        exit(EXIT_FAILURE);
+    }
+
+    attr.qp_state = IBV_QPS_RTS;
+    attr.sq_psn = 0;
+    if (ibv_modify_qp(ud.qp, &attr, IBV_QP_STATE | IBV_QP_SQ_PSN)) {
+        perror("ibv_modify_qp RTS");
+        exit(EXIT_FAILURE);
+    }
+
+    ud.recv_buffer = hugemem_alloc(&ud.mem, (size_t)UD_RECV_DEPTH * UD_RECV_SIZE
+        + UD_CLIENT_SLOTS * sizeof(struct ud_client));
+    if (!ud.recv_buffer) {
+        perror("Failed to allocate UD buffers");
+        exit(EXIT_FAILURE);
+    }
+    ud.clients = (struct ud_client *)(ud.recv_buffer + (size_t)UD_RECV_DEPTH * UD_RECV_SIZE);
+
+    ud.buf_mr = ibv_reg_mr(ud.pd, ud.mem.addr, ud.mem.len, IBV_ACCESS_LOCAL_WRITE);
+    ud.store_mr = ibv_reg_mr(ud.pd, store.base, store.hdr->size, IBV_ACCESS_LOCAL_WRITE);
+    if (!ud.buf_mr || !ud.store_mr) {
+        perror("Failed to register UD memory region");
+        exit(EXIT_FAILURE);
+    }
+    printf("UD buffers: %lu KB on %s pages\n", (unsigned long)(ud.mem.len >> 10), hugemem_kind_name(ud.mem.kind));
+
+    // UD QP 전체를 tenant 하나로 보여준다
+    ud.t = alloc_tenant();
+    if (!ud.t) {
+        fprintf(stderr, "No tenant slot left for the UD queue pair.\n");
+        exit(EXIT_FAILURE);
+    }
+    PERF_SET(ud.t->stats->recv_depth, UD_RECV_DEPTH);
+
+    pthread_mutex_lock(&shm_ctx->lock);
+    shm_ctx->active_tenant_num++;
+    shm_ctx->active_qps_num++;
+    shm_ctx->active_qps_per_tenant[ud.t->tenant_id] = 1;
+    pthread_mutex_unlock(&shm_ctx->lock);
+
+    for (int i = 0; i < UD_RECV_DEPTH; i += 16) {
+        for (int j = 0; j < 16; j++) {
+            index[j] = i + j;
+        }
+        ud_post_recv(index, UD_RECV_DEPTH - i < 16 ? UD_RECV_DEPTH - i : 16);
+    }
+
+    printf("UD Queue Pair created: qpn %u\n\n", ud.qp->qp_num);
+
+    if (pthread_create(&ud.thread, NULL, ud_worker, NULL) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(ud.thread);
+}
+
+// SIDR: 공유 UD QP 번호만 알려주고 연결별 자원은 만들지 않는다
+static void on_connect_ud(struct rdma_cm_id *id) {
+    struct rdma_conn_param conn_param;
+
+    if (!ud.qp) {
+        ud_setup(id);
+    }
 
     memset(&conn_param, 0, sizeof(conn_param));
-	conn_param.initiator_depth = 3;
-    conn_param.responder_resources = 3;
-    conn_param.retry_count = 3;
-    conn_param.private_data = &rep_pdata; 
-    conn_param.private_data_len = sizeof(rep_pdata);
+    conn_param.qp_num = ud.qp->qp_num;
 
     if (rdma_accept(id, &conn_param)) {
         perror("rdma_accept");
         exit(EXIT_FAILURE);
     }
-    printf("Connection accepted.\n\n");
-    
-    memcpy(&rep_pdata,event->param.conn.private_data,sizeof(rep_pdata));
-    printf("Received client Memory at address %p with RKey %u\n", (void *)rep_pdata.buf_va, ntohl(rep_pdata.buf_rkey));
+    printf("UD client accepted.\n\n");
+
+    ud_accepted_id = id;
 }
 
-static int pre_post_recv_buffer() {
-    static int buffer_initialized = 0;
+// signal 된 send completion 하나가 그 앞의 unsignaled send 까지 모두 정리한다
+static void ud_reap_sends() {
+    struct ibv_wc wc[16];
+    int n = ibv_poll_cq(ud.send_cq, 16, wc);
 
-    if (!buffer_initialized) {
-        recv_buffer = calloc(2, sizeof(struct message));  // 메시지 두 개를 받을 수 있도록 설정
-        if (!recv_buffer) {
-            perror("Failed to allocate memory for receive buffer");
-            exit(EXIT_FAILURE);
+    if (n < 0) {
+        perror("ibv_poll_cq");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "UD send completion error: %s\n", ibv_wc_status_str(wc[i].status));
         }
+        ud.done_seq = wc[i].wr_id;  // 같은 SQ 의 send 는 순서대로 끝난다
+    }
+}
 
-        ctx.recv_mr = ibv_reg_mr(ctx.pd, recv_buffer, sizeof(struct message), 
-            IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+// signal 이면 이 send 에 completion 을 받는다 (poll 마다 마지막 응답)
+static void ud_reply(struct ud_client *c, int signal) {
+    struct ibv_send_wr wr, *bad_wr;
+    struct ibv_sge sge;
+
+    while (ud.send_seq - ud.done_seq >= UD_SEND_DEPTH - 1) {
+        ud_reap_sends();
+    }
+
+    sge.addr = (uintptr_t)&c->resp;
+    sge.length = sizeof(struct ud_message);
+    sge.lkey = ud.buf_mr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.opcode = IBV_WR_SEND;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.wr.ud.ah = c->ah;
+    wr.wr.ud.remote_qpn = c->qpn;
+    wr.wr.ud.remote_qkey = RDMA_UDP_QKEY;
+    wr.wr_id = ++ud.send_seq;
+
+    if (++ud.unsignaled == UD_SIGNAL_EVERY || signal) {
+        wr.send_flags = IBV_SEND_SIGNALED;
+        ud.unsignaled = 0;
+    }
+
+    if (ibv_post_send(ud.qp, &wr, &bad_wr)) {
+        fprintf(stderr, "Failed to post UD send work request: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    c->last_send = ud.send_seq;
+    PERF_ADD(ud.t->stats->bytes_out, sge.length);
+}
+
+// 요청을 보낸 client 의 테이블 항목을 찾고, 처음 보는 client 면 set 의 빈 자리나
+// 더 재전송할 수 없는 가장 오래된 항목에 AH 를 새로 만든다. 자리가 없으면 NULL
+static struct ud_client *ud_lookup(struct ibv_wc *wc, const struct ud_message *req, struct ibv_grh *grh,
+    uint64_t now) {
+    uint32_t h = (req->client_id ^ (wc->src_qp * 0x9E3779B1u)) % (UD_CLIENT_SLOTS / UD_CLIENT_WAYS);
+    struct ud_client *set = &ud.clients[h * UD_CLIENT_WAYS], *c = NULL;
+
+    for (int i = 0; i < UD_CLIENT_WAYS; i++) {
+        if (set[i].valid && set[i].client_id == req->client_id && set[i].qpn == wc->src_qp) {
+            set[i].last_seen_ns = now;
+            return &set[i];
+        }
+    }
+
+    for (int i = 0; i < UD_CLIENT_WAYS; i++) {
+        if (!set[i].valid) {
+            c = &set[i];
+            break;
+        }
+        if (!set[i].pending && now - set[i].last_seen_ns > UD_CLIENT_IDLE_US * 1000
+            && (!c || set[i].last_seen_ns < c->last_seen_ns)) {
+            c = &set[i];
+        }
+    }
+    if (!c) {
+        return NULL;
+    }
+
+    // 밀려나는 client 의 응답이 아직 SQ 에 있으면 AH 와 resp 를 그대로 둔다.
+    // poll 마다 마지막 응답을 signal 하므로 이전 poll 의 send 는 곧 completion 이 온다
+    if (c->ah) {
+        while (c->last_send > ud.done_seq) {
+            ud_reap_sends();
+        }
+        ibv_destroy_ah(c->ah);
+        c->ah = NULL;
+    }
+    c->valid = 0;
+    c->ah = ibv_create_ah_from_wc(ud.pd, wc, grh, ud.port_num);
+    if (!c->ah) {
+        perror("ibv_create_ah_from_wc");
+        return NULL;
+    }
+
+    c->valid = 1;
+    c->client_id = req->client_id;
+    c->qpn = wc->src_qp;
+    c->last_req_id = req->req_id - 1;
+    c->last_seen_ns = now;
+    return c;
+}
+
+static void *ud_worker(void *arg) {
+    struct perf_tenant_stats *stats = ud.t->stats;
+    struct ibv_wc wc[16];
+    int index[16];
+    struct ud_client *reply[16];
+    uint64_t start_ns, lsn, max_lsn, now;
+    int n, nreply;
+
+    PERF_SET(stats->thread_id, (uint64_t)syscall(SYS_gettid));
+    PERF_SET(stats->active, 1);
 
-        if (!ctx.recv_mr) {
-            perror("Failed to register memory region");
+    while (1) {
+        n = ibv_poll_cq(ud.recv_cq, 16, wc);
+        PERF_ADD(stats->cq_polls, 1);
+
+        if (n < 0) {
+            perror("ibv_poll_cq");
             exit(EXIT_FAILURE);
         }
+        if (n == 0) {
+            if (ud.send_seq != ud.done_seq) {
+                ud_reap_sends();
+            }
+            continue;
+        }
+        PERF_ADD(stats->cq_batch[n < PERF_BATCH_BUCKETS ? n : PERF_BATCH_BUCKETS - 1], 1);
+        PERF_ADD(stats->recv_posted, -n);
+
+        nreply = 0;
+        max_lsn = 0;
+        now = now_ns();
+        for (int i = 0; i < n; i++) {
+            char *buf = ud.recv_buffer + wc[i].wr_id * UD_RECV_SIZE;
+            struct ud_message *req = (struct ud_message *)(buf + UD_GRH_SIZE);
+            struct ud_client *c;
+            int32_t diff;
+
+            index[i] = wc[i].wr_id;
+
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "UD receive completion error: %s\n", ibv_wc_status_str(wc[i].status));
+                continue;
+            }
+            if (wc[i].byte_len < UD_RECV_SIZE) {
+                continue;
+            }
+            PERF_ADD(stats->bytes_in, sizeof(struct ud_message));
+
+            c = ud_lookup(&wc[i], req, (struct ibv_grh *)buf, now);
+            if (!c) {
+                continue;               // set 이 살아 있는 client 로 가득 찼다
+            }
+
+            diff = (int32_t)(req->req_id - c->last_req_id);
+            if (diff < 0) {
+                continue;               // 이미 응답한 것보다 오래된 재전송
+            }
+            if (diff == 0) {
+                if (!c->pending) {      // 응답이 유실된 재전송: 다시 실행하지 않는다
+                    c->pending = 1;
+                    reply[nreply++] = c;
+                }
+                continue;
+            }
+
+            // 재전송된 이전 응답이 아직 SQ 에 있을 수 있지만, client 는 응답을 받은 뒤에만
+            // 다음 요청을 보내므로 그 내용을 더 이상 보지 않는다
+            start_ns = now_ns();
+            memcpy(&c->resp, req, sizeof(struct ud_message));
+            lsn = handle_message(&c->resp.msg, stats, NULL);  // 재전송용으로 응답을 통째로 둔다
+            if (lsn > max_lsn) {
+                max_lsn = lsn;
+            }
+            c->last_req_id = req->req_id;
+            if (!c->pending) {
+                c->pending = 1;
+                reply[nreply++] = c;
+            }
+
+            if ((unsigned)c->resp.msg.type < PERF_OP_MAX) {
+                PERF_ADD(stats->ops[c->resp.msg.type], 1);
+                PERF_ADD(stats->lat_hist[c->resp.msg.type][perf_lat_bucket(now_ns() - start_ns)], 1);
+            }
+        }
 
-        buffer_initialized = 1;  // 버퍼 초기화 완료
+        // 이 poll 에서 받은 요청 전체를 한 번에 기다린 뒤 응답한다.
+        // 재전송에 대한 캐시 응답은 이전 poll 에서 이미 기다린 것이다
+        if (max_lsn) {
+            wal_wait(&wal, max_lsn);
+        }
+        for (int i = 0; i < nreply; i++) {
+            ud_reply(reply[i], i == nreply - 1);
+            reply[i]->pending = 0;
+        }
+
+        ud_post_recv(index, n);
     }
 
-    recv_sge.addr = (uintptr_t)recv_buffer;
-    recv_sge.length = sizeof(struct message);  // 한 번에 한 메시지를 처리한다고 가정
+    return NULL;
+}
+
+static int pre_post_recv_buffer(struct tenant_context *t, int index) {
+    t->recv_sge.addr = (uintptr_t)(t->recv_buffer + index * sizeof(struct message));
+    t->recv_sge.length = sizeof(struct message);
 
-    recv_sge.lkey = ctx.recv_mr->lkey;
+    t->recv_sge.lkey = t->ctx.recv_mr->lkey;
 
-    memset(&recv_wr, 0, sizeof(recv_wr));
-    recv_wr.wr_id = 0;
-    recv_wr.sg_list = &recv_sge;
-    recv_wr.num_sge = 1;
+    memset(&t->recv_wr, 0, sizeof(t->recv_wr));
+    t->recv_wr.wr_id = index;
+    t->recv_wr.sg_list = &t->recv_sge;
+    t->recv_wr.num_sge = 1;
 
-    if (ibv_post_recv(id->qp, &recv_wr, &bad_recv_wr)) {
+    if (ibv_post_recv(t->ctx.qp, &t->recv_wr, &t->bad_recv_wr)) {
         perror("Failed to post receive work request");
         return 1;
     }
-    printf("Memory registered at address %p with LKey %u\n", recv_buffer, ctx.recv_mr->lkey);
+    PERF_ADD(t->stats->recv_posted, 1);
 
     return 0;
 }
 
 
-static void wait_for_completion()
+// 연결이 끊겼거나 completion 이 실패하면 -1
+static int wait_for_completion(struct tenant_context *t)
 {
     int ret;
 
     do {
-        ret = ibv_poll_cq(ctx.cq, 1, &wc);
-    } while (ret == 0);
+        ret = ibv_poll_cq(t->ctx.cq, 1, &t->wc);
+        PERF_ADD(t->stats->cq_polls, 1);
+    } while (ret == 0 && !t->disconnected);
 
     if (ret < 0) {
         perror("ibv_poll_cq");
         exit(EXIT_FAILURE);
     }
-    
-    if (wc.status != IBV_WC_SUCCESS) {
-        fprintf(stderr, "Work completion error: %s\n", ibv_wc_status_str(wc.status));
-        exit(EXIT_FAILURE);
+    if (ret == 0) {
+        return -1;
+    }
+    PERF_ADD(t->stats->cq_batch[ret < PERF_BATCH_BUCKETS ? ret : PERF_BATCH_BUCKETS - 1], 1);
+
+    if (t->wc.opcode & IBV_WC_RECV) {
+        PERF_ADD(t->stats->recv_posted, -1);
+    }
+
+    if (t->wc.status != IBV_WC_SUCCESS) {
+        // 연결이 끊기면 걸어둔 recv 가 FLUSH_ERR 로 돌아온다
+        if (t->wc.status != IBV_WC_WR_FLUSH_ERR) {
+            fprintf(stderr, "Work completion error: %s\n", ibv_wc_status_str(t->wc.status));
+        }
+        return -1;
     }
 
-    printf("wait_for_completion ended\n");
+    LOG_DEBUG("wait_for_completion ended\n");
+    return 0;
 }
 
-static void process_message() {
+// 요청을 실행하고 그 자리에서 응답으로 고친다 (모든 transport 공통).
+// WAL 에 남긴 요청이면 그 lsn, 아니면 0: 응답은 wal_wait 후에 보내야 한다.
+// ref 가 있으면 GET 은 value 를 msg 에 복사하지 않고 store entry 를 *ref 로 돌려준다
+static uint64_t handle_message(struct message *msg, struct perf_tenant_stats *stats, struct store_entry **ref) {
+    uint64_t lsn = 0;
 
-    while(1) {
-        //printf("here. \n\n");
-        
-        struct message *msg = (struct message *)recv_buffer;
-        wait_for_completion();
-        
-        send_buffer = (char *)calloc(2, sizeof(struct message));
-        //send_buffer = (char *)malloc(sizeof(uint32_t));
-        if (!send_buffer) {
-            perror("Failed to allocate memory for send buffer");
-            exit(EXIT_FAILURE);
-        }
+    //printf("Packet size: %lu bytes\n\n", sizeof(struct message));
+    //printf("Received message - Type: %d, Key: %s, Value: %s\n", msg->type, msg->kv.key, msg->kv.value);
+    LOG_DEBUG("\nrecv_buffer content:\nType: %d\nKey: %s\nValue: %s\n\n", msg->type, msg->kv.key, msg->kv.value);
 
-        ctx.send_mr = ibv_reg_mr(ctx.pd, send_buffer, sizeof(struct message), IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
-        if (!ctx.send_mr) {
-            fprintf(stderr, "Failed to register client metadata buffer.\n");
-            exit(EXIT_FAILURE);
-        }
+    if (hot_interval_sec > 0) {
+        hotkey_record(&hotkeys, msg->kv.key);
+    }
 
-        if (msg == NULL) {
-            printf("Received null message.\n");
-            exit(EXIT_FAILURE);
-        }
+    // backup 의 store 는 primary 가 보낸 record 로만 바뀐다
+    if (backup_mode && (msg->type == MSG_PUT || msg->type == MSG_DELETE || msg->type == MSG_INCR
+        || msg->type == MSG_APPEND || msg->type == MSG_CAS)) {
+        strncpy(msg->kv.value, "READ_ONLY", KEY_VALUE_SIZE);
+        msg->lease_us = 0;
+        msg->version = 0;
+        return 0;
+    }
 
-        //printf("Packet size: %lu bytes\n\n", sizeof(struct message));
-        //printf("Received message - Type: %d, Key: %s, Value: %s\n", msg->type, msg->kv.key, msg->kv.value);
-        printf("\nrecv_buffer content:\n");
-        printf("Type: %d\n", msg->type);
-        printf("Key: %s\n", msg->kv.key);
-        printf("Value: %s\n\n", msg->kv.value);
-    
-        if (msg->type == MSG_PUT) {
-            put(msg->kv.key, msg->kv.value);
-            //printf("PUT operation: Key: %s, Value: %s\n", msg->kv.key, msg->kv.value);
-
-            //snprintf(send_buffer, BUFFER_SIZE, "PUT %s %s", msg->kv.key, msg->kv.value);
-            strncpy(send_buffer, "PUT ", sizeof(msg->type));
-            strncat(send_buffer, msg->kv.key, sizeof(msg->kv.key));
-            strncat(send_buffer, " ", sizeof(msg->type));
-            strncat(send_buffer, msg->kv.value, sizeof(msg->kv.value));
-
-        } else if (msg->type == MSG_GET) {
-            //printf("GET operation: Key: %s, Value: dummy_value\n", msg->kv.key);
-
-            char *value = get(msg->kv.key);
-            if (value) {
-                strncpy(msg->kv.value, value, KEY_VALUE_SIZE);
-            } else {
-                strncpy(msg->kv.value, "NOT_FOUND", KEY_VALUE_SIZE);
-            }
-            
-            //snprintf(send_buffer, BUFFER_SIZE, "GET %s", msg->kv.key);
-            strncpy(send_buffer, "GET ", BUFFER_SIZE);
-            strncat(send_buffer, msg->kv.key, BUFFER_SIZE - strlen(send_buffer) - 1);
+    // 쓰기는 그 key 에 남은 lease 가 끝난 뒤에 store 에 반영한다
+    if (msg->type == MSG_PUT) {
+        lease_write_begin(&leases, msg->kv.key);
+        int ret = put(msg->kv.key, msg->kv.value, &lsn);
+        lease_write_end(&leases, msg->kv.key);
+        if (ret > 0) {
+            PERF_ADD(stats->store_inserts, 1);
+        } else if (ret < 0) {
+            strncpy(msg->kv.value, "STORE_FULL", KEY_VALUE_SIZE);
         }
+        //printf("PUT operation: Key: %s, Value: %s\n", msg->kv.key, msg->kv.value);
 
-        send_sge.addr = (uintptr_t)send_buffer;
-        send_sge.length = sizeof(struct message);
-        //send_sge.length = sizeof(uint32_t);
-        send_sge.lkey = ctx.send_mr->lkey;
+    } else if (msg->type == MSG_GET) {
+        //printf("GET operation: Key: %s, Value: dummy_value\n", msg->kv.key);
 
-        //memset(&send_wr, 0, sizeof(send_wr));
-        send_wr.opcode = IBV_WR_SEND;
-        send_wr.send_flags = IBV_SEND_SIGNALED;
-        send_wr.sg_list = &send_sge;
-        send_wr.num_sge = 1;
-        send_wr.wr_id = 1;
+        // 읽기 전에 쓰기 순번을 찍고, 찾았을 때만 lease 를 준다: 그 뒤의 쓰기는 만료까지 기다린다
+        uint32_t lease_seq = lease_read_begin(&leases, msg->kv.key);
+        int found;
 
-        send_wr.wr.rdma.rkey = ntohl(rep_pdata.buf_rkey);
-	    send_wr.wr.rdma.remote_addr = ntohll(rep_pdata.buf_va); 
+        msg->version = 0;
+        if (ref) {
+            *ref = get_ref(msg->kv.key);
+            found = *ref != NULL;
+            if (found) {
+                msg->version = (*ref)->version;  // 참조가 있는 동안 entry 는 고쳐지지 않는다
+            }
+        } else {
+            found = get(msg->kv.key, msg->kv.value, &msg->version);
+        }
+        if (found) {
+            msg->lease_us = lease_grant(&leases, msg->kv.key, msg->lease_us, lease_seq);
+        } else {
+            strncpy(msg->kv.value, "NOT_FOUND", KEY_VALUE_SIZE);
+            msg->lease_us = 0;
+        }
+    } else if (msg->type == MSG_SCAN) {
+        // 여러 응답으로 나가는 SCAN 은 process_message 가 handle_scan 으로 보낸다 (UD 는 못 한다)
+        strncpy(msg->kv.value, "UNSUPPORTED", KEY_VALUE_SIZE);
+        msg->count = 0;
+    } else if (msg->type == MSG_DELETE) {
+        lease_write_begin(&leases, msg->kv.key);
+        strncpy(msg->kv.value, del(msg->kv.key, &lsn) ? "DELETED" : "NOT_FOUND", KEY_VALUE_SIZE);
+        lease_write_end(&leases, msg->kv.key);
+    } else if (msg->type == MSG_INCR || msg->type == MSG_APPEND || msg->type == MSG_CAS) {
+        struct rmw_op op;
+
+        op.type = msg->type;
+        op.version = msg->version;
+        op.err = NULL;
+        strncpy(op.arg, msg->kv.value, KEY_VALUE_SIZE - 1);
+        op.arg[KEY_VALUE_SIZE - 1] = '\0';
+
+        lease_write_begin(&leases, msg->kv.key);
+        int ret = rmw(&op, msg->kv.key, msg->kv.value, &msg->version, &lsn);
+        lease_write_end(&leases, msg->kv.key);
+        if (ret > 0) {
+            PERF_ADD(stats->store_inserts, 1);
+        } else if (ret == STORE_RMW_REJECTED) {
+            strncpy(msg->kv.value, op.err, KEY_VALUE_SIZE);
+        } else if (ret < 0) {
+            strncpy(msg->kv.value, "STORE_FULL", KEY_VALUE_SIZE);
+        }
+    }
+    if (msg->type != MSG_GET) {
+        msg->lease_us = 0;
+    }
+    if (msg->type == MSG_PUT || msg->type == MSG_DELETE || msg->type == MSG_SCAN) {
+        msg->version = 0;
+    }
 
-        struct message *msg_in_buffer = (struct message *)send_buffer;
-        memcpy(msg_in_buffer, msg, sizeof(struct message));
+    return lsn;
+}
 
-        printf("\nsend_buffer content:\n");
-        printf("Type: %d\n", msg_in_buffer->type);
-        printf("Key: %s\n", msg_in_buffer->kv.key);
-        printf("Value: %s\n\n", msg_in_buffer->kv.value);
+// 받은 요청을 그 자리에서 응답으로 고쳐 같은 transport 로 돌려보낸다
+static void *process_message(void *arg) {
+    struct tenant_context *t = (struct tenant_context *)arg;
+    struct perf_tenant_stats *stats = t->stats;
+    struct message *msg;
+    uint64_t start_ns, lsn;
+    int type;
 
-        if (ibv_post_send(id->qp, &send_wr, &bad_send_wr)) {
-            fprintf(stderr, "Failed to post send work request: %s\n", strerror(errno));
-            exit(EXIT_FAILURE);
-        }
-   
-        wait_for_completion();
+    PERF_SET(stats->thread_id, (uint64_t)syscall(SYS_gettid));
+    PERF_SET(stats->active, 1);
 
-        printf("Send completed successfully\n\n");
+    while ((msg = t->tp->recv(t->tp_conn)) != NULL) {
+        //printf("here. \n\n");
+        start_ns = now_ns();
+        PERF_ADD(stats->bytes_in, sizeof(struct message));
 
+        // send 후에는 msg 가 transport 에 반납되므로 type 을 먼저 기억해 둔다
+        type = msg->type;
 
-        // 이벤트 채널에서 완료 큐 이벤트 기다리기
-        if (ibv_get_cq_event(ctx.comp_channel,&ctx.evt_cq,&cq_context)) {
-            perror("ibv_get_cq_event");
-            free(send_buffer);
-            ibv_dereg_mr(ctx.send_mr);
-            exit(EXIT_FAILURE);
-        }
+        if (type == MSG_SCAN) {
+            if (handle_scan(t, msg)) {
+                fprintf(stderr, "Failed to send scan chunk over %s\n", t->tp->name);
+                break;
+            }
+        } else {
+            // verbs 는 store 전체가 등록되어 있어 GET value 를 그 자리에서 보낼 수 있다
+            t->send_ref = NULL;
+            lsn = handle_message(msg, stats, t->tp == &verbs_transport ? &t->send_ref : NULL);
+            if (lsn) {
+                wal_wait(&wal, lsn);  // 같은 window 의 다른 요청과 함께 fdatasync 된다
+            }
 
-        // 완료 큐에서 이벤트를 처리
-        ibv_ack_cq_events(ctx.cq,1);
+            if (t->tp->send(t->tp_conn, msg)) {
+                fprintf(stderr, "Failed to send response over %s\n", t->tp->name);
+                break;
+            }
+        }
 
-	    if (ibv_req_notify_cq(ctx.cq,0)) {
-            free(send_buffer);
-            ibv_dereg_mr(ctx.send_mr);
-            exit(EXIT_FAILURE);
+        if ((unsigned)type < PERF_OP_MAX) {
+            PERF_ADD(stats->ops[type], 1);
+            PERF_ADD(stats->lat_hist[type][perf_lat_bucket(now_ns() - start_ns)], 1);
         }
-        
-		pre_post_recv_buffer();
+        PERF_ADD(stats->bytes_out, sizeof(struct message));
+    }
+
+    printf("Tenant %d disconnected (%s).\n", t->tenant_id, t->tp->name);
+    t->tp->close(t->tp_conn);
+    if (t->tp != &verbs_transport) {
+        release_tenant(t);  // verbs 는 cleanup() 에서 놓아준다
     }
+    return NULL;
 }
 
+/*
+ * SCAN chunk 하나: 요청의 credit 만큼 index 에서 읽어 보낸다.
+ * verbs 는 scan_buffer 에 모아 응답 SEND 앞에 RDMA WRITE 를 엮고 (SEND 가 도착하면 WRITE 도 끝나 있다),
+ * 다른 transport 는 entry 마다 MSG_SCAN_ENTRY 를 보낸다 (shm ring 이 차면 클라이언트를 기다린다)
+ */
+static int handle_scan(struct tenant_context *t, struct message *msg) {
+    struct scan_entry local[SCAN_CHUNK_MAX], *out = t->tp == &verbs_transport ? t->scan_buffer : local;
+    struct message resp, entry;
+    int n = 0, more = 0, max = msg->count < SCAN_CHUNK_MAX ? msg->count : SCAN_CHUNK_MAX;
+
+    msg->kv.key[KEY_VALUE_SIZE - 1] = '\0';
+    msg->kv.value[KEY_VALUE_SIZE - 1] = '\0';
+    LOG_DEBUG("SCAN operation: %c%s, %s), %d entries at most\n", msg->version == SCAN_AFTER ? '(' : '[',
+        msg->kv.key, msg->kv.value, max);
+
+    memset(&resp, 0, sizeof(resp));
+    resp.type = MSG_SCAN;
+    memcpy(resp.kv.key, msg->kv.key, KEY_VALUE_SIZE);
+    if (!store.index) {
+        strncpy(resp.kv.value, "UNSUPPORTED", KEY_VALUE_SIZE);
+        return t->tp->send(t->tp_conn, &resp);
+    }
 
+    n = store_scan(&store, msg->kv.key, msg->version == SCAN_AFTER, msg->kv.value, out, max, &more);
+    resp.count = n;
+    strncpy(resp.kv.value, more ? "MORE" : "END", KEY_VALUE_SIZE);
+    PERF_ADD(t->stats->bytes_out, n * sizeof(struct scan_entry));
 
-void cleanup(struct rdma_cm_id *id) {
-    if (send_buffer) {
-        assert(send_buffer != NULL); 
-        free(send_buffer);
-        send_buffer = NULL; 
+    if (t->tp == &verbs_transport) {
+        t->send_write_len = n * sizeof(struct scan_entry);
+        return t->tp->send(t->tp_conn, &resp);
     }
 
-    if (recv_buffer) {
-        assert(recv_buffer != NULL); 
-        free(recv_buffer);
-        recv_buffer = NULL; 
+    memset(&entry, 0, sizeof(entry));
+    entry.type = MSG_SCAN_ENTRY;
+    for (int i = 0; i < n; i++) {
+        memcpy(entry.kv.key, out[i].key, KEY_VALUE_SIZE);
+        memcpy(entry.kv.value, out[i].value, KEY_VALUE_SIZE);
+        if (t->tp->send(t->tp_conn, &entry)) {
+            return -1;
+        }
     }
+    return t->tp->send(t->tp_conn, &resp);
+}
 
-    if (ctx.recv_mr) {
-        assert(ctx.recv_mr != NULL); 
-        ibv_dereg_mr(ctx.recv_mr);
-        ctx.recv_mr = NULL;
+static struct message *verbs_recv(void *conn) {
+    struct tenant_context *t = (struct tenant_context *)conn;
+
+    if (t->ready_count > 0) {
+        t->recv_index = t->ready[t->ready_head];
+        t->ready_head = (t->ready_head + 1) % KVS_RECV_DEPTH;
+        t->ready_count--;
+    } else {
+        if (wait_for_completion(t)) {
+            return NULL;
+        }
+        t->recv_index = t->wc.wr_id;
     }
+    return (struct message *)(t->recv_buffer + t->recv_index * sizeof(struct message));
+}
 
-    if (ctx.send_mr) {
-        assert(ctx.send_mr != NULL); 
-        ibv_dereg_mr(ctx.send_mr);
-        ctx.send_mr = NULL; 
+// GET 응답은 [header (type + key) | store entry 의 value] 두 SGE 로 보낸다.
+// entry 는 send 가 끝날 때까지 참조를 잡고 있으므로 그 사이 PUT 은 새 entry 에 쓴다
+static int verbs_send(void *conn, const struct message *msg) {
+    struct tenant_context *t = (struct tenant_context *)conn;
+    struct message *msg_in_buffer = (struct message *)t->send_buffer;
+    struct store_entry *ref = t->send_ref;
+    struct ibv_send_wr write_wr;
+    struct ibv_sge write_sge;
+    int ret = 0;
+
+    t->send_ref = NULL;
+
+    t->send_sge[0].addr = (uintptr_t)t->send_buffer;
+    t->send_sge[0].lkey = t->ctx.send_mr->lkey;
+    if (ref) {
+        memcpy(msg_in_buffer, msg, MSG_HEADER_SIZE);
+        t->send_sge[0].length = MSG_HEADER_SIZE;
+        t->send_sge[1].addr = (uintptr_t)ref->value;
+        t->send_sge[1].length = kv_class_size(kv_class(ref->value));  // 참조 중이라 value 가 바뀌지 않는다
+        t->send_sge[1].lkey = t->store_mr->lkey;
+    } else {
+        t->send_sge[0].length = msg_copy(msg_in_buffer, msg);
+    }
+    //send_sge.length = sizeof(uint32_t);
+
+    //memset(&send_wr, 0, sizeof(send_wr));
+    t->send_wr.opcode = IBV_WR_SEND;
+    t->send_wr.send_flags = IBV_SEND_SIGNALED;
+    t->send_wr.sg_list = t->send_sge;
+    t->send_wr.num_sge = ref ? 2 : 1;
+    t->send_wr.wr_id = 1;
+
+    t->send_wr.wr.rdma.rkey = ntohl(t->rep_pdata.buf_rkey);
+    t->send_wr.wr.rdma.remote_addr = ntohll(t->rep_pdata.buf_va);
+
+    LOG_DEBUG("\nsend_buffer content:\nType: %d\nKey: %s\nValue: %s\n\n", msg_in_buffer->type, msg_in_buffer->kv.key,
+        ref ? ref->value : msg_in_buffer->kv.value);
+
+    // SCAN chunk: 완료를 받지 않는 WRITE 뒤에 SEND 를 엮는다 (WRITE 가 실패하면 SEND 가 flush 된다)
+    t->send_wr.next = NULL;
+    if (t->send_write_len) {
+        write_sge.addr = (uintptr_t)t->scan_buffer;
+        write_sge.length = t->send_write_len;
+        write_sge.lkey = t->ctx.send_mr->lkey;
+
+        memset(&write_wr, 0, sizeof(write_wr));
+        write_wr.opcode = IBV_WR_RDMA_WRITE;
+        write_wr.sg_list = &write_sge;
+        write_wr.num_sge = 1;
+        write_wr.wr.rdma.remote_addr = ntohll(t->rep_pdata.buf_va);
+        write_wr.wr.rdma.rkey = ntohl(t->rep_pdata.buf_rkey);
+        write_wr.next = &t->send_wr;
+        t->send_write_len = 0;
+
+        if (ibv_post_send(t->ctx.qp, &write_wr, &t->bad_send_wr)) {
+            fprintf(stderr, "Failed to post scan write: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    } else if (ibv_post_send(t->ctx.qp, &t->send_wr, &t->bad_send_wr)) {
+        fprintf(stderr, "Failed to post send work request: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
     }
 
-    if (ctx.qp) {
-        assert(ctx.qp != NULL); 
-        rdma_destroy_qp(id);
-        ctx.qp = NULL; 
+    // 완료 (또는 연결이 끊겨 flush) 된 뒤에야 NIC 가 entry 를 더 읽지 않는다.
+    // 그 사이 파이프라인된 다음 요청이 먼저 오면 순서대로 쌓아 둔다
+    while ((ret = wait_for_completion(t)) == 0 && (t->wc.opcode & IBV_WC_RECV)) {
+        t->ready[(t->ready_head + t->ready_count) % KVS_RECV_DEPTH] = t->wc.wr_id;
+        t->ready_count++;
+    }
+    if (ref) {
+        store_release(&store, ref);
+    }
+    if (ret) {
+        return -1;
     }
 
-    if (ctx.cq) {
-        assert(ctx.cq != NULL); 
-        ibv_destroy_cq(ctx.cq);
-        ctx.cq = NULL; 
+    LOG_DEBUG("Send completed successfully\n\n");
+
+    // 이벤트 채널에서 완료 큐 이벤트 기다리기
+    if (ibv_get_cq_event(t->ctx.comp_channel,&t->ctx.evt_cq,&t->cq_context)) {
+        perror("ibv_get_cq_event");
+        exit(EXIT_FAILURE);
     }
 
-    if (ctx.comp_channel) {
-        assert(ctx.comp_channel != NULL);
-        ibv_destroy_comp_channel(ctx.comp_channel);
-        ctx.comp_channel = NULL; 
+    // 완료 큐에서 이벤트를 처리
+    ibv_ack_cq_events(t->ctx.cq,1);
+
+    if (ibv_req_notify_cq(t->ctx.cq,0)) {
+        exit(EXIT_FAILURE);
     }
 
-    if (ctx.pd) {
-        assert(ctx.pd != NULL);
-        ibv_dealloc_pd(ctx.pd);
-        ctx.pd = NULL; 
+    return pre_post_recv_buffer(t, t->recv_index);
+}
+
+static void verbs_close(void *conn) {
+    cleanup((struct tenant_context *)conn);
+}
+
+
+
+void cleanup(struct tenant_context *t) {
+    if (!t) {
+        return;
     }
 
-    if (id) {
-        assert(id != NULL);
-        rdma_destroy_id(id);
-        id = NULL; 
+    // QP, CQ, 버퍼와 MR 은 pool 의 것이므로 돌려주기만 한다
+    if (t->slot) {
+        qp_slot_put(t->slot);
+        t->slot = NULL;
+        t->dev = NULL;
+    }
+    memset(&t->ctx, 0, sizeof(t->ctx));
+    t->store_mr = NULL;
+    t->send_buffer = NULL;
+    t->recv_buffer = NULL;
+
+    if (t->id) {
+        assert(t->id != NULL);
+        rdma_destroy_id(t->id);
+        t->id = NULL;
     }
 
-    if (ec) {
-        assert(ec != NULL); 
-        rdma_destroy_event_channel(ec);
-        ec = NULL;
+    if (t->replica) {
+        printf("Primary disconnected after %lu replicated writes.\n", (unsigned long)backup.applied_total);
+        repl_backup_detach(&backup);
+        t->replica = 0;
     }
 
+    // event channel (ec) 은 listener 것이므로 여기서 닫지 않는다
+    release_tenant(t);
     printf("here.\n");
 }
-
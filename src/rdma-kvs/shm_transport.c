@@ -0,0 +1,301 @@
+#include "transport.h"
+#include "sizeclass.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// 프로세스 간 공유 futex 이므로 FUTEX_PRIVATE_FLAG 는 쓰지 않는다.
+// SIGKILL 로 죽은 상대는 깨워 주지 않으므로 SHM_WAIT_MS 마다 돌아온다
+static void futex_wait(uint32_t *addr, uint32_t val) {
+    struct timespec timeout = { .tv_sec = 0, .tv_nsec = SHM_WAIT_MS * 1000000L };
+
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &timeout, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static void ring_reset(struct shm_ring *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->doorbell = 0;
+    ring->sleeping = 0;
+}
+
+// 상대가 잠들어 있을 때만 syscall 을 한다
+static void ring_doorbell(struct shm_ring *ring, int force) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (force || __atomic_load_n(&ring->sleeping, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&ring->doorbell, 1, __ATOMIC_RELEASE);
+        futex_wake(&ring->doorbell);
+    }
+}
+
+// 서버 쪽에서만: 슬롯을 잡은 클라이언트 프로세스가 close 없이 죽었다.
+// 부모가 아직 거두지 않은 zombie 도 kill(pid, 0) 은 성공하므로 /proc 의 상태도 본다
+static int peer_gone(struct shm_conn *c) {
+    uint32_t pid = c->slot->pid;
+    char path[32], buf[128], *p;
+    ssize_t len;
+    int fd;
+
+    if (c->rx != &c->slot->req || !pid) {
+        return 0;
+    }
+    if (kill(pid, 0) < 0) {
+        return errno == ESRCH;
+    }
+
+    snprintf(path, sizeof(path), "/proc/%u/stat", pid);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+
+    // "pid (comm) state ...": comm 에 ')' 가 들어 있을 수 있으므로 마지막 ')' 다음이 상태다
+    p = strrchr(buf, ')');
+    return p && p[1] == ' ' && (p[2] == 'Z' || p[2] == 'X');
+}
+
+static void ring_release(struct shm_conn *c) {
+    if (c->rx_pending) {
+        __atomic_store_n(&c->rx->head, c->rx->head + 1, __ATOMIC_RELEASE);
+        c->rx_pending = 0;
+    }
+}
+
+static struct message *shm_recv(void *conn) {
+    struct shm_conn *c = (struct shm_conn *)conn;
+    struct shm_ring *ring = c->rx;
+    uint32_t head, seq;
+
+    ring_release(c);
+    head = ring->head;
+
+    while (1) {
+        for (int i = 0; i < SHM_SPIN_LOOPS; i++) {
+            if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != head) {
+                c->rx_pending = 1;
+                return &ring->slots[head & (SHM_RING_SLOTS - 1)];
+            }
+            cpu_relax();
+        }
+
+        if (__atomic_load_n(&c->slot->state, __ATOMIC_ACQUIRE) != SHM_CONN_ACTIVE || peer_gone(c)) {
+            return NULL;
+        }
+
+        // doorbell 값을 먼저 읽어두면 그 사이에 온 wake 를 놓치지 않는다
+        seq = __atomic_load_n(&ring->doorbell, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&ring->sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head
+            && __atomic_load_n(&c->slot->state, __ATOMIC_ACQUIRE) == SHM_CONN_ACTIVE) {
+            futex_wait(&ring->doorbell, seq);
+        }
+        __atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+    }
+}
+
+static int shm_send(void *conn, const struct message *msg) {
+    struct shm_conn *c = (struct shm_conn *)conn;
+    struct shm_ring *ring = c->tx;
+    uint32_t tail = ring->tail;
+
+    // 요청과 응답이 1:1 이면 가득 차는 일은 없다. SCAN 의 entry 들은 클라이언트가 비울 때까지 기다린다
+    while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == SHM_RING_SLOTS) {
+        if (__atomic_load_n(&c->slot->state, __ATOMIC_ACQUIRE) != SHM_CONN_ACTIVE || peer_gone(c)) {
+            return -1;
+        }
+        sched_yield();
+    }
+
+    // 슬롯은 상대 코어로 cache line 째 넘어가므로 key/value 는 등급 크기만큼만 쓴다
+    msg_copy(&ring->slots[tail & (SHM_RING_SLOTS - 1)], msg);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    ring_doorbell(ring, 0);
+
+    // 서버는 받은 요청 슬롯을 그 자리에서 응답으로 썼으므로 복사한 뒤에 돌려준다
+    ring_release(c);
+    return 0;
+}
+
+static void shm_close(void *conn) {
+    struct shm_conn *c = (struct shm_conn *)conn;
+    struct shm_conn_slot *slot = c->slot;
+
+    if (!slot) {
+        return;
+    }
+
+    if (c->rx == &slot->req) {
+        // 서버: 다음 클라이언트를 위해 ring 을 비우고 슬롯을 놓아준다
+        ring_reset(&slot->req);
+        ring_reset(&slot->resp);
+        slot->pid = 0;
+        __atomic_store_n(&slot->state, SHM_CONN_FREE, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&slot->state, SHM_CONN_CLOSED, __ATOMIC_RELEASE);
+        ring_doorbell(&slot->req, 1);
+        munmap(c->region, sizeof(struct shm_transport_region));
+    }
+
+    c->slot = NULL;
+}
+
+const struct kvs_transport shm_transport = {
+    .name = "shm",
+    .recv = shm_recv,
+    .send = shm_send,
+    .close = shm_close,
+};
+
+struct shm_transport_region *shm_transport_create(void) {
+    struct shm_transport_region *region;
+    int fd;
+
+    fd = shm_open(SHM_TRANSPORT_NAME, O_CREAT | O_RDWR, 0666);
+    if (fd == -1) {
+        perror("shm_open " SHM_TRANSPORT_NAME);
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(struct shm_transport_region)) < 0) {
+        perror("ftruncate " SHM_TRANSPORT_NAME);
+        close(fd);
+        return NULL;
+    }
+
+    region = mmap(NULL, sizeof(struct shm_transport_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        perror("mmap " SHM_TRANSPORT_NAME);
+        return NULL;
+    }
+
+    // 이전 서버가 남긴 슬롯은 모두 버린다. magic 은 마지막에 기록
+    memset(region, 0, sizeof(*region));
+    region->version = SHM_TRANSPORT_VERSION;
+    __atomic_store_n(&region->magic, SHM_TRANSPORT_MAGIC, __ATOMIC_RELEASE);
+
+    return region;
+}
+
+// CLAIMED 슬롯이 생길 때까지 기다린다
+int shm_transport_accept(struct shm_transport_region *region, struct shm_conn *conn) {
+    uint32_t seq;
+
+    while (1) {
+        seq = __atomic_load_n(&region->connect_seq, __ATOMIC_ACQUIRE);
+
+        for (int i = 0; i < SHM_MAX_CONN; i++) {
+            struct shm_conn_slot *slot = &region->conn[i];
+
+            if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == SHM_CONN_CLAIMED) {
+                memset(conn, 0, sizeof(*conn));
+                conn->region = region;
+                conn->slot = slot;
+                conn->rx = &slot->req;
+                conn->tx = &slot->resp;
+                return i;
+            }
+        }
+
+        futex_wait(&region->connect_seq, seq);
+    }
+}
+
+void shm_transport_ready(struct shm_conn *conn) {
+    __atomic_store_n(&conn->slot->state, SHM_CONN_ACTIVE, __ATOMIC_RELEASE);
+    futex_wake(&conn->slot->state);
+}
+
+void shm_transport_reject(struct shm_conn *conn) {
+    __atomic_store_n(&conn->slot->state, SHM_CONN_REJECTED, __ATOMIC_RELEASE);
+    futex_wake(&conn->slot->state);
+    conn->slot = NULL;
+}
+
+int shm_transport_connect(struct shm_conn *conn) {
+    struct shm_transport_region *region;
+    uint32_t state;
+    int fd;
+
+    memset(conn, 0, sizeof(*conn));
+
+    fd = shm_open(SHM_TRANSPORT_NAME, O_RDWR, 0);
+    if (fd == -1) {
+        perror("shm_open " SHM_TRANSPORT_NAME " (is the server running?)");
+        return -1;
+    }
+
+    region = mmap(NULL, sizeof(struct shm_transport_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        perror("mmap " SHM_TRANSPORT_NAME);
+        return -1;
+    }
+
+    if (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != SHM_TRANSPORT_MAGIC
+        || region->version != SHM_TRANSPORT_VERSION) {
+        fprintf(stderr, SHM_TRANSPORT_NAME " is not a version %d transport region\n", SHM_TRANSPORT_VERSION);
+        munmap(region, sizeof(*region));
+        return -1;
+    }
+
+    for (int i = 0; i < SHM_MAX_CONN; i++) {
+        struct shm_conn_slot *slot = &region->conn[i];
+        uint32_t expected = SHM_CONN_FREE;
+
+        if (!__atomic_compare_exchange_n(&slot->state, &expected, SHM_CONN_CLAIMED, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        slot->pid = getpid();
+        __atomic_fetch_add(&region->connect_seq, 1, __ATOMIC_RELEASE);
+        futex_wake(&region->connect_seq);
+
+        while ((state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)) == SHM_CONN_CLAIMED) {
+            futex_wait(&slot->state, SHM_CONN_CLAIMED);
+        }
+
+        if (state != SHM_CONN_ACTIVE) {
+            fprintf(stderr, "Server rejected the local connection.\n");
+            __atomic_store_n(&slot->state, SHM_CONN_FREE, __ATOMIC_RELEASE);
+            munmap(region, sizeof(*region));
+            return -1;
+        }
+
+        conn->region = region;
+        conn->slot = slot;
+        conn->rx = &slot->resp;
+        conn->tx = &slot->req;
+        return 0;
+    }
+
+    fprintf(stderr, "No free local connection slot.\n");
+    munmap(region, sizeof(*region));
+    return -1;
+}
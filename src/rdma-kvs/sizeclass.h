@@ -0,0 +1,75 @@
+#ifndef SIZECLASS_H
+#define SIZECLASS_H
+
+#include "common.h"
+
+/*
+ * key/value 크기 등급.
+ * message 와 store entry 의 key/value 자리는 KEY_VALUE_SIZE 로 고정이지만 실제 문자열은 대개 훨씬 짧다.
+ * 그래서 복사와 전송은 NUL 까지 들어가는 가장 작은 등급의 크기만큼만 한다.
+ * 등급 크기는 컴파일 때 정해진 상수라 등급마다 memcpy 가 고정 길이로 펼쳐진다 (32 바이트면 load/store 몇 개).
+ * 런타임에는 문자열 길이로 등급을 고르고 switch 로 그 등급의 복사로 간다.
+ *
+ * 자리 (offset) 는 그대로라 받는 쪽은 바뀌지 않는다. 다만 등급 뒤의 바이트에는 이전 내용이 남아 있을 수 있으므로
+ * key/value 는 NUL 까지만 읽는다.
+ *
+ * 줄어드는 것은 복사하고 보내는 바이트 수뿐이다. struct message, struct kv_pair, store entry,
+ * send/recv 버퍼와 shm ring slot 은 모두 그대로 KEY_VALUE_SIZE 자리를 잡으므로 메모리는 줄지 않는다.
+ * 이 header 는 C 파일들 (server, client, store, shm_transport, kvs_client) 이 쓰므로 template 대신 X-macro 로 펼친다.
+ */
+#define KV_CLASS_LIST(X) \
+    X(0, 32)             \
+    X(1, 64)             \
+    X(2, 128)            \
+    X(3, KEY_VALUE_SIZE)
+#define KV_CLASS_NUM 4
+
+#ifdef __cplusplus
+static_assert(KEY_VALUE_SIZE > 128, "the last size class must be the largest");
+#else
+_Static_assert(KEY_VALUE_SIZE > 128, "the last size class must be the largest");
+#endif
+
+// str (NUL 포함) 이 들어가는 가장 작은 등급. NUL 이 없으면 가장 큰 등급
+static inline int kv_class(const char *str) {
+    size_t len = strnlen(str, KEY_VALUE_SIZE) + 1;
+
+#define X(cls, size) if (len <= (size)) return cls;
+    KV_CLASS_LIST(X)
+#undef X
+    return KV_CLASS_NUM - 1;
+}
+
+static inline size_t kv_class_size(int cls) {
+    switch (cls) {
+#define X(c, size) case c: return size;
+    KV_CLASS_LIST(X)
+#undef X
+    }
+    return KEY_VALUE_SIZE;
+}
+
+static inline void kv_copy(char *dst, const char *src, int cls) {
+    switch (cls) {
+#define X(c, size) case c: memcpy(dst, src, size); break;
+    KV_CLASS_LIST(X)
+#undef X
+    }
+}
+
+// msg 를 보낼 길이: header 와 key 자리 전체, value 는 등급 크기까지
+static inline size_t msg_wire_size(const struct message *msg) {
+    return MSG_HEADER_SIZE + kv_class_size(kv_class(msg->kv.value));
+}
+
+// header 와 key/value 를 등급 크기만큼만 dst 로 복사하고 보낼 길이를 돌려준다
+static inline size_t msg_copy(struct message *dst, const struct message *src) {
+    int value_class = kv_class(src->kv.value);
+
+    memcpy(dst, src, offsetof(struct message, kv.key));
+    kv_copy(dst->kv.key, src->kv.key, kv_class(src->kv.key));
+    kv_copy(dst->kv.value, src->kv.value, value_class);
+    return MSG_HEADER_SIZE + kv_class_size(value_class);
+}
+
+#endif // SIZECLASS_H
@@ -0,0 +1,114 @@
+#include "skiplist.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static struct skiplist_node *node_alloc(int level) {
+    return calloc(1, sizeof(struct skiplist_node) + level * sizeof(struct skiplist_node *));
+}
+
+static int random_level(struct skiplist *l) {
+    int level = 1;
+
+    l->seed ^= l->seed << 13;
+    l->seed ^= l->seed >> 17;
+    l->seed ^= l->seed << 5;
+    for (uint32_t r = l->seed; (r & 3) == 0 && level < SKIPLIST_MAX_LEVEL; r >>= 2) {
+        level++;
+    }
+    return level;
+}
+
+int skiplist_init(struct skiplist *l) {
+    memset(l, 0, sizeof(*l));
+    l->head = node_alloc(SKIPLIST_MAX_LEVEL);
+    if (!l->head) {
+        return -1;
+    }
+    l->head->level = SKIPLIST_MAX_LEVEL;
+    l->level = 1;
+    l->seed = 2463534242u;
+    return 0;
+}
+
+void skiplist_destroy(struct skiplist *l) {
+    struct skiplist_node *node = l->head, *next;
+
+    while (node) {
+        next = node->next[0];
+        free(node);
+        node = next;
+    }
+    l->head = NULL;
+}
+
+// 각 level 에서 key 보다 작은 마지막 node 를 update 에 채우고 level 0 의 다음 node 를 돌려준다
+static struct skiplist_node *find(struct skiplist *l, const char *key, struct skiplist_node **update) {
+    struct skiplist_node *x = l->head;
+
+    for (int i = l->level - 1; i >= 0; i--) {
+        while (x->next[i] && strcmp(x->next[i]->key, key) < 0) {
+            x = x->next[i];
+        }
+        if (update) {
+            update[i] = x;
+        }
+    }
+    return x->next[0];
+}
+
+int skiplist_put(struct skiplist *l, const char *key, uint64_t off) {
+    struct skiplist_node *update[SKIPLIST_MAX_LEVEL], *x;
+    int level;
+
+    x = find(l, key, update);
+    if (x && strcmp(x->key, key) == 0) {
+        x->key = key;
+        x->off = off;
+        return 0;
+    }
+
+    level = random_level(l);
+    if (level > l->level) {
+        for (int i = l->level; i < level; i++) {
+            update[i] = l->head;
+        }
+        l->level = level;
+    }
+
+    x = node_alloc(level);
+    if (!x) {
+        return -1;
+    }
+    x->key = key;
+    x->off = off;
+    x->level = level;
+    for (int i = 0; i < level; i++) {
+        x->next[i] = update[i]->next[i];
+        update[i]->next[i] = x;
+    }
+    l->size++;
+    return 1;
+}
+
+int skiplist_delete(struct skiplist *l, const char *key) {
+    struct skiplist_node *update[SKIPLIST_MAX_LEVEL], *x;
+
+    x = find(l, key, update);
+    if (!x || strcmp(x->key, key) != 0) {
+        return 0;
+    }
+    for (int i = 0; i < x->level; i++) {
+        update[i]->next[i] = x->next[i];
+    }
+    while (l->level > 1 && !l->head->next[l->level - 1]) {
+        l->level--;
+    }
+    free(x);
+    l->size--;
+    return 1;
+}
+
+struct skiplist_node *skiplist_seek(struct skiplist *l, const char *key) {
+    return find(l, key, NULL);
+}
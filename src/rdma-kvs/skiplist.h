@@ -0,0 +1,39 @@
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <stdint.h>
+
+/*
+ * store 의 순서 index (-O). key 순서의 skiplist 로 node 는 store entry 의 offset 과
+ * entry 안의 key 를 가리킨다 (key 를 복사하지 않는다). 메모리에만 있고 store 를 열 때 만든다.
+ * store lock 안에서만 쓰므로 따로 동기화하지 않는다.
+ * level 은 1/4 확률로 올라가서 node 당 평균 next 포인터가 1.33 개다.
+ */
+#define SKIPLIST_MAX_LEVEL 16
+
+struct skiplist_node {
+    const char *key;                 // store entry 의 key
+    uint64_t off;
+    int level;
+    struct skiplist_node *next[];
+};
+
+struct skiplist {
+    struct skiplist_node *head;
+    int level;
+    uint64_t size;
+    uint32_t seed;
+};
+
+int skiplist_init(struct skiplist *l);
+void skiplist_destroy(struct skiplist *l);
+
+// 새로 넣었으면 1, 있던 key 의 entry 를 바꿨으면 0, 메모리가 없으면 -1
+int skiplist_put(struct skiplist *l, const char *key, uint64_t off);
+// 지웠으면 1
+int skiplist_delete(struct skiplist *l, const char *key);
+
+// key 보다 크거나 같은 첫 node, 없으면 NULL. 다음은 node->next[0]
+struct skiplist_node *skiplist_seek(struct skiplist *l, const char *key);
+
+#endif // SKIPLIST_H
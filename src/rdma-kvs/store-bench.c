@@ -0,0 +1,151 @@
+//./store-bench
+//./store-bench -n 100000 -t 16 -w 5
+
+/*
+ * store 를 여러 스레드가 같이 쓸 때의 처리량을 잰다 (네트워크 없이 store_get/store_put 만).
+ * key 를 미리 넣은 뒤 스레드 수를 1, 2, 4, ... 로 늘려가며 -d 초씩 돌린다.
+ * -w 는 PUT 비율 (%), 나머지는 GET. key 는 모든 스레드가 같은 범위에서 고른다 (분할하지 않는다).
+ */
+
+#include "store.h"
+
+#include <time.h>
+#include <unistd.h>
+
+static struct store store;
+static int key_num = 100000, write_pct = 0;
+static volatile int running;
+
+struct bench_thread {
+    pthread_t thread;
+    uint64_t ops;
+    uint32_t seed;
+} __attribute__((aligned(64)));
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t next_rand(uint32_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static void *bench_thread(void *arg) {
+    struct bench_thread *b = (struct bench_thread *)arg;
+    char key[KEY_VALUE_SIZE], value[KEY_VALUE_SIZE];
+    uint32_t r;
+    uint64_t ops = 0;
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        r = next_rand(&b->seed);
+        snprintf(key, sizeof(key), "key%u", r % key_num);
+        // 종류는 따로 뽑는다: key 와 엮이지 않고, 32 bit 를 100 으로 나누면 치우침이 거의 없다
+        if ((int)(next_rand(&b->seed) % 100) < write_pct) {
+            snprintf(value, sizeof(value), "value%u", r);
+            store_put(&store, key, value);
+        } else if (!store_get(&store, key, value, NULL)) {
+            fprintf(stderr, "GET %s: not found\n", key);
+            exit(EXIT_FAILURE);
+        }
+        ops++;
+    }
+    b->ops = ops;
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    const char *path = "/dev/shm/kvs-store-bench";
+    int opt, max_threads = sysconf(_SC_NPROCESSORS_ONLN), seconds = 1;
+    uint32_t buckets = 1 << 16;
+    struct bench_thread *threads;
+    char key[KEY_VALUE_SIZE], value[KEY_VALUE_SIZE];
+    uint64_t start, total;
+    double base = 0, mops;
+
+    // -f: store 파일 (매번 새로 만들고 끝나면 지운다), -B: bucket 수
+    while ((opt = getopt(argc, argv, "f:n:t:d:w:B:")) != -1) {
+        switch (opt) {
+        case 'f':
+            path = optarg;
+            break;
+        case 'n':
+            key_num = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+        case 'w':
+            write_pct = atoi(optarg);
+            break;
+        case 'B':
+            buckets = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-f store-file] [-n keys] [-t max-threads] [-d seconds] [-w put-percent]"
+                " [-B buckets]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (key_num < 1 || max_threads < 1 || buckets < 1) {
+        fprintf(stderr, "keys, threads and buckets must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    unlink(path);
+    if (store_open(&store, path, STORE_DEFAULT_SIZE, buckets) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < key_num; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(value, sizeof(value), "value%d", i);
+        if (store_put(&store, key, value) < 0) {
+            fprintf(stderr, "Store is full after %d keys\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("%d keys, %u buckets, %d%% PUT\n", key_num, buckets, write_pct);
+
+    threads = calloc(max_threads, sizeof(struct bench_thread));
+    if (!threads) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int n = 1; n <= max_threads; n = n * 2 > max_threads && n != max_threads ? max_threads : n * 2) {
+        running = 1;
+        for (int i = 0; i < n; i++) {
+            threads[i].seed = 2463534242u + i * 7919;
+            if (pthread_create(&threads[i].thread, NULL, bench_thread, &threads[i]) != 0) {
+                perror("pthread_create");
+                exit(EXIT_FAILURE);
+            }
+        }
+        start = now_ns();
+        sleep(seconds);
+        __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+
+        total = 0;
+        for (int i = 0; i < n; i++) {
+            pthread_join(threads[i].thread, NULL);
+            total += threads[i].ops;
+        }
+        mops = total / ((now_ns() - start) / 1e3);
+        if (n == 1) {
+            base = mops;
+        }
+        printf("%3d threads: %8.2f Mops/s (x%.2f)\n", n, mops, mops / base);
+    }
+
+    store_close(&store);
+    unlink(path);
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,678 @@
+#include "store.h"
+#include "hugemem.h"
+#include "sizeclass.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static unsigned int store_hash(const char *key) {
+    unsigned int hash = 0;
+    while (*key) {
+        hash = (hash << 5) + *key++;
+    }
+    return hash;
+}
+
+static void store_format(struct store *s, uint64_t size, uint32_t buckets) {
+    struct store_header *hdr = s->hdr;
+    uint64_t bucket_bytes = (uint64_t)buckets * sizeof(uint64_t);
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->version = STORE_VERSION;
+    hdr->size = size;
+    hdr->buckets = buckets;
+    hdr->entry_size = sizeof(struct store_entry);
+    hdr->bucket_off = (sizeof(*hdr) + 63) & ~63ull;
+    hdr->arena_off = (hdr->bucket_off + bucket_bytes + 63) & ~63ull;
+    hdr->arena_used = hdr->arena_off;
+
+    memset(s->base + hdr->bucket_off, 0, bucket_bytes);
+
+    // 헤더가 다 채워진 뒤에 magic 을 써야 중간에 죽어도 반쯤 만든 파일을 열지 않는다
+    __atomic_store_n(&hdr->magic, STORE_MAGIC, __ATOMIC_RELEASE);
+    msync(s->base, hdr->arena_off, MS_SYNC);
+}
+
+// 스레드가 끝나면 pthread key 의 destructor 로 자리를 돌려준다
+static void store_reader_exit(void *arg) {
+    struct store_reader *r = (struct store_reader *)arg;
+
+    __atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+int store_open(struct store *s, const char *path, uint64_t size, uint32_t buckets) {
+    struct stat st;
+    int recovered;
+
+    memset(s, 0, sizeof(*s));
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_mutex_init(&s->hot_lock, NULL);
+    pthread_key_create(&s->reader_key, store_reader_exit);
+    s->epoch = 1;
+
+    s->fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (s->fd < 0) {
+        perror("open store");
+        return -1;
+    }
+
+    if (fstat(s->fd, &st) < 0) {
+        perror("fstat store");
+        close(s->fd);
+        return -1;
+    }
+
+    // hugetlbfs (/dev/hugepages) 위의 파일은 크기가 hugepage 의 배수여야 한다
+    size = (size + HUGEMEM_2M - 1) & ~(HUGEMEM_2M - 1);
+
+    recovered = st.st_size > 0;
+    if (recovered) {
+        size = st.st_size;  // 기존 파일은 만들 때의 크기를 따른다
+    } else if (ftruncate(s->fd, size) < 0) {
+        perror("ftruncate store");
+        close(s->fd);
+        return -1;
+    }
+
+    s->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, s->fd, 0);
+    if (s->base == MAP_FAILED) {
+        perror("mmap store");
+        close(s->fd);
+        return -1;
+    }
+    s->hdr = (struct store_header *)s->base;
+
+    // tmpfs (/dev/shm) 는 huge=advise 면 여기서 2 MB page 로 바뀐다. hugetlbfs 는 이미 hugepage
+    madvise(s->base, size, MADV_HUGEPAGE);
+
+    if (!recovered) {
+        store_format(s, size, buckets);
+    } else if (__atomic_load_n(&s->hdr->magic, __ATOMIC_ACQUIRE) != STORE_MAGIC
+        || s->hdr->version != STORE_VERSION
+        || s->hdr->entry_size != sizeof(struct store_entry)
+        || s->hdr->size != size) {
+        fprintf(stderr, "%s: not a compatible version %d store, remove it to start empty\n", path, STORE_VERSION);
+        store_close(s);
+        return -1;
+    }
+
+    s->bucket = (uint64_t *)(s->base + s->hdr->bucket_off);
+
+    if (posix_memalign((void **)&s->stripe, 64, s->hdr->buckets * sizeof(struct store_stripe)) != 0) {
+        perror("Failed to allocate store bucket locks");
+        store_close(s);
+        return -1;
+    }
+    for (uint32_t i = 0; i < s->hdr->buckets; i++) {
+        pthread_mutex_init(&s->stripe[i].lock, NULL);
+        s->stripe[i].seq = 0;
+    }
+
+    // 죽기 전에 보내던 참조는 남아 있을 이유가 없다. 그때 retired 였던 entry 는 샌다
+    if (recovered) {
+        for (uint32_t i = 0; i < s->hdr->buckets; i++) {
+            for (struct store_entry *e = store_ptr(s, s->bucket[i]); e != NULL; e = store_ptr(s, e->next)) {
+                e->refs = 0;
+                e->retired = 0;
+            }
+        }
+    }
+    return recovered;
+}
+
+void store_close(struct store *s) {
+    if (s->base && s->base != MAP_FAILED) {
+        munmap(s->base, s->hdr->size);
+    }
+    if (s->fd >= 0) {
+        close(s->fd);
+    }
+    if (s->index) {
+        skiplist_destroy(s->index);
+        free(s->index);
+        s->index = NULL;
+    }
+    free(s->stripe);
+    free(s->limbo);
+    s->stripe = NULL;
+    s->limbo = NULL;
+    s->base = NULL;
+    s->hdr = NULL;
+    s->fd = -1;
+}
+
+// seqlock: reader 는 짝수 seq 를 읽고 복사한 뒤 그대로인지 본다
+static uint32_t seq_read_begin(const uint32_t *seq) {
+    uint32_t v;
+
+    while ((v = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+        cpu_relax();
+    }
+    return v;
+}
+
+static int seq_read_retry(const uint32_t *seq, uint32_t v) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != v;
+}
+
+// writer 는 lock 안에서만 부른다. begin 뒤의 refs 읽기가 reader 의 refs++ 와 엇갈리지 않도록 full fence
+static void seq_write_begin(uint32_t *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void seq_write_end(uint32_t *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+// 이 스레드의 reader 자리. 처음 부르면 빈 자리를 잡는다
+static struct store_reader *store_reader(struct store *s) {
+    struct store_reader *r = pthread_getspecific(s->reader_key);
+
+    if (r) {
+        return r;
+    }
+    for (int i = 0; i < STORE_MAX_READERS; i++) {
+        if (__atomic_exchange_n(&s->readers[i].in_use, 1, __ATOMIC_ACQ_REL) == 0) {
+            r = &s->readers[i];
+            pthread_setspecific(s->reader_key, r);
+            return r;
+        }
+    }
+    fprintf(stderr, "Too many threads using the store (max %d)\n", STORE_MAX_READERS);
+    exit(EXIT_FAILURE);
+}
+
+// 이 뒤로 읽는 entry 는 epoch_exit 전까지 재사용되지 않는다
+static struct store_reader *store_epoch_enter(struct store *s) {
+    struct store_reader *r = store_reader(s);
+
+    __atomic_store_n(&r->epoch, __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return r;
+}
+
+static void store_epoch_exit(struct store_reader *r) {
+    __atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+// key 를 가리키는 link (bucket 또는 앞 entry 의 next). 없으면 NULL
+// writer 는 bucket lock 안에서, reader 는 epoch 안에서 부른다
+static uint64_t *store_find(struct store *s, const char *key, unsigned int index) {
+    uint64_t *link = &s->bucket[index];
+    struct store_entry *entry;
+
+    while ((entry = store_ptr(s, __atomic_load_n(link, __ATOMIC_ACQUIRE))) != NULL) {
+        if (strncmp(entry->key, key, KEY_VALUE_SIZE) == 0) {
+            return link;
+        }
+        link = &entry->next;
+    }
+    return NULL;
+}
+
+// bucket lock 안에서 부른다. index 를 쓰면 key 의 entry 가 off 로 바뀐 것을 알린다 (0 이면 지웠다)
+static void store_index_update(struct store *s, const char *key, uint64_t off) {
+    int ret;
+
+    if (!s->index) {
+        return;
+    }
+    pthread_mutex_lock(&s->lock);
+    if (off) {
+        ret = skiplist_put(s->index, ((struct store_entry *)store_ptr(s, off))->key, off);
+    } else {
+        ret = skiplist_delete(s->index, key);
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (ret < 0) {
+        perror("Failed to update store index");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// pin 된 key 면 hot table 의 자리, 아니면 -1. lock 없이 hot_seq 로 확인한다
+static int store_hot_find(struct store *s, const char *key, unsigned int hash) {
+    uint32_t v, n;
+    int found;
+
+    do {
+        v = seq_read_begin(&s->hot_seq);
+        found = -1;
+        n = __atomic_load_n(&s->hot_num, __ATOMIC_RELAXED);
+        for (uint32_t i = 0; i < n && i < STORE_HOT_MAX; i++) {
+            if (s->hot_hash[i] == hash && strncmp(s->hot_key[i], key, KEY_VALUE_SIZE) == 0) {
+                found = i;
+                break;
+            }
+        }
+    } while (seq_read_retry(&s->hot_seq, v));
+    return found;
+}
+
+// bucket lock 안에서 (seq 가 홀수일 때) 부른다. pin 된 key 의 entry 가 바뀌었으면 따라간다.
+// 같은 bucket 의 key 는 다른 스레드가 새로 pin 할 수 없으므로 찾은 자리만 lock 안에서 다시 본다
+static void store_hot_update(struct store *s, const char *key, unsigned int hash, uint64_t off) {
+    int i = store_hot_find(s, key, hash);
+
+    if (i < 0) {
+        return;
+    }
+    pthread_mutex_lock(&s->hot_lock);
+    if ((uint32_t)i < s->hot_num && s->hot_hash[i] == hash && strncmp(s->hot_key[i], key, KEY_VALUE_SIZE) == 0) {
+        __atomic_store_n(&s->hot_off[i], off, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&s->hot_lock);
+}
+
+// hot table, 없으면 chain. reader 는 bucket seq 로 결과를 확인한다
+static struct store_entry *store_lookup(struct store *s, const char *key, unsigned int hash, struct store_reader *r) {
+    uint64_t *link, off;
+    int i = store_hot_find(s, key, hash);
+
+    if (i >= 0 && (off = __atomic_load_n(&s->hot_off[i], __ATOMIC_ACQUIRE)) != 0) {
+        __atomic_store_n(&r->hot_hits, r->hot_hits + 1, __ATOMIC_RELAXED);
+        return store_ptr(s, off);
+    }
+    link = store_find(s, key, hash % s->hdr->buckets);
+    return link ? store_ptr(s, __atomic_load_n(link, __ATOMIC_ACQUIRE)) : NULL;
+}
+
+// store lock 안에서 부른다. epoch 를 올리고, 지금 읽는 reader 중 가장 오래된 epoch 보다
+// 먼저 빠진 limbo entry 를 free list 로 돌린다
+static void store_reclaim(struct store *s) {
+    uint64_t min = __atomic_add_fetch(&s->epoch, 1, __ATOMIC_SEQ_CST), e;
+    uint32_t kept = 0;
+    struct store_entry *entry;
+
+    for (int i = 0; i < STORE_MAX_READERS; i++) {
+        e = __atomic_load_n(&s->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (e && e < min) {
+            min = e;
+        }
+    }
+
+    for (uint32_t i = 0; i < s->limbo_num; i++) {
+        if (s->limbo[i].epoch < min) {
+            entry = store_ptr(s, s->limbo[i].off);
+            entry->retired = 0;
+            entry->next = s->free_head;
+            s->free_head = s->limbo[i].off;
+        } else {
+            s->limbo[kept++] = s->limbo[i];
+        }
+    }
+    s->limbo_num = kept;
+}
+
+// free list 에서 먼저 꺼내고 없으면 arena 끝에서 자른다. 가득 찼으면 0
+static uint64_t store_alloc(struct store *s) {
+    uint64_t off;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->limbo_num >= STORE_LIMBO_BATCH || (!s->free_head && s->limbo_num)) {
+        store_reclaim(s);
+    }
+
+    off = s->free_head;
+    if (off) {
+        s->free_head = ((struct store_entry *)store_ptr(s, off))->next;
+    } else {
+        off = s->hdr->arena_used;
+        if (off + sizeof(struct store_entry) > s->hdr->size) {
+            off = 0;
+        } else {
+            s->hdr->arena_used = off + sizeof(struct store_entry);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return off;
+}
+
+// retired 를 1 -> 2 로 바꾼 쪽 (writer 또는 마지막 release) 만 limbo 에 넣는다
+static void store_limbo_push(struct store *s, struct store_entry *entry) {
+    uint32_t expected = 1;
+
+    if (!__atomic_compare_exchange_n(&entry->retired, &expected, 2, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    if (s->limbo_num == s->limbo_cap) {
+        s->limbo_cap = s->limbo_cap ? s->limbo_cap * 2 : STORE_LIMBO_BATCH * 2;
+        s->limbo = realloc(s->limbo, s->limbo_cap * sizeof(struct store_limbo));
+        if (!s->limbo) {
+            perror("Failed to grow store limbo list");
+            exit(EXIT_FAILURE);
+        }
+    }
+    s->limbo[s->limbo_num].off = (char *)entry - s->base;
+    s->limbo[s->limbo_num].epoch = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+    s->limbo_num++;
+    pthread_mutex_unlock(&s->lock);
+}
+
+// chain 에서 빠진 entry: 보내는 중이 아니면 바로, 아니면 마지막 release 때 limbo 로 보낸다
+static void store_retire(struct store *s, struct store_entry *entry) {
+    __atomic_store_n(&entry->retired, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&entry->refs, __ATOMIC_SEQ_CST) == 0) {
+        store_limbo_push(s, entry);
+    }
+}
+
+// bucket lock 안에서 부른다. link 는 store_find 의 결과 (새 key 면 NULL). 쓴 entry 의 version 을 돌려준다
+static int store_write_locked(struct store *s, unsigned int hash, uint64_t *link, const char *key, const char *value,
+    uint64_t *version) {
+    unsigned int index = hash % s->hdr->buckets;
+    struct store_stripe *stripe = &s->stripe[index];
+    struct store_entry *entry, *old = NULL;
+    uint64_t off;
+
+    if (link) {
+        old = store_ptr(s, *link);
+        seq_write_begin(&stripe->seq);
+        if (__atomic_load_n(&old->refs, __ATOMIC_SEQ_CST) == 0) {
+            strncpy(old->value, value, KEY_VALUE_SIZE);
+            *version = ++old->version;
+            seq_write_end(&stripe->seq);
+            return 0;
+        }
+        seq_write_end(&stripe->seq);
+    }
+
+    // 새 key 이거나, 이전 value 를 NIC 가 아직 읽고 있다
+    off = store_alloc(s);
+    if (!off) {
+        return -1;
+    }
+
+    // entry 를 다 채운 뒤 chain 에 연결한다: 도중에 죽으면 공간만 새고 index 는 온전하다
+    entry = store_ptr(s, off);
+    strncpy(entry->key, key, KEY_VALUE_SIZE);
+    strncpy(entry->value, value, KEY_VALUE_SIZE);
+    entry->refs = 0;
+    entry->retired = 0;
+    entry->version = old ? old->version + 1 : 1;
+    *version = entry->version;
+
+    seq_write_begin(&stripe->seq);
+    if (old) {
+        entry->next = old->next;
+        __atomic_store_n(link, off, __ATOMIC_RELEASE);
+    } else {
+        entry->next = s->bucket[index];
+        __atomic_store_n(&s->bucket[index], off, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&s->hdr->entries, 1, __ATOMIC_RELAXED);
+    }
+    store_hot_update(s, key, hash, off);
+    seq_write_end(&stripe->seq);
+
+    // index 가 새 entry 를 가리킨 뒤에 예전 entry 를 내보낸다 (node 의 key 가 그 entry 안에 있다)
+    store_index_update(s, key, off);
+    if (old) {
+        store_retire(s, old);
+    }
+    return old ? 0 : 1;
+}
+
+int store_put(struct store *s, const char *key, const char *value) {
+    unsigned int hash = store_hash(key);
+    struct store_stripe *stripe = &s->stripe[hash % s->hdr->buckets];
+    uint64_t version;
+    int ret;
+
+    pthread_mutex_lock(&stripe->lock);
+    ret = store_write_locked(s, hash, store_find(s, key, hash % s->hdr->buckets), key, value, &version);
+    pthread_mutex_unlock(&stripe->lock);
+    return ret;
+}
+
+// bucket lock 을 잡고 있으니 chain 을 seq 없이 읽어도 된다
+int store_rmw(struct store *s, const char *key, store_rmw_fn fn, void *arg, char *value, uint64_t *version) {
+    unsigned int hash = store_hash(key);
+    struct store_stripe *stripe = &s->stripe[hash % s->hdr->buckets];
+    struct store_entry *entry;
+    char out[KEY_VALUE_SIZE];
+    uint64_t *link;
+    int ret;
+
+    pthread_mutex_lock(&stripe->lock);
+    link = store_find(s, key, hash % s->hdr->buckets);
+    entry = link ? store_ptr(s, *link) : NULL;
+
+    memset(out, 0, sizeof(out));
+    if (fn(arg, entry ? entry->value : NULL, entry ? entry->version : 0, out) != 0) {
+        strncpy(value, entry ? entry->value : "", KEY_VALUE_SIZE);
+        *version = entry ? entry->version : 0;
+        pthread_mutex_unlock(&stripe->lock);
+        return STORE_RMW_REJECTED;
+    }
+
+    ret = store_write_locked(s, hash, link, key, out, version);
+    pthread_mutex_unlock(&stripe->lock);
+    if (ret >= 0) {
+        memcpy(value, out, KEY_VALUE_SIZE);
+    }
+    return ret;
+}
+
+int store_get(struct store *s, const char *key, char *out, uint64_t *version) {
+    unsigned int hash = store_hash(key);
+    struct store_stripe *stripe = &s->stripe[hash % s->hdr->buckets];
+    struct store_reader *r = store_epoch_enter(s);
+    struct store_entry *entry;
+    uint32_t v;
+
+    do {
+        v = seq_read_begin(&stripe->seq);
+        entry = store_lookup(s, key, hash, r);
+        if (entry) {
+            // 도중에 바뀐 value 면 등급이 틀렸을 수 있지만 seq 가 달라져 다시 읽는다
+            kv_copy(out, entry->value, kv_class(entry->value));
+            if (version) {
+                *version = entry->version;
+            }
+        }
+    } while (seq_read_retry(&stripe->seq, v));
+
+    store_epoch_exit(r);
+    return entry != NULL;
+}
+
+void store_foreach(struct store *s, void (*fn)(void *arg, const char *key, const char *value), void *arg) {
+    for (uint32_t i = 0; i < s->hdr->buckets; i++) {
+        pthread_mutex_lock(&s->stripe[i].lock);
+        for (struct store_entry *e = store_ptr(s, s->bucket[i]); e != NULL; e = store_ptr(s, e->next)) {
+            fn(arg, e->key, e->value);
+        }
+        pthread_mutex_unlock(&s->stripe[i].lock);
+    }
+}
+
+// refs 를 올린 뒤에도 seq 가 그대로면 writer 는 이 entry 를 제자리에서 고치지 않는다
+struct store_entry *store_get_ref(struct store *s, const char *key) {
+    unsigned int hash = store_hash(key);
+    struct store_stripe *stripe = &s->stripe[hash % s->hdr->buckets];
+    struct store_reader *r = store_epoch_enter(s);
+    struct store_entry *entry;
+    uint32_t v;
+
+    while (1) {
+        v = seq_read_begin(&stripe->seq);
+        entry = store_lookup(s, key, hash, r);
+        if (entry) {
+            __atomic_add_fetch(&entry->refs, 1, __ATOMIC_SEQ_CST);
+        }
+        if (__atomic_load_n(&stripe->seq, __ATOMIC_SEQ_CST) == v) {
+            break;
+        }
+        if (entry) {
+            store_release(s, entry);
+        }
+    }
+
+    store_epoch_exit(r);
+    return entry;
+}
+
+void store_release(struct store *s, struct store_entry *entry) {
+    if (__atomic_sub_fetch(&entry->refs, 1, __ATOMIC_SEQ_CST) == 0
+        && __atomic_load_n(&entry->retired, __ATOMIC_SEQ_CST) == 1) {
+        store_limbo_push(s, entry);
+    }
+}
+
+int store_delete(struct store *s, const char *key) {
+    unsigned int hash = store_hash(key), index = hash % s->hdr->buckets;
+    struct store_stripe *stripe = &s->stripe[index];
+    struct store_entry *entry = NULL;
+    uint64_t *link;
+
+    pthread_mutex_lock(&stripe->lock);
+    link = store_find(s, key, index);
+    if (link) {
+        entry = store_ptr(s, *link);
+        seq_write_begin(&stripe->seq);
+        __atomic_store_n(link, entry->next, __ATOMIC_RELEASE);
+        store_hot_update(s, key, hash, 0);
+        seq_write_end(&stripe->seq);
+
+        __atomic_sub_fetch(&s->hdr->entries, 1, __ATOMIC_RELAXED);
+        store_index_update(s, key, 0);
+        store_retire(s, entry);
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    return entry != NULL;
+}
+
+// 시작할 때 (worker 가 생기기 전에) 부른다
+int store_enable_index(struct store *s) {
+    struct skiplist *index = malloc(sizeof(*index));
+    uint64_t off;
+
+    if (!index || skiplist_init(index) < 0) {
+        perror("Failed to allocate store index");
+        free(index);
+        return -1;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    for (uint32_t i = 0; i < s->hdr->buckets; i++) {
+        for (off = s->bucket[i]; off; off = ((struct store_entry *)store_ptr(s, off))->next) {
+            if (skiplist_put(index, ((struct store_entry *)store_ptr(s, off))->key, off) < 0) {
+                pthread_mutex_unlock(&s->lock);
+                perror("Failed to build store index");
+                skiplist_destroy(index);
+                free(index);
+                return -1;
+            }
+        }
+    }
+    s->index = index;
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+// store lock 이 index 와 limbo 회수를 막으므로 node 의 entry 는 사라지지 않는다.
+// value 는 PUT 이 제자리에서 고칠 수 있어 entry 마다 bucket seq 로 확인한다
+int store_scan(struct store *s, const char *start, int after, const char *end, struct scan_entry *out, int max,
+    int *more) {
+    struct skiplist_node *node;
+    struct store_entry *entry;
+    struct store_stripe *stripe;
+    uint32_t v;
+    int n = 0;
+
+    pthread_mutex_lock(&s->lock);
+    node = skiplist_seek(s->index, start);
+    if (after && node && strcmp(node->key, start) == 0) {
+        node = node->next[0];
+    }
+    for (; node && n < max; node = node->next[0]) {
+        if (end[0] && strcmp(node->key, end) >= 0) {
+            break;
+        }
+        entry = store_ptr(s, node->off);
+        stripe = &s->stripe[store_hash(entry->key) % s->hdr->buckets];
+        do {
+            v = seq_read_begin(&stripe->seq);
+            kv_copy(out[n].key, entry->key, kv_class(entry->key));
+            kv_copy(out[n].value, entry->value, kv_class(entry->value));
+        } while (seq_read_retry(&stripe->seq, v));
+        n++;
+    }
+    *more = node && (!end[0] || strcmp(node->key, end) < 0);
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+// 먼저 비우고 key 마다 그 bucket lock 안에서 채운다: 그 사이 PUT/DELETE 가 off 를 놓치지 않는다
+int store_pin_hot(struct store *s, const char **keys, int n) {
+    struct store_stripe *stripe;
+    unsigned int hash;
+    uint64_t *link;
+    uint32_t slot;
+
+    pthread_mutex_lock(&s->hot_lock);
+    seq_write_begin(&s->hot_seq);
+    __atomic_store_n(&s->hot_num, 0, __ATOMIC_RELAXED);
+    seq_write_end(&s->hot_seq);
+    pthread_mutex_unlock(&s->hot_lock);
+
+    for (int i = 0; i < n; i++) {
+        hash = store_hash(keys[i]);
+        stripe = &s->stripe[hash % s->hdr->buckets];
+
+        pthread_mutex_lock(&stripe->lock);
+        link = store_find(s, keys[i], hash % s->hdr->buckets);
+        pthread_mutex_lock(&s->hot_lock);
+        slot = s->hot_num;
+        if (link && slot < STORE_HOT_MAX && store_hot_find(s, keys[i], hash) < 0) {
+            seq_write_begin(&s->hot_seq);
+            s->hot_hash[slot] = hash;
+            s->hot_off[slot] = *link;
+            strncpy(s->hot_key[slot], keys[i], KEY_VALUE_SIZE - 1);
+            s->hot_key[slot][KEY_VALUE_SIZE - 1] = '\0';
+            __atomic_store_n(&s->hot_num, slot + 1, __ATOMIC_RELAXED);
+            seq_write_end(&s->hot_seq);
+        }
+        pthread_mutex_unlock(&s->hot_lock);
+        pthread_mutex_unlock(&stripe->lock);
+    }
+    return __atomic_load_n(&s->hot_num, __ATOMIC_RELAXED);
+}
+
+uint64_t store_hot_hits(struct store *s) {
+    uint64_t hits = 0;
+
+    for (int i = 0; i < STORE_MAX_READERS; i++) {
+        hits += __atomic_load_n(&s->readers[i].hot_hits, __ATOMIC_RELAXED);
+    }
+    return hits;
+}
+
+void store_sync(struct store *s) {
+    if (msync(s->base, s->hdr->arena_used, MS_SYNC) < 0) {
+        perror("msync store");
+    }
+}
+
+void store_set_checkpoint(struct store *s, uint64_t lsn, uint64_t off) {
+    pthread_mutex_lock(&s->lock);
+    s->hdr->wal_ckpt_lsn = lsn;
+    s->hdr->wal_ckpt_off = off;
+    pthread_mutex_unlock(&s->lock);
+
+    msync(s->base, sizeof(struct store_header), MS_SYNC);
+}
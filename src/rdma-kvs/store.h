@@ -0,0 +1,159 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include "common.h"
+#include "skiplist.h"
+
+/*
+ * 파일 (기본 /dev/shm) 에 매핑한 key-value store.
+ * [store_header][bucket offset 배열][entry arena] 로 구성되며 모든 링크는
+ * 매핑 시작 기준 offset 이라 어느 주소에 다시 매핑해도 그대로 쓸 수 있다.
+ * 서버가 재시작하면 파일을 다시 매핑하는 것으로 복구가 끝난다.
+ *
+ * GET 응답은 entry 의 value 를 그대로 SGE 로 보낼 수 있다 (store_get_ref).
+ * 참조가 잡힌 entry 는 제자리에서 고치지 않는다: PUT 은 새 entry 에 써서 chain 에서
+ * 바꿔 끼우고, 예전 entry 는 마지막 store_release 때 free list 로 돌아간다.
+ *
+ * 여러 worker 스레드가 같은 store 를 쓴다.
+ *  - GET 은 lock 을 잡지 않는다: bucket 의 seqlock 을 읽고 chain 을 따라가 value 를 복사한 뒤
+ *    seq 가 그대로인지 확인한다 (바뀌었으면 다시).
+ *  - PUT/DELETE 는 bucket 마다 있는 lock 을 잡고, chain 이나 value 를 고치는 동안 seq 를 홀수로 둔다.
+ *  - chain 에서 빠진 entry 는 바로 재사용하지 않는다 (epoch 기반 회수). 빠질 때의 epoch 를 적어 limbo 에
+ *    두고, 그보다 먼저 들어와 아직 읽고 있는 reader 가 없을 때 free list 로 돌린다.
+ *  - arena/free list/limbo, 순서 index, checkpoint 는 store lock 하나로 묶는다.
+ *  lock 순서: bucket lock -> hot_lock -> store lock. bucket seq 가 홀수인 동안 store lock 을 기다리지 않는다
+ *  (store_scan 이 store lock 을 잡은 채 seq 를 기다린다).
+ */
+#define STORE_MAGIC 0x6b767364u  // "kvsd"
+#define STORE_VERSION 4
+
+#define STORE_DEFAULT_PATH "/dev/shm/kvs-store"
+#define STORE_DEFAULT_SIZE (256ull << 20)
+#define STORE_DEFAULT_BUCKETS 100
+#define STORE_HOT_MAX 32         // hot table 크기
+#define STORE_MAX_READERS 256    // 동시에 store 를 쓰는 스레드 수 (끝난 스레드의 자리는 재사용)
+#define STORE_LIMBO_BATCH 64     // limbo 가 이만큼 쌓이면 할당할 때 회수를 시도한다
+
+struct store_entry {
+    uint64_t next;               // 다음 entry 의 offset, 0 이면 끝 (free list 에서도 쓴다)
+    uint32_t refs;               // 진행 중인 zero-copy send 수 (열 때 0 으로 되돌린다)
+    uint32_t retired;            // 1: chain 에서 빠졌고 refs 가 0 이 되면 limbo 로, 2: limbo 에 있다
+    uint64_t version;            // 새 key 는 1, value 가 바뀔 때마다 1 씩 (entry 를 바꿔 끼워도 이어진다)
+    char key[KEY_VALUE_SIZE];
+    char value[KEY_VALUE_SIZE];
+};
+
+struct store_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;               // 매핑 전체 크기
+    uint32_t buckets;
+    uint32_t entry_size;         // KEY_VALUE_SIZE 가 바뀐 빌드에서 열지 않도록
+    uint64_t bucket_off;
+    uint64_t arena_off;
+    uint64_t arena_used;         // 다음 entry 를 놓을 offset (bump 할당)
+    uint64_t entries;
+    uint64_t wal_ckpt_lsn;       // 이 lsn 까지는 store 에 반영되어 디스크에 있다
+    uint64_t wal_ckpt_off;       // WAL 재생을 시작할 offset
+};
+
+// bucket 하나의 writer lock 과 seqlock (메모리에만 둔다)
+struct store_stripe {
+    pthread_mutex_t lock;
+    uint32_t seq;                // 홀수면 writer 가 chain 이나 value 를 고치는 중
+} __attribute__((aligned(64)));
+
+// 스레드마다 하나: 읽는 동안 들어올 때의 global epoch 를 걸어 둔다
+struct store_reader {
+    uint64_t epoch;              // 0 이면 읽고 있지 않다
+    uint64_t hot_hits;           // 스레드마다 세서 cache line 을 나누지 않는다
+    uint32_t in_use;
+} __attribute__((aligned(64)));
+
+struct store_limbo {
+    uint64_t off;
+    uint64_t epoch;              // chain 에서 빠진 뒤의 global epoch
+};
+
+/*
+ * hot table: 자주 읽히는 key 를 chain 을 따라가지 않고 찾는다 (store_pin_hot).
+ * 먼저 hash 배열 (cache line 두 개) 만 훑고, 맞는 것만 key 를 비교한다.
+ * PUT 이 entry 를 바꿔 끼우거나 DELETE 하면 bucket seq 가 홀수인 동안 off 도 고친다.
+ * 고치는 쪽은 hot_lock, 읽는 쪽은 hot_seq 로 확인한다.
+ */
+struct store {
+    int fd;
+    char *base;
+    struct store_header *hdr;
+    uint64_t *bucket;
+    struct store_stripe *stripe; // bucket 마다 하나
+    uint64_t free_head;          // 재사용할 entry 의 offset (메모리에만 둔다: 재시작하면 샌다)
+    pthread_mutex_t lock;
+
+    uint64_t epoch;              // global epoch, 1 부터
+    pthread_key_t reader_key;    // 스레드의 store_reader, 스레드가 끝나면 자리를 돌려준다
+    struct store_reader readers[STORE_MAX_READERS];
+    struct store_limbo *limbo;
+    uint32_t limbo_num, limbo_cap;
+
+    pthread_mutex_t hot_lock;
+    uint32_t hot_seq;
+    uint32_t hot_num;
+    uint32_t hot_hash[STORE_HOT_MAX];
+    uint64_t hot_off[STORE_HOT_MAX];     // 0 이면 지금은 store 에 없다
+    char hot_key[STORE_HOT_MAX][KEY_VALUE_SIZE];
+
+    struct skiplist *index;      // -O: key 순서 index (없으면 NULL)
+};
+
+// 새로 만들었으면 0, 기존 파일을 복구했으면 1, 실패하면 -1
+int store_open(struct store *s, const char *path, uint64_t size, uint32_t buckets);
+void store_close(struct store *s);
+
+// 새 key 면 1, 기존 값을 덮어썼으면 0, arena 가 가득 찼으면 -1
+int store_put(struct store *s, const char *key, const char *value);
+// 찾으면 value 를 out 에 (version 이 NULL 이 아니면 version 도 같은 시점의 것으로) 복사하고 1
+int store_get(struct store *s, const char *key, char *out, uint64_t *version);
+// 지웠으면 1, 없으면 0. entry 공간은 참조가 다 풀리면 재사용한다
+int store_delete(struct store *s, const char *key);
+
+/*
+ * read-modify-write: bucket lock 을 잡은 채 fn 에 지금 value (없으면 NULL) 와 version 을 주고,
+ * fn 이 0 을 돌려주면 out 을 새 value 로 쓴다. 그 사이 같은 key 의 다른 쓰기는 끼어들지 못한다.
+ * store_put 과 같이 1/0/-1, fn 이 거절하면 STORE_RMW_REJECTED (아무것도 쓰지 않는다).
+ * value 에는 끝난 뒤의 value (거절이면 지금 value, 없으면 ""), *version 에는 그 version 을 돌려준다
+ */
+#define STORE_RMW_REJECTED (-2)
+typedef int (*store_rmw_fn)(void *arg, const char *old, uint64_t version, char *out);
+int store_rmw(struct store *s, const char *key, store_rmw_fn fn, void *arg, char *value, uint64_t *version);
+
+// 찾으면 entry 에 참조를 하나 잡아 돌려준다: store_release 전까지 value 가 바뀌지 않는다
+struct store_entry *store_get_ref(struct store *s, const char *key);
+void store_release(struct store *s, struct store_entry *entry);
+
+// 모든 entry 의 key/value 에 fn 을 부른다 (bucket 하나씩 lock 을 잡고, 순서는 정해져 있지 않다)
+void store_foreach(struct store *s, void (*fn)(void *arg, const char *key, const char *value), void *arg);
+
+// key 순서 index 를 지금 있는 entry 로 만들고 이후 PUT/DELETE 마다 고친다
+int store_enable_index(struct store *s);
+
+// [start, end) 의 entry 를 key 순서로 max 개까지 out 에 복사한다 (end 가 "" 이면 끝까지).
+// after 면 start 와 같은 key 는 건너뛴다 (start, end). 범위에 더 남아 있으면 *more = 1
+int store_scan(struct store *s, const char *start, int after, const char *end, struct scan_entry *out, int max,
+    int *more);
+
+// hot table 을 keys 로 다시 채운다 (store 에 있는 것만). 넣은 개수
+int store_pin_hot(struct store *s, const char **keys, int n);
+// hot table 에서 찾은 GET 수 (모든 스레드의 합)
+uint64_t store_hot_hits(struct store *s);
+
+// 매핑의 dirty page 를 파일에 내린다
+void store_sync(struct store *s);
+// store_sync 이후에 부른다: 이 lsn 까지의 WAL 은 더 이상 필요 없다
+void store_set_checkpoint(struct store *s, uint64_t lsn, uint64_t off);
+
+static inline void *store_ptr(const struct store *s, uint64_t off) {
+    return off ? s->base + off : NULL;
+}
+
+#endif // STORE_H
@@ -0,0 +1,83 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "common.h"
+
+/*
+ * 클라이언트/서버 메시지 경로 아래의 transport 추상화.
+ * 양쪽 모두 send 한 번, recv 한 번으로 요청 하나를 주고받는다.
+ * recv 가 돌려준 message 는 같은 연결의 다음 send/recv 전까지 유효하며,
+ * 서버는 받은 message 를 그 자리에서 응답으로 고쳐 send 한다.
+ */
+struct kvs_transport {
+    const char *name;
+    struct message *(*recv)(void *conn);    // 연결이 끊기면 NULL
+    int (*send)(void *conn, const struct message *msg);
+    void (*close)(void *conn);
+};
+
+/*
+ * 같은 호스트의 클라이언트를 위한 shared memory backend.
+ * /kvs-shm 에 연결 슬롯을 두고, 슬롯마다 요청/응답 SPSC ring 을 하나씩 둔다.
+ * 받는 쪽은 잠시 spin 한 뒤 futex 로 잠들고, 보내는 쪽은 상대가 잠들어
+ * 있을 때만 doorbell 을 울린다 (FUTEX_WAKE).
+ */
+#define SHM_TRANSPORT_NAME "/kvs-shm"
+#define SHM_TRANSPORT_MAGIC 0x6b76736cu  // "kvsl"
+#define SHM_TRANSPORT_VERSION 1
+
+#define SHM_MAX_CONN 4
+#define SHM_RING_SLOTS 16      // 2 의 거듭제곱
+#define SHM_SPIN_LOOPS 4096    // futex 로 잠들기 전 polling 횟수
+#define SHM_WAIT_MS 100        // futex 로 잠드는 최대 시간. 깨면 클라이언트가 살아 있는지 본다
+
+enum shm_conn_state {
+    SHM_CONN_FREE,
+    SHM_CONN_CLAIMED,      // 클라이언트가 잡고 서버 accept 를 기다리는 중
+    SHM_CONN_ACTIVE,
+    SHM_CONN_REJECTED,
+    SHM_CONN_CLOSED        // 클라이언트가 끊음, 서버가 정리 후 FREE 로
+};
+
+struct shm_ring {
+    uint32_t head __attribute__((aligned(64)));  // consumer 만 쓴다
+    uint32_t tail __attribute__((aligned(64)));  // producer 만 쓴다
+    uint32_t doorbell __attribute__((aligned(64)));  // futex word
+    uint32_t sleeping;
+    struct message slots[SHM_RING_SLOTS] __attribute__((aligned(64)));
+};
+
+struct shm_conn_slot {
+    uint32_t state;        // futex word (enum shm_conn_state)
+    uint32_t pid;
+    struct shm_ring req;
+    struct shm_ring resp;
+};
+
+struct shm_transport_region {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t connect_seq;  // futex word: 슬롯이 CLAIMED 되면 증가
+    struct shm_conn_slot conn[SHM_MAX_CONN];
+};
+
+// 한 쪽 끝의 연결 상태
+struct shm_conn {
+    struct shm_transport_region *region;
+    struct shm_conn_slot *slot;
+    struct shm_ring *rx, *tx;
+    int rx_pending;        // recv 로 넘겨준 슬롯을 아직 돌려주지 않음
+};
+
+extern const struct kvs_transport shm_transport;
+
+// 서버
+struct shm_transport_region *shm_transport_create(void);
+int shm_transport_accept(struct shm_transport_region *region, struct shm_conn *conn);
+void shm_transport_reject(struct shm_conn *conn);
+void shm_transport_ready(struct shm_conn *conn);
+
+// 클라이언트
+int shm_transport_connect(struct shm_conn *conn);
+
+#endif // TRANSPORT_H
@@ -0,0 +1,36 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+/*
+ * io_uring 최소 래퍼 (liburing 없이 syscall 직접 사용).
+ * 한 스레드만 submit/reap 한다고 가정한다.
+ */
+struct uring {
+    int fd;
+    unsigned entries;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_pending;         // 아직 io_uring_enter 로 넘기지 않은 sqe 수
+
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+};
+
+int uring_init(struct uring *r, unsigned entries);
+void uring_exit(struct uring *r);
+
+// 비어 있는 sqe 를 0 으로 채워 돌려준다. ring 이 가득 차면 NULL
+struct io_uring_sqe *uring_get_sqe(struct uring *r);
+// 쌓인 sqe 를 넘기고 wait_nr 개의 completion 이 올 때까지 기다린다
+int uring_submit_and_wait(struct uring *r, unsigned wait_nr);
+// completion 하나를 꺼낸다. 없으면 0
+int uring_reap(struct uring *r, struct io_uring_cqe *cqe);
+
+#endif // URING_H
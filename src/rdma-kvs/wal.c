@@ -0,0 +1,385 @@
+#define _GNU_SOURCE
+#include "wal.h"
+
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WAL_ALIGN(x) (((x) + 7) & ~7u)
+
+struct wal_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ckpt_lsn;           // 이 lsn 까지의 record 는 구멍으로 사라졌을 수 있다
+    uint64_t ckpt_off;           // checkpoint 뒤의 첫 record (0 이면 checkpoint 가 없었다)
+};
+
+static uint32_t crc_table[256];
+
+static void crc32c_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32c(const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint32_t c = ~0u;
+
+    while (len--) {
+        c = crc_table[(c ^ *p++) & 0xff] ^ (c >> 8);
+    }
+    return ~c;
+}
+
+static uint32_t record_crc(const struct wal_record *rec) {
+    return crc32c((const char *)rec + sizeof(rec->crc),
+        sizeof(*rec) - sizeof(rec->crc) + rec->key_len + rec->value_len);
+}
+
+static int record_valid(const char *map, uint64_t off, uint64_t size) {
+    const struct wal_record *rec = (const struct wal_record *)(map + off);
+
+    return off + sizeof(*rec) <= size && rec->len >= sizeof(*rec) && rec->len % 8 == 0 && off + rec->len <= size
+        && rec->key_len < KEY_VALUE_SIZE && rec->value_len < KEY_VALUE_SIZE
+        && sizeof(*rec) + rec->key_len + rec->value_len <= rec->len
+        && rec->crc == record_crc(rec);
+}
+
+// off 뒤에 온전한 record 가 하나라도 있으면 1: 그 사이는 찢어진 꼬리가 아니다 (구멍이거나 손상)
+static int valid_record_after(const char *map, uint64_t off, uint64_t size) {
+    for (off = (off + 8) & ~7ull; off + sizeof(struct wal_record) <= size; off += 8) {
+        if (record_valid(map, off, size)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 시작 offset 부터 온전한 record 를 재생한다. 멈춘 곳 뒤에 더 온전한 record 가 없을 때만
+// (마지막 group 의 write 가 찢어졌다) 거기서 잘라내고, 있으면 아무것도 지우지 않고 -1
+static long wal_replay(struct wal *w, uint64_t *off, uint64_t size, uint64_t start_lsn, uint64_t *last_lsn,
+    wal_apply_fn apply, void *arg) {
+    char key[KEY_VALUE_SIZE], value[KEY_VALUE_SIZE];
+    char *map;
+    long count = 0;
+
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, w->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap wal");
+        return -1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    while (*off + sizeof(struct wal_record) <= size) {
+        const struct wal_record *rec = (const struct wal_record *)(map + *off);
+
+        if (!record_valid(map, *off, size)) {
+            break;
+        }
+
+        if (rec->lsn > start_lsn) {
+            memcpy(key, (const char *)(rec + 1), rec->key_len);
+            key[rec->key_len] = '\0';
+            memcpy(value, (const char *)(rec + 1) + rec->key_len, rec->value_len);
+            value[rec->value_len] = '\0';
+
+            apply(arg, rec->type, key, value);
+            count++;
+        }
+        if (rec->lsn > *last_lsn) {
+            *last_lsn = rec->lsn;
+        }
+        *off += rec->len;
+    }
+
+    if (*off < size && valid_record_after(map, *off, size)) {
+        fprintf(stderr, "wal: bad record at offset %lu is followed by valid records, not truncating\n",
+            (unsigned long)*off);
+        munmap(map, size);
+        return -1;
+    }
+    munmap(map, size);
+
+    if (*off < size && ftruncate(w->fd, *off) < 0) {
+        perror("ftruncate wal");
+        return -1;
+    }
+    return count;
+}
+
+long wal_open(struct wal *w, const char *path, uint64_t start_off, uint64_t start_lsn, wal_apply_fn apply, void *arg) {
+    struct wal_file_header hdr;
+    pthread_condattr_t cattr;
+    struct stat st;
+    uint64_t off, last_lsn = start_lsn;
+    long count = 0;
+
+    memset(w, 0, sizeof(*w));
+    crc32c_init();
+
+    w->fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (w->fd < 0) {
+        perror("open wal");
+        return -1;
+    }
+
+    if (fstat(w->fd, &st) < 0) {
+        perror("fstat wal");
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        char block[WAL_HEADER_SIZE];
+
+        memset(block, 0, sizeof(block));
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = WAL_MAGIC;
+        hdr.version = WAL_VERSION;
+        memcpy(block, &hdr, sizeof(hdr));
+        if (pwrite(w->fd, block, sizeof(block), 0) != sizeof(block) || fdatasync(w->fd) < 0) {
+            perror("write wal header");
+            return -1;
+        }
+        st.st_size = WAL_HEADER_SIZE;
+    } else if (pread(w->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+        || hdr.magic != WAL_MAGIC || hdr.version < 1 || hdr.version > WAL_VERSION) {
+        fprintf(stderr, "%s: not a version %d write-ahead log\n", path, WAL_VERSION);
+        return -1;
+    }
+    if (hdr.version == 1) {
+        hdr.ckpt_lsn = 0;
+        hdr.ckpt_off = 0;
+    }
+
+    // 로그 앞부분은 checkpoint 로 지워졌는데 store 는 그 checkpoint 를 갖고 있지 않다
+    if (hdr.ckpt_off && start_lsn < hdr.ckpt_lsn) {
+        fprintf(stderr, "%s: records up to lsn %lu were checkpointed into a store that is gone"
+            " (store is at lsn %lu), refusing to start\n", path, (unsigned long)hdr.ckpt_lsn, (unsigned long)start_lsn);
+        return -1;
+    }
+    if (hdr.ckpt_off > start_off) {
+        start_off = hdr.ckpt_off;
+    }
+    if (hdr.ckpt_lsn > last_lsn) {
+        last_lsn = hdr.ckpt_lsn;
+    }
+
+    // checkpoint 이후의 offset 부터. 로그를 새로 만들었으면 offset 만 이어간다
+    off = start_off > WAL_HEADER_SIZE ? start_off : WAL_HEADER_SIZE;
+    if (off < (uint64_t)st.st_size) {
+        count = wal_replay(w, &off, st.st_size, start_lsn, &last_lsn, apply, arg);
+        if (count < 0) {
+            return -1;
+        }
+    }
+
+    w->write_off = off;
+    w->durable_off = off;
+    w->next_lsn = last_lsn + 1;
+    w->durable_lsn = last_lsn;
+
+    if (posix_memalign((void **)&w->buf[0], 4096, WAL_BUF_SIZE)
+        || posix_memalign((void **)&w->buf[1], 4096, WAL_BUF_SIZE)) {
+        perror("Failed to allocate wal buffers");
+        return -1;
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&w->flush_cond, &cattr);
+    pthread_cond_init(&w->durable_cond, NULL);
+    pthread_cond_init(&w->space_cond, NULL);
+
+    return count;
+}
+
+static void *wal_flusher(void *arg) {
+    struct wal *w = (struct wal *)arg;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe cqe;
+    struct timespec deadline;
+    char *buf;
+    uint32_t len;
+    uint64_t off, last_lsn;
+
+    while (1) {
+        pthread_mutex_lock(&w->lock);
+        while (w->buf_len == 0) {
+            pthread_cond_wait(&w->flush_cond, &w->lock);
+        }
+
+        // 첫 record 가 들어온 뒤 window 동안, 또는 batch 가 찰 때까지 더 모은다
+        if (w->batch_records < w->batch_max && w->window_us > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_nsec += (long)w->window_us * 1000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+
+            while (w->batch_records < w->batch_max && w->buf_len < WAL_BUF_SIZE / 2) {
+                if (pthread_cond_timedwait(&w->flush_cond, &w->lock, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+        }
+
+        buf = w->buf[w->active];
+        len = w->buf_len;
+        off = w->write_off;
+        last_lsn = w->next_lsn - 1;
+        w->records += w->batch_records;
+
+        w->active ^= 1;
+        w->buf_len = 0;
+        w->batch_records = 0;
+        w->write_off += len;
+        pthread_cond_broadcast(&w->space_cond);
+        pthread_mutex_unlock(&w->lock);
+
+        // write 가 끝나야 fdatasync 가 시작되도록 묶는다
+        sqe = uring_get_sqe(&w->ring);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = w->fd;
+        sqe->addr = (uintptr_t)buf;
+        sqe->len = len;
+        sqe->off = off;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = 1;
+
+        sqe = uring_get_sqe(&w->ring);
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = w->fd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->user_data = 2;
+
+        if (uring_submit_and_wait(&w->ring, 2) < 0) {
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < 2; i++) {
+            while (!uring_reap(&w->ring, &cqe)) {
+                uring_submit_and_wait(&w->ring, 1);
+            }
+            if (cqe.res < 0 || (cqe.user_data == 1 && (uint32_t)cqe.res != len)) {
+                fprintf(stderr, "wal %s failed: %s\n", cqe.user_data == 1 ? "write" : "fdatasync",
+                    cqe.res < 0 ? strerror(-cqe.res) : "short write");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        pthread_mutex_lock(&w->lock);
+        w->durable_lsn = last_lsn;
+        w->durable_off = off + len;
+        w->groups++;
+        pthread_cond_broadcast(&w->durable_cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    return NULL;
+}
+
+int wal_start(struct wal *w, uint32_t window_us, uint32_t batch_max) {
+    w->window_us = window_us;
+    w->batch_max = batch_max > 0 ? batch_max : 1;
+
+    if (uring_init(&w->ring, 8) != 0) {
+        return -1;
+    }
+
+    if (pthread_create(&w->flusher, NULL, wal_flusher, w) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    pthread_detach(w->flusher);
+    return 0;
+}
+
+uint64_t wal_append(struct wal *w, int type, const char *key, const char *value) {
+    struct wal_record *rec;
+    uint32_t key_len = strnlen(key, KEY_VALUE_SIZE - 1);
+    uint32_t value_len = value ? strnlen(value, KEY_VALUE_SIZE - 1) : 0;
+    uint32_t len = WAL_ALIGN(sizeof(*rec) + key_len + value_len);
+    uint64_t lsn;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->buf_len + len > WAL_BUF_SIZE) {
+        pthread_cond_signal(&w->flush_cond);
+        pthread_cond_wait(&w->space_cond, &w->lock);
+    }
+
+    rec = (struct wal_record *)(w->buf[w->active] + w->buf_len);
+    memset(rec, 0, len);
+    rec->len = len;
+    rec->lsn = lsn = w->next_lsn++;
+    rec->type = type;
+    rec->key_len = key_len;
+    rec->value_len = value_len;
+    memcpy(rec + 1, key, key_len);
+    memcpy((char *)(rec + 1) + key_len, value, value_len);
+    rec->crc = record_crc(rec);
+
+    w->buf_len += len;
+    if (++w->batch_records == 1 || w->batch_records >= w->batch_max) {
+        pthread_cond_signal(&w->flush_cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return lsn;
+}
+
+void wal_wait(struct wal *w, uint64_t lsn) {
+    if (__atomic_load_n(&w->durable_lsn, __ATOMIC_ACQUIRE) >= lsn) {
+        return;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    while (w->durable_lsn < lsn) {
+        pthread_cond_wait(&w->durable_cond, &w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+void wal_mark(struct wal *w, uint64_t *lsn, uint64_t *off) {
+    pthread_mutex_lock(&w->lock);
+    *lsn = w->next_lsn - 1;
+    *off = w->write_off + w->buf_len;
+    pthread_mutex_unlock(&w->lock);
+}
+
+int wal_truncate(struct wal *w, uint64_t lsn, uint64_t off) {
+    struct wal_file_header hdr;
+    uint64_t punch;
+
+    pthread_mutex_lock(&w->lock);
+    punch = off < w->durable_off ? off : w->durable_off;  // 아직 쓰는 중인 구간은 건드리지 않는다
+    pthread_mutex_unlock(&w->lock);
+
+    punch &= ~(uint64_t)(WAL_HEADER_SIZE - 1);
+    if (punch <= WAL_HEADER_SIZE) {
+        return 0;
+    }
+
+    // 구멍보다 헤더가 먼저 디스크에 있어야 재시작이 구멍에서 재생을 시작하지 않는다
+    hdr.magic = WAL_MAGIC;
+    hdr.version = WAL_VERSION;
+    hdr.ckpt_lsn = lsn;
+    hdr.ckpt_off = off;
+    if (pwrite(w->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fdatasync(w->fd) < 0) {
+        perror("write wal checkpoint");
+        return -1;
+    }
+
+    if (fallocate(w->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, WAL_HEADER_SIZE, punch - WAL_HEADER_SIZE) < 0) {
+        perror("fallocate wal");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "common.h"
+#include "uring.h"
+
+/*
+ * Write-ahead log.
+ * worker 는 record 를 메모리 버퍼에 붙이고 (wal_append) 자기 lsn 이 디스크에
+ * 내려갈 때까지 기다린다 (wal_wait). flusher 스레드 하나가 window 동안 모인
+ * record 를 한 번의 write + fdatasync (io_uring, linked) 로 내려보내므로
+ * fsync 는 요청마다가 아니라 group 마다 한 번이다.
+ *
+ * 파일은 [WAL_HEADER_SIZE 헤더][record ...] 이고 offset 은 계속 증가한다.
+ * checkpoint 가 끝난 앞부분은 구멍을 뚫어 (FALLOC_FL_PUNCH_HOLE) 공간을 돌려준다.
+ * 구멍을 뚫기 전에 헤더에 checkpoint 의 lsn/offset 을 먼저 내려 두므로, store 가 그 lsn 보다
+ * 뒤처져 있으면 (예: /dev/shm 의 store 가 재부팅으로 사라졌다) 재생하지 않고 시작을 거부한다.
+ */
+#define WAL_MAGIC 0x6b76776cu    // "kvwl"
+#define WAL_VERSION 2            // 1 은 checkpoint 필드가 없다 (0 으로 읽는다)
+#define WAL_HEADER_SIZE 4096
+#define WAL_BUF_SIZE (4u << 20)  // group 하나의 최대 크기 (버퍼 두 개를 번갈아 쓴다)
+
+#define WAL_DEFAULT_WINDOW_US 100
+#define WAL_DEFAULT_BATCH 64
+
+enum wal_type {
+    WAL_PUT = 1,
+    WAL_DELETE = 2
+};
+
+struct wal_record {
+    uint32_t crc;                // crc 뒤의 header 와 payload 의 crc32c
+    uint32_t len;                // header 포함, 8 바이트 정렬
+    uint64_t lsn;
+    uint16_t type;
+    uint16_t key_len;
+    uint32_t value_len;
+    // key, value (NUL 없음)
+};
+
+typedef void (*wal_apply_fn)(void *arg, int type, const char *key, const char *value);
+
+struct wal {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t flush_cond;   // flusher 를 깨운다
+    pthread_cond_t durable_cond; // wal_wait 중인 worker 를 깨운다
+    pthread_cond_t space_cond;   // 버퍼가 가득 찬 appender 를 깨운다
+
+    char *buf[2];
+    int active;
+    uint32_t buf_len;            // active 버퍼에 쌓인 바이트
+    uint32_t batch_records;      // active 버퍼에 쌓인 record 수
+    uint64_t write_off;          // active 버퍼가 쓰일 파일 offset
+    uint64_t durable_off;        // 여기까지는 디스크에 있다
+
+    uint64_t next_lsn;
+    uint64_t durable_lsn;
+
+    uint32_t window_us;
+    uint32_t batch_max;
+    struct uring ring;
+    pthread_t flusher;
+
+    uint64_t groups;             // fdatasync 횟수
+    uint64_t records;
+};
+
+// path 를 열고 start_off 부터 lsn > start_lsn 인 record 를 apply 로 재생한다.
+// 재생한 record 수를 돌려주고, 실패하면 (start_lsn 이 로그의 checkpoint 보다 앞이거나
+// 찢어진 꼬리가 아닌 곳에 깨진 record 가 있으면) -1
+long wal_open(struct wal *w, const char *path, uint64_t start_off, uint64_t start_lsn, wal_apply_fn apply, void *arg);
+int wal_start(struct wal *w, uint32_t window_us, uint32_t batch_max);
+
+uint64_t wal_append(struct wal *w, int type, const char *key, const char *value);
+void wal_wait(struct wal *w, uint64_t lsn);
+
+// 지금까지 붙인 마지막 lsn 과 그 다음 record 가 들어갈 offset
+void wal_mark(struct wal *w, uint64_t *lsn, uint64_t *off);
+// lsn 까지 store 에 내려간 checkpoint 를 헤더에 기록하고 off 앞부분을 비운다
+int wal_truncate(struct wal *w, uint64_t lsn, uint64_t off);
+
+#endif // WAL_H
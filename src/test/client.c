@@ -1,69 +1,338 @@
 //./client 10.10.1.1 5 16 256
+//./client -w b -d zipfian -z 0.99 -r 100000 10.10.1.1 1000000 24 256
+//./client -t 4 -c 8 -R 200000 -a poisson 10.10.1.1 1000000 24 256
+//./client -t 4 -T ycsb-b.trace 10.10.1.1
 
 #include "common.h"
+#include "histogram.h"
+#include "hugemem.h"
+#include "trace.h"
+#include "workload.h"
+#include <math.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+
+struct conn {
+    struct rdma_context ctx;
+    struct rdma_cm_id *id;
+    struct rdma_event_channel *ec;
+    struct rdma_cm_event *event;
+    struct ibv_qp_init_attr qp_attr;
+    struct pdata rep_pdata;
+
+    struct ibv_recv_wr recv_wr, *bad_recv_wr;
+    struct ibv_send_wr send_wr, *bad_send_wr;
+    struct ibv_sge send_sge, recv_sge;
+    char *send_buffer, *recv_buffer;
+    char *value_buf;        // 큰 value 는 서버가 여기서 READ 하고 여기로 WRITE 한다
+    struct hugemem mem;     // send/recv/value 버퍼를 한 hugepage 영역에 두고 MR 하나로 등록
+    uint32_t send_len;
+    char key[KEY_MAX];
+    uint32_t value_len;     // value_buf 에 들어 있는 value 길이 (NUL 포함)
+
+    // 이 연결에서 진행 중인 요청 (연결당 하나)
+    int busy;
+    int pending;            // 남은 completion 수 (send + recv)
+    int rmw_put;            // RMW 의 두 번째 단계 (PUT) 진행 중
+    struct workload_req req;
+    uint32_t value_seed;    // trace 재생 시 value block 오프셋
+    uint64_t intended_ns;   // 스케줄상 보냈어야 하는 시각
+    uint64_t start_ns;      // 실제로 보낸 시각
+};
+
+struct worker {
+    int index;
+    pthread_t thread;
+    struct conn *conns;
+    struct workload wl;
+
+    uint64_t ops;           // 이 스레드가 보낼 op 수
+    double rate;            // ops/s, 0 이면 closed loop
+    uint64_t trace_next;    // 다음에 재생할 trace record (num_threads 간격)
+
+    // 지연 시간은 intended 시각부터 잰다 (coordinated omission 보정)
+    struct histogram op_hist[WL_OP_MAX];
+    struct histogram service_hist;
+    struct histogram interval_hist;
+    uint64_t interval_start;
+    uint64_t interval_ops;
+    uint64_t late_ops;
+};
+
+// -s 시계열: 구간마다 모든 worker 의 interval_hist 를 합친다
+struct series_point {
+    uint64_t ops;
+    struct histogram hist;
+};
+
+static int num_threads = 1;
+static int conns_per_thread = 1;
+static double target_rate = 0;
+static int poisson_arrival = 1;
+
+static int series_interval = 0;
+static struct series_point *series = NULL;
+static int series_len = 0;
+static pthread_mutex_t series_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// -T: 미리 만든 trace 를 mmap 해서 재생한다 (op 당 RNG/할당 없음)
+static const char *trace_path = NULL;
+static int trace_timed = 0;
+static struct trace trace = { .fd = -1 };
+static char *trace_values = NULL;
+
+static pthread_barrier_t start_barrier;
+static uint64_t bench_start;
+
+static struct workload_config wl_cfg = {
+    .read_prop = 0.5,
+    .update_prop = 0.5,
+    .key_dist = DIST_ZIPFIAN,
+    .zipf_theta = 0.99,
+    .record_count = 1000,
+    .value_dist = SIZE_FIXED,
+};
+
+static void setup_connection(struct conn *c, const char *server_ip);
+static void pre_post_recv_buffer(struct conn *c);
+static void connect_server(struct conn *c);
+
+static void *run_worker(void *arg);
+static void load_records(struct conn *c, struct workload *wl);
+void print_summary(struct worker *workers, double elapsed_sec);
+static void start_request(struct conn *c, struct workload *wl, int type);
+void post_send_message(struct conn *c);
+static int poll_request(struct conn *c);
+void cleanup(struct conn *c);
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
 
-static struct rdma_context ctx;
-static struct rdma_cm_id *id = NULL;
-static struct rdma_event_channel *ec = NULL;
-static struct rdma_cm_event *event = NULL;
-static struct ibv_qp_init_attr qp_attr;
-static struct pdata rep_pdata;
-
-struct ibv_recv_wr recv_wr, *bad_recv_wr = NULL;
-struct ibv_send_wr send_wr, *bad_send_wr = NULL;
-struct ibv_sge send_sge, recv_sge;
-struct ibv_wc wc;
-static char *send_buffer = NULL, *recv_buffer = NULL;
-
-static void setup_connection(const char *server_ip);
-static void pre_post_recv_buffer();
-static void connect_server();
-
-int on_connect(int dataset_size, int key_size, int value_size);
-void post_send_message();
-int receive_response();
-int wait_for_completion();
-int post_and_wait(struct ibv_send_wr *wr, const char *operation_name);
-void cleanup(struct rdma_cm_id *id);
-
-void generate_random_string(char *str, size_t size) {
-    const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-    if (size) {
-        --size;
-        for (size_t n = 0; n < size; n++) {
-            int key = rand() % (int)(sizeof(charset) - 1);
-            str[n] = charset[key];
+int main(int argc, char **argv) {
+    const char *usage =
+        "Usage: %s [options] <server-ip> <dataset-size> <key-size> <value-size>\n"
+        "       %s [options] -T <trace-file> <server-ip> [max-ops]\n"
+        "  -s sec        print a throughput/latency time series every sec seconds\n"
+        "  -w a..f       YCSB core workload preset (default a)\n"
+        "  -d dist       key distribution: uniform | zipfian | latest\n"
+        "  -z theta      zipfian constant (default 0.99)\n"
+        "  -r records    keys preloaded before the run (default 1000)\n"
+        "  -v dist       value size distribution: fixed | uniform | zipfian\n"
+        "  -m bytes      minimum value size for uniform/zipfian values\n"
+        "  -t threads    load generator threads (default 1)\n"
+        "  -c conns      connections per thread (default 1)\n"
+        "  -R ops/s      open-loop target rate over all threads (default: closed loop)\n"
+        "  -a arrival    open-loop inter-arrival: poisson | constant\n"
+        "  -T file       replay a trace written by gen-trace instead of generating ops\n"
+        "  -C            with -T, send each op at its recorded timestamp\n";
+    enum key_dist key_dist;
+    int opt, key_dist_set = 0;
+
+    // -s <sec>: 구간별 처리량/지연 시간 시계열 출력
+    while ((opt = getopt(argc, argv, "s:w:d:z:r:v:m:t:c:R:a:T:C")) != -1) {
+        switch (opt) {
+        case 's':
+            series_interval = atoi(optarg);
+            break;
+        case 'w':
+            if (workload_preset(&wl_cfg, optarg[0]) != 0) {
+                fprintf(stderr, "Unknown workload: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'd':
+            if (workload_parse_key_dist(optarg, &key_dist) != 0) {
+                fprintf(stderr, "Unknown key distribution: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            key_dist_set = 1;
+            break;
+        case 'z':
+            wl_cfg.zipf_theta = atof(optarg);
+            break;
+        case 'r':
+            wl_cfg.record_count = strtoull(optarg, NULL, 10);
+            break;
+        case 'v':
+            if (workload_parse_size_dist(optarg, &wl_cfg.value_dist) != 0) {
+                fprintf(stderr, "Unknown value size distribution: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'm':
+            wl_cfg.value_min = atoi(optarg);
+            break;
+        case 't':
+            num_threads = atoi(optarg);
+            break;
+        case 'c':
+            conns_per_thread = atoi(optarg);
+            break;
+        case 'R':
+            target_rate = atof(optarg);
+            break;
+        case 'a':
+            if (strcmp(optarg, "poisson") == 0) {
+                poisson_arrival = 1;
+            } else if (strcmp(optarg, "constant") == 0) {
+                poisson_arrival = 0;
+            } else {
+                fprintf(stderr, "Unknown arrival process: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'T':
+            trace_path = optarg;
+            break;
+        case 'C':
+            trace_timed = 1;
+            break;
+        default:
+            fprintf(stderr, usage, argv[0], argv[0]);
+            return EXIT_FAILURE;
         }
-        str[size] = '\0';
     }
-}
 
-int get_random_command() {
-    return (rand() % 2 == 0) ? MSG_PUT : MSG_GET;
-}
+    if (num_threads < 1 || conns_per_thread < 1 || (trace_timed && !trace_path)
+        || (trace_path ? argc - optind < 1 || argc - optind > 2 : argc - optind != 4)) {
+        fprintf(stderr, usage, argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
 
+    // -d 는 preset 의 분포보다 우선
+    if (key_dist_set) {
+        wl_cfg.key_dist = key_dist;
+    }
 
-int main(int argc, char **argv) {
-    if (argc != 5) {
-        fprintf(stderr, "Usage: %s <server-ip> <dataset-size> <key-size> <value-size>\n", argv[0]);
-        return EXIT_FAILURE;
+    argv += optind - 1;
+    uint64_t dataset_size;
+
+    if (trace_path) {
+        if (trace_open(&trace, trace_path) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        if (trace_timed && !(trace.hdr->flags & TRACE_TIMED)) {
+            fprintf(stderr, "%s has no timestamps (generate it with -R)\n", trace_path);
+            exit(EXIT_FAILURE);
+        }
+
+        // keyspace 와 크기는 trace 를 만들 때의 설정을 따른다
+        wl_cfg.record_count = trace.hdr->record_count;
+        wl_cfg.key_size = trace.hdr->key_size;
+        wl_cfg.value_max = trace.hdr->value_max;
+
+        dataset_size = trace.hdr->count;
+        if (argc - optind == 2 && strtoull(argv[2], NULL, 10) > 0 && strtoull(argv[2], NULL, 10) < dataset_size) {
+            dataset_size = strtoull(argv[2], NULL, 10);
+        }
+
+        trace_values = malloc(wl_cfg.value_max + TRACE_VALUE_SLACK);
+        if (!trace_values) {
+            perror("Failed to allocate trace value block");
+            exit(EXIT_FAILURE);
+        }
+        trace_fill_value_block(trace_values, wl_cfg.value_max + TRACE_VALUE_SLACK);
+
+        if (trace_timed) {
+            target_rate = 0;
+        }
+    } else {
+        dataset_size = strtoull(argv[2], NULL, 10);
+        wl_cfg.key_size = atoi(argv[3]);
+        wl_cfg.value_max = atoi(argv[4]);
+    }
+
+    if (wl_cfg.key_size >= KEY_MAX || wl_cfg.value_max > KEY_VALUE_SIZE) {
+        fprintf(stderr, "key/value size exceeds message limit (%d/%d)\n", KEY_MAX - 1, KEY_VALUE_SIZE);
+        exit(EXIT_FAILURE);
+    }
+
+    struct worker *workers = calloc(num_threads, sizeof(struct worker));
+    if (!workers) {
+        perror("Failed to allocate workers");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t seed = (uint64_t)time(NULL);
+    for (int t = 0; t < num_threads; t++) {
+        struct worker *w = &workers[t];
+
+        w->index = t;
+        w->ops = dataset_size / num_threads + ((uint64_t)t < dataset_size % num_threads);
+        w->rate = target_rate / num_threads;
+        w->trace_next = t;
+        workload_init(&w->wl, &wl_cfg, seed + t * 0x9E3779B97F4A7C15ull);
+        workload_partition(&w->wl, t, num_threads);
+
+        w->conns = calloc(conns_per_thread, sizeof(struct conn));
+        if (!w->conns) {
+            perror("Failed to allocate connections");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < conns_per_thread; i++) {
+            setup_connection(&w->conns[i], argv[1]);
+            pre_post_recv_buffer(&w->conns[i]);
+            connect_server(&w->conns[i]);
+        }
     }
+    printf("%d threads x %d connections connected\n", num_threads, conns_per_thread);
+
+    // load phase: GET/UPDATE 가 실제로 존재하는 key 를 보도록 keyspace 를 미리 채운다
+    uint64_t load_start = now_ns();
+    load_records(&workers[0].conns[0], &workers[0].wl);
+    printf("Loaded %lu records in %.3f s\n", (unsigned long)wl_cfg.record_count, (now_ns() - load_start) / 1e9);
 
-    int dataset_size = atoi(argv[2]);
-    int key_size = atoi(argv[3]);
-    int value_size = atoi(argv[4]);
+    if (trace_path) {
+        printf("Replaying %lu of %lu trace records from %s%s\n", (unsigned long)dataset_size,
+            (unsigned long)trace.hdr->count, trace_path, trace_timed ? " at recorded timestamps" : "");
+    }
+    if (trace_timed) {
+        printf("Open loop: trace schedule\n");
+    } else if (target_rate > 0) {
+        printf("Open loop: %.0f ops/s target, %s arrivals\n", target_rate, poisson_arrival ? "poisson" : "constant");
+    } else {
+        printf("Closed loop\n");
+    }
+
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+    for (int t = 0; t < num_threads; t++) {
+        if (pthread_create(&workers[t].thread, NULL, run_worker, &workers[t]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    setup_connection(argv[1]);
-    pre_post_recv_buffer();
-    connect_server();
-    on_connect(dataset_size, key_size, value_size);
+    bench_start = now_ns();
+    pthread_barrier_wait(&start_barrier);
+
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    print_summary(workers, (now_ns() - bench_start) / 1e9);
+
+    for (int t = 0; t < num_threads; t++) {
+        for (int i = 0; i < conns_per_thread; i++) {
+            cleanup(&workers[t].conns[i]);
+        }
+        free(workers[t].conns);
+    }
+    free(workers);
+    free(series);
+    free(trace_values);
+    if (trace_path) {
+        trace_close(&trace);
+    }
 
     return 0;
 }
 
-static void setup_connection(const char *server_ip) {
+static void setup_connection(struct conn *c, const char *server_ip) {
     int ret;
     struct sockaddr_in addr;
 
@@ -72,339 +341,538 @@ static void setup_connection(const char *server_ip) {
     addr.sin_port = htons(SERVER_PORT);
     addr.sin_addr.s_addr = inet_addr(server_ip);
 
-    ec = rdma_create_event_channel();
-    if (!ec) {
+    c->ec = rdma_create_event_channel();
+    if (!c->ec) {
         perror("rdma_create_event_channel");
         exit(EXIT_FAILURE);
     }
 
-    ret = rdma_create_id(ec, &id, NULL, RDMA_PS_TCP);
+    ret = rdma_create_id(c->ec, &c->id, NULL, RDMA_PS_TCP);
     if (ret) {
         perror("rdma_create_id");
         exit(EXIT_FAILURE);
     }
 
-    ret = rdma_resolve_addr(id, NULL, (struct sockaddr *)&addr, TIMEOUT_IN_MS);
+    ret = rdma_resolve_addr(c->id, NULL, (struct sockaddr *)&addr, TIMEOUT_IN_MS);
     if (ret) {
         perror("rdma_resolve_addr");
         exit(EXIT_FAILURE);
     }
 
-    ret = rdma_get_cm_event(ec, &event);
+    ret = rdma_get_cm_event(c->ec, &c->event);
     if (ret) {
         perror("rdma_get_cm_event");
         exit(EXIT_FAILURE);
     }
 
-    ret = rdma_ack_cm_event(event);
+    ret = rdma_ack_cm_event(c->event);
     if (ret) {
         perror("rdma_ack_cm_event");
         exit(EXIT_FAILURE);
     }
 
-    build_context(&ctx, id);
-    build_qp_attr(&qp_attr, &ctx);
+    build_context(&c->ctx, c->id);
+    build_qp_attr(&c->qp_attr, &c->ctx);
 
-    printf("Creating QP...\n");
-    ret = rdma_create_qp(id, ctx.pd, &qp_attr);
+    ret = rdma_create_qp(c->id, c->ctx.pd, &c->qp_attr);
     if (ret) {
         perror("rdma_create_qp");
         exit(EXIT_FAILURE);
     }
-    printf("Queue Pair created: %p\n\n", (void*)id->qp);
-    ctx.qp = id->qp;
+    c->ctx.qp = c->id->qp;
 
-    ret = rdma_resolve_route(id, TIMEOUT_IN_MS);
+    ret = rdma_resolve_route(c->id, TIMEOUT_IN_MS);
     if (ret) {
         perror("rdma_resolve_route");
         exit(EXIT_FAILURE);
     }
 
-    ret = rdma_get_cm_event(ec, &event);
+    ret = rdma_get_cm_event(c->ec, &c->event);
     if (ret) {
         perror("rdma_get_cm_event");
         exit(EXIT_FAILURE);
     }
 
-    ret = rdma_ack_cm_event(event);
+    ret = rdma_ack_cm_event(c->event);
     if (ret) {
         perror("rdma_ack_cm_event");
         exit(EXIT_FAILURE);
     }
-}
 
+    // send/recv 는 eager 크기, value 버퍼는 최대 value 크기. 한 영역에 잡고 한 번만 등록한다
+    c->send_buffer = hugemem_alloc(&c->mem, 2 * MSG_INLINE_SIZE + KEY_VALUE_SIZE);
+    if (!c->send_buffer) {
+        perror("Failed to allocate memory for send buffer");
+        exit(EXIT_FAILURE);
+    }
 
-static void pre_post_recv_buffer() {
-    static int buffer_initialized = 0;
+    c->ctx.send_mr = ibv_reg_mr(c->ctx.pd, c->mem.addr, c->mem.len, IBV_ACCESS_LOCAL_WRITE
+        | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
 
-    if (!buffer_initialized) {
-        recv_buffer = calloc(1, sizeof(struct message));  // 메시지 두 개를 받을 수 있도록 설정
-        if (!recv_buffer) {
-            perror("Failed to allocate memory for receive buffer");
-            exit(EXIT_FAILURE);
-        }
+    if (!c->ctx.send_mr) {
+        fprintf(stderr, "Failed to register client metadata buffer.\n");
+        exit(EXIT_FAILURE);
+    }
+}
 
-        ctx.recv_mr = ibv_reg_mr(ctx.pd, recv_buffer, BUFFER_SIZE, 
-            IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
 
-        if (!ctx.recv_mr) {
-            perror("Failed to register memory region");
-            exit(EXIT_FAILURE);
-        }
+// 첫 호출은 버퍼 등록만 하고, 이후에는 요청마다 recv 를 하나씩 건다
+static void pre_post_recv_buffer(struct conn *c) {
 
-        buffer_initialized = 1;  // 버퍼 초기화 완료
-        printf("Memory registered at address %p with LKey %u\n", recv_buffer, ctx.recv_mr->lkey);
+    if (!c->recv_buffer) {
+        // send 버퍼 바로 뒤, 같은 MR
+        c->recv_buffer = c->send_buffer + MSG_INLINE_SIZE;
+        c->value_buf = c->recv_buffer + MSG_INLINE_SIZE;
+        c->ctx.recv_mr = c->ctx.send_mr;
+        return;
     }
 
-    recv_sge.addr = (uintptr_t)recv_buffer;
-    recv_sge.length = sizeof(struct message);  // 한 번에 한 메시지를 처리한다고 가정
-    recv_sge.lkey = ctx.recv_mr->lkey;
+    c->recv_sge.addr = (uintptr_t)c->recv_buffer;
+    c->recv_sge.length = MSG_INLINE_SIZE;  // 한 번에 한 메시지를 처리한다고 가정
+    c->recv_sge.lkey = c->ctx.recv_mr->lkey;
 
-    memset(&recv_wr, 0, sizeof(recv_wr));
-    recv_wr.wr_id = 0;
-    recv_wr.sg_list = &recv_sge;
-    recv_wr.num_sge = 1;
+    memset(&c->recv_wr, 0, sizeof(c->recv_wr));
+    c->recv_wr.wr_id = 0;
+    c->recv_wr.sg_list = &c->recv_sge;
+    c->recv_wr.num_sge = 1;
 
-    if (ibv_post_recv(id->qp, &recv_wr, &bad_recv_wr)) {
+    if (ibv_post_recv(c->id->qp, &c->recv_wr, &c->bad_recv_wr)) {
         perror("Failed to post receive work request");
         exit(EXIT_FAILURE);
     }
-    
+
 }
 
 
-static void connect_server() {
+static void connect_server(struct conn *c) {
     struct rdma_conn_param conn_param;
 
-    rep_pdata.buf_va = (uintptr_t)recv_buffer;
-    rep_pdata.buf_rkey = htonl(ctx.recv_mr->rkey);
+    c->rep_pdata.buf_va = (uintptr_t)c->recv_buffer;
+    c->rep_pdata.buf_rkey = htonl(c->ctx.recv_mr->rkey);
 
     memset(&conn_param, 0, sizeof(conn_param));
     conn_param.initiator_depth = 3;
     conn_param.responder_resources = 3;
     conn_param.retry_count = 3;
-    conn_param.private_data = &rep_pdata; 
-    conn_param.private_data_len = sizeof(rep_pdata);
+    conn_param.private_data = &c->rep_pdata;
+    conn_param.private_data_len = sizeof(c->rep_pdata);
 
-    printf("Connecting...\n");
-    if (rdma_connect(id, &conn_param)) {
+    if (rdma_connect(c->id, &conn_param)) {
         perror("Failed to connect to remote host");
         exit(EXIT_FAILURE);
     }
 
-    if (rdma_get_cm_event(ec, &event)) {
+    if (rdma_get_cm_event(c->ec, &c->event)) {
         perror("Failed to get cm event");
         exit(EXIT_FAILURE);
     }
-    printf("Connection established.\n");
 
-    memcpy(&rep_pdata, event->param.conn.private_data, sizeof(rep_pdata));
-    printf("Received Server Memory at address %p with RKey %u\n\n",(void *)rep_pdata.buf_va, ntohl(rep_pdata.buf_rkey));
-
-    if (rdma_ack_cm_event(event)) {
-        perror("Failed to acknowledge cm event");
+    if (c->event->event != RDMA_CM_EVENT_ESTABLISHED) {
+        fprintf(stderr, "Connection failed: %s\n", rdma_event_str(c->event->event));
         exit(EXIT_FAILURE);
     }
-    printf("The client is connected successfully. \n\n");
-}
 
-int on_connect(int dataset_size, int key_size, int value_size) {
-     struct message msg_send;
+    memcpy(&c->rep_pdata, c->event->param.conn.private_data, sizeof(c->rep_pdata));
 
-    send_buffer = (char *)calloc(1, sizeof(struct message));
-    if (!send_buffer) {
-        perror("Failed to allocate memory for send buffer");
+    if (rdma_ack_cm_event(c->event)) {
+        perror("Failed to acknowledge cm event");
         exit(EXIT_FAILURE);
     }
+}
 
-    ctx.send_mr = ibv_reg_mr(ctx.pd, send_buffer, sizeof(struct message), IBV_ACCESS_LOCAL_WRITE 
-        | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
-    
-    if (!ctx.send_mr) {
-        fprintf(stderr, "Failed to register client metadata buffer.\n");
-        exit(EXIT_FAILURE);
+static void load_records(struct conn *c, struct workload *wl) {
+    for (uint64_t k = 0; k < wl_cfg.record_count; k++) {
+        workload_key(wl, k, c->key);
+        c->req.value_len = workload_value_len(wl);
+        workload_value(wl, c->value_buf, c->req.value_len);
+        c->value_len = c->req.value_len > 0 ? c->req.value_len : 1;
+        c->req.op = WL_INSERT;
+        start_request(c, NULL, MSG_PUT);
+        while (poll_request(c) == 0);
+        c->busy = 0;
     }
+}
 
-    srand(time(NULL)); 
-
-    for (int i = 0; i < dataset_size; i++) {
-        int cmd_type = get_random_command();
+// trace 의 value block 에서 복사한다: 재생 중에는 RNG 를 돌리지 않는다
+static void fill_value(struct conn *c, struct workload *wl, char *buf) {
+    int len = c->req.value_len;
 
-        if (cmd_type == MSG_PUT) {
-            generate_random_string(msg_send.kv.key, key_size);
-            generate_random_string(msg_send.kv.value, value_size);
+    c->value_len = len > 0 ? len : 1;
+    buf[0] = '\0';
+    if (!trace_path) {
+        workload_value(wl, buf, len);
+        return;
+    }
+    if (len <= 0) {
+        return;
+    }
+    memcpy(buf, trace_values + c->value_seed, len - 1);
+    buf[len - 1] = '\0';
+}
 
-            msg_send.type = MSG_PUT;
+// trace 의 다음 record 를 요청으로 읽는다
+static void next_trace_request(struct worker *w, struct conn *c) {
+    const struct trace_record *r = &trace.rec[w->trace_next];
 
-            //printf("PUT: Key = %s, Value = %s\n", msg_send.kv.key, msg_send.kv.value);
-            printf("PUT: Key = %s\n", msg_send.kv.key);
+    c->req.op = r->op;
+    c->req.key_id = r->key_id;
+    c->req.value_len = r->value_len;
+    c->req.scan_len = 0;
+    c->value_seed = r->value_seed % TRACE_VALUE_SLACK;
+    w->trace_next += num_threads;
+}
 
-        } else if (cmd_type == MSG_GET) {
-            char key[key_size];
+static double next_interarrival_ns(struct worker *w) {
+    double mean = 1e9 / w->rate;
 
-            generate_random_string(msg_send.kv.key, key_size);
+    if (!poisson_arrival) {
+        return mean;
+    }
+    return -log(1.0 - workload_rand_double(&w->wl)) * mean;
+}
 
-            msg_send.kv.value[0] = '\0'; 
-            msg_send.type = MSG_GET;
+static void record_series(struct worker *w, uint64_t now) {
+    int k = (int)((w->interval_start - bench_start) / ((uint64_t)series_interval * 1000000000ull));
 
-            printf("GET: Key = %s\n", msg_send.kv.key);
+    pthread_mutex_lock(&series_lock);
+    if (k >= series_len) {
+        int n = k + 16;
+        series = realloc(series, n * sizeof(struct series_point));
+        if (!series) {
+            perror("Failed to grow time series");
+            exit(EXIT_FAILURE);
         }
-
-        memcpy(send_buffer, &msg_send, sizeof(struct message));
-        post_send_message();
+        for (int i = series_len; i < n; i++) {
+            series[i].ops = 0;
+            hist_init(&series[i].hist);
+        }
+        series_len = n;
     }
+    series[k].ops += w->interval_ops;
+    hist_merge(&series[k].hist, &w->interval_hist);
+    pthread_mutex_unlock(&series_lock);
 
-    cleanup(id);
-    return 0;
+    hist_init(&w->interval_hist);
+    w->interval_ops = 0;
+    w->interval_start = now;
 }
 
-void post_send_message() {
-    struct message *msg_send = (struct message *)send_buffer;
+static void complete_request(struct worker *w, struct conn *c, uint64_t now) {
+    uint64_t latency = now - c->intended_ns;
 
-    send_sge.addr = (uintptr_t)send_buffer;
-    send_sge.length = sizeof(struct message);
-    send_sge.lkey = ctx.send_mr->lkey;
+    hist_record(&w->op_hist[c->req.op], latency);
+    hist_record(&w->service_hist, now - c->start_ns);
 
-    send_wr.wr_id = 2;
-    send_wr.sg_list = &send_sge;
-    send_wr.num_sge = 1;
-    send_wr.send_flags = IBV_SEND_SIGNALED;
-
-    //send_wr.opcode = IBV_WR_RDMA_WRITE;
-    send_wr.wr.rdma.rkey = ntohl(rep_pdata.buf_rkey); 
-	send_wr.wr.rdma.remote_addr = ntohll(rep_pdata.buf_va); 
+    if (series_interval > 0) {
+        hist_record(&w->interval_hist, latency);
+        w->interval_ops++;
+        if (now - w->interval_start >= (uint64_t)series_interval * 1000000000ull) {
+            record_series(w, now);
+        }
+    }
+    c->busy = 0;
+}
 
-    struct message *msg_in_buffer = (struct message *)send_buffer;
-    // printf("\nsend_buffer content:\n");
-    // printf("Type: %d\n", msg_in_buffer->type);
-    // printf("Key: %s\n", msg_in_buffer->kv.key);
-    // printf("Value: %s\n\n", msg_in_buffer->kv.value);
+/*
+ * 스레드 하나가 conns_per_thread 개의 연결을 돌아가며 사용한다.
+ * closed loop 는 빈 연결이 생기는 즉시 다음 요청을 보내고, open loop 는
+ * 고정된 스케줄 (constant 또는 poisson) 의 intended 시각에 맞춰 보낸다.
+ * 모든 연결이 바쁘면 요청은 밀리지만 지연 시간은 intended 시각부터 재므로
+ * 대기 시간이 결과에 그대로 드러난다.
+ */
+static void *run_worker(void *arg) {
+    struct worker *w = (struct worker *)arg;
+    uint64_t issued = 0, completed = 0, now, next_intended;
+    int next_conn = 0;
+    int paced = w->rate > 0 || trace_timed;
+
+    for (int op = 0; op < WL_OP_MAX; op++) {
+        hist_init(&w->op_hist[op]);
+    }
+    hist_init(&w->service_hist);
+    hist_init(&w->interval_hist);
+
+    pthread_barrier_wait(&start_barrier);
+
+    now = now_ns();
+    next_intended = now;
+    if (trace_timed && w->ops > 0) {
+        next_intended = bench_start + trace.rec[w->trace_next].ts_ns;
+    }
+    w->interval_start = bench_start;
+
+    while (completed < w->ops) {
+        now = now_ns();
+
+        while (issued < w->ops && (!paced || next_intended <= now)) {
+            struct conn *c = NULL;
+
+            for (int i = 0; i < conns_per_thread; i++) {
+                struct conn *cand = &w->conns[(next_conn + i) % conns_per_thread];
+                if (!cand->busy) {
+                    c = cand;
+                    next_conn = (next_conn + i + 1) % conns_per_thread;
+                    break;
+                }
+            }
+            if (!c) {
+                break;
+            }
+
+            if (trace_path) {
+                next_trace_request(w, c);
+            } else {
+                workload_next(&w->wl, &c->req);
+            }
+            workload_key(&w->wl, c->req.key_id, c->key);
+            if (c->req.op == WL_UPDATE || c->req.op == WL_INSERT) {
+                fill_value(c, &w->wl, c->value_buf);
+            }
+            c->rmw_put = 0;
+
+            //printf("%s: Key = %s\n", workload_op_names[c->req.op], c->key);
+
+            c->intended_ns = paced ? next_intended : now;
+            if (now - c->intended_ns > 1000000ull) {
+                w->late_ops++;
+            }
+
+            switch (c->req.op) {
+            case WL_READ:
+            case WL_SCAN:  // 서버에 MSG_SCAN 이 없으므로 시작 key 에 대한 GET 으로 보낸다
+            case WL_RMW:   // GET 후 완료되면 PUT
+                start_request(c, &w->wl, MSG_GET);
+                break;
+            default:
+                start_request(c, &w->wl, MSG_PUT);
+                break;
+            }
+
+            issued++;
+            if (trace_timed) {
+                if (issued < w->ops) {
+                    next_intended = bench_start + trace.rec[w->trace_next].ts_ns;
+                }
+            } else if (w->rate > 0) {
+                next_intended += (uint64_t)next_interarrival_ns(w);
+            }
+        }
 
-    // if (post_and_wait(&send_wr, "RDMA Write") != 0) {
-    //     exit(EXIT_FAILURE);
-    // }
+        for (int i = 0; i < conns_per_thread; i++) {
+            struct conn *c = &w->conns[i];
 
-    send_wr.opcode = IBV_WR_SEND;
-    //send_sge.length = sizeof(struct message);
+            if (!c->busy || poll_request(c) == 0) {
+                continue;
+            }
 
-    pre_post_recv_buffer();
-    //sleep(5);
+            if (c->req.op == WL_RMW && !c->rmw_put) {
+                c->rmw_put = 1;
+                start_request(c, &w->wl, MSG_PUT);
+                continue;
+            }
 
-    if (post_and_wait(&send_wr, "Send") != 0) {
-        exit(EXIT_FAILURE);
+            complete_request(w, c, now_ns());
+            completed++;
+        }
     }
-    if (receive_response() != 0) {
-        fprintf(stderr, "Failed to receive response\n");
-        exit(EXIT_FAILURE);
+
+    if (series_interval > 0 && w->interval_ops) {
+        record_series(w, now_ns());
     }
+    return NULL;
 }
 
-int post_and_wait(struct ibv_send_wr *wr, const char *operation_name) {
-    if (ibv_post_send(id->qp, wr, &bad_send_wr)) {
-        fprintf(stderr, "Failed to post %s work request: %s\n", operation_name, strerror(errno));
+void print_summary(struct worker *workers, double elapsed_sec) {
+    struct histogram all, service;
+    struct histogram *op_hist = calloc(WL_OP_MAX, sizeof(struct histogram));
+    uint64_t late = 0;
+
+    if (!op_hist) {
+        perror("Failed to allocate summary");
         exit(EXIT_FAILURE);
     }
 
-    if (wait_for_completion() != 0) {
-        fprintf(stderr, "%s operation failed\n", operation_name);
-        exit(EXIT_FAILURE);
+    hist_init(&all);
+    hist_init(&service);
+    for (int op = 0; op < WL_OP_MAX; op++) {
+        hist_init(&op_hist[op]);
     }
 
-    printf("%s completed successfully\n", operation_name);
-    return 0;
+    for (int t = 0; t < num_threads; t++) {
+        for (int op = 0; op < WL_OP_MAX; op++) {
+            hist_merge(&op_hist[op], &workers[t].op_hist[op]);
+            hist_merge(&all, &workers[t].op_hist[op]);
+        }
+        hist_merge(&service, &workers[t].service_hist);
+        late += workers[t].late_ops;
+    }
+
+    if (series_interval > 0) {
+        printf("\n%8s %12s %10s %10s %10s\n", "time s", "ops/s", "p50 us", "p99 us", "max us");
+        for (int k = 0; k < series_len; k++) {
+            if (series[k].ops == 0) {
+                continue;
+            }
+            printf("%8d %12.0f %10.2f %10.2f %10.2f\n", (k + 1) * series_interval,
+                (double)series[k].ops / series_interval,
+                hist_percentile(&series[k].hist, 50) / 1e3, hist_percentile(&series[k].hist, 99) / 1e3,
+                series[k].hist.max / 1e3);
+        }
+    }
+
+    printf("\n%lu ops in %.3f s (%d threads x %d connections)\n", (unsigned long)all.total, elapsed_sec,
+        num_threads, conns_per_thread);
+    if (target_rate > 0) {
+        printf("target %.0f ops/s, achieved %.0f ops/s, %lu ops sent >1ms behind schedule\n",
+            target_rate, all.total / elapsed_sec, (unsigned long)late);
+    }
+    hist_print_header(stdout);
+    for (int op = 0; op < WL_OP_MAX; op++) {
+        hist_print_summary(stdout, workload_op_names[op], &op_hist[op], elapsed_sec);
+    }
+    hist_print_summary(stdout, "ALL", &all, elapsed_sec);
+    // 실제 전송 시각부터 잰 값: ALL 과의 차이가 클라이언트 측 대기 시간
+    hist_print_summary(stdout, "SERVICE", &service, elapsed_sec);
+
+    free(op_hist);
 }
 
-int wait_for_completion() {
-    struct ibv_wc wc;
-    int ret;
+// key 는 c->key, value 는 c->value_buf 에 있다 (RMW 는 같은 key 로 GET 후 새 value 를 PUT).
+// EAGER_MAX 이하 value 는 메시지에 싣고, 더 크면 버퍼 주소만 보내 서버가 READ 해 가게 한다.
+// GET 은 항상 value 버퍼를 알려줘서 큰 value 는 서버가 바로 WRITE 한다
+static void start_request(struct conn *c, struct workload *wl, int type) {
+    struct msg_hdr *hdr = (struct msg_hdr *)c->send_buffer;
 
-    while ((ret = ibv_poll_cq(ctx.cq, 1, &wc)) == 0);
+    if (type == MSG_PUT && c->rmw_put) {
+        fill_value(c, wl, c->value_buf);
+    }
 
-    if (ret < 0) {
-        fprintf(stderr, "Failed to poll CQ: %s\n", strerror(errno));
-        exit(EXIT_FAILURE);
+    hdr->type = type;
+    hdr->flags = 0;
+    hdr->status = MSG_OK;
+    hdr->key_len = strlen(c->key) + 1;
+    memcpy(msg_key(hdr), c->key, hdr->key_len);
+    c->send_len = sizeof(*hdr) + hdr->key_len;
+
+    if (type == MSG_PUT && c->value_len <= EAGER_MAX) {
+        hdr->value_len = c->value_len;
+        memcpy(msg_value(hdr), c->value_buf, c->value_len);
+        c->send_len += c->value_len;
+    } else {
+        hdr->flags = MSG_RNDV;
+        hdr->value_len = type == MSG_PUT ? c->value_len : KEY_VALUE_SIZE;  // GET 은 버퍼 크기
+        hdr->addr = (uintptr_t)c->value_buf;
+        hdr->rkey = c->ctx.send_mr->rkey;
     }
 
-    if (wc.status != IBV_WC_SUCCESS) {
-        fprintf(stderr, "WR failed with status %s\n", ibv_wc_status_str(wc.status));
-        exit(EXIT_FAILURE);
+    if (!c->rmw_put) {
+        c->start_ns = now_ns();
     }
+    c->busy = 1;
+    c->pending = 2;
 
-    return 0;
+    post_send_message(c);
 }
 
-int receive_response() {
-    if (wait_for_completion() != 0) {
-        fprintf(stderr, "Failed to receive response\n");
-        exit(EXIT_FAILURE);
-    }
+void post_send_message(struct conn *c) {
 
-    struct message *response = (struct message *)recv_buffer;
-    // printf("\nrecv_buffer content:\n");
-    // printf("Type: %d\n", response->type);
-    // printf("Key: %s\n", response->kv.key);
-    // printf("Value: %s\n\n", response->kv.value);
+    c->send_sge.addr = (uintptr_t)c->send_buffer;
+    c->send_sge.length = c->send_len;
+    c->send_sge.lkey = c->ctx.send_mr->lkey;
 
+    c->send_wr.wr_id = 2;
+    c->send_wr.sg_list = &c->send_sge;
+    c->send_wr.num_sge = 1;
+    c->send_wr.send_flags = IBV_SEND_SIGNALED;
 
-    // if (response->type == MSG_GET) {
-    //     printf("GET Received response: Key: %s, Value: %s\n\n", response->kv.key, response->kv.value);
-    // } else if (response->type == MSG_PUT) {
-    //     printf("PUT Response value: %s\n\n", response->kv.value);
-    // }
+    //send_wr.opcode = IBV_WR_RDMA_WRITE;
+    c->send_wr.wr.rdma.rkey = ntohl(c->rep_pdata.buf_rkey);
+	c->send_wr.wr.rdma.remote_addr = ntohll(c->rep_pdata.buf_va);
 
-    return 0;
+    c->send_wr.opcode = IBV_WR_SEND;
+
+    pre_post_recv_buffer(c);
+
+    if (ibv_post_send(c->id->qp, &c->send_wr, &c->bad_send_wr)) {
+        fprintf(stderr, "Failed to post Send work request: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
 }
 
-void cleanup(struct rdma_cm_id *id) {
+// send 와 응답 recv completion 이 모두 오면 1
+static int poll_request(struct conn *c) {
+    struct ibv_wc wc[2];
+    int ret;
 
-    if (send_buffer) {
-        free(send_buffer);
-        send_buffer = NULL;
+    ret = ibv_poll_cq(c->ctx.cq, c->pending, wc);
+
+    if (ret < 0) {
+        fprintf(stderr, "Failed to poll CQ: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
     }
 
-    if (recv_buffer) {
-        free(recv_buffer);
-        recv_buffer = NULL;
+    for (int i = 0; i < ret; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "WR failed with status %s\n", ibv_wc_status_str(wc[i].status));
+            exit(EXIT_FAILURE);
+        }
     }
 
-    if (ctx.recv_mr) {
-        ibv_dereg_mr(ctx.recv_mr);
-        ctx.recv_mr = NULL;
+    c->pending -= ret;
+    if (c->pending > 0) {
+        return 0;
     }
 
-    if (ctx.send_mr) {
-        ibv_dereg_mr(ctx.send_mr);
-        ctx.send_mr = NULL;
+    // 서버 arena 가 차면 이후 결과는 의미가 없다
+    if (((struct msg_hdr *)c->recv_buffer)->status == MSG_NO_SPACE) {
+        fprintf(stderr, "Server is out of value space (raise server -A)\n");
+        exit(EXIT_FAILURE);
+    }
+    return 1;
+}
+
+void cleanup(struct conn *c) {
+
+    // send/recv 는 같은 MR 이다
+    c->ctx.recv_mr = NULL;
+
+    if (c->ctx.send_mr) {
+        ibv_dereg_mr(c->ctx.send_mr);
+        c->ctx.send_mr = NULL;
     }
 
-    if (ctx.qp) {
-        rdma_destroy_qp(id);
-        ctx.qp = NULL;
+    hugemem_free(&c->mem);
+    c->send_buffer = NULL;
+    c->recv_buffer = NULL;
+
+    if (c->ctx.qp) {
+        rdma_destroy_qp(c->id);
+        c->ctx.qp = NULL;
     }
 
-    if (ctx.cq) {
-        ibv_destroy_cq(ctx.cq);
-        ctx.cq = NULL;
+    if (c->ctx.cq) {
+        ibv_destroy_cq(c->ctx.cq);
+        c->ctx.cq = NULL;
     }
 
-    if (ctx.comp_channel) {
-        ibv_destroy_comp_channel(ctx.comp_channel);
-        ctx.comp_channel = NULL;
+    if (c->ctx.comp_channel) {
+        ibv_destroy_comp_channel(c->ctx.comp_channel);
+        c->ctx.comp_channel = NULL;
     }
 
-    if (ctx.pd) {
-        ibv_dealloc_pd(ctx.pd);
-        ctx.pd = NULL;
+    if (c->ctx.pd) {
+        ibv_dealloc_pd(c->ctx.pd);
+        c->ctx.pd = NULL;
     }
 
-    if (id) {
-        rdma_destroy_id(id);
-        id = NULL;
+    if (c->id) {
+        rdma_disconnect(c->id);
+        rdma_destroy_id(c->id);
+        c->id = NULL;
     }
 
-    if (ec) {
-        rdma_destroy_event_channel(ec);
-        ec = NULL;
+    if (c->ec) {
+        rdma_destroy_event_channel(c->ec);
+        c->ec = NULL;
     }
 }
-
@@ -38,17 +38,47 @@ enum msg_type {
     MSG_GET
 };
 
-struct kv_pair {
-    char key[KEY_VALUE_SIZE];
-    char value[KEY_VALUE_SIZE];
-    struct kv_pair *next;
-} __attribute__((packed));
+/*
+ * 크기에 따라 두 가지로 보낸다.
+ * eager:      [msg_hdr][key][value] 를 SEND 하나로 (value_len <= EAGER_MAX)
+ * rendezvous: [msg_hdr][key] 만 SEND 하고 value 는 addr/rkey 로 가리킨다.
+ *             PUT 은 서버가 RDMA READ 로 자기 저장소에 바로 가져가고, GET 은 서버가
+ *             value 를 client 버퍼에 RDMA WRITE 한 뒤 응답 header 를 SEND 한다.
+ * 그래서 recv 버퍼는 MSG_INLINE_SIZE 면 되고 큰 value 는 양쪽에서 한 번도 복사되지 않는다.
+ * key_len/value_len 은 끝의 NUL 을 포함한 길이다.
+ */
+#define EAGER_MAX 4096
+#define KEY_MAX 1024
+
+#define MSG_RNDV 0x1            // value 는 addr/rkey 가 가리킨다
+
+enum msg_status {
+    MSG_OK,
+    MSG_NOT_FOUND,
+    MSG_NO_SPACE,               // 서버 value arena 가 가득 찼거나 client 버퍼가 작다
+    MSG_BAD_REQUEST             // eager value 가 EAGER_MAX 보다 크거나 받은 길이를 넘는다
+};
 
-struct message {
-    enum msg_type type;
-    struct kv_pair kv;
+struct msg_hdr {
+    uint32_t type;
+    uint32_t flags;
+    uint32_t key_len;
+    uint32_t value_len;         // GET 요청에서는 client 버퍼 크기
+    uint64_t addr;
+    uint32_t rkey;
+    uint32_t status;            // 응답만
 } __attribute__((packed));
 
+#define MSG_INLINE_SIZE (sizeof(struct msg_hdr) + KEY_MAX + EAGER_MAX)
+
+static inline char *msg_key(struct msg_hdr *hdr) {
+    return (char *)(hdr + 1);
+}
+
+static inline char *msg_value(struct msg_hdr *hdr) {
+    return (char *)(hdr + 1) + hdr->key_len;
+}
+
 
 struct rdma_context {
     struct ibv_device *device;
@@ -0,0 +1,143 @@
+//./gen-trace -w b -d zipfian -r 100000 -o ycsb-b.trace 1000000 24 256
+//./gen-trace -w a -R 200000 -a poisson -o ycsb-a-200k.trace 1000000 24 256
+
+#include "trace.h"
+#include "workload.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+    const char *usage =
+        "Usage: %s [options] -o <trace-file> <ops> <key-size> <value-size>\n"
+        "  -w a..f       YCSB core workload preset (default a)\n"
+        "  -d dist       key distribution: uniform | zipfian | latest\n"
+        "  -z theta      zipfian constant (default 0.99)\n"
+        "  -r records    keys the replaying client preloads (default 1000)\n"
+        "  -v dist       value size distribution: fixed | uniform | zipfian\n"
+        "  -m bytes      minimum value size for uniform/zipfian values\n"
+        "  -R ops/s      stamp records with an arrival schedule at this rate\n"
+        "  -a arrival    poisson | constant (with -R)\n"
+        "  -S seed       random seed (default: time)\n";
+    struct workload_config cfg = {
+        .read_prop = 0.5,
+        .update_prop = 0.5,
+        .key_dist = DIST_ZIPFIAN,
+        .zipf_theta = 0.99,
+        .record_count = 1000,
+        .value_dist = SIZE_FIXED,
+    };
+    struct workload wl;
+    struct workload_req req;
+    struct trace_header hdr;
+    struct trace_writer tw;
+    struct trace_record rec;
+    enum key_dist key_dist;
+    const char *path = NULL;
+    double rate = 0, ts = 0;
+    int opt, key_dist_set = 0, poisson = 1;
+    uint64_t seed = (uint64_t)time(NULL);
+
+    while ((opt = getopt(argc, argv, "w:d:z:r:v:m:R:a:S:o:")) != -1) {
+        switch (opt) {
+        case 'w':
+            if (workload_preset(&cfg, optarg[0]) != 0) {
+                fprintf(stderr, "Unknown workload: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'd':
+            if (workload_parse_key_dist(optarg, &key_dist) != 0) {
+                fprintf(stderr, "Unknown key distribution: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            key_dist_set = 1;
+            break;
+        case 'z':
+            cfg.zipf_theta = atof(optarg);
+            break;
+        case 'r':
+            cfg.record_count = strtoull(optarg, NULL, 10);
+            break;
+        case 'v':
+            if (workload_parse_size_dist(optarg, &cfg.value_dist) != 0) {
+                fprintf(stderr, "Unknown value size distribution: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'm':
+            cfg.value_min = atoi(optarg);
+            break;
+        case 'R':
+            rate = atof(optarg);
+            break;
+        case 'a':
+            poisson = strcmp(optarg, "constant") != 0;
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        default:
+            fprintf(stderr, usage, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!path || argc - optind != 3) {
+        fprintf(stderr, usage, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (key_dist_set) {
+        cfg.key_dist = key_dist;
+    }
+
+    uint64_t ops = strtoull(argv[optind], NULL, 10);
+    cfg.key_size = atoi(argv[optind + 1]);
+    cfg.value_max = atoi(argv[optind + 2]);
+
+    workload_init(&wl, &cfg, seed);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.record_count = cfg.record_count;
+    hdr.key_size = cfg.key_size;
+    hdr.value_max = cfg.value_max;
+    hdr.flags = rate > 0 ? TRACE_TIMED : 0;
+
+    if (trace_writer_open(&tw, path, &hdr) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    for (uint64_t i = 0; i < ops; i++) {
+        workload_next(&wl, &req);
+
+        memset(&rec, 0, sizeof(rec));
+        rec.ts_ns = (uint64_t)ts;
+        rec.key_id = req.key_id;
+        rec.op = req.op;
+        rec.value_len = req.value_len;
+        rec.value_seed = (uint32_t)(workload_rand(&wl) % TRACE_VALUE_SLACK);
+
+        if (trace_writer_append(&tw, &rec) != 0) {
+            return EXIT_FAILURE;
+        }
+
+        if (rate > 0) {
+            ts += poisson ? -log(1.0 - workload_rand_double(&wl)) * 1e9 / rate : 1e9 / rate;
+        }
+    }
+
+    if (trace_writer_close(&tw) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("Wrote %lu records (%lu preload keys%s) to %s\n", (unsigned long)ops,
+        (unsigned long)cfg.record_count, rate > 0 ? ", timed" : "", path);
+    return EXIT_SUCCESS;
+}
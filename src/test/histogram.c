@@ -0,0 +1,71 @@
+#include "histogram.h"
+
+#include <string.h>
+
+void hist_init(struct histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_merge(struct histogram *dst, const struct histogram *src) {
+    for (int i = 0; i < HIST_COUNTS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+// index 가 가리키는 구간의 상한값
+static uint64_t hist_value(int index) {
+    if (index < (1 << HIST_SUB_BITS)) {
+        return (uint64_t)index;
+    }
+    int bucket = index / HIST_HALF - 1;
+    uint64_t sub = (uint64_t)(index - bucket * HIST_HALF);
+    return ((sub + 1) << bucket) - 1;
+}
+
+uint64_t hist_percentile(const struct histogram *h, double pct) {
+    uint64_t seen = 0, target;
+
+    if (h->total == 0) {
+        return 0;
+    }
+
+    target = (uint64_t)(h->total * pct / 100.0 + 0.5);
+    if (target == 0) target = 1;
+
+    for (int i = 0; i < HIST_COUNTS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t v = hist_value(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const struct histogram *h) {
+    return h->total ? h->sum / h->total : 0.0;
+}
+
+void hist_print_header(FILE *out) {
+    fprintf(out, "%-6s %10s %12s %10s %10s %10s %10s %10s %10s\n",
+        "op", "count", "ops/s", "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+}
+
+void hist_print_summary(FILE *out, const char *name, const struct histogram *h, double elapsed_sec) {
+    if (h->total == 0) {
+        return;
+    }
+    fprintf(out, "%-6s %10lu %12.0f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+        name, (unsigned long)h->total, elapsed_sec > 0 ? h->total / elapsed_sec : 0.0,
+        hist_mean(h) / 1e3,
+        hist_percentile(h, 50) / 1e3,
+        hist_percentile(h, 90) / 1e3,
+        hist_percentile(h, 99) / 1e3,
+        hist_percentile(h, 99.9) / 1e3,
+        h->max / 1e3);
+}
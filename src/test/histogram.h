@@ -0,0 +1,48 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * HDR 스타일 log-linear 히스토그램 (ns 단위).
+ * 2^HIST_SUB_BITS 미만은 1ns 단위로, 그 이상은 2의 거듭제곱 구간마다
+ * 2^(HIST_SUB_BITS-1) 개의 선형 sub-bucket 으로 나눈다 (상대 오차 < 1/64).
+ */
+#define HIST_SUB_BITS 7
+#define HIST_HALF (1 << (HIST_SUB_BITS - 1))
+#define HIST_COUNTS ((64 - HIST_SUB_BITS + 2) * HIST_HALF)
+
+struct histogram {
+    uint64_t counts[HIST_COUNTS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+};
+
+static inline int hist_index(uint64_t v) {
+    if (v < (1ull << HIST_SUB_BITS)) {
+        return (int)v;
+    }
+    int bucket = 63 - __builtin_clzll(v) - HIST_SUB_BITS + 1;
+    return bucket * HIST_HALF + (int)(v >> bucket);
+}
+
+static inline void hist_record(struct histogram *h, uint64_t v) {
+    h->counts[hist_index(v)]++;
+    h->total++;
+    h->sum += v;
+    if (v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+}
+
+void hist_init(struct histogram *h);
+void hist_merge(struct histogram *dst, const struct histogram *src);
+uint64_t hist_percentile(const struct histogram *h, double pct);
+double hist_mean(const struct histogram *h);
+
+void hist_print_header(FILE *out);
+void hist_print_summary(FILE *out, const char *name, const struct histogram *h, double elapsed_sec);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,111 @@
+#define _GNU_SOURCE
+#include "hugemem.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define ROUND_UP(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+static const char *kind_names[] = { "4k", "thp", "2m", "1g" };
+
+const char *hugemem_kind_name(int kind) {
+    return kind >= HUGEMEM_SMALL && kind <= HUGEMEM_HUGETLB_1G ? kind_names[kind] : "?";
+}
+
+static void *map_hugetlb(size_t len, int flags) {
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE | flags, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// THP 는 2 MB 정렬된 구간에서만 생기므로 더 크게 잡고 앞뒤를 잘라낸다
+static void *map_thp(size_t len) {
+    char *p, *aligned;
+
+    p = mmap(NULL, len + HUGEMEM_2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+
+    aligned = (char *)ROUND_UP((uintptr_t)p, HUGEMEM_2M);
+    if (aligned > p) {
+        munmap(p, aligned - p);
+    }
+    munmap(aligned + len, p + len + HUGEMEM_2M - (aligned + len));
+
+    if (madvise(aligned, len, MADV_HUGEPAGE) < 0) {
+        munmap(aligned, len);
+        return NULL;
+    }
+    // 미리 건드려 둬야 등록할 때 page fault 로 4 KB 가 끼어들지 않는다
+    memset(aligned, 0, len);
+    return aligned;
+}
+
+void *hugemem_alloc_kind(struct hugemem *m, size_t size, int max_kind) {
+    memset(m, 0, sizeof(*m));
+
+    if (size < HUGEMEM_MIN) {
+        max_kind = HUGEMEM_SMALL;
+    }
+
+    if (max_kind >= HUGEMEM_HUGETLB_1G && size >= HUGEMEM_1G) {
+        m->len = ROUND_UP(size, HUGEMEM_1G);
+        m->addr = map_hugetlb(m->len, MAP_HUGE_1GB);
+        if (m->addr) {
+            m->kind = HUGEMEM_HUGETLB_1G;
+            return m->addr;
+        }
+    }
+
+    if (max_kind >= HUGEMEM_HUGETLB_2M) {
+        m->len = ROUND_UP(size, HUGEMEM_2M);
+        m->addr = map_hugetlb(m->len, MAP_HUGE_2MB);
+        if (m->addr) {
+            m->kind = HUGEMEM_HUGETLB_2M;
+            return m->addr;
+        }
+    }
+
+    if (max_kind >= HUGEMEM_THP) {
+        m->len = ROUND_UP(size, HUGEMEM_2M);
+        m->addr = map_thp(m->len);
+        if (m->addr) {
+            m->kind = HUGEMEM_THP;
+            return m->addr;
+        }
+    }
+
+    m->len = ROUND_UP(size, 4096);
+    m->addr = mmap(NULL, m->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (m->addr == MAP_FAILED) {
+        perror("mmap");
+        memset(m, 0, sizeof(*m));
+        return NULL;
+    }
+    m->kind = HUGEMEM_SMALL;
+    return m->addr;
+}
+
+void *hugemem_alloc(struct hugemem *m, size_t size) {
+    return hugemem_alloc_kind(m, size, HUGEMEM_HUGETLB_1G);
+}
+
+void hugemem_free(struct hugemem *m) {
+    if (m->addr) {
+        munmap(m->addr, m->len);
+    }
+    memset(m, 0, sizeof(*m));
+}
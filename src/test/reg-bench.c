@@ -0,0 +1,309 @@
+//./reg-bench
+//./reg-bench -s 4096 -r 256 -v 100000 -t 5
+
+/*
+ * hugepage 가 MR 에 주는 효과를 잰다.
+ * 1) page 종류별 (4k / thp / 2m / 1g) ibv_reg_mr, ibv_dereg_mr 시간
+ * 2) 큰 영역 안의 임의 위치로 value 크기 RDMA WRITE 를 계속 보내는 처리량.
+ *    QP 를 자기 자신에게 연결해 (loopback) 원격 노드 없이 NIC 의 translation 만 본다.
+ */
+
+#include "common.h"
+#include "hugemem.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEPTH 32           // 동시에 걸어두는 WRITE 수
+
+static struct ibv_context *verbs;
+static struct ibv_pd *pd;
+static uint8_t port_num = 1;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void open_device(const char *name) {
+    struct ibv_device **list = ibv_get_device_list(NULL);
+    struct ibv_device *dev = NULL;
+
+    for (int i = 0; list && list[i]; i++) {
+        if (!name || strcmp(ibv_get_device_name(list[i]), name) == 0) {
+            dev = list[i];
+            break;
+        }
+    }
+    if (!dev) {
+        fprintf(stderr, "No RDMA device%s%s\n", name ? " named " : "", name ? name : "");
+        exit(EXIT_FAILURE);
+    }
+
+    verbs = ibv_open_device(dev);
+    if (!verbs) {
+        perror("ibv_open_device");
+        exit(EXIT_FAILURE);
+    }
+    printf("Device %s\n", ibv_get_device_name(dev));
+    ibv_free_device_list(list);
+
+    pd = ibv_alloc_pd(verbs);
+    if (!pd) {
+        perror("ibv_alloc_pd");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// 각 page 종류로 size 바이트를 잡아 등록/해제 시간을 iters 번 평균낸다
+static void bench_register(size_t size, int iters) {
+    struct hugemem mem;
+    struct ibv_mr *mr;
+    uint64_t reg_ns, dereg_ns, start;
+
+    for (int kind = HUGEMEM_SMALL; kind <= HUGEMEM_HUGETLB_1G; kind++) {
+        reg_ns = dereg_ns = 0;
+
+        if (!hugemem_alloc_kind(&mem, size, kind)) {
+            exit(EXIT_FAILURE);
+        }
+        if (mem.kind != kind) {
+            printf("%8lu MB  %-4s  not available\n", (unsigned long)(size >> 20), hugemem_kind_name(kind));
+            hugemem_free(&mem);
+            continue;
+        }
+        memset(mem.addr, 0, mem.len);
+
+        for (int i = 0; i < iters; i++) {
+            start = now_ns();
+            mr = ibv_reg_mr(pd, mem.addr, mem.len, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+            if (!mr) {
+                perror("ibv_reg_mr");
+                exit(EXIT_FAILURE);
+            }
+            reg_ns += now_ns() - start;
+
+            start = now_ns();
+            ibv_dereg_mr(mr);
+            dereg_ns += now_ns() - start;
+        }
+
+        printf("%8lu MB  %-4s  reg %10.3f ms  dereg %10.3f ms\n", (unsigned long)(size >> 20),
+            hugemem_kind_name(kind), reg_ns / 1e6 / iters, dereg_ns / 1e6 / iters);
+        hugemem_free(&mem);
+    }
+}
+
+static struct ibv_qp *create_loopback_qp(struct ibv_cq *cq) {
+    struct ibv_qp_init_attr init;
+    struct ibv_qp_attr attr;
+    struct ibv_port_attr port;
+    union ibv_gid gid;
+    struct ibv_qp *qp;
+
+    memset(&init, 0, sizeof(init));
+    init.qp_type = IBV_QPT_RC;
+    init.send_cq = cq;
+    init.recv_cq = cq;
+    init.cap.max_send_wr = BENCH_DEPTH;
+    init.cap.max_recv_wr = 1;
+    init.cap.max_send_sge = 1;
+    init.cap.max_recv_sge = 1;
+
+    qp = ibv_create_qp(pd, &init);
+    if (!qp) {
+        perror("ibv_create_qp");
+        exit(EXIT_FAILURE);
+    }
+
+    if (ibv_query_port(verbs, port_num, &port) || ibv_query_gid(verbs, port_num, 0, &gid)) {
+        perror("ibv_query_port");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_INIT;
+    attr.port_num = port_num;
+    attr.qp_access_flags = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+    if (ibv_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_ACCESS_FLAGS)) {
+        perror("ibv_modify_qp INIT");
+        exit(EXIT_FAILURE);
+    }
+
+    // 상대 QP 가 자기 자신
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTR;
+    attr.path_mtu = port.active_mtu;
+    attr.dest_qp_num = qp->qp_num;
+    attr.max_dest_rd_atomic = 1;
+    attr.min_rnr_timer = 12;
+    attr.ah_attr.port_num = port_num;
+    attr.ah_attr.dlid = port.lid;
+    if (port.link_layer == IBV_LINK_LAYER_ETHERNET) {
+        attr.ah_attr.is_global = 1;
+        attr.ah_attr.grh.dgid = gid;
+        attr.ah_attr.grh.sgid_index = 0;
+        attr.ah_attr.grh.hop_limit = 1;
+    }
+    if (ibv_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_AV | IBV_QP_PATH_MTU | IBV_QP_DEST_QPN
+        | IBV_QP_RQ_PSN | IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER)) {
+        perror("ibv_modify_qp RTR");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.qp_state = IBV_QPS_RTS;
+    attr.timeout = 14;
+    attr.retry_cnt = 7;
+    attr.rnr_retry = 7;
+    attr.max_rd_atomic = 1;
+    if (ibv_modify_qp(qp, &attr, IBV_QP_STATE | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT | IBV_QP_RNR_RETRY
+        | IBV_QP_SQ_PSN | IBV_QP_MAX_QP_RD_ATOMIC)) {
+        perror("ibv_modify_qp RTS");
+        exit(EXIT_FAILURE);
+    }
+
+    return qp;
+}
+
+// 영역 앞 절반에서 뒤 절반으로, 임의 위치의 value 를 seconds 동안 WRITE 한다
+static void bench_throughput(int max_kind, size_t size, uint32_t value_size, int seconds) {
+    struct hugemem mem;
+    struct ibv_mr *mr;
+    struct ibv_cq *cq;
+    struct ibv_qp *qp;
+    struct ibv_sge sge;
+    struct ibv_send_wr wr, *bad_wr;
+    struct ibv_wc wc[BENCH_DEPTH];
+    size_t half = size / 2, slots = half / value_size;
+    uint64_t start, end, done = 0, posted = 0, seed = 88172645463325252ull;
+    int n;
+
+    if (!hugemem_alloc_kind(&mem, size, max_kind)) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mem.addr, 0, mem.len);
+
+    mr = ibv_reg_mr(pd, mem.addr, mem.len, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+    cq = ibv_create_cq(verbs, BENCH_DEPTH, NULL, NULL, 0);
+    if (!mr || !cq) {
+        perror("Failed to register bench region");
+        exit(EXIT_FAILURE);
+    }
+    qp = create_loopback_qp(cq);
+
+    memset(&wr, 0, sizeof(wr));
+    wr.opcode = IBV_WR_RDMA_WRITE;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    sge.length = value_size;
+    sge.lkey = mr->lkey;
+    wr.wr.rdma.rkey = mr->rkey;
+
+    start = now_ns();
+    end = start + (uint64_t)seconds * 1000000000ull;
+
+    while (1) {
+        // 남는 자리만큼 다시 채운다. 위치는 xorshift 로 골라 translation cache 를 넘기게 한다
+        while (posted - done < BENCH_DEPTH && now_ns() < end) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            sge.addr = (uintptr_t)mem.addr + (seed % slots) * value_size;
+            wr.wr.rdma.remote_addr = (uintptr_t)mem.addr + half + ((seed >> 32) % slots) * value_size;
+
+            if (ibv_post_send(qp, &wr, &bad_wr)) {
+                perror("ibv_post_send");
+                exit(EXIT_FAILURE);
+            }
+            posted++;
+        }
+        if (posted == done) {
+            break;
+        }
+
+        n = ibv_poll_cq(cq, BENCH_DEPTH, wc);
+        if (n < 0) {
+            perror("ibv_poll_cq");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < n; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "RDMA WRITE failed: %s\n", ibv_wc_status_str(wc[i].status));
+                exit(EXIT_FAILURE);
+            }
+        }
+        done += n;
+    }
+
+    end = now_ns() - start;
+    printf("%-4s  %lu MB region, %u B values: %.0f ops/s, %.3f GB/s\n", hugemem_kind_name(mem.kind),
+        (unsigned long)(size >> 20), value_size, done * 1e9 / end, (double)done * value_size / end);
+
+    ibv_destroy_qp(qp);
+    ibv_destroy_cq(cq);
+    ibv_dereg_mr(mr);
+    hugemem_free(&mem);
+}
+
+int main(int argc, char **argv) {
+    const char *usage =
+        "Usage: %s [options]\n"
+        "  -d device     RDMA device (default: first)\n"
+        "  -s MB         largest region to register (default 1024)\n"
+        "  -n iters      registrations per size (default 5)\n"
+        "  -r MB         throughput region size (default 1024)\n"
+        "  -v bytes      value size for the throughput run (default KEY_VALUE_SIZE)\n"
+        "  -t seconds    throughput run length (default 5)\n";
+    const char *device = NULL;
+    size_t max_size = 1024ul << 20, region = 1024ul << 20;
+    uint32_t value_size = KEY_VALUE_SIZE;
+    int opt, iters = 5, seconds = 5;
+
+    while ((opt = getopt(argc, argv, "d:s:n:r:v:t:")) != -1) {
+        switch (opt) {
+        case 'd':
+            device = optarg;
+            break;
+        case 's':
+            max_size = strtoull(optarg, NULL, 10) << 20;
+            break;
+        case 'n':
+            iters = atoi(optarg);
+            break;
+        case 'r':
+            region = strtoull(optarg, NULL, 10) << 20;
+            break;
+        case 'v':
+            value_size = atoi(optarg);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, usage, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (iters <= 0 || value_size == 0 || region < 2 * (size_t)value_size) {
+        fprintf(stderr, usage, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    open_device(device);
+
+    printf("\nRegistration (average of %d)\n", iters);
+    for (size_t size = HUGEMEM_2M; size <= max_size; size *= 4) {
+        bench_register(size, iters);
+    }
+
+    printf("\nRandom RDMA WRITE, %d in flight\n", BENCH_DEPTH);
+    bench_throughput(HUGEMEM_SMALL, region, value_size, seconds);
+    bench_throughput(HUGEMEM_HUGETLB_1G, region, value_size, seconds);
+
+    ibv_dealloc_pd(pd);
+    ibv_close_device(verbs);
+    return EXIT_SUCCESS;
+}
@@ -1,36 +1,84 @@
+
 #include "common.h"
+#include "hugemem.h"
+
+#include <assert.h>
+#include <unistd.h>
 
-static struct rdma_context ctx;
-static struct rdma_cm_id *listen_id; 
-static struct rdma_cm_id *id = NULL;
+#define MAX_CONN_NUM 64
+
+static struct rdma_cm_id *listen_id;
 static struct rdma_event_channel *ec = NULL;
 static struct rdma_cm_event *event = NULL;
-static struct ibv_qp_init_attr qp_attr;
-static struct pdata rep_pdata;
-
-struct ibv_recv_wr recv_wr, *bad_recv_wr = NULL;
-struct ibv_send_wr send_wr, *bad_send_wr = NULL;
-struct ibv_sge recv_sge, send_sge;
-struct ibv_wc wc;
-static char *send_buffer = NULL, *recv_buffer = NULL;
-static void *cq_context;
 static int count = 0;
 
+// 연결마다 전용 스레드가 요청을 처리한다 (부하 생성기의 -t/-c 연결 수만큼)
+struct conn_context {
+    struct rdma_context ctx;
+    struct rdma_cm_id *id;
+    struct ibv_qp_init_attr qp_attr;
+    struct pdata rep_pdata;
+
+    struct ibv_recv_wr recv_wr, *bad_recv_wr;
+    struct ibv_send_wr send_wr, *bad_send_wr;
+    struct ibv_sge recv_sge, send_sge;
+    struct ibv_wc wc;
+    char *send_buffer, *recv_buffer;
+    struct hugemem mem;             // send/recv 버퍼를 한 hugepage 영역에 두고 MR 하나로 등록
+    struct ibv_mr *arena_mr;        // value arena (rendezvous READ/WRITE 가 여기서 바로 오간다)
+    void *cq_context;
+
+    pthread_t thread;
+    volatile int disconnected;
+};
+
+static struct conn_context conns[MAX_CONN_NUM];
+static pthread_mutex_t conns_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 static void setup_connection();
 static int handle_event();
-static void on_connect();
+static void on_connect(struct rdma_cm_id *id);
 
-static int pre_post_recv_buffer();
-static void wait_for_completion();
-static void process_message();
-int post_and_wait(struct ibv_send_wr *wr, const char *operation_name);
-void cleanup(struct rdma_cm_id *id);
+static void setup_buffers(struct conn_context *c);
+static int pre_post_recv_buffer(struct conn_context *c);
+static int wait_for_completion(struct conn_context *c);
+static void *process_message(void *arg);
+void cleanup(struct conn_context *c);
 
 
 #define HASH_SIZE 100
 
-static struct kv_pair *hash_table[HASH_SIZE];
+/*
+ * value 는 모두 등록된 arena 의 slot 에 있어서 RDMA READ 로 바로 받고 RDMA WRITE 로
+ * 바로 보낸다. slot 크기는 2 의 거듭제곱 class 이고 해제된 slot 은 class 별 free list 로.
+ * refs: entry 가 가리키면 1, 진행 중인 GET 응답마다 +1. 덮어쓴 값은 마지막
+ * 참조가 풀릴 때 free list 로 돌아가므로 보내는 도중에 바뀌지 않는다.
+ */
+#define SLOT_MIN_SHIFT 6
+#define SLOT_CLASSES 12             // 64 B .. 128 KB
+
+struct value_slot {
+    struct value_slot *next_free;
+    uint32_t cls;
+    uint32_t len;                   // NUL 포함
+    int refs;
+    char data[];
+};
+
+struct entry {
+    struct entry *next;
+    struct value_slot *value;
+    char key[];
+};
+
+static struct entry *hash_table[HASH_SIZE];
+static pthread_mutex_t hash_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct hugemem arena;
+static size_t arena_size = 512ul << 20;
+static size_t arena_used = 0;
+static struct value_slot *free_slots[SLOT_CLASSES];
 
 unsigned int hash(const char *key) {
     unsigned int hash = 0;
@@ -40,34 +88,123 @@ unsigned int hash(const char *key) {
     return hash % HASH_SIZE;
 }
 
-void put(const char *key, const char *value) {
+// len 바이트 value 를 담을 slot (refs = 1). arena 가 가득 차면 NULL
+static struct value_slot *slot_alloc(uint32_t len) {
+    size_t need = sizeof(struct value_slot) + len;
+    struct value_slot *slot;
+    uint32_t cls = 0;
+
+    while (((size_t)1 << (SLOT_MIN_SHIFT + cls)) < need) {
+        cls++;
+    }
+    if (cls >= SLOT_CLASSES) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&hash_lock);
+    slot = free_slots[cls];
+    if (slot) {
+        free_slots[cls] = slot->next_free;
+    } else if (arena_used + ((size_t)1 << (SLOT_MIN_SHIFT + cls)) <= arena.len) {
+        slot = (struct value_slot *)((char *)arena.addr + arena_used);
+        arena_used += (size_t)1 << (SLOT_MIN_SHIFT + cls);
+    }
+    pthread_mutex_unlock(&hash_lock);
+
+    if (slot) {
+        slot->cls = cls;
+        slot->len = len;
+        slot->refs = 1;
+    }
+    return slot;
+}
+
+// hash_lock 을 잡고 부른다
+static void slot_unref_locked(struct value_slot *slot) {
+    if (--slot->refs == 0) {
+        slot->next_free = free_slots[slot->cls];
+        free_slots[slot->cls] = slot;
+    }
+}
+
+static void slot_unref(struct value_slot *slot) {
+    pthread_mutex_lock(&hash_lock);
+    slot_unref_locked(slot);
+    pthread_mutex_unlock(&hash_lock);
+}
+
+// 같은 key 가 있으면 value 만 바꾼다. 이전 slot 은 참조가 다 풀리면 재사용된다.
+// 찾기와 넣기는 한 critical section 안에서 한다 (새 key 를 동시에 넣어도 entry 는 하나).
+// entry 는 lock 밖에서 미리 만들고, 이미 있던 key 면 버린다
+void put(const char *key, struct value_slot *value) {
     unsigned int index = hash(key);
-    printf("PUT operation hash key: %d\n", index);
-    
-    struct kv_pair *new_entry = malloc(sizeof(struct kv_pair));
-    strncpy(new_entry->key, key, KEY_VALUE_SIZE);
-    strncpy(new_entry->value, value, KEY_VALUE_SIZE);
+    struct entry *entry, *new_entry;
+    //printf("PUT operation hash key: %d\n", index);
+
+    new_entry = malloc(sizeof(struct entry) + strlen(key) + 1);
+    if (!new_entry) {
+        perror("Failed to allocate entry");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(new_entry->key, key);
+    new_entry->value = value;
+
+    pthread_mutex_lock(&hash_lock);
+    for (entry = hash_table[index]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            slot_unref_locked(entry->value);
+            entry->value = value;
+            pthread_mutex_unlock(&hash_lock);
+            free(new_entry);
+            return;
+        }
+    }
     new_entry->next = hash_table[index];
     hash_table[index] = new_entry;
+    pthread_mutex_unlock(&hash_lock);
     //printf("PUT operation: Key: %s, Value: %s\n\n", key, value);
 }
 
-char *get(const char *key) {
+// 찾은 value 의 slot 에 참조를 하나 잡아 돌려준다 (다 보낸 뒤 slot_unref)
+struct value_slot *get(const char *key) {
     unsigned int index = hash(key);
-    printf("GET operation hash key: %d\n", index);
-    struct kv_pair *entry = hash_table[index];
-    while (entry != NULL) {
-        if (strncmp(entry->key, key, KEY_VALUE_SIZE) == 0) {
-            printf("GET operation: Key: %s, Value: %s\n", key, entry->value);
-            return entry->value;
+    struct value_slot *value = NULL;
+    //printf("GET operation hash key: %d\n", index);
+
+    pthread_mutex_lock(&hash_lock);
+    for (struct entry *entry = hash_table[index]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0) {
+            value = entry->value;
+            value->refs++;
+            break;
         }
-        entry = entry->next;
     }
+    pthread_mutex_unlock(&hash_lock);
     //printf("GET operation: Key: %s, Value: not found\n\n", key);
-    return NULL;
+    return value;
 }
 
-int main() {
+int main(int argc, char **argv) {
+    int opt;
+
+    // -A: value arena 크기 (MB)
+    while ((opt = getopt(argc, argv, "A:")) != -1) {
+        switch (opt) {
+        case 'A':
+            arena_size = strtoull(optarg, NULL, 10) << 20;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-A arena-MB]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!hugemem_alloc(&arena, arena_size)) {
+        perror("Failed to allocate value arena");
+        exit(EXIT_FAILURE);
+    }
+    printf("Value arena: %lu MB on %s pages\n", (unsigned long)(arena.len >> 20), hugemem_kind_name(arena.kind));
+
     setup_connection();
     return EXIT_SUCCESS;
 }
@@ -96,7 +233,7 @@ static void setup_connection() {
         exit(EXIT_FAILURE);
     }
 
-    if (rdma_listen(listen_id, 1)) {
+    if (rdma_listen(listen_id, MAX_CONN_NUM)) {
         perror("rdma_listen");
         exit(EXIT_FAILURE);
     }
@@ -104,7 +241,7 @@ static void setup_connection() {
     //printf("Listening for incoming connections...\n");
 
     while (1) {
-        
+
         count++;
         //printf("count: %d\n", count);
 
@@ -113,8 +250,6 @@ static void setup_connection() {
             exit(EXIT_FAILURE);
         }
 
-        id = event->id;
-
         if (handle_event()) {
             break;
         }
@@ -127,299 +262,380 @@ static void setup_connection() {
 }
 
 static int handle_event() {
+    struct conn_context *c = (struct conn_context *)event->id->context;
 
     printf("Event type: %s\n", rdma_event_str(event->event));
 
     if (event->event == RDMA_CM_EVENT_CONNECT_REQUEST) {
         printf("Connection request received.\n");
-        on_connect();
+        on_connect(event->id);
     } else if(event->event == RDMA_CM_EVENT_ESTABLISHED) {
 		printf("connect established.\n");
-        id = event->id;
-        process_message();
+        if (pthread_create(&c->thread, NULL, process_message, c) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(c->thread);
     } else if (event->event == RDMA_CM_EVENT_DISCONNECTED) {
         printf("Disconnected from client.\n");
-        cleanup(id);
-        exit(EXIT_FAILURE);
+        // 자원 정리는 해당 연결의 스레드가 CQ 를 더 이상 보지 않을 때 한다
+        if (c) {
+            c->disconnected = 1;
+        }
     }
 
     return 0;
 }
 
-static void on_connect() {
+static void on_connect(struct rdma_cm_id *id) {
+    struct conn_context *c = NULL;
     struct rdma_conn_param conn_param;
 
+    pthread_mutex_lock(&conns_lock);
+    for (int i = 0; i < MAX_CONN_NUM; i++) {
+        if (conns[i].id == NULL) {
+            c = &conns[i];
+            memset(c, 0, sizeof(*c));
+            c->id = id;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&conns_lock);
+
+    if (!c) {
+        fprintf(stderr, "Too many connections, rejecting.\n");
+        rdma_reject(id, NULL, 0);
+        return;
+    }
+    id->context = c;
+
     /* Allocate resources */
-    build_context(&ctx, id);
-    build_qp_attr(&qp_attr, &ctx);
+    build_context(&c->ctx, id);
+    build_qp_attr(&c->qp_attr, &c->ctx);
 
     printf("Creating QP...\n");
-    if (rdma_create_qp(id, ctx.pd, &qp_attr)) {
+    if (rdma_create_qp(id, c->ctx.pd, &c->qp_attr)) {
         perror("rdma_create_qp");
         exit(EXIT_FAILURE);
     }
+    c->ctx.qp = id->qp;
     printf("Queue Pair created: %p\n", (void*)id->qp);
 
-    pre_post_recv_buffer();
+    setup_buffers(c);
+    pre_post_recv_buffer(c);
 
-    rep_pdata.buf_va = htonll((uintptr_t) recv_buffer);
-    rep_pdata.buf_rkey = htonl(ctx.recv_mr->rkey);
+    c->rep_pdata.buf_va = htonll((uintptr_t) c->recv_buffer);
+    c->rep_pdata.buf_rkey = htonl(c->ctx.recv_mr->rkey);
 
     memset(&conn_param, 0, sizeof(conn_param));
 	conn_param.initiator_depth = 3;
     conn_param.responder_resources = 3;
     conn_param.retry_count = 3;
-    conn_param.private_data = &rep_pdata; 
-    conn_param.private_data_len = sizeof(rep_pdata);
+    conn_param.private_data = &c->rep_pdata;
+    conn_param.private_data_len = sizeof(c->rep_pdata);
 
     if (rdma_accept(id, &conn_param)) {
         perror("rdma_accept");
         exit(EXIT_FAILURE);
     }
     printf("Connection accepted.\n\n");
-    
-    memcpy(&rep_pdata,event->param.conn.private_data,sizeof(rep_pdata));
-    printf("Received client Memory at address %p with RKey %u\n", (void *)rep_pdata.buf_va, ntohl(rep_pdata.buf_rkey));
-}
-
-static int pre_post_recv_buffer() {
-    static int buffer_initialized = 0;
-
-    if (!buffer_initialized) {
-        recv_buffer = calloc(2, sizeof(struct message));  // 메시지 두 개를 받을 수 있도록 설정
-        if (!recv_buffer) {
-            perror("Failed to allocate memory for receive buffer");
-            exit(EXIT_FAILURE);
-        }
 
-        ctx.recv_mr = ibv_reg_mr(ctx.pd, recv_buffer, sizeof(struct message), 
-            IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
-
-        if (!ctx.recv_mr) {
-            perror("Failed to register memory region");
-            exit(EXIT_FAILURE);
-        }
+    memcpy(&c->rep_pdata,event->param.conn.private_data,sizeof(c->rep_pdata));
+    printf("Received client Memory at address %p with RKey %u\n", (void *)c->rep_pdata.buf_va, ntohl(c->rep_pdata.buf_rkey));
+}
 
-        buffer_initialized = 1;  // 버퍼 초기화 완료
-        printf("Memory registered at address %p with LKey %u\n", recv_buffer, ctx.recv_mr->lkey);
+// send/recv 는 header + key + eager value 크기면 된다 (큰 value 는 arena 로 바로 오간다).
+// 둘을 한 영역에 두고 MR 하나로 등록하고, arena 는 이 연결의 PD 에 따로 등록한다
+static void setup_buffers(struct conn_context *c) {
+    if (!hugemem_alloc(&c->mem, 2 * MSG_INLINE_SIZE)) {
+        perror("Failed to allocate memory for message buffers");
+        exit(EXIT_FAILURE);
     }
+    c->send_buffer = c->mem.addr;
+    c->recv_buffer = c->send_buffer + MSG_INLINE_SIZE;
+
+    c->ctx.send_mr = ibv_reg_mr(c->ctx.pd, c->mem.addr, c->mem.len,
+        IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+    c->arena_mr = ibv_reg_mr(c->ctx.pd, arena.addr, arena.len, IBV_ACCESS_LOCAL_WRITE);
+    if (!c->ctx.send_mr || !c->arena_mr) {
+        perror("Failed to register memory region");
+        exit(EXIT_FAILURE);
+    }
+    c->ctx.recv_mr = c->ctx.send_mr;
+
+    printf("Memory registered at address %p with LKey %u (%lu KB, %s pages)\n", c->mem.addr, c->ctx.send_mr->lkey,
+        (unsigned long)(c->mem.len >> 10), hugemem_kind_name(c->mem.kind));
+}
 
-    recv_sge.addr = (uintptr_t)recv_buffer;
-    recv_sge.length = sizeof(struct message);  // 한 번에 한 메시지를 처리한다고 가정
+static int pre_post_recv_buffer(struct conn_context *c) {
+    c->recv_sge.addr = (uintptr_t)c->recv_buffer;
+    c->recv_sge.length = MSG_INLINE_SIZE;  // 한 번에 한 메시지를 처리한다고 가정
 
-    recv_sge.lkey = ctx.recv_mr->lkey;
+    c->recv_sge.lkey = c->ctx.recv_mr->lkey;
 
-    memset(&recv_wr, 0, sizeof(recv_wr));
-    recv_wr.wr_id = 0;
-    recv_wr.sg_list = &recv_sge;
-    recv_wr.num_sge = 1;
+    memset(&c->recv_wr, 0, sizeof(c->recv_wr));
+    c->recv_wr.wr_id = 0;
+    c->recv_wr.sg_list = &c->recv_sge;
+    c->recv_wr.num_sge = 1;
 
-    if (ibv_post_recv(id->qp, &recv_wr, &bad_recv_wr)) {
+    if (ibv_post_recv(c->id->qp, &c->recv_wr, &c->bad_recv_wr)) {
         perror("Failed to post receive work request");
         return 1;
     }
-    
+
 
     return 0;
 }
 
 
-static void wait_for_completion()
+// 연결이 끊기면 -1
+static int wait_for_completion(struct conn_context *c)
 {
     int ret;
 
     do {
-        ret = ibv_poll_cq(ctx.cq, 1, &wc);
-    } while (ret == 0);
+        ret = ibv_poll_cq(c->ctx.cq, 1, &c->wc);
+    } while (ret == 0 && !c->disconnected);
+
+    if (ret == 0) {
+        return -1;
+    }
 
     if (ret < 0) {
         perror("ibv_poll_cq");
         exit(EXIT_FAILURE);
     }
-    
-    if (wc.status != IBV_WC_SUCCESS) {
-        fprintf(stderr, "Work completion error: %s\n", ibv_wc_status_str(wc.status));
+
+    if (c->wc.status != IBV_WC_SUCCESS) {
+        if (c->disconnected || c->wc.status == IBV_WC_WR_FLUSH_ERR) {
+            return -1;
+        }
+        fprintf(stderr, "Work completion error: %s\n", ibv_wc_status_str(c->wc.status));
         exit(EXIT_FAILURE);
     }
 
     //printf("wait_for_completion ended\n");
+    return 0;
 }
 
-static void process_message() {
+// 클라이언트 버퍼 (addr, rkey) 의 value 를 slot 으로 직접 읽어온다
+static int read_value(struct conn_context *c, struct value_slot *slot, uint64_t addr, uint32_t rkey) {
+    struct ibv_sge sge;
+    struct ibv_send_wr wr, *bad_wr;
+
+    sge.addr = (uintptr_t)slot->data;
+    sge.length = slot->len;
+    sge.lkey = c->arena_mr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = 2;
+    wr.opcode = IBV_WR_RDMA_READ;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.wr.rdma.remote_addr = addr;
+    wr.wr.rdma.rkey = rkey;
+
+    if (ibv_post_send(c->id->qp, &wr, &bad_wr)) {
+        fprintf(stderr, "Failed to post RDMA read: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return wait_for_completion(c);
+}
+
+static void *process_message(void *arg) {
+    struct conn_context *c = (struct conn_context *)arg;
+    struct msg_hdr *req = (struct msg_hdr *)c->recv_buffer;
+    struct msg_hdr *resp = (struct msg_hdr *)c->send_buffer;
+    struct ibv_send_wr write_wr;
+    struct ibv_sge write_sge;
+    struct value_slot *slot;
 
     while(1) {
         //printf("here. \n\n");
-        
-        struct message *msg = (struct message *)recv_buffer;
-        wait_for_completion();
-        
-        send_buffer = (char *)calloc(2, sizeof(struct message));
-        //send_buffer = (char *)malloc(sizeof(uint32_t));
-        if (!send_buffer) {
-            perror("Failed to allocate memory for send buffer");
-            exit(EXIT_FAILURE);
-        }
-
-        ctx.send_mr = ibv_reg_mr(ctx.pd, send_buffer, sizeof(struct message), IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
-        if (!ctx.send_mr) {
-            fprintf(stderr, "Failed to register client metadata buffer.\n");
-            exit(EXIT_FAILURE);
-        }
 
-        if (msg == NULL) {
-            printf("Received null message.\n");
-            exit(EXIT_FAILURE);
+        if (wait_for_completion(c) != 0) {
+            break;
         }
 
-        //printf("Packet size: %lu bytes\n\n", sizeof(struct message));
-        //printf("Received message - Type: %d, Key: %s, Value: %s\n", msg->type, msg->kv.key, msg->kv.value);
-        // printf("\nrecv_buffer content:\n");
-        // printf("Type: %d\n", msg->type);
-        // printf("Key: %s\n", msg->kv.key);
-        // printf("Value: %s\n\n", msg->kv.value);
-    
-        if (msg->type == MSG_PUT) {
-            put(msg->kv.key, msg->kv.value);
-            //printf("PUT operation: Key: %s, Value: %s\n", msg->kv.key, msg->kv.value);
-
-            //snprintf(send_buffer, BUFFER_SIZE, "PUT %s %s", msg->kv.key, msg->kv.value);
-            strncpy(send_buffer, "PUT ", sizeof(msg->type));
-            strncat(send_buffer, msg->kv.key, sizeof(msg->kv.key));
-            strncat(send_buffer, " ", sizeof(msg->type));
-            strncat(send_buffer, msg->kv.value, sizeof(msg->kv.value));
-
-        } else if (msg->type == MSG_GET) {
-            //printf("GET operation: Key: %s, Value: dummy_value\n", msg->kv.key);
-
-            char *value = get(msg->kv.key);
+        //printf("Received message - Type: %d, Key: %s, Value length: %u\n", req->type, msg_key(req), req->value_len);
+
+        memset(resp, 0, sizeof(*resp));
+        resp->type = req->type;
+        resp->status = MSG_OK;
+        slot = NULL;        // GET 이 응답을 다 보낸 뒤 놓을 참조
+
+        if (req->key_len == 0 || req->key_len > KEY_MAX) {
+            resp->status = MSG_NOT_FOUND;
+        } else if (req->type == MSG_PUT && !(req->flags & MSG_RNDV)
+            && (req->value_len > EAGER_MAX
+                || sizeof(*req) + (uint64_t)req->key_len + req->value_len > c->wc.byte_len)) {
+            // eager value 는 recv 버퍼에 실제로 들어온 만큼만 믿는다
+            resp->status = MSG_BAD_REQUEST;
+        } else if (req->type == MSG_PUT) {
+            struct value_slot *value;
+
+            msg_key(req)[req->key_len - 1] = '\0';
+            value = req->value_len ? slot_alloc(req->value_len) : NULL;
+            if (!value) {
+                resp->status = MSG_NO_SPACE;
+            } else if (req->flags & MSG_RNDV) {
+                // 큰 value 는 클라이언트 버퍼에서 arena 로 바로 가져온다
+                if (read_value(c, value, req->addr, req->rkey) != 0) {
+                    slot_unref(value);
+                    break;
+                }
+            } else {
+                memcpy(value->data, msg_value(req), req->value_len);
+            }
             if (value) {
-                strncpy(msg->kv.value, value, KEY_VALUE_SIZE);
+                value->data[value->len - 1] = '\0';
+                put(msg_key(req), value);
+            }
+            //printf("PUT operation: Key: %s, Value length: %u\n", msg_key(req), req->value_len);
+
+        } else if (req->type == MSG_GET) {
+            msg_key(req)[req->key_len - 1] = '\0';
+            slot = get(msg_key(req));
+            if (!slot) {
+                resp->status = MSG_NOT_FOUND;
+            } else if (slot->len <= EAGER_MAX) {
+                resp->value_len = slot->len;
+                memcpy(msg_value(resp), slot->data, slot->len);
+                slot_unref(slot);
+                slot = NULL;
+            } else if (!(req->flags & MSG_RNDV) || slot->len > req->value_len) {
+                resp->status = MSG_NO_SPACE;
+                slot_unref(slot);
+                slot = NULL;
             } else {
-                strncpy(msg->kv.value, "NOT_FOUND", KEY_VALUE_SIZE);
+                resp->flags = MSG_RNDV;
+                resp->value_len = slot->len;
             }
-            
-            //snprintf(send_buffer, BUFFER_SIZE, "GET %s", msg->kv.key);
-            strncpy(send_buffer, "GET ", BUFFER_SIZE);
-            strncat(send_buffer, msg->kv.key, BUFFER_SIZE - strlen(send_buffer) - 1);
+            //printf("GET operation: Key: %s, Value length: %u\n", msg_key(req), resp->value_len);
         }
 
-        send_sge.addr = (uintptr_t)send_buffer;
-        send_sge.length = sizeof(struct message);
-        //send_sge.length = sizeof(uint32_t);
-        send_sge.lkey = ctx.send_mr->lkey;
+        c->send_sge.addr = (uintptr_t)c->send_buffer;
+        c->send_sge.length = sizeof(*resp) + (resp->flags & MSG_RNDV ? 0 : resp->value_len);
+        c->send_sge.lkey = c->ctx.send_mr->lkey;
 
         //memset(&send_wr, 0, sizeof(send_wr));
-        send_wr.opcode = IBV_WR_SEND;
-        send_wr.send_flags = IBV_SEND_SIGNALED;
-        send_wr.sg_list = &send_sge;
-        send_wr.num_sge = 1;
-        send_wr.wr_id = 1;
-
-        send_wr.wr.rdma.rkey = ntohl(rep_pdata.buf_rkey);
-	    send_wr.wr.rdma.remote_addr = ntohll(rep_pdata.buf_va); 
-
-        struct message *msg_in_buffer = (struct message *)send_buffer;
-        memcpy(msg_in_buffer, msg, sizeof(struct message));
+        c->send_wr.opcode = IBV_WR_SEND;
+        c->send_wr.send_flags = IBV_SEND_SIGNALED;
+        c->send_wr.sg_list = &c->send_sge;
+        c->send_wr.num_sge = 1;
+        c->send_wr.wr_id = 1;
+        c->send_wr.next = NULL;
+
+        // 큰 GET: arena 의 slot 을 클라이언트 버퍼로 WRITE 하고 header SEND 를 뒤에 잇는다.
+        // RC 는 순서를 지키므로 SEND 가 도착하면 value 도 이미 와 있다
+        if (slot) {
+            write_sge.addr = (uintptr_t)slot->data;
+            write_sge.length = slot->len;
+            write_sge.lkey = c->arena_mr->lkey;
+
+            memset(&write_wr, 0, sizeof(write_wr));
+            write_wr.wr_id = 3;
+            write_wr.opcode = IBV_WR_RDMA_WRITE;
+            write_wr.sg_list = &write_sge;
+            write_wr.num_sge = 1;
+            write_wr.wr.rdma.remote_addr = req->addr;
+            write_wr.wr.rdma.rkey = req->rkey;
+            write_wr.next = &c->send_wr;
+        }
 
-        // printf("\nsend_buffer content:\n");
-        // printf("Type: %d\n", msg_in_buffer->type);
-        // printf("Key: %s\n", msg_in_buffer->kv.key);
-        // printf("Value: %s\n\n", msg_in_buffer->kv.value);
+        // 응답 전에 다음 요청용 recv 를 건다 (클라이언트가 바로 다음 요청을 보낼 수 있다)
+        pre_post_recv_buffer(c);
 
-        if (ibv_post_send(id->qp, &send_wr, &bad_send_wr)) {
+        if (ibv_post_send(c->id->qp, slot ? &write_wr : &c->send_wr, &c->bad_send_wr)) {
             fprintf(stderr, "Failed to post send work request: %s\n", strerror(errno));
             exit(EXIT_FAILURE);
         }
-   
-        wait_for_completion();
 
-        printf("Send completed successfully\n\n");
+        // SEND 가 끝나면 앞의 WRITE 도 끝났으니 slot 을 놓아도 된다
+        if (wait_for_completion(c) != 0) {
+            if (slot) {
+                slot_unref(slot);
+            }
+            break;
+        }
+        if (slot) {
+            slot_unref(slot);
+        }
+
+        //printf("Send completed successfully\n\n");
 
 
         // 이벤트 채널에서 완료 큐 이벤트 기다리기
-        if (ibv_get_cq_event(ctx.comp_channel,&ctx.evt_cq,&cq_context)) {
+        if (ibv_get_cq_event(c->ctx.comp_channel,&c->ctx.evt_cq,&c->cq_context)) {
             perror("ibv_get_cq_event");
-            free(send_buffer);
-            ibv_dereg_mr(ctx.send_mr);
-            exit(EXIT_FAILURE);
+            break;
         }
 
         // 완료 큐에서 이벤트를 처리
-        ibv_ack_cq_events(ctx.cq,1);
+        ibv_ack_cq_events(c->ctx.cq,1);
 
-	    if (ibv_req_notify_cq(ctx.cq,0)) {
-            free(send_buffer);
-            ibv_dereg_mr(ctx.send_mr);
-            exit(EXIT_FAILURE);
+	    if (ibv_req_notify_cq(c->ctx.cq,0)) {
+            break;
         }
-        
-		pre_post_recv_buffer();
     }
-}
 
+    cleanup(c);
+    return NULL;
+}
 
 
-void cleanup(struct rdma_cm_id *id) {
-    if (send_buffer) {
-        assert(send_buffer != NULL); 
-        free(send_buffer);
-        send_buffer = NULL; 
-    }
 
-    if (recv_buffer) {
-        assert(recv_buffer != NULL); 
-        free(recv_buffer);
-        recv_buffer = NULL; 
-    }
+void cleanup(struct conn_context *c) {
+    // send/recv 는 같은 MR 이다
+    c->ctx.recv_mr = NULL;
 
-    if (ctx.recv_mr) {
-        assert(ctx.recv_mr != NULL); 
-        ibv_dereg_mr(ctx.recv_mr);
-        ctx.recv_mr = NULL;
+    if (c->ctx.send_mr) {
+        assert(c->ctx.send_mr != NULL);
+        ibv_dereg_mr(c->ctx.send_mr);
+        c->ctx.send_mr = NULL;
     }
 
-    if (ctx.send_mr) {
-        assert(ctx.send_mr != NULL); 
-        ibv_dereg_mr(ctx.send_mr);
-        ctx.send_mr = NULL; 
+    if (c->arena_mr) {
+        ibv_dereg_mr(c->arena_mr);
+        c->arena_mr = NULL;
     }
 
-    if (ctx.qp) {
-        assert(ctx.qp != NULL); 
-        rdma_destroy_qp(id);
-        ctx.qp = NULL; 
-    }
+    // MR 을 먼저 풀고 나서 메모리를 돌려준다
+    hugemem_free(&c->mem);
+    c->send_buffer = NULL;
+    c->recv_buffer = NULL;
 
-    if (ctx.cq) {
-        assert(ctx.cq != NULL); 
-        ibv_destroy_cq(ctx.cq);
-        ctx.cq = NULL; 
+    if (c->ctx.qp) {
+        assert(c->ctx.qp != NULL);
+        rdma_destroy_qp(c->id);
+        c->ctx.qp = NULL;
     }
 
-    if (ctx.comp_channel) {
-        assert(ctx.comp_channel != NULL);
-        ibv_destroy_comp_channel(ctx.comp_channel);
-        ctx.comp_channel = NULL; 
+    if (c->ctx.cq) {
+        assert(c->ctx.cq != NULL);
+        ibv_destroy_cq(c->ctx.cq);
+        c->ctx.cq = NULL;
     }
 
-    if (ctx.pd) {
-        assert(ctx.pd != NULL);
-        ibv_dealloc_pd(ctx.pd);
-        ctx.pd = NULL; 
+    if (c->ctx.comp_channel) {
+        assert(c->ctx.comp_channel != NULL);
+        ibv_destroy_comp_channel(c->ctx.comp_channel);
+        c->ctx.comp_channel = NULL;
     }
 
-    if (id) {
-        assert(id != NULL);
-        rdma_destroy_id(id);
-        id = NULL; 
+    if (c->ctx.pd) {
+        assert(c->ctx.pd != NULL);
+        ibv_dealloc_pd(c->ctx.pd);
+        c->ctx.pd = NULL;
     }
 
-    if (ec) {
-        assert(ec != NULL); 
-        rdma_destroy_event_channel(ec);
-        ec = NULL;
+    // 슬롯 반환
+    pthread_mutex_lock(&conns_lock);
+    if (c->id) {
+        assert(c->id != NULL);
+        rdma_destroy_id(c->id);
+        c->id = NULL;
     }
-
-    printf("here.\n");
+    pthread_mutex_unlock(&conns_lock);
 }
-
@@ -0,0 +1,137 @@
+#include "trace.h"
+#include "workload.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int trace_open(struct trace *t, const char *path) {
+    struct stat st;
+
+    memset(t, 0, sizeof(*t));
+    t->fd = open(path, O_RDONLY);
+    if (t->fd < 0) {
+        perror("open trace");
+        return -1;
+    }
+
+    if (fstat(t->fd, &st) < 0) {
+        perror("fstat trace");
+        close(t->fd);
+        return -1;
+    }
+    t->size = st.st_size;
+
+    if (t->size < sizeof(struct trace_header)) {
+        fprintf(stderr, "%s: too small to be a trace\n", path);
+        close(t->fd);
+        return -1;
+    }
+
+    // 재생 중 page fault 가 나지 않도록 미리 채워둔다
+    t->map = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, t->fd, 0);
+    if (t->map == MAP_FAILED) {
+        perror("mmap trace");
+        close(t->fd);
+        return -1;
+    }
+    madvise(t->map, t->size, MADV_SEQUENTIAL);
+
+    t->hdr = (const struct trace_header *)t->map;
+    t->rec = (const struct trace_record *)(t->hdr + 1);
+
+    if (t->hdr->magic != TRACE_MAGIC || t->hdr->version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d trace\n", path, TRACE_VERSION);
+        trace_close(t);
+        return -1;
+    }
+
+    // 곱하면 큰 count 가 넘쳐서 통과하므로 나눠서 비교한다
+    if (t->hdr->count > (t->size - sizeof(struct trace_header)) / sizeof(struct trace_record)) {
+        fprintf(stderr, "%s: truncated (%lu records in header)\n", path, (unsigned long)t->hdr->count);
+        trace_close(t);
+        return -1;
+    }
+
+    // 재생은 op 로 배열을 고르고 value_len 만큼 value_max 크기 버퍼에 복사하므로 여기서 한 번 거른다
+    for (uint64_t i = 0; i < t->hdr->count; i++) {
+        if (t->rec[i].op >= WL_OP_MAX || t->rec[i].value_len > t->hdr->value_max) {
+            fprintf(stderr, "%s: record %lu has op %u, value length %u (value max %u)\n", path,
+                (unsigned long)i, t->rec[i].op, t->rec[i].value_len, t->hdr->value_max);
+            trace_close(t);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void trace_close(struct trace *t) {
+    if (t->map && t->map != MAP_FAILED) {
+        munmap(t->map, t->size);
+    }
+    if (t->fd >= 0) {
+        close(t->fd);
+    }
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+}
+
+int trace_writer_open(struct trace_writer *tw, const char *path, const struct trace_header *hdr) {
+    tw->fp = fopen(path, "wb");
+    if (!tw->fp) {
+        perror("fopen trace");
+        return -1;
+    }
+
+    tw->hdr = *hdr;
+    tw->hdr.magic = TRACE_MAGIC;
+    tw->hdr.version = TRACE_VERSION;
+    tw->hdr.count = 0;
+
+    if (fwrite(&tw->hdr, sizeof(tw->hdr), 1, tw->fp) != 1) {
+        perror("write trace header");
+        return -1;
+    }
+    return 0;
+}
+
+int trace_writer_append(struct trace_writer *tw, const struct trace_record *rec) {
+    if (fwrite(rec, sizeof(*rec), 1, tw->fp) != 1) {
+        perror("write trace record");
+        return -1;
+    }
+    tw->hdr.count++;
+    return 0;
+}
+
+// 마지막에 count 를 채운 header 로 덮어쓴다
+int trace_writer_close(struct trace_writer *tw) {
+    int ret = 0;
+
+    if (fseek(tw->fp, 0, SEEK_SET) != 0 || fwrite(&tw->hdr, sizeof(tw->hdr), 1, tw->fp) != 1) {
+        perror("finalize trace header");
+        ret = -1;
+    }
+    if (fclose(tw->fp) != 0) {
+        perror("close trace");
+        ret = -1;
+    }
+    tw->fp = NULL;
+    return ret;
+}
+
+void trace_fill_value_block(char *block, int size) {
+    static const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+/";
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+
+    for (int i = 0; i < size; i++) {
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        block[i] = charset[(x * 0x2545F4914F6CDD1Dull) >> 58];
+    }
+}
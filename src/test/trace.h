@@ -0,0 +1,63 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * 바이너리 워크로드 trace.
+ * [trace_header][trace_record x count] 로 구성되며 little-endian 으로 기록한다.
+ * key 는 key id 로만 저장하고 문자열은 workload_key() 로 만든다. value 는
+ * 미리 채워둔 value block 의 (value_seed 위치, value_len 길이) 구간을 쓴다.
+ */
+#define TRACE_MAGIC 0x5254564bu  // "KVTR"
+#define TRACE_VERSION 1
+
+#define TRACE_TIMED 0x1          // ts_ns 에 맞춰 재생할 수 있다
+
+struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t record_count;       // 재생 전에 preload 할 key 수
+    uint32_t key_size;
+    uint32_t value_max;
+    uint32_t flags;
+    uint32_t reserved;
+} __attribute__((packed));
+
+struct trace_record {
+    uint64_t ts_ns;              // trace 시작 기준 상대 시각
+    uint64_t key_id;
+    uint32_t value_len;
+    uint32_t value_seed;
+    uint8_t op;                  // enum workload_op
+    uint8_t reserved[7];
+} __attribute__((packed));
+
+struct trace {
+    int fd;
+    void *map;
+    size_t size;
+    const struct trace_header *hdr;
+    const struct trace_record *rec;
+};
+
+struct trace_writer {
+    FILE *fp;
+    struct trace_header hdr;
+};
+
+// header 와 모든 record 를 검사한다 (op < WL_OP_MAX, value_len <= value_max)
+int trace_open(struct trace *t, const char *path);
+void trace_close(struct trace *t);
+
+int trace_writer_open(struct trace_writer *tw, const char *path, const struct trace_header *hdr);
+int trace_writer_append(struct trace_writer *tw, const struct trace_record *rec);
+int trace_writer_close(struct trace_writer *tw);
+
+// 재생 시 value 로 쓰는 고정 블록: value_max + TRACE_VALUE_SLACK 바이트
+#define TRACE_VALUE_SLACK 256
+void trace_fill_value_block(char *block, int size);
+
+#endif // TRACE_H
@@ -0,0 +1,262 @@
+#include "workload.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+const char *workload_op_names[WL_OP_MAX] = { "READ", "UPDATE", "INSERT", "SCAN", "RMW" };
+
+// YCSB core workloads A-F
+int workload_preset(struct workload_config *cfg, char name) {
+    cfg->read_prop = cfg->update_prop = cfg->insert_prop = cfg->scan_prop = cfg->rmw_prop = 0;
+    cfg->key_dist = DIST_ZIPFIAN;
+
+    switch (name) {
+    case 'a': case 'A':  // update heavy
+        cfg->read_prop = 0.5;
+        cfg->update_prop = 0.5;
+        break;
+    case 'b': case 'B':  // read mostly
+        cfg->read_prop = 0.95;
+        cfg->update_prop = 0.05;
+        break;
+    case 'c': case 'C':  // read only
+        cfg->read_prop = 1.0;
+        break;
+    case 'd': case 'D':  // read latest
+        cfg->read_prop = 0.95;
+        cfg->insert_prop = 0.05;
+        cfg->key_dist = DIST_LATEST;
+        break;
+    case 'e': case 'E':  // short ranges
+        cfg->scan_prop = 0.95;
+        cfg->insert_prop = 0.05;
+        break;
+    case 'f': case 'F':  // read-modify-write
+        cfg->read_prop = 0.5;
+        cfg->rmw_prop = 0.5;
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+int workload_parse_key_dist(const char *name, enum key_dist *dist) {
+    if (strcmp(name, "uniform") == 0) {
+        *dist = DIST_UNIFORM;
+    } else if (strcmp(name, "zipfian") == 0) {
+        *dist = DIST_ZIPFIAN;
+    } else if (strcmp(name, "latest") == 0) {
+        *dist = DIST_LATEST;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int workload_parse_size_dist(const char *name, enum size_dist *dist) {
+    if (strcmp(name, "fixed") == 0) {
+        *dist = SIZE_FIXED;
+    } else if (strcmp(name, "uniform") == 0) {
+        *dist = SIZE_UNIFORM;
+    } else if (strcmp(name, "zipfian") == 0) {
+        *dist = SIZE_ZIPFIAN;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Zipfian generator from Gray et al., "Quickly Generating Billion-Record
+ * Synthetic Databases" (the one YCSB uses). Rank 0 is the most popular item.
+ */
+static double zeta(uint64_t from, uint64_t to, double theta) {
+    double sum = 0;
+    for (uint64_t i = from; i < to; i++) {
+        sum += 1.0 / pow((double)(i + 1), theta);
+    }
+    return sum;
+}
+
+static void zipf_update_eta(struct zipf_gen *z) {
+    z->eta = (1 - pow(2.0 / z->items, 1 - z->theta)) / (1 - z->zeta2 / z->zetan);
+}
+
+static void zipf_init(struct zipf_gen *z, uint64_t items, double theta) {
+    z->items = items ? items : 1;
+    z->theta = theta;
+    z->zeta2 = zeta(0, 2, theta);
+    z->zetan = zeta(0, z->items, theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    zipf_update_eta(z);
+}
+
+// latest 분포에서 item 수가 늘어날 때 zeta 를 증분 계산
+static void zipf_grow(struct zipf_gen *z, uint64_t items) {
+    if (items <= z->items) {
+        return;
+    }
+    z->zetan += zeta(z->items, items, z->theta);
+    z->items = items;
+    zipf_update_eta(z);
+}
+
+static uint64_t zipf_next(struct zipf_gen *z, struct workload *w) {
+    double u = workload_rand_double(w);
+    double uz = u * z->zetan;
+    uint64_t v;
+
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, z->theta)) {
+        return 1;
+    }
+    v = (uint64_t)(z->items * pow(z->eta * u - z->eta + 1, z->alpha));
+    return v < z->items ? v : z->items - 1;
+}
+
+void workload_init(struct workload *w, const struct workload_config *cfg, uint64_t seed) {
+    memset(w, 0, sizeof(*w));
+    w->cfg = *cfg;
+    w->rng = seed ? seed : 0x9E3779B97F4A7C15ull;
+    w->insert_next = cfg->record_count;
+    w->insert_stride = 1;
+
+    if (w->cfg.zipf_theta <= 0 || w->cfg.zipf_theta == 1.0) {
+        w->cfg.zipf_theta = 0.99;
+    }
+    if (w->cfg.value_min <= 0 || w->cfg.value_min > w->cfg.value_max) {
+        w->cfg.value_min = w->cfg.value_max;
+    }
+    if (w->cfg.max_scan_len <= 0) {
+        w->cfg.max_scan_len = 100;
+    }
+
+    zipf_init(&w->keys, cfg->record_count, w->cfg.zipf_theta);
+    zipf_init(&w->sizes, (uint64_t)(w->cfg.value_max - w->cfg.value_min + 1), w->cfg.zipf_theta);
+}
+
+// 여러 스레드가 같은 keyspace 를 쓸 때 INSERT 되는 key id 가 겹치지 않도록 나눈다
+void workload_partition(struct workload *w, int index, int count) {
+    w->insert_next = w->cfg.record_count + index;
+    w->insert_stride = count > 0 ? count : 1;
+}
+
+static uint64_t next_key(struct workload *w) {
+    uint64_t n = w->insert_next;
+
+    switch (w->cfg.key_dist) {
+    case DIST_UNIFORM:
+        return workload_rand(w) % n;
+    case DIST_ZIPFIAN:
+        zipf_grow(&w->keys, n);
+        return zipf_next(&w->keys, w);
+    case DIST_LATEST:
+        zipf_grow(&w->keys, n);
+        return n - 1 - zipf_next(&w->keys, w);
+    }
+    return 0;
+}
+
+int workload_value_len(struct workload *w) {
+    int span = w->cfg.value_max - w->cfg.value_min + 1;
+
+    switch (w->cfg.value_dist) {
+    case SIZE_FIXED:
+        return w->cfg.value_max;
+    case SIZE_UNIFORM:
+        return w->cfg.value_min + (int)(workload_rand(w) % span);
+    case SIZE_ZIPFIAN:
+        return w->cfg.value_min + (int)zipf_next(&w->sizes, w);
+    }
+    return w->cfg.value_max;
+}
+
+void workload_next(struct workload *w, struct workload_req *req) {
+    const struct workload_config *c = &w->cfg;
+    double total = c->read_prop + c->update_prop + c->insert_prop + c->scan_prop + c->rmw_prop;
+    double u = workload_rand_double(w) * total;
+
+    memset(req, 0, sizeof(*req));
+
+    if ((u -= c->read_prop) < 0) {
+        req->op = WL_READ;
+    } else if ((u -= c->update_prop) < 0) {
+        req->op = WL_UPDATE;
+    } else if ((u -= c->insert_prop) < 0) {
+        req->op = WL_INSERT;
+    } else if ((u -= c->scan_prop) < 0) {
+        req->op = WL_SCAN;
+    } else {
+        req->op = WL_RMW;
+    }
+
+    if (req->op == WL_INSERT) {
+        req->key_id = w->insert_next;
+        w->insert_next += w->insert_stride;
+    } else {
+        req->key_id = next_key(w);
+    }
+
+    if (req->op == WL_UPDATE || req->op == WL_INSERT || req->op == WL_RMW) {
+        req->value_len = workload_value_len(w);
+    }
+    if (req->op == WL_SCAN) {
+        req->scan_len = 1 + (int)(workload_rand(w) % c->max_scan_len);
+    }
+}
+
+// FNV-1a 64
+static uint64_t key_hash(uint64_t v) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < 8; i++) {
+        h ^= v & 0xff;
+        h *= 0x100000001b3ull;
+        v >>= 8;
+    }
+    return h;
+}
+
+// "user" + 16 hex digits of the hashed id, padded with 'x' (snprintf 없이 trace replay 에서도 쓴다)
+void workload_key(const struct workload *w, uint64_t key_id, char *buf) {
+    static const char hex[] = "0123456789abcdef";
+    int size = w->cfg.key_size;
+    uint64_t h = key_hash(key_id);
+    char tmp[20] = { 'u', 's', 'e', 'r' };
+    int len = sizeof(tmp);
+
+    if (size <= 0) {
+        return;
+    }
+
+    for (int i = 19; i >= 4; i--, h >>= 4) {
+        tmp[i] = hex[h & 15];
+    }
+    if (len > size - 1) {
+        len = size - 1;
+    }
+    memcpy(buf, tmp, len);
+    memset(buf + len, 'x', size - 1 - len);
+    buf[size - 1] = '\0';
+}
+
+void workload_value(struct workload *w, char *buf, int len) {
+    static const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+/";
+    int n = 0;
+
+    if (len <= 0) {
+        return;
+    }
+
+    // rand 한 번으로 6bit 씩 10 글자
+    while (n < len - 1) {
+        uint64_t r = workload_rand(w);
+        for (int i = 0; i < 10 && n < len - 1; i++, r >>= 6) {
+            buf[n++] = charset[r & 63];
+        }
+    }
+    buf[len - 1] = '\0';
+}
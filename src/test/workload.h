@@ -0,0 +1,103 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+
+/*
+ * YCSB 스타일 워크로드 생성기.
+ * key 는 0..record_count-1 의 key id 로 표현하고, 실제 문자열은
+ * workload_key() 가 id 의 해시로 만들어 hot key 가 테이블 전체에 흩어지게 한다.
+ */
+
+enum workload_op {
+    WL_READ,
+    WL_UPDATE,
+    WL_INSERT,
+    WL_SCAN,
+    WL_RMW,
+    WL_OP_MAX
+};
+
+enum key_dist {
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_LATEST
+};
+
+enum size_dist {
+    SIZE_FIXED,
+    SIZE_UNIFORM,
+    SIZE_ZIPFIAN
+};
+
+struct workload_config {
+    double read_prop;
+    double update_prop;
+    double insert_prop;
+    double scan_prop;
+    double rmw_prop;
+
+    enum key_dist key_dist;
+    double zipf_theta;
+    uint64_t record_count;
+    int max_scan_len;
+
+    int key_size;
+    enum size_dist value_dist;
+    int value_min;
+    int value_max;
+};
+
+struct zipf_gen {
+    uint64_t items;
+    double theta;
+    double zeta2;
+    double zetan;
+    double alpha;
+    double eta;
+};
+
+struct workload {
+    struct workload_config cfg;
+    uint64_t rng;
+    uint64_t insert_next;
+    uint64_t insert_stride;
+    struct zipf_gen keys;
+    struct zipf_gen sizes;
+};
+
+struct workload_req {
+    enum workload_op op;
+    uint64_t key_id;
+    int value_len;
+    int scan_len;
+};
+
+extern const char *workload_op_names[WL_OP_MAX];
+
+int workload_preset(struct workload_config *cfg, char name);
+int workload_parse_key_dist(const char *name, enum key_dist *dist);
+int workload_parse_size_dist(const char *name, enum size_dist *dist);
+
+void workload_init(struct workload *w, const struct workload_config *cfg, uint64_t seed);
+void workload_partition(struct workload *w, int index, int count);
+void workload_next(struct workload *w, struct workload_req *req);
+int workload_value_len(struct workload *w);
+
+// buf 에는 key_size 바이트 (NUL 포함) 가 기록된다
+void workload_key(const struct workload *w, uint64_t key_id, char *buf);
+void workload_value(struct workload *w, char *buf, int len);
+
+static inline uint64_t workload_rand(struct workload *w) {
+    // xorshift64*
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return w->rng * 0x2545F4914F6CDD1Dull;
+}
+
+static inline double workload_rand_double(struct workload *w) {
+    return (workload_rand(w) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif // WORKLOAD_H